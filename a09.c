@@ -15,7 +15,7 @@
                   integer arithmetic is twos complement.
    
    syntax:
-     a09 [-{b|r|s|x|f}filename]|[-c] [-lfilename] [-ooption] [-dsym=value]* sourcefile.
+     a09 [-{b|r|s|x|f|z}filename]|[-c] [-pfilename] [-lfilename] [-jfilename] [-ooption] [-dsym=value]* sourcefile.
                   
    Options
    -c            suppresses code output
@@ -24,7 +24,12 @@
    -sfilename    s-record output file name (default its a binary file)
    -xfilename    intel hex output file name (-"-)
    -ffilename    Flex9 output file name (-"-)
+   -zfilename    LZ-compressed self-extracting binary output file name (-"-)
+   -pfilename[,base]
+                 previous build image; only changed ranges are written
+   -mgap         merge changed ranges that are up to gap bytes apart
    -lfilename    list file name (default no listing)
+   -jfilename    JSON Lines listing file name (one record per source line)
    -dsym[=value] define a symbol
    -oopt         defines an option
    -u            Set all undefined symbols as external (for RELASMB output)
@@ -110,6 +115,8 @@
     RED | NRD*        
     FBG*| NFB         Fill gaps in binary output files
     UEX | NUE*        Undefined labels are treated as external
+    XRF | NXR*        Print cross-reference table
+    SYV | NSV*        Print symbol table sorted by value, too
     * denotes default value
 
     
@@ -322,6 +329,41 @@
                          https://github.com/Arakula/A09/issues/18
                        for details.
    v1.62 2025-01-30 improved line level cleanup and flag handling
+   v1.63 2026-10-19 -z command line switch added; produces an LZ-compressed
+                      binary with a position-independent 6809 decompressor
+                    -p / -m command line switches added for delta output
+                    buffered list file output
+                    listing is formatted in a separate thread on POSIX systems
+                    -j command line switch added for JSON Lines listing output
+                    cross-reference database; OPT XRF|NXR* and -xref switch
+                    faster symbol table output; OPT SYV|NSV* added
+                    -stats switch added for timing and counters
+                    -trace switch added for Chrome trace event output
+                    -cost switch added for per-macro and per-file cost report
+                    -mem switch added for memory accounting
+                    A09_NO_MAIN compile switch for the micro-benchmarks
+                    -nofast switch added to disable the fast paths
+                    -maxerr and -failfast switches added
+                    liba09 library interface (A09_LIBRARY), a09reset()
+                    -batch and -jobs switches added
+                    -serve / -client assembly server on a UNIX socket
+                    -watch switch added
+                    -pch precompiled header snapshots
+                    -MD and -MF switches added
+                    -cache output cache
+                    -sym symbol file output, -i symbol import
+                    -link switch added, COMMON pseudo-op found again
+                    -mklib switch added for indexed .rel libraries
+                    note that the whole-word switches shadow what they
+                      meant up to V1.62: -xref and -maxerr wrote Intel Hex
+                      to "ref" and "err", -stats, -sym and -serve S-records
+                      to "tats", "ym" and "erve", -trace relocatable output
+                      to "ace", -failfast FLEX output to "ailfast", -batch
+                      binary output to "atch", -link, -mklib and -client a
+                      listing to "ink", "ib" and "ient", -MF FLEX output,
+                      and -watch, -pch and -cache suppressed the code (-c)
+                    macro expansion lines are flagged as such again, which
+                      fixes the "Error in expression" at each ENDM
 */
 
 /* @see https://stackoverflow.com/questions/2989810/which-cross-platform-preprocessor-defines-win32-or-win32-or-win32
@@ -341,19 +383,52 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <time.h>
+#include <sys/stat.h>
 #if UNIX
 #define stricmp strcasecmp
 #include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #else
 #include <malloc.h>
 #endif
 
+#ifndef LISTTHREAD                      /* format listing in separate thread */
+#ifdef A09_LIBRARY                      /* not in liba09: its exit() jumps   */
+#define LISTTHREAD 0                    /* back into the assembling thread   */
+#else
+#define LISTTHREAD UNIX                 /* (needs POSIX threads)             */
+#endif
+#endif
+#if LISTTHREAD
+#include <pthread.h>
+#endif
+
+#ifdef A09_LIBRARY                      /* liba09: no main(); console output */
+#define A09_NO_MAIN                     /* and exit() are routed to the      */
+#include <setjmp.h>                     /* assembling context                */
+#include <pthread.h>
+#include "liba09.h"
+int a09printf(const char *format, ...);
+void a09exit(int rc);
+#define printf a09printf
+#define exit a09exit
+#endif
+
 /*****************************************************************************/
 /* Definitions                                                               */
 /*****************************************************************************/
 
-#define VERSION      "1.62"
-#define VERSNUM      "$013E"            /* can be queried as &VERSION        */
+#define VERSION      "1.63"
+#define VERSNUM      "$013F"            /* can be queried as &VERSION        */
 #define RMBDEFCHR    "$00"
 
 #define MAXFILES     128
@@ -364,6 +439,7 @@
 #define MAXIDLEN     32
 #define MAXLISTBYTES 7
 #define FNLEN        256
+#define MAXIMPORTS   8
 #define LINELEN      1024
 
 /*****************************************************************************/
@@ -379,6 +455,7 @@ struct linebuf
   unsigned char lvl;                    /* line level                        */
   unsigned char rel;                    /* relocation mode                   */
   unsigned char flg;                    /* flags                             */
+  short mac;                            /* expanded from macro # (-1 = none) */
   char txt[1];                          /* text buffer                       */
   };
 
@@ -638,9 +715,9 @@ struct oprecord optable09[]=
                OPCAT_TWOBYTE,     0x1143 },
   { "COMF",    OPCAT_6309 |
                OPCAT_TWOBYTE,     0x1153 },
+  { "COMMON",  OPCAT_PSEUDO,      PSEUDO_COMMON },
   { "COMW",    OPCAT_6309 |
                OPCAT_TWOBYTE,     0x1053 },
-  { "COMMON",  OPCAT_PSEUDO,      PSEUDO_COMMON },
   { "CPD",     OPCAT_DBLREG2BYTE, 0x1083 },
   { "CPX",     OPCAT_DBLREG1BYTE, 0x8c },
   { "CPY",     OPCAT_DBLREG2BYTE, 0x108c },
@@ -1698,6 +1775,7 @@ struct symrecord
     struct symrecord *parent;           /* parent symbol (for COMMON)        */
     long flags;                         /* forward reference flag (otherwise)*/
     } u;
+  long xref;                            /* last cross-reference (1-based)    */
   };
 
 struct symtable
@@ -1902,6 +1980,8 @@ struct operandrecord
 #define OPTION_RED    0x08000000L       /* redefine label if code label, too */
 #define OPTION_FBG    0x10000000L       /* fill binary gaps                  */
 #define OPTION_UEX    0x20000000L       /* undefined is treated as external  */
+#define OPTION_XRF    0x40000000L       /* print cross-reference table       */
+#define OPTION_SYV    0x80000000L       /* print symbol table by value, too  */
 
 struct
   {
@@ -1971,9 +2051,14 @@ struct
   { "NFB",           0, OPTION_FBG },
   { "UEX",  OPTION_UEX,          0 },
   { "NUE",           0, OPTION_UEX },
+  { "XRF",  OPTION_XRF,          0 },
+  { "NXR",           0, OPTION_XRF },
+  { "SYV",  OPTION_SYV,          0 },
+  { "NSV",           0, OPTION_SYV },
   };
 
-unsigned long dwOptions =               /* options flags, init to default:   */
+unsigned long dwOptions;                /* options flags                     */
+unsigned long dwDefOptions =            /* default options flags:            */
     OPTION_M09 |                        /* MC6809 mode                       */
     OPTION_MAC |                        /* print macro calling line          */
     OPTION_SYM |                        /* print symbol table                */
@@ -2072,9 +2157,84 @@ char listing = LIST_OFF;                /* listing flag                      */
 
 FILE *listfile = NULL;                  /* list file                         */
 FILE *objfile = NULL;                   /* object file                       */
+FILE *jsonfile = NULL;                  /* JSON Lines listing file           */
 char listname[FNLEN + 1];               /* list file name                    */
 char objname[FNLEN + 1];                /* object file name                  */
+char jsonname[FNLEN + 1] = "";          /* JSON Lines listing file name      */
+char jsonlisting = 0;                   /* JSON Lines listing flag           */
 char srcname[FNLEN + 1];                /* source file name                  */
+char prevname[FNLEN + 1] = "";          /* previous image for delta output   */
+long prevbase = -1;                     /* load address of binary prev. image*/
+int deltagap = 4;                       /* max. unchanged bytes within range */
+char fastpaths = 1;                     /* 0 = reference engine (-nofast)    */
+long maxerrors = 0;                     /* stop after N errors (-maxerr)     */
+char failfast = 0;                      /* stop after pass 1 with errors     */
+char keepimage = 0;                     /* keep the memory image (liba09)    */
+                                        /* called for each error / warning   */
+void (*diaghook)(char *fn, long ln, int num, int warn, char *msg) = NULL;
+
+struct memsrc                           /* source file in memory             */
+  {
+  char *name;                           /* file name                         */
+  const char *text;                     /* contents                          */
+  size_t len;                           /* length of contents                */
+  time_t mtime;                         /* modification time (cached files)  */
+  time_t loaded;                        /* time it was read (cached files)   */
+  };
+struct memsrc memsrcs[MAXFILES];        /* sources that are read from memory */
+int nmemsrcs = 0;                       /* # memory sources                  */
+char batchmode = 0;                     /* -batch: each file is a module     */
+int batchjobs = 1;                      /* # batch worker processes (-jobs)  */
+char inbatch = 0;                       /* assembling a batch module         */
+char inccaching = 0;                    /* keep included files in memory     */
+struct memsrc inccache[MAXFILES];       /* include files kept across the     */
+int ninccache = 0;                      /* assemblies of a batch / server    */
+int cachepipe = -1;                     /* reports the files that are read   */
+char watchmode = 0;                     /* -watch: reassemble on changes     */
+char inwatch = 0;                       /* assembling for -watch             */
+char pchname[FNLEN + 1] = "";           /* -pch: header to precompile        */
+char pchsnap[FNLEN + 1] = "";           /* its snapshot file                 */
+unsigned long pchstate = 0;             /* hash of the state before it       */
+struct linebuf *pchnext = NULL;         /* 1st line behind the header        */
+struct linebuf *pchlines = NULL;        /* macro lines from a snapshot       */
+int pchmain[2] = {0};                   /* fnms[] range of the main sources  */
+char depfile = 0;                       /* -MD: write make dependencies      */
+char depname[FNLEN + 1] = "";           /* dependency file name (-MF)        */
+char cachedir[FNLEN + 1] = "";          /* -cache: output cache directory    */
+char symname[FNLEN + 1] = "";           /* symbol file name (-sym)           */
+char symfile = 0;                       /* symbol file flag                  */
+char symimports[MAXIMPORTS][FNLEN + 1]; /* symbol files to import (-i)       */
+int nsymimports = 0;                    /* # symbol files to import          */
+char incache = 0;                       /* assembling for the output cache   */
+char linkmode = 0;                      /* -link: link .rel modules          */
+char libname[FNLEN + 1] = "";           /* -mklib: library to write          */
+unsigned short linkbase = 0;            /* load address of the 1st module    */
+
+/*****************************************************************************/
+/* Cross-reference definitions                                               */
+/*****************************************************************************/
+
+struct xrefrecord
+  {
+  char *fn;                             /* file name of referencing line     */
+  long ln;                              /* line number therein               */
+  unsigned short addr;                  /* location counter at reference     */
+  char kind;                            /* reference kind (see below)        */
+  long prev;                            /* previous ref. to symbol (1-based) */
+  };
+                                        /* reference kinds :                 */
+#define XREF_DEF              0         /* definition                        */
+#define XREF_READ             1         /* read access                       */
+#define XREF_WRITE            2         /* write access                      */
+#define XREF_BRANCH           3         /* branch, jump or subroutine call   */
+
+struct xrefrecord *xreftable = NULL;    /* cross-reference records           */
+long xrefcount = 0;                     /* # used records                    */
+long xrefalloc = 0;                     /* # allocated records               */
+char xrefing = 0;                       /* flag whether recording refs       */
+char xrefkind = XREF_READ;              /* reference kind on current line    */
+char xrefname[FNLEN + 1] = "";          /* cross-reference database name     */
+char xreffile = 0;                      /* cross-reference database flag     */
 
                                         /* assembler mode specifics:         */
 struct oprecord *optable = optable09;   /* used op table                     */
@@ -2160,6 +2320,7 @@ int printovr = 0;                       /* print override flags:             */
 #define OUT_FLEX  3                     /* Flex9 ASMB-compatible output      */
 #define OUT_GAS   4                     /* GNU relocation output             */
 #define OUT_REL   5                     /* Flex9 RELASMB output              */
+#define OUT_LZB   6                     /* LZ-compressed self-extracting bin */
 int outmode = OUT_BIN;                  /* default to binary output          */
 
 int hexmaxcount = 16;                   /* max. # bytes per S09 line         */
@@ -2184,6 +2345,11 @@ int nLinesPerPage = 66;                 /* # lines on a page                 */
 int nColsPerLine = 80;                  /* # columns per line                */
 char szTitle[128] = "";                 /* title for listings                */
 char szSubtitle[128] = "";              /* subtitle for listings             */
+char szListDate[32] = "";               /* date for listing page headers     */
+
+#define LISTBUFSIZE 65536               /* list file output buffer size      */
+char szListBuf[LISTBUFSIZE];            /* list file output buffer           */
+int nListBuf = 0;                       /* # bytes in output buffer          */
 
 char szBuf1[LINELEN];                   /* general-purpose buffers for parse */
 char szBuf2[LINELEN];
@@ -2198,6 +2364,195 @@ int nPredefinedTexts = 0;               /* # predefined texts                */
 int nTexts = 0;                         /* # currently defined texts         */
 
 unsigned char bUsedBytes[8192] = {0};   /* 1 bit per byte of the address spc */
+unsigned char *memimage = NULL;        /* memory image for LZ/delta output  */
+
+                                        /* listing record types :            */
+#define LREC_LINE       0               /* assembled source line             */
+#define LREC_TAIL       1               /* pass 2 summary and tables         */
+
+struct listrec                          /* everything outlist() needs        */
+  {
+  char type;                            /* record type                       */
+  struct linebuf *line;                 /* listed source line                */
+  unsigned char lvl;                    /* line level                        */
+  unsigned char rel;                    /* relocation mode                   */
+  unsigned char flg;                    /* line flags                        */
+  char absmode;                         /* absolute mode                     */
+  char skipped;                         /* conditionally skipped line        */
+  char condline;                        /* conditional line                  */
+  struct oprecord *op;                  /* operation code (or NULL)          */
+  struct symrecord *label;              /* line label (or NULL)              */
+  unsigned short lblvalue;              /* label value                       */
+  unsigned short oldlc;                 /* location counter before the line  */
+  unsigned short loccounter;            /* location counter                  */
+  unsigned short tfradr;                /* transfer address                  */
+  int phase;                            /* phase                             */
+  long dpsetting;                       /* direct page setting               */
+  int printovr;                         /* print override flags              */
+  long warning;                         /* warning flags                     */
+  long counts[4];                       /* LREC_TAIL: errors, warnings and   */
+                                        /*  total errors, warnings           */
+  int codeptr;                          /* # code bytes                      */
+  unsigned char codebuf[256];           /* code bytes                        */
+  char srcline[LINELEN];                /* (expanded) source line            */
+  };
+
+/*****************************************************************************/
+/* Statistics                                                                */
+/*****************************************************************************/
+
+struct
+  {
+  double tload;                         /* time spent loading files          */
+  double tpass[3];                      /* time spent in pass 1 / 2          */
+  double tlist;                         /* time spent formatting the listing */
+  double toutput;                       /* time spent writing output files   */
+  double ttotal;                        /* total time                        */
+  long lines[3];                        /* # lines processed in pass 1 / 2   */
+  long findsym;                         /* # findsym() calls                 */
+  long findsymprobes;                   /* # symbol table probes therein     */
+  long findop;                          /* # findop() calls                  */
+  long findopprobes;                    /* # mnemonic table probes therein   */
+  long macros;                          /* # macro expansions                */
+  long macrolines;                      /* # expanded macro lines            */
+  long includes;                        /* # included files (INCLUDE, BIN)   */
+  long bytes;                           /* # bytes emitted                   */
+  } stats = {0};
+
+char statsing = 0;                      /* flag whether statistics wanted    */
+char statsname[FNLEN + 1] = "";         /* JSON statistics file name         */
+
+FILE *tracefile = NULL;                 /* Chrome trace event file           */
+char tracename[FNLEN + 1] = "";         /* trace event file name             */
+char tracing = 0;                       /* flag whether tracing wanted       */
+double tracebase = 0.;                  /* time stamp of trace start         */
+
+struct costrecord
+  {
+  long calls;                           /* # macro invocations               */
+  long lines;                           /* # loaded / expanded lines         */
+  long lines12[3];                      /* # lines processed in pass 1 / 2   */
+  long bytes;                           /* # bytes generated                 */
+  double t12[3];                        /* time spent in pass 1 / 2          */
+  };
+
+struct costrecord costmac[MAXMACROS];   /* costs per macro definition        */
+struct costrecord costfile[MAXFILES];   /* costs per source file             */
+char costing = 0;                       /* flag whether cost report wanted   */
+char costname[FNLEN + 1] = "";          /* cost report file name             */
+double costnested = 0.;                 /* time spent in macro expansions    */
+char *costlastfn = NULL;                /* consecutive lines mostly come     */
+int costlastidx = 0;                    /* from the same file                */
+
+/*****************************************************************************/
+/* stattime : returns a wall clock time stamp in seconds                     */
+/*****************************************************************************/
+
+double stattime()
+{
+#if UNIX
+struct timespec ts;
+
+clock_gettime(CLOCK_MONOTONIC, &ts);
+return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+return (double)clock() / CLOCKS_PER_SEC; /* wall clock time on Windows        */
+#endif
+}
+
+/*****************************************************************************/
+/* steptime : time stamp for the per-line / per-file timings, if wanted      */
+/*****************************************************************************/
+
+double steptime()
+{
+return (statsing || tracing || costing) ? stattime() : 0.;
+}
+
+/*****************************************************************************/
+/* Memory accounting                                                         */
+/*****************************************************************************/
+                                        /* accounted memory categories :     */
+#define MEM_SRCLINES          0         /* source lines                      */
+#define MEM_MACLINES          1         /* macro expansion lines             */
+#define MEM_BINLINES          2         /* BINARY lines                      */
+#define MEM_TEXTS             3         /* texts[]                           */
+#define MEM_SYMBOLS           4         /* symbol table                      */
+#define MEM_LOCALS            5         /* local label table                 */
+#define MEM_RELOCS            6         /* relocation table                  */
+#define MEM_XREFS             7         /* cross-reference records           */
+#define MEM_COUNT             8
+
+struct
+  {
+  char *name;                           /* category name                     */
+  long cur;                             /* current # bytes                   */
+  long peak;                            /* peak # bytes                      */
+  long allocs;                          /* # allocations                     */
+  } memacct[MEM_COUNT + 1] =            /* last one is the total             */
+  {
+  { "source lines", 0, 0, 0 },
+  { "macro lines", 0, 0, 0 },
+  { "binary lines", 0, 0, 0 },
+  { "texts", 0, 0, 0 },
+  { "symbols", 0, 0, 0 },
+  { "local labels", 0, 0, 0 },
+  { "relocations", 0, 0, 0 },
+  { "cross-references", 0, 0, 0 },
+  { "total", 0, 0, 0 },
+  };
+
+char memreport = 0;                     /* flag whether memory report wanted */
+
+/*****************************************************************************/
+/* memadd : accounts for an allocated (or, if negative, freed) memory block  */
+/*****************************************************************************/
+
+void memadd(int kind, long bytes)
+{
+int i;
+
+for (i = 0; i < 2; i++, kind = MEM_COUNT) /* category and total                */
+  {
+  memacct[kind].cur += bytes;
+  if (bytes > 0)
+    memacct[kind].allocs++;
+  if (memacct[kind].cur > memacct[kind].peak)
+    memacct[kind].peak = memacct[kind].cur;
+  }
+}
+
+/*****************************************************************************/
+/* outmem : prints the current and peak memory usage                         */
+/*****************************************************************************/
+
+void outmem(int pass)
+{
+int i;
+
+printf("Memory after pass %d:       current       peak     allocs\n", pass);
+for (i = 0; i <= MEM_COUNT; i++)
+  printf("  %-22s %10ld %10ld %10ld\n", memacct[i].name,
+         memacct[i].cur, memacct[i].peak, memacct[i].allocs);
+}
+
+/*****************************************************************************/
+/* errorout : prints an error that isn't bound to the current line's error   */
+/*            bits (mostly fatal ones) and passes it to the diagnostics hook */
+/*****************************************************************************/
+
+void errorout(const char *fn, long ln, int num, const char *format, ...)
+{
+char msg[2 * FNLEN + 256];
+va_list argp;
+
+va_start(argp, format);
+vsprintf(msg, format, argp);
+va_end(argp);
+printf("%s(%ld) : error %d: %s\n", fn, ln, num, msg);
+if (diaghook)
+  diaghook((char *)fn, ln, num, 0, msg);
+}
 
 /*****************************************************************************/
 /* Necessary forward declarations                                            */
@@ -2205,6 +2560,11 @@ unsigned char bUsedBytes[8192] = {0};   /* 1 bit per byte of the address spc */
 
 struct linebuf *readfile(char *name, unsigned char lvl, struct linebuf *after);
 struct linebuf *readbinary(char *name, unsigned char lvl, struct linebuf *after, struct symrecord *lp);
+void listsync(void);
+void pchsave(void);
+int assemble(int argc, char *argv[]);
+int runwatch(int argc, char *argv[]);
+int outcache(int argc, char *argv[]);
 
 /*****************************************************************************/
 /* allocline : allocates a line of text                                      */
@@ -2216,13 +2576,15 @@ struct linebuf * allocline
     char *fn,
     int line,
     unsigned char lvl,
-    char *text
+    char *text,
+    int memkind                         /* memory category (MEM_xxxLINES)    */
     )
 {
 struct linebuf *pNew = (struct linebuf *)
     malloc(sizeof(struct linebuf) + strlen(text));
 if (!pNew)
   return NULL;
+memadd(memkind, (long)(sizeof(struct linebuf) + strlen(text)));
 pNew->next = (prev) ? prev->next : NULL;
 pNew->prev = prev;
 if (prev)
@@ -2231,6 +2593,7 @@ if (pNew->next)
   pNew->next->prev = pNew;
 pNew->lvl = lvl;
 pNew->flg = 0;
+pNew->mac = -1;
 pNew->fn = fn;
 pNew->ln = line;
 pNew->rel = ' ';
@@ -2254,94 +2617,171 @@ if (dwOptions & OPTION_LFN)             /* if long file names wanted         */
 return fn;                              /* can't do that yet                 */
 }
 
+/*****************************************************************************/
+/* flushlist : writes the list file output buffer                            */
+/*****************************************************************************/
+
+void flushlist()
+{
+if (nListBuf && listfile)
+  fwrite(szListBuf, 1, nListBuf, listfile);
+nListBuf = 0;
+}
+
+/*****************************************************************************/
+/* listout : appends a span of characters to the list file output buffer     */
+/*****************************************************************************/
+
+void listout(const char *s, int len)
+{
+if (!fastpaths)                         /* reference engine writes directly  */
+  {
+  fwrite(s, 1, len, listfile);
+  return;
+  }
+if (nListBuf + len > LISTBUFSIZE)       /* if buffer would overflow          */
+  {
+  flushlist();                          /* write it out                      */
+  if (len > LISTBUFSIZE)                /* if too big for the buffer anyway, */
+    {                                   /* write it out directly             */
+    fwrite(s, 1, len, listfile);
+    return;
+    }
+  }
+memcpy(szListBuf + nListBuf, s, len);
+nListBuf += len;
+}
+
 /*****************************************************************************/
 /* PageFeed : advances the list file                                         */
 /*****************************************************************************/
 
 void PageFeed()
 {
-time_t tim;
-struct tm *ltm;
+char szHdr[256];
+int len;
 
-time(&tim);
-ltm = localtime(&tim);
+listsync();                             /* wait for listing thread           */
+if ((dwOptions & OPTION_DAT) &&         /* format date only once per run     */
+    !szListDate[0])
+  {
+  time_t tim;
+  struct tm *ltm;
 
-fputc('\x0c', listfile);                /* print header                      */
-nCurPage++;                             /* advance to next page              */
-fprintf(listfile, "\n\n%-32.32s ", szTitle);
-if (dwOptions & OPTION_DAT)
-  fprintf(listfile,
+  time(&tim);
+  ltm = localtime(&tim);
+  sprintf(szListDate,
           "%04d-%02d-%02d ",
           ltm->tm_year + 1900,
           ltm->tm_mon + 1,
           ltm->tm_mday);
-fprintf(listfile,
-        "A09 %d Assembler V" VERSION " Page %d\n",
-        (dwOptions & OPTION_H09) ? 6309 :
-            (dwOptions & OPTION_M00) ? 6800 :
-            (dwOptions & OPTION_M01) ? 6801 :
-            (dwOptions & OPTION_H01) ? 6301 :
-            6809,
-        nCurPage);
-fprintf(listfile, "%-.79s\n\n", szSubtitle);
+  }
+
+nCurPage++;                             /* advance to next page              */
+len = sprintf(szHdr, "\x0c\n\n%-32.32s %s", /* print header                 */
+              szTitle,
+              (dwOptions & OPTION_DAT) ? szListDate : "");
+len += sprintf(szHdr + len,
+               "A09 %d Assembler V" VERSION " Page %d\n",
+               (dwOptions & OPTION_H09) ? 6309 :
+                   (dwOptions & OPTION_M00) ? 6800 :
+                   (dwOptions & OPTION_M01) ? 6801 :
+                   (dwOptions & OPTION_H01) ? 6301 :
+                   6809,
+               nCurPage);
+len += sprintf(szHdr + len, "%-.79s\n\n", szSubtitle);
+listout(szHdr, len);
 
 nCurLine = 5;                           /* remember current line             */
 nCurCol = 0;                            /* and reset current column          */
 }
 
+/*****************************************************************************/
+/* putlistnl : puts a newline to the list file                               */
+/*****************************************************************************/
+
+void putlistnl()
+{
+listout("\n", 1);
+nCurLine++;
+nCurCol = 0;
+if ((nCurLine >= nLinesPerPage) &&      /* if beyond # lines per page        */
+    (dwOptions & OPTION_PAG))           /* if pagination activated           */
+  PageFeed();                           /* do a page feed                    */
+}
+
 /*****************************************************************************/
 /* putlist : puts something to the list file                                 */
 /*****************************************************************************/
 
 void putlist(const char *szFmt, ...)
 {
-char szList[1024];                      /* buffer for 1k list output         */
-char *p;
+static char szList[4 * LINELEN];        /* buffer for list output            */
+const char *p, *q;
+int span;
 
-va_list al;
-va_start(al, szFmt);
-vsprintf(szList, szFmt, al);            /* generate formatted output buffer  */
-va_end(al);
+listsync();                             /* wait for listing thread           */
+if (strchr(szFmt, '%') ||               /* if there's something to format,   */
+    !fastpaths)                         /* or for the reference engine       */
+  {
+  va_list al;
+  va_start(al, szFmt);
+  vsprintf(szList, szFmt, al);          /* generate formatted output buffer  */
+  va_end(al);
+  p = szList;
+  }
+else                                    /* otherwise use it directly         */
+  p = szFmt;
 
-for (p = szList; *p; p++)               /* then walk through the buffer      */
+while (*p)                              /* then walk through the buffer      */
   {
-  fputc(*p, listfile);                  /* print out each character          */
   if (*p == '\n')                       /* if newline sent                   */
     {
-    nCurLine++;
-    nCurCol = 0;
-    if ((nCurLine >= nLinesPerPage) &&  /* if beyond # lines per page        */
-        (dwOptions & OPTION_PAG))       /* if pagination activated           */
-      PageFeed();                       /* do a page feed                    */
+    putlistnl();
+    p++;
+    continue;
     }
-  else                                  /* if another character              */
+                                        /* characters that can't reach the   */
+                                        /* line length check go in one span  */
+  span = (dwOptions & OPTION_CLL) ? nColsPerLine * 3 / 4 - 1 - nCurCol : LINELEN;
+  if (!fastpaths)                       /* reference engine goes by char     */
+    span = 0;
+  for (q = p; *q && *q != '\n' && q - p < span; q++)
+    ;
+  if (q > p)
     {
-    nCurCol++;                          /* advance to next column            */
-    if (dwOptions & OPTION_CLL)         /* if line length checked            */
-      {
-                                        /* check if word would go too far    */
-      if ((nCurCol >= nColsPerLine * 3 / 4) &&
-          (*p == ' '))
-        {
-        int i;                          /* look whether more delimiters      */
-        char c;
-        for (i = nCurCol + 1; i < nColsPerLine; i++)
-          {
-          c = p[i - nCurCol];
-          if ((c == '\t') || (c == ' ') || (!c))
-            break;
-          }
-        if (i >= nColsPerLine)          /* if no more delimiters,            */
-          nCurCol = nColsPerLine;       /* make sure to advance to new line  */
-        }
+    listout(p, (int)(q - p));
+    nCurCol += (int)(q - p);
+    p = q;
+    continue;
+    }
 
-      if (nCurCol >= nColsPerLine)      /* if it IS too far                  */
-        {
-        putlist("\n");                  /* recurse with a newline            */
-        nCurCol = 0;
-        }
+  listout(p, 1);                        /* close to the margin, go by char   */
+  nCurCol++;                            /* advance to next column            */
+  if (!(dwOptions & OPTION_CLL))        /* if line length not checked        */
+    {
+    p++;
+    continue;
+    }
+                                        /* check if word would go too far    */
+  if ((nCurCol >= nColsPerLine * 3 / 4) &&
+      (*p == ' '))
+    {
+    int i;                              /* look whether more delimiters      */
+    char c;
+    for (i = nCurCol + 1; i < nColsPerLine; i++)
+      {
+      c = p[i - nCurCol];
+      if ((c == '\t') || (c == ' ') || (!c))
+        break;
       }
+    if (i >= nColsPerLine)              /* if no more delimiters,            */
+      nCurCol = nColsPerLine;           /* make sure to advance to new line  */
     }
+
+  if (nCurCol >= nColsPerLine)          /* if it IS too far                  */
+    putlistnl();                        /* put out a newline                 */
+  p++;
   }
 }
 
@@ -2353,10 +2793,12 @@ struct oprecord * findop(char * nm)
 {
 int lo,hi,i,s;
 
+stats.findop++;
 lo = 0;
 hi = optablesize - 1;
 do
   {
+  stats.findopprobes++;
   i = (lo + hi) / 2;
   s = strcmp(optable[i].name, nm);
   if (s < 0)
@@ -2377,7 +2819,7 @@ return optable + i;
 
 struct symrecord * findlocal(struct symrecord *sym, char forward, int insert)
 {
-static struct symrecord empty = {"", SYMCAT_EMPTYLOCAL, 0, {0}};
+static struct symrecord empty = {"", SYMCAT_EMPTYLOCAL, 0, {0}, 0};
 int lo,hi,i,j,s;
 
 if ((!sym) ||                           /* if no main symbol for that        */
@@ -2435,8 +2877,8 @@ if (insert)                             /* if inserting,                     */
   i = (s < 0 ? i + 1 : i);
   if (lcltable.counter == MAXLABELS)
     {
-    printf("%s(%ld): error 25: out of local symbol storage\n",
-           expandfn(curline->fn), curline->ln);
+    errorout(expandfn(curline->fn), curline->ln, 25,
+             "out of local symbol storage");
     if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
       putlist( "*** Error 25: out of local symbol storage\n");
     exit(4);
@@ -2445,6 +2887,7 @@ if (insert)                             /* if inserting,                     */
   for (j = lcltable.counter; j > i; j--)
     lcltable.rec[j] = lcltable.rec[j - 1];
   lcltable.counter++;
+  memadd(MEM_LOCALS, sizeof(struct symrecord));
   strcpy(lcltable.rec[i].name, sym->name);
   lcltable.rec[i].cat = SYMCAT_LOCALLABEL;
   lcltable.rec[i].value = loccounter;
@@ -2515,12 +2958,14 @@ if (i)                                  /* if starting with number           */
     }
   }
 
+stats.findsym++;
 lo = 0;                                 /* do binary search for the thing    */
 hi = symtable.counter - 1;
 s = 1;
 i = 0;
 while (hi >= lo)
   {
+  stats.findsymprobes++;
   i = (lo + hi) / 2;
   s = strcmp(symtable.rec[i].name, name);
   if (s < 0)
@@ -2539,8 +2984,7 @@ if (s)                                  /* if symbol not found               */
   i = (s < 0 ? i + 1 : i);
   if (symtable.counter == MAXLABELS)
     {
-    printf("%s(%ld): error 23: out of symbol storage\n",
-           expandfn(curline->fn), curline->ln);
+    errorout(expandfn(curline->fn), curline->ln, 23, "out of symbol storage");
     if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
       putlist( "*** Error 23: out of symbol storage\n");
     exit(4);
@@ -2553,10 +2997,12 @@ if (s)                                  /* if symbol not found               */
   for (j = symtable.counter; j > i; j--)
     symtable.rec[j] = symtable.rec[j-1];
   symtable.counter++;
+  memadd(MEM_SYMBOLS, sizeof(struct symrecord));
   strcpy(symtable.rec[i].name, name);
   symtable.rec[i].cat = (islocal) ? SYMCAT_EMPTYLOCAL : SYMCAT_EMPTY;
   symtable.rec[i].value = 0;
   symtable.rec[i].u.flags = 0;
+  symtable.rec[i].xref = 0;
   }
 
 if (islocal)                            /* if searching for a local label    */
@@ -2566,6 +3012,78 @@ if (islocal)                            /* if searching for a local label    */
 return symtable.rec + i;                /* return the found or inserted sym  */
 }  
 
+/*****************************************************************************/
+/* addxref : records a definition or reference of a symbol in pass 2         */
+/*****************************************************************************/
+
+void addxref(struct symrecord *p, char kind)
+{
+struct xrefrecord *x;
+
+if (!xrefing || pass != 2 || !p ||      /* only global table symbols in      */
+    inMacro ||                          /* pass 2 outside macro definitions  */
+    p < symtable.rec ||                 /* are of interest                   */
+    p >= symtable.rec + symtable.counter)
+  return;
+if (p->xref)                            /* suppress duplicates on one line   */
+  {
+  x = xreftable + p->xref - 1;
+  if (x->ln == curline->ln && x->fn == curline->fn && x->kind == kind)
+    return;
+  }
+if (xrefcount == xrefalloc)             /* if out of records, get more       */
+  {
+  long n = xrefalloc ? xrefalloc * 2 : 4096;
+  x = (struct xrefrecord *)realloc(xreftable, n * sizeof(struct xrefrecord));
+  if (!x)
+    {
+    errorout(expandfn(curline->fn), curline->ln, 22,
+             "memory allocation error");
+    exit(4);
+    }
+  memadd(MEM_XREFS, (n - xrefalloc) * (long)sizeof(struct xrefrecord));
+  xreftable = x;
+  xrefalloc = n;
+  }
+x = xreftable + xrefcount++;
+x->fn = curline->fn;
+x->ln = curline->ln;
+x->addr = (unsigned short)(oldlc + phase);
+x->kind = kind;
+x->prev = p->xref;                      /* chain to previous reference       */
+p->xref = xrefcount;
+}
+
+/*****************************************************************************/
+/* xrefopkind : returns the kind of symbol references an opcode makes        */
+/*****************************************************************************/
+
+char xrefopkind(struct oprecord *op)
+{
+switch (op->cat & OPCAT_PSEUDO)         /* look at basic category            */
+  {
+  case OPCAT_SBRANCH :
+  case OPCAT_LBR2BYTE :
+  case OPCAT_LBR1BYTE :
+  case OPCAT_IDXEXT :                   /* 6800-style JMP / JSR              */
+    return XREF_BRANCH;
+  case OPCAT_SINGLEADDR :               /* NEG, CLR, INC, ...                */
+  case OPCAT_ACCADDR :
+  case OPCAT_BITDIRECT :                /* AIM, OIM, EIM                     */
+  case OPCAT_SETMASK :                  /* BSET, BCLR                        */
+    if (!strcmp(op->name, "JMP"))
+      return XREF_BRANCH;
+    if (!strcmp(op->name, "TST") || !strcmp(op->name, "TIM"))
+      return XREF_READ;
+    return XREF_WRITE;
+  }
+if (!strcmp(op->name, "JSR"))
+  return XREF_BRANCH;
+if (op->cat & OPCAT_NOIMM)              /* stores                            */
+  return XREF_WRITE;
+return XREF_READ;
+}
+
 /*****************************************************************************/
 /* findsymat : finds 1st symbol for a given address                          */
 /*****************************************************************************/
@@ -2900,7 +3418,11 @@ if (lp->cat != SYMCAT_EMPTY &&
   }
 
 if (lp->cat != SYMCAT_EMPTY)
+  {
+  if (texts[lp->value])
+    memadd(MEM_TEXTS, -(long)(strlen(texts[lp->value]) + 1));
   free(texts[lp->value]);
+  }
 else if (nTexts >= MAXTEXTS)
   {
   error |= ERR_MALLOC;
@@ -2917,7 +3439,10 @@ if (!text)                              /* if NULL input                     */
 
 texts[lp->value] = (char *)malloc(strlen(text) + 1);
 if (texts[lp->value])
+  {
+  memadd(MEM_TEXTS, (long)(strlen(text) + 1));
   strcpy(texts[lp->value], text);
+  }
 
 if (!strcmp(namebuf, "&FILCHR"))        /* special for FILCHR : set internal */
   {                                     /* byte                              */
@@ -2945,12 +3470,43 @@ return lp->value;
 }
 
 /*****************************************************************************/
-/* outsymtable : prints the symbol table                                     */
+/* cmplclname : compares two local label indices by name, then by address    */
 /*****************************************************************************/
 
-void outsymtable()
+int cmplclname(const void *a, const void *b)
 {
-int i,j = 0;
+int ia = *(const int *)a, ib = *(const int *)b;
+int s = strcmp(lcltable.rec[ia].name, lcltable.rec[ib].name);
+return s ? s : ia - ib;                 /* lcltable is sorted by address     */
+}
+
+/*****************************************************************************/
+/* cmpsymvalue : compares two symbol pointers by value, then by name         */
+/*****************************************************************************/
+
+int cmpsymvalue(const void *a, const void *b)
+{
+const struct symrecord *sa = *(const struct symrecord * const *)a;
+const struct symrecord *sb = *(const struct symrecord * const *)b;
+int s;
+
+if (sa->value != sb->value)
+  return (sa->value < sb->value) ? -1 : 1;
+s = strcmp(sa->name, sb->name);
+if (s)
+  return s;
+return (sa < sb) ? -1 : (sa > sb);      /* keep local labels in order        */
+}
+
+/*****************************************************************************/
+/* outsymrows : prints a list of symbols, 4 per row                          */
+/*****************************************************************************/
+
+void outsymrows(struct symrecord **syms, int n, char const *title)
+{
+char const *lpa = (dwOptions & OPTION_LPA) ? "* " : "";
+char szRow[4 * (MAXIDLEN + 10) + 4];
+int i, len = 0;
 
 if (dwOptions & OPTION_PAG)             /* if pagination active,             */
   {
@@ -2960,8 +3516,49 @@ if (dwOptions & OPTION_PAG)             /* if pagination active,             */
 else
   putlist("\n");
 
-putlist("%sSYMBOL TABLE", (dwOptions & OPTION_LPA) ? "* " : "");
-for (i = 0; i < symtable.counter; i++) 
+putlist("%s%s", lpa, title);
+for (i = 0; !fastpaths && i < n; i++)   /* reference engine: entry by entry  */
+  {
+  if (i % 4 == 0)
+    putlist("\n%s", lpa);
+  putlist(" %9s %02d %04X", syms[i]->name, syms[i]->cat, syms[i]->value);
+  }
+for (i = 0; fastpaths && i < n; i++)
+  {
+  if (i % 4 == 0)                       /* start a new row                   */
+    len = sprintf(szRow, "\n%s", lpa);
+  len += sprintf(szRow + len, " %9s %02d %04X", syms[i]->name,
+                 syms[i]->cat, syms[i]->value);
+  if (i % 4 == 3 || i == n - 1)         /* put out complete rows at once     */
+    putlist("%s", szRow);
+  }
+putlist("\n%s%d SYMBOLS\n", lpa, n);
+}
+
+/*****************************************************************************/
+/* outsymtable : prints the symbol table                                     */
+/*****************************************************************************/
+
+void outsymtable()
+{
+struct symrecord **syms;
+int *lcl;
+int i, k, n = 0;
+
+syms = (struct symrecord **)malloc((symtable.counter + lcltable.counter + 1) *
+                                   sizeof(struct symrecord *));
+lcl = (int *)malloc((lcltable.counter + 1) * sizeof(int));
+if (!syms || !lcl)
+  {
+  errorout(srcname, 0, 22, "memory allocation error");
+  exit(4);
+  }
+for (k = 0; k < lcltable.counter; k++)  /* sort local labels by name once,   */
+  lcl[k] = k;                           /* so that they can be merged into   */
+if (fastpaths)                          /* the (sorted) symbol table         */
+  qsort(lcl, lcltable.counter, sizeof(int), cmplclname);
+
+for (i = 0, k = 0; i < symtable.counter; i++) 
   if (symtable.rec[i].cat != SYMCAT_EMPTY)
     {
                                         /* suppress listing of predef texts  */
@@ -2973,31 +3570,39 @@ for (i = 0; i < symtable.counter; i++)
         )
       continue;
                                         /* if local label                    */
-    if (symtable.rec[i].cat == SYMCAT_LOCALLABEL)
-      {
-      int k;                            /* walk local label list             */
+    if (symtable.rec[i].cat == SYMCAT_LOCALLABEL &&
+        !fastpaths)                     /* reference engine: walk the whole  */
+      {                                 /* local label list for each one     */
       for (k = 0; k < lcltable.counter; k++)
         if (!strcmp(lcltable.rec[k].name, symtable.rec[i].name))
-          {
-          if (j % 4 == 0)
-            putlist("\n%s", (dwOptions & OPTION_LPA) ? "* " : "");
-          putlist( " %9s %02d %04X", lcltable.rec[k].name,
-                                     lcltable.rec[k].cat,
-                                     lcltable.rec[k].value); 
-          j++;
-          }
+          syms[n++] = lcltable.rec + k;
       }
-    else                                /* if normal label                   */
-      {
-      if (j % 4 == 0)
-        putlist("\n%s", (dwOptions & OPTION_LPA) ? "* " : "");
-      putlist( " %9s %02d %04X", symtable.rec[i].name,
-                                 symtable.rec[i].cat,
-                                 symtable.rec[i].value); 
-      j++;
+    else if (symtable.rec[i].cat == SYMCAT_LOCALLABEL)
+      {                                 /* add all local labels of that name */
+      while (k < lcltable.counter &&
+             strcmp(lcltable.rec[lcl[k]].name, symtable.rec[i].name) < 0)
+        k++;
+      for (; k < lcltable.counter &&
+             !strcmp(lcltable.rec[lcl[k]].name, symtable.rec[i].name); k++)
+        syms[n++] = lcltable.rec + lcl[k];
       }
+    else                                /* if normal label                   */
+      syms[n++] = symtable.rec + i;
     }
-putlist("\n%s%d SYMBOLS\n", (dwOptions & OPTION_LPA) ? "* " : "", j);
+outsymrows(syms, n, "SYMBOL TABLE");
+
+if (dwOptions & OPTION_SYV)             /* if sorted by value, too,          */
+  {
+  for (i = k = 0; i < n; i++)           /* drop texts and macros, their      */
+    if (syms[i]->cat != SYMCAT_TEXT &&  /* values aren't addresses           */
+        syms[i]->cat != SYMCAT_MACRO)
+      syms[k++] = syms[i];
+  qsort(syms, k, sizeof(struct symrecord *), cmpsymvalue);
+  outsymrows(syms, k, "SYMBOL TABLE BY VALUE");
+  }
+
+free(lcl);
+free(syms);
 } 
 
 /*****************************************************************************/
@@ -3067,76 +3672,413 @@ putlist("\n%s%d TEXTS\n", (dwOptions & OPTION_LPA) ? "* " : "", j);
 } 
 
 /*****************************************************************************/
-/* findreg : finds a register per name                                       */
+/* xrefsorted : puts the references to a symbol in chronological order       */
 /*****************************************************************************/
 
-struct regrecord * findreg(char *nm)
+long xrefsorted(struct symrecord *p, long *refs)
 {
-int i;
-for (i = 0; regtable[i].name != NULL; i++)
-  {
-  if (strcmp(regtable[i].name,nm) == 0)
-    return regtable + i;
-  }
-return 0;                   
+long i, k, n = 0;
+
+for (i = p->xref; i; i = xreftable[i - 1].prev)
+  n++;
+k = n;                                  /* chain runs backwards, so fill     */
+for (i = p->xref; i; i = xreftable[i - 1].prev)
+  refs[--k] = i - 1;                    /* the array from its end            */
+return n;
 }
 
 /*****************************************************************************/
-/* findreg63 : finds a register per name for HD63 operations                 */
+/* xrefsym : returns whether a symbol goes into the cross-reference          */
 /*****************************************************************************/
 
-struct regrecord * findreg63(char *nm)
+int xrefsym(struct symrecord *p)
 {
-int i;
-for (i = 0; i < (sizeof(regtable63) / sizeof(regtable63[0])); i++)
-  {
-  if (strcmp(regtable63[i].name,nm) == 0)
-    return regtable63 + i;
-  }
-return 0;                   
+return p->cat != SYMCAT_EMPTY &&        /* empties, texts and local label    */
+       p->cat != SYMCAT_TEXT &&         /* anchors don't have references     */
+       p->cat != SYMCAT_LOCALLABEL;
 }
 
 /*****************************************************************************/
-/* findbitreg : finds a bit transfer register per name (6309 only)           */
+/* outxreftable : prints the cross-reference table                           */
 /*****************************************************************************/
 
-struct regrecord * findbitreg(char *nm)
+void outxreftable()
 {
-int i;
+static const char kinds[] = "DRWB";     /* indexed by XREF_xxx               */
+char const *lpa = (dwOptions & OPTION_LPA) ? "* " : "";
+long *refs = (long *)malloc((xrefcount + 1) * sizeof(long));
+long i, k, n, nsyms = 0, nrefs = 0;
+int col, len;
+char szRef[FNLEN + 32];
+
+if (!refs)
+  return;
+if (dwOptions & OPTION_PAG)             /* if pagination active,             */
+  {
+  if (nCurLine > 5)                     /* if not on 1st line,               */
+    PageFeed();                         /* shift to next page                */
+  }
+else
+  putlist("\n");
 
-for (i = 0; i < bitregtablesize; i++)
+putlist("%sCROSS REFERENCE\n", lpa);
+for (i = 0; i < symtable.counter; i++)
   {
-  if (strcmp(bitregtable[i].name,nm) == 0)
-    return bitregtable + i;
+  if (!xrefsym(symtable.rec + i))
+    continue;
+  putlist("%s %9s %02d %04X", lpa, symtable.rec[i].name,
+          symtable.rec[i].cat, symtable.rec[i].value);
+  col = (int)strlen(lpa) + 18;
+  n = xrefsorted(symtable.rec + i, refs);
+  for (k = 0; k < n; k++)
+    {
+    struct xrefrecord *x = xreftable + refs[k];
+    len = sprintf(szRef, " %c %s(%ld)", kinds[(int)x->kind],
+                  expandfn(x->fn), x->ln);
+    if (k && col + len >= nColsPerLine) /* wrap before the line gets too     */
+      {                                 /* long for the line length check    */
+      putlist("\n%s%18s", lpa, "");
+      col = (int)strlen(lpa) + 18;
+      }
+    putlist("%s", szRef);
+    col += len;
+    }
+  putlist("\n");
+  nsyms++;
+  nrefs += n;
   }
-return 0;                   
+putlist("%s%ld SYMBOLS, %ld REFERENCES\n", lpa, nsyms, nrefs);
+free(refs);
 }
 
 /*****************************************************************************/
-/* strupr : converts a string to uppercase (crude)                           */
+/* xrefput : writes a little-endian number to the cross-reference file       */
 /*****************************************************************************/
 
-char *strupr(char *name)
+void xrefput(FILE *fp, unsigned long value, int bytes)
 {
-int i;
-if (!name)
-  return name;
-for (i = 0; name[i]; i++)
-  if ((name[i] >= 'a') && (name[i] <= 'z'))
-    name[i] -= ('a' - 'A');
-return name;
+while (bytes--)
+  {
+  fputc((int)(value & 0xff), fp);
+  value >>= 8;
+  }
 }
 
 /*****************************************************************************/
-/* addreloc : adds a relocation record to the list                           */
+/* writexref : writes the indexed cross-reference database                   */
 /*****************************************************************************/
 
-void addreloc(struct relocrecord *p)
-{
-struct relocrecord rel = {0};           /* internal copy                     */
+/* The database is laid out so that an editor can map it into memory and
+   binary search the symbol index without parsing anything; all numbers
+   are little-endian, all offsets are relative to the file start:
 
-if (p)                                  /* if there's a record,              */
-  rel = *p;                             /* copy to internal                  */
+     header (32 bytes)    "A09X", version, # files, # symbols, # refs,
+                          offsets of file table, symbol index, ref table
+     file table           per file: offset of its name
+     symbol index         per symbol, sorted by name (16 bytes):
+                          name offset, 1st ref index, # refs,
+                          value (2 bytes), category, 0
+     ref table            per reference, grouped by symbol (12 bytes):
+                          line, file index (2 bytes), address (2 bytes),
+                          kind (D=0, R=1, W=2, B=3), 3 * 0
+     string pool          zero-terminated file and symbol names         */
+
+void writexref()
+{
+FILE *fp;
+long *refs = (long *)malloc((xrefcount + 1) * sizeof(long));
+long i, k, n, nsyms = 0, nrefs = 0;
+unsigned long fileoff, symoff, refoff, stroff;
+int j;
+
+if (!refs || !(fp = fopen(xrefname, "wb")))
+  {
+  errorout(srcname, 0, 30, "cannot write cross-reference file %s", xrefname);
+  exit(4);
+  }
+
+for (i = 0; i < symtable.counter; i++)  /* count what goes in there          */
+  if (xrefsym(symtable.rec + i))
+    {
+    nsyms++;
+    nrefs += xrefsorted(symtable.rec + i, refs);
+    }
+fileoff = 32;
+symoff = fileoff + 4 * nfnms;
+refoff = symoff + 16 * nsyms;
+stroff = refoff + 12 * nrefs;
+
+fwrite("A09X", 1, 4, fp);               /* header                            */
+xrefput(fp, 1, 4);
+xrefput(fp, nfnms, 4);
+xrefput(fp, nsyms, 4);
+xrefput(fp, nrefs, 4);
+xrefput(fp, fileoff, 4);
+xrefput(fp, symoff, 4);
+xrefput(fp, refoff, 4);
+
+for (j = 0; j < nfnms; j++)             /* file table                        */
+  {
+  xrefput(fp, stroff, 4);
+  stroff += strlen(fnms[j]) + 1;
+  }
+
+for (i = 0, k = 0; i < symtable.counter; i++)
+  if (xrefsym(symtable.rec + i))        /* symbol index                      */
+    {
+    n = xrefsorted(symtable.rec + i, refs);
+    xrefput(fp, stroff, 4);
+    xrefput(fp, k, 4);
+    xrefput(fp, n, 4);
+    xrefput(fp, symtable.rec[i].value, 2);
+    xrefput(fp, (unsigned char)symtable.rec[i].cat, 1);
+    xrefput(fp, 0, 1);
+    stroff += strlen(symtable.rec[i].name) + 1;
+    k += n;
+    }
+
+for (i = 0; i < symtable.counter; i++)
+  if (xrefsym(symtable.rec + i))        /* ref table                         */
+    {
+    n = xrefsorted(symtable.rec + i, refs);
+    for (k = 0; k < n; k++)
+      {
+      struct xrefrecord *x = xreftable + refs[k];
+      for (j = 0; j < nfnms && fnms[j] != x->fn; j++)
+        ;
+      xrefput(fp, x->ln, 4);
+      xrefput(fp, (j < nfnms) ? j : 0xffff, 2);
+      xrefput(fp, x->addr, 2);
+      xrefput(fp, x->kind, 1);
+      xrefput(fp, 0, 3);
+      }
+    }
+
+for (j = 0; j < nfnms; j++)             /* string pool                       */
+  fwrite(fnms[j], 1, strlen(fnms[j]) + 1, fp);
+for (i = 0; i < symtable.counter; i++)
+  if (xrefsym(symtable.rec + i))
+    fwrite(symtable.rec[i].name, 1, strlen(symtable.rec[i].name) + 1, fp);
+
+fclose(fp);
+free(refs);
+}
+
+/*****************************************************************************/
+/* depput : writes a file name in make syntax                                */
+/*****************************************************************************/
+
+void depput(FILE *fp, char *name)
+{
+for (; *name; name++)
+  {
+  if (*name == ' ' || *name == '#')     /* escape what make would split      */
+    fputc('\\', fp);                    /* or take as a comment              */
+  else if (*name == '$')
+    fputc('$', fp);
+  fputc(*name, fp);
+  }
+}
+
+/*****************************************************************************/
+/* writesyms : writes the symbol file; one line per symbol with name,        */
+/*             category and value, as in the listing's symbol table          */
+/*****************************************************************************/
+
+void writesyms()
+{
+FILE *fp;
+struct symrecord *p;
+int i;
+
+if (!(fp = fopen(symname, "w")))
+  {
+  errorout(srcname, 0, 39, "cannot write symbol file %s", symname);
+  exit(4);
+  }
+fprintf(fp, "* A09 V%s symbols of %s\n", VERSION, srcname);
+for (i = 0; i < symtable.counter; i++)
+  {
+  p = symtable.rec + i;
+  if (p->cat != SYMCAT_CONSTANT &&      /* values and addresses, the latter  */
+      p->cat != SYMCAT_VARIABLE &&      /* only if they aren't relocated     */
+      (relocatable ||
+       (p->cat != SYMCAT_LABEL && p->cat != SYMCAT_PUBLIC)))
+    continue;
+  fprintf(fp, "%s %02X %04X\n", p->name, p->cat, p->value);
+  }
+fclose(fp);
+}
+
+/*****************************************************************************/
+/* importsyms : defines the symbols from a symbol file as constants          */
+/*****************************************************************************/
+
+void importsyms(char *name)
+{
+FILE *fp = fopen(name, "r");
+char line[LINELEN], sym[LINELEN];
+struct symrecord *p;
+unsigned cat;
+unsigned long value;
+long ln = 0;
+int i;
+
+if (!fp)
+  {
+  errorout(name, 0, 39, "cannot open symbol file");
+  exit(4);
+  }
+for (i = 0; i < nfnms && strcmp(name, fnms[i]); i++)
+  ;
+if (i == nfnms && nfnms < MAXFILES)     /* it's a dependency, too            */
+  fnms[nfnms++] = strdup(name);
+while (fgets(line, sizeof(line), fp))
+  {
+  ln++;
+  if (line[0] == '*' ||                 /* skip comments and empty lines     */
+      line[0] == '\n' || line[0] == '\r')
+    continue;
+  if (sscanf(line, "%s %x %lx", sym, &cat, &value) != 3 ||
+      strlen(sym) > (size_t)maxidlen)
+    {
+    errorout(name, ln, 39, "invalid symbol file line");
+    exit(4);
+    }
+  if (symtable.counter == MAXLABELS)
+    {
+    errorout(name, ln, 23, "out of symbol storage");
+    exit(4);
+    }
+  p = findsym(sym, 1);
+  if (p->cat == SYMCAT_EMPTY)           /* the first definition counts       */
+    {
+    p->cat = SYMCAT_CONSTANT;
+    p->value = (unsigned short)value;
+    }
+  }
+fclose(fp);
+}
+
+/*****************************************************************************/
+/* writedeps : writes the make dependency file                               */
+/*****************************************************************************/
+
+void writedeps()
+{
+FILE *fp;
+int i;
+char *targets[3];
+int ntargets = 0;
+
+if (!(fp = fopen(depname, "w")))
+  {
+  errorout(srcname, 0, 37, "cannot write dependency file %s", depname);
+  exit(4);
+  }
+if (outmode != OUT_NONE)                /* targets: the object file and the  */
+  targets[ntargets++] = objname;        /* listings                          */
+if (listing & LIST_ON)
+  targets[ntargets++] = listname;
+if (jsonlisting)
+  targets[ntargets++] = jsonname;
+if (!ntargets)                          /* without them, the dependency      */
+  targets[ntargets++] = depname;        /* file itself                       */
+for (i = 0; i < ntargets; i++)
+  {
+  if (i)
+    fputc(' ', fp);
+  depput(fp, targets[i]);
+  }
+fputc(':', fp);
+for (i = 0; i < nfnms; i++)             /* everything that has been loaded   */
+  {
+  fputs(" \\\n ", fp);
+  depput(fp, fnms[i]);
+  }
+fputc('\n', fp);
+for (i = 0; i < nfnms; i++)             /* plus an empty rule for each file  */
+  if (i < pchmain[0] ||                 /* that's not a main source, so      */
+      i >= pchmain[1])                  /* make doesn't stop if it's gone    */
+    {
+    fputc('\n', fp);
+    depput(fp, fnms[i]);
+    fputs(":\n", fp);
+    }
+fclose(fp);
+}
+
+/*****************************************************************************/
+/* findreg : finds a register per name                                       */
+/*****************************************************************************/
+
+struct regrecord * findreg(char *nm)
+{
+int i;
+for (i = 0; regtable[i].name != NULL; i++)
+  {
+  if (strcmp(regtable[i].name,nm) == 0)
+    return regtable + i;
+  }
+return 0;                   
+}
+
+/*****************************************************************************/
+/* findreg63 : finds a register per name for HD63 operations                 */
+/*****************************************************************************/
+
+struct regrecord * findreg63(char *nm)
+{
+int i;
+for (i = 0; i < (sizeof(regtable63) / sizeof(regtable63[0])); i++)
+  {
+  if (strcmp(regtable63[i].name,nm) == 0)
+    return regtable63 + i;
+  }
+return 0;                   
+}
+
+/*****************************************************************************/
+/* findbitreg : finds a bit transfer register per name (6309 only)           */
+/*****************************************************************************/
+
+struct regrecord * findbitreg(char *nm)
+{
+int i;
+
+for (i = 0; i < bitregtablesize; i++)
+  {
+  if (strcmp(bitregtable[i].name,nm) == 0)
+    return bitregtable + i;
+  }
+return 0;                   
+}
+
+/*****************************************************************************/
+/* strupr : converts a string to uppercase (crude)                           */
+/*****************************************************************************/
+
+char *strupr(char *name)
+{
+int i;
+if (!name)
+  return name;
+for (i = 0; name[i]; i++)
+  if ((name[i] >= 'a') && (name[i] <= 'z'))
+    name[i] -= ('a' - 'A');
+return name;
+}
+
+/*****************************************************************************/
+/* addreloc : adds a relocation record to the list                           */
+/*****************************************************************************/
+
+void addreloc(struct relocrecord *p)
+{
+struct relocrecord rel = {0};           /* internal copy                     */
+
+if (p)                                  /* if there's a record,              */
+  rel = *p;                             /* copy to internal                  */
 
 if ((!relocatable) ||                   /* if generating unrelocatable binary*/
     (!rel.sym) ||                       /* or no symbol                      */
@@ -3151,6 +4093,7 @@ switch (rel.sym->cat)                   /* check symbol category             */
     /* fall thru on purpose for now ... */
   case SYMCAT_LABEL :                   /* normal label ?                    */
   case SYMCAT_EXTERN :                  /* external symbol ?                 */
+  case SYMCAT_COMMON :                  /* COMMON block ?                    */
     break;                              /* these are allowed                 */
   case SYMCAT_COMMONDATA :              /* Common data ?                     */
     rel.sym = rel.sym->u.parent;        /* switch to COMMON block            */
@@ -3166,6 +4109,7 @@ if (relcounter >= MAXRELOCS)            /* if no more space                  */
   }
 
 reltable[relcounter++] = rel;           /* add relocation record             */
+memadd(MEM_RELOCS, sizeof(struct relocrecord));
 
 switch (p->sym->cat)                    /* do specials...                    */
   {
@@ -3176,6 +4120,7 @@ switch (p->sym->cat)                    /* do specials...                    */
       (p->exprcat & EXPRCAT_NEGATIVE) ? '-' : '+';
     break;
   case SYMCAT_EXTERN :                  /* external symbol ?                 */
+  case SYMCAT_COMMON :                  /* COMMON block ?                    */
     curline->rel =
       (p->exprcat & EXPRCAT_NEGATIVE) ? 'x' : 'X';
     break;
@@ -3272,6 +4217,7 @@ if (p->cat == SYMCAT_EMPTY)
   p->value = 0;
   p->u.flags |= SYMFLAG_FORWARD;
   }
+addxref(p, xrefkind);
 
 if (p->cat == SYMCAT_MACRO ||
     p->cat == SYMCAT_PARMNAME ||
@@ -3307,6 +4253,8 @@ if (pp)
   pp->exprcat = exprcat;
   pp->sym = p;
   }
+if (p->cat == SYMCAT_COMMON)            /* a COMMON block's value is its     */
+  return 0;                             /* size; it's referenced at offset 0 */
 return p->value;
 }
  
@@ -4589,2343 +5537,3547 @@ hexbuffer[hexcount++] = x;              /* then put byte into buffer         */
 }
 
 /*****************************************************************************/
-/* outbyte : writes one byte to the output in the selected format            */
+/* LZ-compressed self-extracting binary output                               */
+/*****************************************************************************/
+
+/* The output file starts with a position-independent 6809 decompressor that
+   can be loaded and started anywhere outside the target area; it unpacks the
+   memory image to its original addresses and then either jumps to the
+   transfer address (if one has been given with END) or returns via RTS.
+   The stub is followed by the compressed stream (all words big-endian):
+     flags (bit 0 set: jump to transfer address), transfer address,
+     # segments; then for each segment its load address, tokens, and 00.
+   Tokens:  01..7F  literal run; that many bytes follow
+            80..BF  short match, length (t & 3F) + 3, 1 byte offset 0..FF
+                    (meaning -256..-1 relative to the output pointer)
+            C0..FF  long match, length (t & 3F) + 4, 2 byte negative offset */
+
+unsigned char lzbstub[] =
+  {
+  0x33, 0x8D, 0x00, 0x51,               /* UNLZ  LEAU  STREAM,PCR            */
+  0xA6, 0xC0,                           /*       LDA   ,U+   flags           */
+  0xAE, 0xC1,                           /*       LDX   ,U++  exec address    */
+  0x10, 0xAE, 0xC1,                     /*       LDY   ,U++  # segments      */
+  0x34, 0x32,                           /*       PSHS  A,X,Y                 */
+  0xEC, 0x63,                           /* SEGLP LDD   3,S                   */
+  0x27, 0x3C,                           /*       BEQ   DONE                  */
+  0x83, 0x00, 0x01,                     /*       SUBD  #1                    */
+  0xED, 0x63,                           /*       STD   3,S                   */
+  0x10, 0xAE, 0xC1,                     /*       LDY   ,U++  load address    */
+  0xE6, 0xC0,                           /* TOKLP LDB   ,U+   token           */
+  0x27, 0xF0,                           /*       BEQ   SEGLP                 */
+  0x2B, 0x09,                           /*       BMI   MATCH                 */
+  0xA6, 0xC0,                           /* LITLP LDA   ,U+                   */
+  0xA7, 0xA0,                           /*       STA   ,Y+                   */
+  0x5A,                                 /*       DECB                        */
+  0x26, 0xF9,                           /*       BNE   LITLP                 */
+  0x20, 0xF1,                           /*       BRA   TOKLP                 */
+  0xC1, 0xC0,                           /* MATCH CMPB  #$C0                  */
+  0x24, 0x0C,                           /*       BHS   LONGM                 */
+  0xC4, 0x3F,                           /*       ANDB  #$3F                  */
+  0xCB, 0x03,                           /*       ADDB  #3                    */
+  0x34, 0x04,                           /*       PSHS  B                     */
+  0x86, 0xFF,                           /*       LDA   #$FF                  */
+  0xE6, 0xC0,                           /*       LDB   ,U+                   */
+  0x20, 0x08,                           /*       BRA   COPY                  */
+  0xC4, 0x3F,                           /* LONGM ANDB  #$3F                  */
+  0xCB, 0x04,                           /*       ADDB  #4                    */
+  0x34, 0x04,                           /*       PSHS  B                     */
+  0xEC, 0xC1,                           /*       LDD   ,U++                  */
+  0x30, 0xAB,                           /* COPY  LEAX  D,Y                   */
+  0x35, 0x04,                           /*       PULS  B                     */
+  0xA6, 0x80,                           /* CPYLP LDA   ,X+                   */
+  0xA7, 0xA0,                           /*       STA   ,Y+                   */
+  0x5A,                                 /*       DECB                        */
+  0x26, 0xF9,                           /*       BNE   CPYLP                 */
+  0x20, 0xCC,                           /*       BRA   TOKLP                 */
+  0x35, 0x32,                           /* DONE  PULS  A,X,Y                 */
+  0x44,                                 /*       LSRA                        */
+  0x24, 0x02,                           /*       BCC   RET                   */
+  0x6E, 0x84,                           /*       JMP   ,X                    */
+  0x39                                  /* RET   RTS                         */
+  };                                    /* STREAM follows here               */
+
+                                        /* 6809 cycles spent in the stub     */
+#define LZBCYC_INIT     72              /* setup and final jump / return     */
+#define LZBCYC_SEG      37              /* per segment incl. terminator      */
+#define LZBCYC_LIT      15              /* per literal run                   */
+#define LZBCYC_SHORT    55              /* per short match                   */
+#define LZBCYC_LONG     52              /* per long match                    */
+#define LZBCYC_BYTE     17              /* per byte copied                   */
+
+#define LZBHASHSIZE     4096            /* # hash chain heads                */
+#define LZBMAXCHAIN     256             /* max. # candidates tried per match */
+
+int *lzbhead = NULL;                    /* hash chain heads                  */
+int *lzbprev = NULL;                    /* hash chain links (per address)    */
+
+/*****************************************************************************/
+/* lzbhash : calculates the hash value for the 3 bytes at a given address    */
+/*****************************************************************************/
+
+int lzbhash(int addr)
+{
+return ((memimage[addr] << 4) ^
+        (memimage[addr + 1] << 2) ^
+        memimage[addr + 2]) & (LZBHASHSIZE - 1);
+}
+
+/*****************************************************************************/
+/* lzbliterals : writes out a literal run                                    */
 /*****************************************************************************/
 
-void outbyte(unsigned char uc, int off)
+long lzbliterals(int addr, int len, long *cycles)
 {
-int nByte = (loccounter + off) / 8;
-unsigned char nBitMask = (unsigned char) (1 << ((loccounter + off) % 8));
+long written = 0;
+int run;
 
-if (bUsedBytes[nByte] & nBitMask)       /* if address already used           */
-  warning |= WRN_AREA;                  /* set warning code                  */
-else                                    /* otherwise                         */
-  bUsedBytes[nByte] |= nBitMask;        /* mark it as used                   */
+while (len > 0)
+  {
+  run = (len > 0x7f) ? 0x7f : len;
+  fputc(run, objfile);
+  fwrite(memimage + addr, 1, run, objfile);
+  *cycles += LZBCYC_LIT + (long)run * LZBCYC_BYTE;
+  written += run + 1;
+  addr += run;
+  len -= run;
+  }
+return written;
+}
 
-if ((outmode == OUT_REL) &&             /* if in REL output mode             */
-    (absmode))                          /* and producing an absolute module  */
+/*****************************************************************************/
+/* lzbsegment : compresses one contiguous segment of the memory image        */
+/*****************************************************************************/
+
+long lzbsegment(int start, int end, long *cycles)
+{
+long written = 2;
+int addr = start, litstart = start;
+int cand, chain, len, maxlen, dist;
+int bestlen, bestdist, bestgain, gain;
+
+fputc((start >> 8) & 0xff, objfile);    /* segment load address              */
+fputc(start & 0xff, objfile);
+*cycles += LZBCYC_SEG;
+
+for (cand = 0; cand < LZBHASHSIZE; cand++)
+  lzbhead[cand] = -1;
+
+while (addr < end)
   {
-  if (reldataorg + 1 != loccounter + off)
+  bestlen = bestdist = bestgain = 0;
+  if (end - addr >= 3)
     {
-    long curoff = ftell(objfile);
-    if (relabsfoff >= 0)
+    maxlen = end - addr;
+    if (maxlen > 0x3f + 4)
+      maxlen = 0x3f + 4;
+    for (cand = lzbhead[lzbhash(addr)], chain = 0;
+         cand >= 0 && chain < LZBMAXCHAIN;
+         cand = lzbprev[cand], chain++)
       {
-      long blockcnt = curoff - relabsfoff - 4;
-      fseek(objfile, relabsfoff, SEEK_SET);
-      fputc((unsigned char)(blockcnt >> 8), objfile);
-      fputc((unsigned char)(blockcnt & 0xFF), objfile);
-      fseek(objfile, curoff, SEEK_SET);
+      for (len = 0;
+           len < maxlen && memimage[cand + len] == memimage[addr + len];
+           len++)
+        ;
+      dist = addr - cand;
+      if (dist <= 256)                  /* short match costs 2 bytes         */
+        {
+        if (len > 0x3f + 3)
+          len = 0x3f + 3;
+        gain = len - 2;
+        }
+      else                              /* long match costs 3 bytes          */
+        gain = len - 3;
+      if (gain > bestgain)
+        {
+        bestgain = gain;
+        bestlen = len;
+        bestdist = dist;
+        }
       }
-    relabsfoff = curoff;
-    fputc(0, objfile);
-    fputc(1, objfile);
-    fputc((unsigned char)((loccounter + off) >> 8), objfile);
-    fputc((unsigned char)((loccounter + off) & 0xFF), objfile);
-    reldatasize += 4;
     }
-  reldataorg = loccounter + off;
-  }
 
-switch (outmode)
-  {
-  case OUT_BIN :                        /* binary file                       */
-  case OUT_REL :                        /* FLEX Relocatable                  */
-    fputc(uc, objfile);
-    reldatasize++;
-    break;
-  case OUT_SREC :                       /* Motorola S-records                */
-    outhex(uc);
-    break;
-  case OUT_IHEX :                       /* Intel Hex                         */
-    outihex(uc);
-    break;
-  case OUT_FLEX :                       /* FLEX                              */
-    outflex(uc);
-    break;
-  }
-}
+  if (bestgain > 0)                     /* if worth a match                  */
+    {
+    written += lzbliterals(litstart, addr - litstart, cycles);
+    if (bestdist <= 256)
+      {
+      fputc(0x80 | (bestlen - 3), objfile);
+      fputc((-bestdist) & 0xff, objfile);
+      written += 2;
+      *cycles += LZBCYC_SHORT;
+      }
+    else
+      {
+      fputc(0xc0 | (bestlen - 4), objfile);
+      fputc(((-bestdist) >> 8) & 0xff, objfile);
+      fputc((-bestdist) & 0xff, objfile);
+      written += 3;
+      *cycles += LZBCYC_LONG;
+      }
+    *cycles += (long)bestlen * LZBCYC_BYTE;
+    }
+  else
+    bestlen = 1;
 
-/*****************************************************************************/
-/* outbuffer : writes the output to a file in the selected format            */
-/*****************************************************************************/
+  for (; bestlen > 0; bestlen--, addr++)/* enter all covered addresses       */
+    if (end - addr >= 3)
+      {
+      cand = lzbhash(addr);
+      lzbprev[addr] = lzbhead[cand];
+      lzbhead[cand] = addr;
+      }
+  if (bestgain > 0)
+    litstart = addr;
+  }
 
-void outbuffer()
-{
-int i;
-for (i = 0; i < codeptr; i++)
-  outbyte(codebuf[i], i);
+written += lzbliterals(litstart, addr - litstart, cycles);
+fputc(0, objfile);                      /* end of segment                    */
+return written + 1;
 }
 
 /*****************************************************************************/
-/* report : reports an error                                                 */
+/* writelzb : writes the LZ-compressed self-extracting binary                */
 /*****************************************************************************/
 
-void report()
+void writelzb()
 {
-int i;
+int addr, start, nseg = 0;
+long total = 0, written, cycles = LZBCYC_INIT;
 
-for (i = 0; i < 16; i++)
+if (!(dwOptions & (OPTION_M09 | OPTION_H09)))
   {
-  if (error & 1)
-    {
-    printf("%s(%ld) : error %d: %s in \"%s\"\n", 
-           expandfn(curline->fn), curline->ln, i + 1,
-           errormsg[i], curline->txt);
-    if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
-      putlist( "*** Error %d: %s\n", i + 1, errormsg[i]);
-    errors++;
-    }
-  error >>= 1;
+  errorout(srcname, 0, 26, "LZ-compressed output needs 6809 or 6309 mode");
+  errors++;
+  return;
   }
 
-if ((dwOptions & OPTION_TSC))           /* suppress warning 1 in TSC mode    */
-  warning &= ~WRN_OPT;
+lzbhead = (int *)malloc(LZBHASHSIZE * sizeof(int));
+lzbprev = (int *)malloc(0x10000 * sizeof(int));
+if (!lzbhead || !lzbprev)
+  {
+  errorout(srcname, 0, 22, "memory allocation error");
+  exit(4);
+  }
 
-if (!(dwOptions & OPTION_WAR))          /* reset warnings if not wanted      */
-  warning = WRN_OK;
+for (addr = 0; addr < 0x10000; addr++)  /* count contiguous segments         */
+  if ((bUsedBytes[addr / 8] & (1 << (addr % 8))) &&
+      (!addr || !(bUsedBytes[(addr - 1) / 8] & (1 << ((addr - 1) % 8)))))
+    nseg++;
 
-for (i = 0; i < 16; i++)
+fwrite(lzbstub, 1, sizeof(lzbstub), objfile);
+fputc(tfradrset ? 1 : 0, objfile);
+fputc((tfradr >> 8) & 0xff, objfile);
+fputc(tfradr & 0xff, objfile);
+fputc((nseg >> 8) & 0xff, objfile);
+fputc(nseg & 0xff, objfile);
+written = sizeof(lzbstub) + 5;
+
+for (addr = 0; addr < 0x10000; )
   {
-  if (warning & 1)
+  if (!(bUsedBytes[addr / 8] & (1 << (addr % 8))))
     {
-    printf("%s(%ld) : warning %d: %s in \"%s\"\n", 
-           expandfn(curline->fn), curline->ln, i + 1, warningmsg[i], curline->txt);
-    if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
-      putlist( "*** warning %d: %s\n", i + 1, warningmsg[i]);
-    warnings++;
+    addr++;
+    continue;
     }
-  warning >>= 1;
+  for (start = addr;
+       addr < 0x10000 && (bUsedBytes[addr / 8] & (1 << (addr % 8)));
+       addr++)
+    ;
+  total += addr - start;
+  written += lzbsegment(start, addr, &cycles);
   }
-} 
+
+printf("LZ output: %ld bytes in %d segment(s) compressed to %ld bytes (%ld%%),"
+       " approx. %ld cycles to unpack\n",
+       total, nseg, written,
+       total ? (written * 100 + total / 2) / total : 0L, cycles);
+
+free(lzbprev);
+free(lzbhead);
+}
 
 /*****************************************************************************/
-/* pemt_expr : recursively processes a PEMT expression enclosed in @(...)    */
+/* Delta output against a previous build image                               */
 /*****************************************************************************/
 
-int pemt_expr
-    (
-    const char *szBuf1,                 /* buffer we're working on           */
-    int atat,                           /* @ position in szBuf1              */
-    char *szOutBuf,                     /* output buffer address             */
-    int *newpos                         /* position after processing         */
-    )
+unsigned char *previmage = NULL;        /* memory image of previous build    */
+unsigned char *prevused = NULL;         /* 1 bit per byte used in prev. build*/
+
+/*****************************************************************************/
+/* prevset : sets a byte in the previous image                               */
+/*****************************************************************************/
+
+void prevset(long addr, unsigned char uc)
 {
-char lBsl = 0;
-char szInt[LINELEN];
-int i, lvl = 1, ol = 0, odec = 0;
-const char *fmts[] =
-  {
-  "%04lX",
-  "%ld",
-  "%04lX"
-  };
+addr &= 0xffff;
+previmage[addr] = uc;
+prevused[addr / 8] |= (unsigned char)(1 << (addr % 8));
+}
 
-for (i = atat + 2; szBuf1[i]; i++)      /* walk through the string           */
+/*****************************************************************************/
+/* prevhex : converts a 2-digit hex number from a hex record                 */
+/*****************************************************************************/
+
+int prevhex(char *s)
+{
+int i, c, val = 0;
+
+for (i = 0; i < 2; i++)
   {
-  char c = szBuf1[i];
-  if (c == '*' && !lBsl)                /* if on a plain *, replace with addr*/
+  c = toupper(s[i]);
+  if (c >= '0' && c <= '9')
+    val = val * 16 + c - '0';
+  else if (c >= 'A' && c <= 'F')
+    val = val * 16 + c - 'A' + 10;
+  else
+    return -1;
+  }
+return val;
+}
+
+/*****************************************************************************/
+/* loadprevimage : loads the previous build image in any supported format    */
+/*****************************************************************************/
+
+int loadprevimage()
+{
+FILE *fp;
+unsigned char *buf, *p, *end;
+long len, addr, base, i;
+int n, type, isflex;
+char line[LINELEN];
+
+previmage = (unsigned char *)malloc(0x10000);
+prevused = (unsigned char *)malloc(8192);
+if (!previmage || !prevused || !(fp = fopen(prevname, "rb")))
+  return 0;
+memset(prevused, 0, 8192);
+
+n = fgetc(fp);
+if (n == 'S' || n == ':')               /* Motorola S-records / Intel Hex    */
+  {
+  fclose(fp);
+  if (!(fp = fopen(prevname, "r")))
+    return 0;
+  while (fgets(line, sizeof(line), fp))
     {
-    /* inside @(...), * is expanded to $addr, as this is the format used
-       in scanexpr()! */
-    int odec2 = 0;
-    const char *fmts2[] =
-      {
-      "$%04lX",
-      "%ld",
-      "$%04lX"
-      };
-    if (szBuf1[i + 1] == ',' &&         /* *,d means "output addr as dec"    */
-        (szBuf1[i + 2] == 'd' ||        /* *,x means output addr as hex"     */
-         szBuf1[i + 2] == 'x'))
+    if (line[0] == 'S' && line[1] == '1')
       {
-      odec2 = 1 + (szBuf1[i + 2] == 'x');
-      i += 2;
+      n = prevhex(line + 2) - 3;        /* # data bytes                      */
+      addr = (prevhex(line + 4) << 8) | prevhex(line + 6);
+      for (i = 0; i < n; i++)
+        if ((type = prevhex(line + 8 + 2 * i)) >= 0)
+          prevset(addr + i, (unsigned char)type);
       }
-    ol += sprintf(szInt + ol, fmts2[odec2], oldlc);
-    }
-  else if (c == '@' && szBuf1[i + 1] == '(' && !lBsl)
-    {                                   /* if on @(, recurse                 */
-    ol += pemt_expr(szBuf1, i, szInt + ol, &i);
-    }
-  else if (c == '(')                    /* if on (, increase level           */
-    {
-    if (!lBsl)
-      lvl++;
-    szInt[ol++] = c;
-    szInt[ol] = '\0';
-    }
-  else if (c == ')')                    /* if on ), stop this.               */
-    {
-    if (!lBsl)
-      lvl--;
-    if (!lvl)
+    else if (line[0] == ':')
       {
-      /* ),d as end means "output as dec", ),x means "output as hex"  */
-      if (szBuf1[i + 1] == ',' && 
-          (szBuf1[i + 2] == 'd' || szBuf1[i + 2] == 'x'))
-        {
-        odec = 1 + (szBuf1[i + 2] == 'x');
-        i += 2;
-        }
-      break;
+      n = prevhex(line + 1);
+      addr = (prevhex(line + 3) << 8) | prevhex(line + 5);
+      if (prevhex(line + 7) != 0)       /* only data records are of interest */
+        continue;
+      for (i = 0; i < n; i++)
+        if ((type = prevhex(line + 9 + 2 * i)) >= 0)
+          prevset(addr + i, (unsigned char)type);
       }
-    szInt[ol++] = c;
-    szInt[ol] = '\0';
-    }
-  else if (c == '\\' && !lBsl)
-    ;
-  else
-    {
-    szInt[ol++] = c;
-    szInt[ol] = '\0';
     }
-
-  lBsl = !lBsl && (c == '\\');          /* remember whether on \             */
+  fclose(fp);
+  return 1;
   }
 
-*newpos = i;                            /* tell caller where we ended        */
-if (i > atat + 2)                       /* if something to evaluate          */
-  {                                     /* evaluate it                       */
-  char *osp = srcptr;
-  long l;
-  struct relocrecord pp = {0};
-  srcptr = szInt;
-  l = scanexpr(0, &pp);
-  if (pass == 2 && unknown)             /* unresolved items are not allowed  */
-    error |= ERR_LABEL_UNDEF;
-  ol = sprintf(szOutBuf, fmts[odec], l);
-  srcptr = osp;
+fseek(fp, 0, SEEK_END);                 /* binary; load it completely        */
+len = ftell(fp);
+fseek(fp, 0, SEEK_SET);
+if (!(buf = (unsigned char *)malloc(len + 1)))
+  {
+  fclose(fp);
+  return 0;
   }
+len = (long)fread(buf, 1, len, fp);
+fclose(fp);
 
-return ol;
-}
-
-/*****************************************************************************/
-/* pemt_putlist : lists the (rest of the) line with PEMT expressions         */
-/*****************************************************************************/
+isflex = (prevbase < 0);                /* FLEX binary, unless base given    */
+for (p = buf, end = buf + len; isflex && p < end; )
+  {
+  if (*p == 0x02 && p + 4 <= end && p + 4 + p[3] <= end)
+    p += 4 + p[3];                      /* data record                       */
+  else if (*p == 0x16 && p + 3 <= end)
+    p += 3;                             /* transfer address record           */
+  else if (*p == 0x00)
+    p++;                                /* sector padding                    */
+  else
+    isflex = 0;
+  }
 
-void pemt_putlist(const char *szLine, int off)
-{
-/* Specials: 
-   - '*' means "current address", unless prefixed with '\'
-     always output as hex value without leading $, as this is
-     for dasmfw / f9dasm, which expect hex without $.
-     For more complex evaluations, use @(...).
-   - '@(...)' means "evaluate the expression with scanexpr() and
-     use the result as a numerical value", unless prefixed with '\'
-*/
-char lBsl = 0;
-for ( ; szLine[off]; off++)
+if (isflex)
   {
-  char c = szLine[off];
-  if (szLine[off] == '*' && !lBsl)
-    putlist("%04X", oldlc);
-  else if (c == '@' && szLine[off + 1] == '(' && !lBsl)
+  for (p = buf; p < end; )
     {
-    char szExpr[33];
-    pemt_expr(szLine, off, szExpr, &off);
-    putlist("%s", szExpr);
+    if (*p == 0x02)
+      {
+      addr = (p[1] << 8) | p[2];
+      for (i = 0; i < p[3]; i++)
+        prevset(addr + i, p[4 + i]);
+      p += 4 + p[3];
+      }
+    else
+      p += (*p == 0x16) ? 3 : 1;
     }
-  else if (c == '\\' && !lBsl)          /* \ is an escape char, so ...       */
-    ;                                   /* skip the first one.               */
-    /* NB: to output a \, two are needed. To output \*, \\\* must be written */
-  else
-    putlist("%c", c);
-  lBsl = !lBsl && (c == '\\');
   }
-putlist("\n");
+else                                    /* plain binary image                */
+  {
+  base = prevbase;
+  if (base < 0)                         /* default: lowest assembled address */
+    for (base = 0;
+         base < 0xffff && !(bUsedBytes[base / 8] & (1 << (base % 8)));
+         base++)
+      ;
+  for (i = 0; i < len && base + i < 0x10000; i++)
+    prevset(base + i, buf[i]);
+  }
+
+free(buf);
+return 1;
 }
 
 /*****************************************************************************/
-/* outlist : lists the code bytes for an instruction                         */
+/* writedelta : writes only the address ranges changed since last build     */
 /*****************************************************************************/
 
-void outlist(struct oprecord *op, struct symrecord *lpLabel)
+void writedelta()
 {
-int i;
-
-if (LINE_IS_INVISIBLE(curline->flg) &&  /* don't list invisible lines        */
-    !(dwOptions & OPTION_INV))
-  return;
-
-if (LINE_IS_MACINV(curline->flg) &&     /* don't list macro invocations if   */
-    !(dwOptions & OPTION_MAC))          /* not explicitly requested          */
-  return;
-
-if (LINE_IS_MACEXP(curline->flg) &&     /* don't list macro expansions if    */
-    !(dwOptions & OPTION_EXP))          /* not explicitly requested          */
-  return;
+long addr, start, end, next;
+long total = 0, changed = 0, written = 0;
+int ranges = 0;
 
-if ((curline->lvl & LINCAT_LVLMASK) &&  /* if level 1..nn                    */
-    !(dwOptions & OPTION_LLL))          /* and this is not to be listed      */
-  return;
+#define DELTA_USED(a) (bUsedBytes[(a) / 8] & (1 << ((a) % 8)))
+#define DELTA_CHANGED(a) \
+    (DELTA_USED(a) && \
+     (!(prevused[(a) / 8] & (1 << ((a) % 8))) || previmage[a] != memimage[a]))
 
-if ((suppress || nSkipCount) &&         /* if this is conditionally skipped  */
-    !(dwOptions & OPTION_CON))          /* and this is not to be listed      */
-  return;
-if ((condline) &&                       /* if this is a condition line       */
-    !(dwOptions & OPTION_CON))          /* and this is not to be listed      */
+if (!loadprevimage())
+  {
+  errorout(srcname, 0, 27, "cannot read previous image %s", prevname);
+  errors++;
   return;
+  }
 
-if (dwOptions & OPTION_NUM)             /* if number output                  */
-  putlist("%4d ", curline->ln);         /* print out the line number         */
-
-if (!absmode &&                         /* if in relocating assembler mode   */
-    !(dwOptions & OPTION_LPA))
-  putlist("%c", curline->rel);          /* output relocation information     */
+for (addr = 0; addr < 0x10000; addr++)
+  {
+  if (DELTA_USED(addr))
+    total++;
+  if (DELTA_CHANGED(addr))
+    changed++;
+  }
 
-if (dwOptions & OPTION_LPA)             /* if in patch mode                  */
+for (addr = 0; addr < 0x10000; )
   {
-  const char *blnkfil = "      ";
-  if (LINE_IS_PEMTCMT(curline->flg))    /* if PEMT comment flag set          */
+  if (!DELTA_CHANGED(addr))
     {
-    putlist("*");                       /* prefix line with *                */
-    blnkfil++;
+    addr++;
+    continue;
     }
-  if ((op) && (op->cat == OPCAT_PSEUDO))
-    {
-    switch (op->code)
+  start = addr;                         /* find end of range; unchanged gaps */
+  end = addr + 1;                       /* up to deltagap bytes are merged   */
+  for (next = end;
+       next < 0x10000 && DELTA_USED(next) && next - end <= deltagap;
+       next++)
+    if (DELTA_CHANGED(next))
+      end = next + 1;
+
+  hexaddr = (unsigned short)start;      /* write the range                   */
+  for (addr = start; addr < end; addr++)
+    switch (outmode)
       {
-      case PSEUDO_SETDP :
-        if (dpsetting >= 0)
-          putlist("setdp %04X %02X\n", loccounter, dpsetting);
-        break;
-      case PSEUDO_ORG :
-#if 0
-        putlist("insert %04X \\        ORG     $%04X\n", loccounter, loccounter);
-#endif
-        break;
-      case PSEUDO_RZB :
-      case PSEUDO_FILL :
-      case PSEUDO_FCB :
-      case PSEUDO_FCC :
-        putlist("data %04X", oldlc);
-        if (codeptr > 1)
-          putlist("-%04X", oldlc + codeptr - 1);
-        /* we got a little conceptual problem here... if RZB or FILL reserve
-        more than sizeof(codebuf) bytes, this is not correctly reflected. */
-        putlist("\n");
-        break;
-      case PSEUDO_FCW :
-        putlist("word %04x", oldlc);
-        if (codeptr > 2)
-          putlist("-%04X", oldlc + codeptr - 1);
-        putlist("\n");
+      case OUT_SREC :
+        outhex(memimage[addr]);
         break;
-      case PSEUDO_FCQ :
-        putlist("dword %04x", oldlc);
-        if (codeptr > 2)
-          putlist("-%04X", oldlc + codeptr - 1);
-        putlist("\n");
+      case OUT_IHEX :
+        outihex(memimage[addr]);
         break;
-      case PSEUDO_PEMT :
-        pemt_putlist(szBuf1, 0);
+      case OUT_FLEX :
+        outflex(memimage[addr]);
         break;
       }
-    }
-  if (codeptr > 0)                      /* if there are code bytes           */
+  switch (outmode)
     {
-    char *name = lpLabel ? lpLabel->name : findsymat(oldlc);
-    if (name)
-      putlist("label %04X %s\n", oldlc, name);
-    putlist("patch ");                  /* write "patch"                     */
+    case OUT_SREC :
+      flushhex();
+      break;
+    case OUT_IHEX :
+      flushihex();
+      break;
+    case OUT_FLEX :
+      flushflex();
+      break;
     }
-  else if (*curline->txt)
-    putlist(blnkfil);
-#if 0
-  else
-    putlist("comment %04X", oldlc);
-#endif
-  }
-else if ((warning & WRN_OPT) &&         /* excessive branch, TSC style       */
-    (dwOptions & OPTION_TSC) &&         
-    (dwOptions & OPTION_WAR))
-  putlist(">");
-else if (LINE_IS_MACDEF(curline->flg))  /* if in macro definition            */
-  putlist("#");                         /* prefix line with #                */
-else if (LINE_IS_MACEXP(curline->flg))  /* if in macro expansion             */
-  putlist("+");                         /* prefix line with +                */
-else if (LINE_IS_MACINV(curline->flg))  /* if in macro invocation            */
-  putlist("&");                         /* prefix line with &                */
-else if (LINE_IS_INVISIBLE(curline->flg))
-  putlist("-");
-else if (LINE_IS_PEMTCMT(curline->flg))
-  putlist("-");
-else if (*curline->txt)                 /* otherwise                         */
-  putlist(" ");                         /* prefix line with blank            */
-
-if (codeptr > 0 || printovr & PRINTOV_PADDR)
-  putlist("%04X ", (unsigned short)(oldlc + ((dwOptions & OPTION_LPA) ? 0 : phase)));
-else if (printovr & PRINTOV_PLABEL)
-  putlist("%04X ", (unsigned short)lpLabel->value);
-else if (printovr & PRINTOV_PDP && dpsetting >= 0)
-  putlist("%02X   ", (unsigned short)dpsetting);
-else if (printovr & PRINTOV_PTFR)
-  putlist("%04X ", tfradr);
-else if (printovr & PRINTOV_PPHA)
-  putlist("%04X ", (unsigned short)phase);
-else if (*curline->txt)
-  putlist("     ");
-else
-  {
-  putlist( "\n");
-  return;
+  ranges++;
+  written += end - start;
   }
 
-for (i = 0; i < codeptr && i < MAXLISTBYTES; i++)
-  {
-  if (dwOptions & OPTION_LPA)
-    putlist("%02X ", codebuf[i]);
-  else
-    putlist("%02X", codebuf[i]);
-  }
-for (; i <= MAXLISTBYTES; i++)
-  {
-  if (dwOptions & OPTION_LPA)
-    putlist("   ");
-  else
-    putlist("  ");
-  }
+printf("Delta output: %ld of %ld bytes changed, %ld bytes in %d range(s) written\n",
+       changed, total, written, ranges);
 
-if ((dwOptions & OPTION_LPA) &&
-    (*curline->txt))
-  putlist("* ");
+#undef DELTA_USED
+#undef DELTA_CHANGED
+free(prevused);
+free(previmage);
+}
 
-if (strcmp(curline->txt, srcline) &&    /* if text inserted                  */
-    (dwOptions & OPTION_EXP))           /* and expansion activated           */
-  putlist("%s", curline->txt);          /* just print out the source line    */
-else                                    /* otherwise                         */
-  putlist("%s", srcline);               /* print possibly expanded line      */
+/*****************************************************************************/
+/* outbyte : writes one byte to the output in the selected format            */
+/*****************************************************************************/
 
-putlist("\n");                          /* send newline                      */
+void outbyte(unsigned char uc, int off)
+{
+int nByte = ((loccounter + off) & 0xffff) / 8; /* wrap beyond 64K      */
+unsigned char nBitMask = (unsigned char) (1 << ((loccounter + off) % 8));
 
-/* allow to create [l]comments by using a double comment character;
-   commentchar+@ on start of line creates an insert instead of a comment */
-if ((dwOptions & OPTION_LPA) &&         /* patch output - check for comments */
-    (*curline->txt))
+stats.bytes++;
+
+if (bUsedBytes[nByte] & nBitMask)       /* if address already used           */
+  warning |= WRN_AREA;                  /* set warning code                  */
+else                                    /* otherwise                         */
+  bUsedBytes[nByte] |= nBitMask;        /* mark it as used                   */
+
+if (memimage)                           /* if collecting a memory image      */
   {
-#if 1
-  /* work on the already expanded text */
-  const char *srcptr = srcline;
-#else
-  /* work on the original text */
-  const char *srcptr = curline->txt;
-#endif
-  char c, iscchr, incomment = 0, nonblnk = 0, add_after = 0;
-  int fnd = -1, bef = 0;
-  for (i = 0; srcptr[i]; i++)
-    {
-    c = srcptr[i];
-    iscchr = ((c == '*') ||
-              ((dwOptions & OPTION_GAS) && (c == '|')) ||
-              (c == ';'));
-    if (!incomment &&
-        iscchr &&
-        (c == srcptr[i + 1] || 
-         (srcptr[i + 1] == '@' && !nonblnk)))
-      {
-      c = srcptr[++i];
-      if (srcptr[i + 1] == '+')
-        {
-        ++i;
-        add_after = 1;
-        }
-      fnd = ++i;
-      if (isspace(srcptr[fnd]))
-        fnd++;
-      break;
-      }
-    else if (isspace(c))
-      {
-      if (!nonblnk)
-        bef++;
-      }
-    else
-      {
-      if (iscchr)
-        incomment = 1;
-      nonblnk = 1;
-      }
-    }
-  if (fnd > 0 && (srcptr[fnd] || !(nonblnk || bef > 2)))
-    {
-    if (nonblnk || bef > 2)
-      putlist("lcomment %s%04X ", add_after ? "after " : "", oldlc);
-    else if (c == '@')
-      putlist("insert %s%04X ", add_after ? "after " : "", oldlc);
-    else
-      putlist("comment %s%04X ", add_after ? "after " : "", oldlc);
-    if (isspace(srcptr[fnd]))
-      putlist("\\");
-    pemt_putlist(srcptr, fnd);
-    }
+  memimage[(loccounter + off) & 0xffff] = uc;
+  if (outmode == OUT_LZB || prevname[0])/* output is written at the end      */
+    return;
   }
 
-if (codeptr > MAXLISTBYTES &&           /* if there are additional bytes,    */
-    (dwOptions & (OPTION_LPA | OPTION_MUL)))
-  {                                     /* print them.                       */
-  if (dwOptions & OPTION_LPA)           /* if in patch mode                  */
-    putlist("patch");                   /* write "patch"                     */
-  for (i = MAXLISTBYTES; i < codeptr; i++)
+if ((outmode == OUT_REL) &&             /* if in REL output mode             */
+    (absmode))                          /* and producing an absolute module  */
+  {
+  if (reldataorg + 1 != loccounter + off)
     {
-    if (!(i % MAXLISTBYTES))
+    long curoff = ftell(objfile);
+    if (relabsfoff >= 0)
       {
-      if (i != MAXLISTBYTES)
-        {
-        putlist("\n");
-        if (dwOptions & OPTION_LPA &&   /* if in patch mode                  */
-            i < codeptr)                /* and bytes follow                  */
-          putlist("patch");             /* write "patch"                     */
-        }
-      if (dwOptions & OPTION_NUM)       /* if number output                  */
-        putlist("     ");
-      if (!absmode)
-        putlist(" ");
-      putlist(" %04X ",
-              (unsigned short)(oldlc +
-                               ((dwOptions & OPTION_LPA) ? 0 : phase) +
-                               i));
+      long blockcnt = curoff - relabsfoff - 4;
+      fseek(objfile, relabsfoff, SEEK_SET);
+      fputc((unsigned char)(blockcnt >> 8), objfile);
+      fputc((unsigned char)(blockcnt & 0xFF), objfile);
+      fseek(objfile, curoff, SEEK_SET);
       }
-    if (dwOptions & OPTION_LPA)         /* if in patch mode                  */
-      putlist("%02X ", codebuf[i]);
-    else
-      putlist("%02X", codebuf[i]);
+    relabsfoff = curoff;
+    fputc(0, objfile);
+    fputc(1, objfile);
+    fputc((unsigned char)((loccounter + off) >> 8), objfile);
+    fputc((unsigned char)((loccounter + off) & 0xFF), objfile);
+    reldatasize += 4;
     }
-  putlist("\n");
+  reldataorg = loccounter + off;
   }
 
-if (strcmp(curline->txt, srcline) &&    /* if text inserted                  */
-    (dwOptions & OPTION_EXP))           /* and expansion activated           */
+switch (outmode)
   {
-  if (dwOptions & OPTION_NUM)
-    putlist("%4d ", curline->ln);
-  if (!absmode)
-    putlist(" ");
-  putlist("+                   ( %s )\n", srcline);
+  case OUT_BIN :                        /* binary file                       */
+  case OUT_REL :                        /* FLEX Relocatable                  */
+    fputc(uc, objfile);
+    reldatasize++;
+    break;
+  case OUT_SREC :                       /* Motorola S-records                */
+    outhex(uc);
+    break;
+  case OUT_IHEX :                       /* Intel Hex                         */
+    outihex(uc);
+    break;
+  case OUT_FLEX :                       /* FLEX                              */
+    outflex(uc);
+    break;
   }
 }
 
 /*****************************************************************************/
-/* setlabel : sets a label                                                   */
+/* outbuffer : writes the output to a file in the selected format            */
 /*****************************************************************************/
 
-void setlabel(struct symrecord * lp)
+void outbuffer()
 {
-if (lp)
+int i;
+for (i = 0; i < codeptr; i++)
+  outbyte(codebuf[i], i);
+}
+
+/*****************************************************************************/
+/* jsonstring : writes a string in JSON notation                             */
+/*****************************************************************************/
+
+void jsonstring(FILE *fp, const char *s)
+{
+fputc('"', fp);
+for (; *s; s++)
   {
-  if (lp->cat == SYMCAT_PUBLICUNDEF)
+  if (*s == '"' || *s == '\\')
     {
-    lp->cat = SYMCAT_PUBLIC;
-    lp->value = (unsigned short)(loccounter + phase);
+    fputc('\\', fp);
+    fputc(*s, fp);
     }
-  else if (lp->cat == SYMCAT_EMPTYLOCAL)
+  else if ((unsigned char)*s < ' ' ||   /* control characters and, as they   */
+           (unsigned char)*s >= 0x80)   /* aren't UTF-8, Latin-1 characters  */
+    fprintf(fp, "\\u%04x", (unsigned char)*s);
+  else
+    fputc(*s, fp);
+  }
+fputc('"', fp);
+}
+
+/*****************************************************************************/
+/* outjson : writes a JSON Lines record for the current line                 */
+/*****************************************************************************/
+
+void outjson()
+{
+int i;
+
+fprintf(jsonfile, "{\"fn\":");
+jsonstring(jsonfile, expandfn(curline->fn));
+fprintf(jsonfile,
+        ",\"ln\":%ld,\"lvl\":%d,\"flg\":%d,\"oldlc\":%u,\"phase\":%d,"
+        "\"codeptr\":%d,\"codebuf\":\"",
+        curline->ln,
+        curline->lvl & LINCAT_LVLMASK,
+        curline->flg,
+        oldlc,
+        phase,
+        codeptr);
+for (i = 0; i < codeptr; i++)
+  fprintf(jsonfile, "%02X", codebuf[i]);
+fprintf(jsonfile, "\",\"error\":%ld,\"warning\":%ld,\"txt\":",
+        error, warning);
+jsonstring(jsonfile, curline->txt);
+fprintf(jsonfile, "}\n");
+}
+
+/*****************************************************************************/
+/* traceevent : writes a complete trace event that started at tstart         */
+/*****************************************************************************/
+
+void traceevent
+    (
+    char const *name,                   /* event name                        */
+    char const *cat,                    /* event category                    */
+    double tstart,                      /* start time stamp                  */
+    int lvl,                            /* nesting level (<0 : none)         */
+    char const *fn,                     /* source file (NULL : none)         */
+    long ln                             /* line number therein               */
+    )
+{
+double tend;
+
+if (!tracefile)
+  return;
+tend = stattime();
+fprintf(tracefile, ",\n{\"name\":");
+jsonstring(tracefile, name);
+fprintf(tracefile, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+        "\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+        cat, (tstart - tracebase) * 1e6, (tend - tstart) * 1e6);
+if (lvl >= 0)
+  fprintf(tracefile, "\"level\":%d%s", lvl, fn ? "," : "");
+if (fn)
+  {
+  fprintf(tracefile, "\"file\":");
+  jsonstring(tracefile, expandfn(fn));
+  fprintf(tracefile, ",\"line\":%ld", ln);
+  }
+fprintf(tracefile, "}}");
+}
+
+/*****************************************************************************/
+/* addcost : charges the costs of a processed line to its macro or file      */
+/*****************************************************************************/
+
+void addcost(struct linebuf *pline, double t, long bytes)
+{
+struct costrecord *c;
+
+if (pline->mac >= 0)
+  c = costmac + pline->mac;
+else
+  {
+  if (pline->fn != costlastfn)
     {
-    lp->cat = SYMCAT_LOCALLABEL;
+    for (costlastidx = 0; costlastidx < nfnms; costlastidx++)
+      if (fnms[costlastidx] == pline->fn)
+        break;
+    if (costlastidx >= nfnms)           /* not a loaded file? Leave it.      */
+      return;
+    costlastfn = pline->fn;
     }
-  else if (lp->cat == SYMCAT_LOCALLABEL)
-    ;
-  else if (lp->cat != SYMCAT_EMPTY && lp->cat != SYMCAT_UNRESOLVED)
+  c = costfile + costlastidx;
+  }
+c->lines12[(int)pass]++;
+c->t12[(int)pass] += t;
+c->bytes += bytes;
+}
+
+/*****************************************************************************/
+/* cmpcost : compares two cost records by descending total time              */
+/*****************************************************************************/
+
+int cmpcost(const void *a, const void *b)
+{
+const struct costrecord *ca = *(const struct costrecord * const *)a;
+const struct costrecord *cb = *(const struct costrecord * const *)b;
+double ta = ca->t12[1] + ca->t12[2];
+double tb = cb->t12[1] + cb->t12[2];
+
+if (ta != tb)
+  return (ta > tb) ? -1 : 1;
+return (ca < cb) ? -1 : (ca > cb);
+}
+
+/*****************************************************************************/
+/* outcost : prints the cost report to a file or (fp == NULL) the listing    */
+/*****************************************************************************/
+
+void outcost(FILE *fp)
+{
+struct costrecord *recs[MAXMACROS + MAXFILES];
+char *macnames[MAXMACROS] = {0};
+char szLine[FNLEN + 100];
+char const *lpa = (!fp && (dwOptions & OPTION_LPA)) ? "* " : "";
+int i, n = 0, k;
+
+for (i = 0; i < symtable.counter; i++)  /* find the macro names              */
+  if (symtable.rec[i].cat == SYMCAT_MACRO &&
+      symtable.rec[i].value < MAXMACROS)
+    macnames[symtable.rec[i].value] = symtable.rec[i].name;
+for (i = 0; i < nfnms; i++)
+  if (costfile[i].lines)
+    recs[n++] = costfile + i;
+for (i = 0; i < nMacros; i++)
+  if (costmac[i].calls)
+    recs[n++] = costmac + i;
+qsort(recs, n, sizeof(struct costrecord *), cmpcost);
+
+if (!fp)
+  {
+  if (dwOptions & OPTION_PAG)           /* if pagination active,             */
     {
-    if (dwOptions & OPTION_RED)
-      {
-      /* if existing constant value equals the current location, let it through */
-      if (lp->cat == SYMCAT_CONSTANT &&
-          lp->value == (unsigned short)(loccounter + phase))
-        lp->cat = (global) ? SYMCAT_PUBLIC : SYMCAT_LABEL;
-      }
-    if ((lp->cat != SYMCAT_LABEL && lp->cat != SYMCAT_PUBLIC) ||
-        lp->value != (unsigned short)(loccounter + phase))
-      error |= ERR_LABEL_MULT;
+    if (nCurLine > 5)                   /* if not on 1st line,               */
+      PageFeed();                       /* shift to next page                */
     }
   else
-    {
-    lp->cat = (global) ? SYMCAT_PUBLIC : SYMCAT_LABEL;
-    lp->value = (unsigned short)(loccounter + phase);
-    } 
-  } 
+    putlist("\n");
+  }
+sprintf(szLine, "%sCOST REPORT\n"
+        "%s   CALLS    LINES   PASS 1   PASS 2    BYTES    MS P1    MS P2  NAME\n",
+        lpa, lpa);
+if (fp)
+  fputs(szLine, fp);
+else
+  putlist("%s", szLine);
+for (k = 0; k < n; k++)
+  {
+  struct costrecord *c = recs[k];
+  int ismac = (c >= costmac && c < costmac + MAXMACROS);
+
+  i = ismac ? (int)(c - costmac) : (int)(c - costfile);
+  if (ismac)
+    sprintf(szLine, "%s%8ld ", lpa, c->calls);
+  else
+    sprintf(szLine, "%s       - ", lpa);
+  sprintf(szLine + strlen(szLine), "%8ld %8ld %8ld %8ld %8.3f %8.3f  %s %s\n",
+          c->lines, c->lines12[1], c->lines12[2], c->bytes,
+          c->t12[1] * 1000., c->t12[2] * 1000.,
+          ismac ? "MACRO" : "FILE",
+          ismac ? (macnames[i] ? macnames[i] : "?") : expandfn(fnms[i]));
+  if (fp)
+    fputs(szLine, fp);
+  else
+    putlist("%s", szLine);
+  }
 }
 
 /*****************************************************************************/
-/* putbyte : adds a byte to the instruction code buffer                      */
+/* conopen : opens a stream for a report that goes to the console            */
 /*****************************************************************************/
 
-void putbyte(unsigned char b)
+FILE *conopen()
 {
-if (codeptr < sizeof(codebuf))
-  codebuf[codeptr] = b;
-codeptr++;
+#ifdef A09_LIBRARY
+return tmpfile();                       /* liba09 collects it in conclose()  */
+#else
+return stdout;
+#endif
 }
 
 /*****************************************************************************/
-/* putword : adds a word to the instruction code buffer                      */
+/* conclose : closes a stream opened by conopen()                            */
 /*****************************************************************************/
 
-void putword(unsigned short w)
+void conclose(FILE *fp)
 {
-putbyte((unsigned char)(w >> 8));
-putbyte((unsigned char)(w & 0xff));
+#ifdef A09_LIBRARY
+char buf[256];
+
+if (!fp)
+  return;
+rewind(fp);                             /* pass it on to the context's       */
+while (fgets(buf, sizeof(buf), fp))     /* console output                    */
+  printf("%s", buf);
+fclose(fp);
+#else
+(void)fp;
+#endif
 }
 
 /*****************************************************************************/
-/* putdword : adds a doubleword to the instruction code buffer               */
+/* writecost : writes the cost report to its own file or the console         */
 /*****************************************************************************/
 
-void putdword(unsigned long d)
+void writecost()
 {
-putbyte((unsigned char)((d >> 24) & 0xff));
-putbyte((unsigned char)((d >> 16) & 0xff));
-putbyte((unsigned char)((d >>  8) & 0xff));
-putbyte((unsigned char)(d & 0xff));
+FILE *fp = costname[0] ? fopen(costname, "w") : conopen();
+
+if (!fp)
+  {
+  errorout(srcname, 0, 33,
+           "cannot write cost report %s", costname[0] ? costname : "-");
+  return;
+  }
+outcost(fp);
+if (costname[0])
+  fclose(fp);
+else
+  conclose(fp);
 }
 
 /*****************************************************************************/
-/* doaddress : assemble the right addressing bytes for an instruction        */
+/* errorlimit : stops the assembly when the error limit is reached           */
 /*****************************************************************************/
 
-void doaddress(struct relocrecord *p)
+void errorlimit()
 {
-int offs;
-int addrelocation = 0;
-      
-if (p)                                  /* create relocation record          */
-  p->addr = (unsigned short)(loccounter + codeptr);
-
-switch (mode)
+printf("error limit of %ld reached, assembly stopped in pass %d\n",
+       maxerrors, pass);
+if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
+  putlist("*** Error limit of %ld reached, assembly stopped\n", maxerrors);
+if (objfile)                            /* don't leave a partial object file */
   {
-  case ADRMODE_IMM :
-    if (opsize == 2)
-      {
-      putbyte((unsigned char)operand);
-      addrelocation = 1;
-      p->exprcat |= EXPRCAT_ONEBYTE;
-      }
-    else if (opsize == 5)               /* LDQ special                       */
-      putdword(operand);
-    else
-      {
-      putword((unsigned short)operand);
-      addrelocation = 1;
-      }
-    break; 
-  case ADRMODE_DIR :
-    putbyte((unsigned char)operand);
-    break;
-  case ADRMODE_EXT :
-    if (((codebuf[0] == 0x7e) ||        /* special for JMP                   */
-         (codebuf[0] == 0xbd)) &&       /* and JSR                           */
-        pass > 1)
-      {
-      int nDiff = (int)(short)operand - (int)(short)(loccounter + phase) - 3;
-      if (((nDiff & 0xff80) == 0x0000) ||
-           ((nDiff & 0xff80) == 0xff80))
-           warning |= (certain) ? WRN_OPT : 0;
-      }
-    putword((unsigned short)operand);
-    addrelocation = 1;
-    break;
-  case ADRMODE_IDX :
-    putbyte((unsigned char)operand);
-    break;
-  case ADRMODE_POST :
-  case ADRMODE_IND :
-    putbyte(postbyte);
-    switch (opsize)
-      {
-      case 2:
-        putbyte((unsigned char)operand);
-        break;
-      case 3:
-        putword((unsigned short)operand); 
-        addrelocation = 1;
-      }
-    break;
-  case ADRMODE_PCR :
-  case ADRMODE_PIN :
-    offs = (unsigned short)operand - (loccounter + phase) - codeptr - 2;
-    if (offs < -128 || offs >= 128 || opsize == 3 || unknown || !certain)
-      {
-      // all unknowns with opsize 0 (w/o < or > prefix) are treated as 16-bit
-      if (opsize == 0 || opsize == 3)  
-        {
-        offs--;
-        opsize = 3;
-        postbyte++;
-        p->addr++;
-        }
-      if (!unknown)
-        {
-        // for Motorola as9 compatibility - overflows are captured
-        // and wrapped around if possible
-        if (opsize == 3)
-          {
-          if (offs < -32768)
-            {
-            offs += 0x10000;
-            warning |= WRN_REL_WRAP;
-            }
-          else if (offs > 32767)
-            {
-            offs -= 0x10000;
-            warning |= WRN_REL_WRAP;
-            }
-          }
-        if ((opsize == 2 && (offs < -128 || offs >= 128)) ||
-            (opsize == 3 && (offs < -32768 || offs >= 32768)))
-          error |= ERR_RANGE;
-        }
-      }
-    putbyte(postbyte);
-    if (opsize == 3)
-      {
-      putword((unsigned short)offs); 
-      if (mode == ADRMODE_PIN ||
-          p->exprcat & EXPRCAT_EXTADDR)
-        addrelocation = 1;
-      }
-    else
-      putbyte((unsigned char)offs);   
-  }     
-
-if (addrelocation)
-  addreloc(p);
+  fclose(objfile);
+  objfile = NULL;
+  unlink(objname);
+  }
+exit(1);                                /* listing is flushed by listexit()  */
 }
 
 /*****************************************************************************/
-/* onebyte : saves integer as one instruction byte                           */
+/* report : reports an error                                                 */
 /*****************************************************************************/
 
-void onebyte(int co)
+void report()
 {
-putbyte((unsigned char)co);
-}
+int i;
 
-/*****************************************************************************/
-/* twobyte : saves integer as two instruction bytes                          */
-/*****************************************************************************/
+for (i = 0; i < 16; i++)
+  {
+  if (error & 1)
+    {
+    printf("%s(%ld) : error %d: %s in \"%s\"\n", 
+           expandfn(curline->fn), curline->ln, i + 1,
+           errormsg[i], curline->txt);
+    if (diaghook)
+      diaghook(curline->fn, curline->ln, i + 1, 0, errormsg[i]);
+    if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
+      putlist( "*** Error %d: %s\n", i + 1, errormsg[i]);
+    errors++;
+    if (maxerrors &&                    /* if error limit reached, stop;     */
+        errors >= maxerrors)            /* counted per pass, as pass 2       */
+                                        /* repeats most errors of pass 1     */
+      errorlimit();
+    }
+  error >>= 1;
+  }
 
-void twobyte(int co)
-{
-putword((unsigned short)co);
-}
+if ((dwOptions & OPTION_TSC))           /* suppress warning 1 in TSC mode    */
+  warning &= ~WRN_OPT;
 
-/*****************************************************************************/
-/* threebyte : saves long integer as three instruction bytes                 */
-/*****************************************************************************/
+if (!(dwOptions & OPTION_WAR))          /* reset warnings if not wanted      */
+  warning = WRN_OK;
 
-void threebyte(unsigned long co)
-{
-putbyte((unsigned char)((co >> 16) & 0xff));
-putbyte((unsigned char)((co >> 8) & 0xff));
-putbyte((unsigned char)(co & 0xff));
-}
+for (i = 0; i < 16; i++)
+  {
+  if (warning & 1)
+    {
+    printf("%s(%ld) : warning %d: %s in \"%s\"\n", 
+           expandfn(curline->fn), curline->ln, i + 1, warningmsg[i], curline->txt);
+    if (diaghook)
+      diaghook(curline->fn, curline->ln, i + 1, 1, warningmsg[i]);
+    if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
+      putlist( "*** warning %d: %s\n", i + 1, warningmsg[i]);
+    warnings++;
+    }
+  warning >>= 1;
+  }
+} 
 
 /*****************************************************************************/
-/* fourbyte : saves long integer as four instruction bytes                   */
+/* pemt_expr : recursively processes a PEMT expression enclosed in @(...)    */
 /*****************************************************************************/
 
-void fourbyte(unsigned long co)
+int pemt_expr
+    (
+    const char *szBuf1,                 /* buffer we're working on           */
+    int atat,                           /* @ position in szBuf1              */
+    char *szOutBuf,                     /* output buffer address             */
+    int *newpos                         /* position after processing         */
+    )
 {
-putbyte((unsigned char)((co >> 24) & 0xff));
-putbyte((unsigned char)((co >> 16) & 0xff));
-putbyte((unsigned char)((co >> 8) & 0xff));
-putbyte((unsigned char)(co & 0xff));
+char lBsl = 0;
+char szInt[LINELEN];
+int i, lvl = 1, ol = 0, odec = 0;
+const char *fmts[] =
+  {
+  "%04lX",
+  "%ld",
+  "%04lX"
+  };
+
+for (i = atat + 2; szBuf1[i]; i++)      /* walk through the string           */
+  {
+  char c = szBuf1[i];
+  if (c == '*' && !lBsl)                /* if on a plain *, replace with addr*/
+    {
+    /* inside @(...), * is expanded to $addr, as this is the format used
+       in scanexpr()! */
+    int odec2 = 0;
+    const char *fmts2[] =
+      {
+      "$%04lX",
+      "%ld",
+      "$%04lX"
+      };
+    if (szBuf1[i + 1] == ',' &&         /* *,d means "output addr as dec"    */
+        (szBuf1[i + 2] == 'd' ||        /* *,x means output addr as hex"     */
+         szBuf1[i + 2] == 'x'))
+      {
+      odec2 = 1 + (szBuf1[i + 2] == 'x');
+      i += 2;
+      }
+    ol += sprintf(szInt + ol, fmts2[odec2], oldlc);
+    }
+  else if (c == '@' && szBuf1[i + 1] == '(' && !lBsl)
+    {                                   /* if on @(, recurse                 */
+    ol += pemt_expr(szBuf1, i, szInt + ol, &i);
+    }
+  else if (c == '(')                    /* if on (, increase level           */
+    {
+    if (!lBsl)
+      lvl++;
+    szInt[ol++] = c;
+    szInt[ol] = '\0';
+    }
+  else if (c == ')')                    /* if on ), stop this.               */
+    {
+    if (!lBsl)
+      lvl--;
+    if (!lvl)
+      {
+      /* ),d as end means "output as dec", ),x means "output as hex"  */
+      if (szBuf1[i + 1] == ',' && 
+          (szBuf1[i + 2] == 'd' || szBuf1[i + 2] == 'x'))
+        {
+        odec = 1 + (szBuf1[i + 2] == 'x');
+        i += 2;
+        }
+      break;
+      }
+    szInt[ol++] = c;
+    szInt[ol] = '\0';
+    }
+  else if (c == '\\' && !lBsl)
+    ;
+  else
+    {
+    szInt[ol++] = c;
+    szInt[ol] = '\0';
+    }
+
+  lBsl = !lBsl && (c == '\\');          /* remember whether on \             */
+  }
+
+*newpos = i;                            /* tell caller where we ended        */
+if (i > atat + 2)                       /* if something to evaluate          */
+  {                                     /* evaluate it                       */
+  char *osp = srcptr;
+  long l;
+  struct relocrecord pp = {0};
+  srcptr = szInt;
+  l = scanexpr(0, &pp);
+  if (pass == 2 && unknown)             /* unresolved items are not allowed  */
+    error |= ERR_LABEL_UNDEF;
+  ol = sprintf(szOutBuf, fmts[odec], l);
+  srcptr = osp;
+  }
+
+return ol;
 }
 
 /*****************************************************************************/
-/* oneimm : saves one immediate value                                        */
+/* pemt_putlist : lists the (rest of the) line with PEMT expressions         */
 /*****************************************************************************/
 
-void oneimm(int co)
+void pemt_putlist(const char *szLine, int off)
 {
-struct relocrecord p = {0};
-
-scanoperands(&p, 0);
-if (mode >= ADRMODE_POST)
-  error |= ERR_ILLEGAL_ADDR;
-putbyte((unsigned char)co);
-
-/* addreloc(0, 2, p); */                /* no relocation for immediate op's  */
-
-putbyte((unsigned char)operand);
-}
-
-/*****************************************************************************/
-/* lea :                                                                     */
-/*****************************************************************************/
-
-void lea(int co)
-{
-struct relocrecord p = {0};
-
-onebyte((unsigned char)co);
-scanoperands(&p, 0);
-if (mode == ADRMODE_IMM)
-  error |= ERR_ILLEGAL_ADDR;
-if (mode < ADRMODE_POST)
+/* Specials: 
+   - '*' means "current address", unless prefixed with '\'
+     always output as hex value without leading $, as this is
+     for dasmfw / f9dasm, which expect hex without $.
+     For more complex evaluations, use @(...).
+   - '@(...)' means "evaluate the expression with scanexpr() and
+     use the result as a numerical value", unless prefixed with '\'
+*/
+char lBsl = 0;
+for ( ; szLine[off]; off++)
   {
-  opsize = 3;
-  postbyte = 0x8f;
-  mode = ADRMODE_POST;
+  char c = szLine[off];
+  if (szLine[off] == '*' && !lBsl)
+    putlist("%04X", oldlc);
+  else if (c == '@' && szLine[off + 1] == '(' && !lBsl)
+    {
+    char szExpr[33];
+    pemt_expr(szLine, off, szExpr, &off);
+    putlist("%s", szExpr);
+    }
+  else if (c == '\\' && !lBsl)          /* \ is an escape char, so ...       */
+    ;                                   /* skip the first one.               */
+    /* NB: to output a \, two are needed. To output \*, \\\* must be written */
+  else
+    putlist("%c", c);
+  lBsl = !lBsl && (c == '\\');
   }
-doaddress(&p);
+putlist("\n");
 }
 
 /*****************************************************************************/
-/* sbranch : processes a short branch                                        */
+/* outlist : lists the code bytes for an instruction                         */
 /*****************************************************************************/
 
-void sbranch(int co)
+void outlist(struct listrec *r)
 {
-struct relocrecord p = {0};
-int offs;
-
-scanoperands(&p, 0);
-if (mode != ADRMODE_DIR && mode != ADRMODE_EXT)
-  error |= ERR_ILLEGAL_ADDR;
-offs = (unsigned short)operand - (loccounter + phase) - 2;
-if (!unknown && (offs < -128 || offs >= 128))
-  error |= ERR_RANGE;
-if (pass == 2 && unknown)
-  error |= ERR_LABEL_UNDEF;
-putbyte((unsigned char)co);
-putbyte((unsigned char)offs);
-}
-
-/*****************************************************************************/
-/* lbra : does a long branch                                                 */
-/*****************************************************************************/
+int i;
 
-void lbra(int co)
-{
-struct relocrecord p = {0};
-int nDiff;
+if (LINE_IS_INVISIBLE(r->flg) &&        /* don't list invisible lines        */
+    !(dwOptions & OPTION_INV))
+  return;
 
-scanoperands(&p, 0);
-if (mode != ADRMODE_DIR && mode != ADRMODE_EXT)
-  error |= ERR_ILLEGAL_ADDR;
-putbyte((unsigned char)co);
+if (LINE_IS_MACINV(r->flg) &&           /* don't list macro invocations if   */
+    !(dwOptions & OPTION_MAC))          /* not explicitly requested          */
+  return;
 
-nDiff = operand - (loccounter + phase) - 3;
+if (LINE_IS_MACEXP(r->flg) &&           /* don't list macro expansions if    */
+    !(dwOptions & OPTION_EXP))          /* not explicitly requested          */
+  return;
 
-if (p.exprcat & EXPRCAT_EXTADDR)
-  {
-  p.exprcat |= EXPRCAT_EXTOFF;
-  doaddress(&p);
-  }
-else
-  {
-  putword((unsigned short)nDiff);
-  if (((nDiff & 0xff80) == 0x0000) ||
-      ((nDiff & 0xff80) == 0xff80))
-    warning |= (certain) ? WRN_OPT : 0;
-  }
-}
+if ((r->lvl & LINCAT_LVLMASK) &&        /* if level 1..nn                    */
+    !(dwOptions & OPTION_LLL))          /* and this is not to be listed      */
+  return;
 
-/*****************************************************************************/
-/* lbranch : does a long branch                                              */
-/*****************************************************************************/
+if ((r->skipped) &&                     /* if this is conditionally skipped  */
+    !(dwOptions & OPTION_CON))          /* and this is not to be listed      */
+  return;
+if ((r->condline) &&                    /* if this is a condition line       */
+    !(dwOptions & OPTION_CON))          /* and this is not to be listed      */
+  return;
 
-void lbranch(int co)
-{
-struct relocrecord p = {0};
-int nDiff;
+if (dwOptions & OPTION_NUM)             /* if number output                  */
+  putlist("%4d ", r->line->ln);         /* print out the line number         */
 
-scanoperands(&p, 0);
-if (mode != ADRMODE_DIR && mode != ADRMODE_EXT)
-  error |= ERR_ILLEGAL_ADDR;
-putword((unsigned short)co);
-nDiff = operand - (loccounter + phase) - 4;
+if (!r->absmode &&                      /* if in relocating assembler mode   */
+    !(dwOptions & OPTION_LPA))
+  putlist("%c", r->rel);                /* output relocation information     */
 
-if (p.exprcat & EXPRCAT_EXTADDR)
+if (dwOptions & OPTION_LPA)             /* if in patch mode                  */
   {
-  p.exprcat |= EXPRCAT_EXTOFF;
-  doaddress(&p);
+  const char *blnkfil = "      ";
+  if (LINE_IS_PEMTCMT(r->flg))          /* if PEMT comment flag set          */
+    {
+    putlist("*");                       /* prefix line with *                */
+    blnkfil++;
+    }
+  if ((r->op) && (r->op->cat == OPCAT_PSEUDO))
+    {
+    switch (r->op->code)
+      {
+      case PSEUDO_SETDP :
+        if (r->dpsetting >= 0)
+          putlist("setdp %04X %02X\n", r->loccounter, r->dpsetting);
+        break;
+      case PSEUDO_ORG :
+#if 0
+        putlist("insert %04X \\        ORG     $%04X\n", r->loccounter, r->loccounter);
+#endif
+        break;
+      case PSEUDO_RZB :
+      case PSEUDO_FILL :
+      case PSEUDO_FCB :
+      case PSEUDO_FCC :
+        putlist("data %04X", r->oldlc);
+        if (r->codeptr > 1)
+          putlist("-%04X", r->oldlc + r->codeptr - 1);
+        /* we got a little conceptual problem here... if RZB or FILL reserve
+        more than sizeof(codebuf) bytes, this is not correctly reflected. */
+        putlist("\n");
+        break;
+      case PSEUDO_FCW :
+        putlist("word %04x", r->oldlc);
+        if (r->codeptr > 2)
+          putlist("-%04X", r->oldlc + r->codeptr - 1);
+        putlist("\n");
+        break;
+      case PSEUDO_FCQ :
+        putlist("dword %04x", r->oldlc);
+        if (r->codeptr > 2)
+          putlist("-%04X", r->oldlc + r->codeptr - 1);
+        putlist("\n");
+        break;
+      case PSEUDO_PEMT :
+        pemt_putlist(szBuf1, 0);
+        break;
+      }
+    }
+  if (r->codeptr > 0)                   /* if there are code bytes           */
+    {
+    char *name = r->label ? r->label->name : findsymat(r->oldlc);
+    if (name)
+      putlist("label %04X %s\n", r->oldlc, name);
+    putlist("patch ");                  /* write "patch"                     */
+    }
+  else if (*r->line->txt)
+    putlist(blnkfil);
+#if 0
+  else
+    putlist("comment %04X", r->oldlc);
+#endif
   }
+else if ((r->warning & WRN_OPT) &&      /* excessive branch, TSC style       */
+    (dwOptions & OPTION_TSC) &&         
+    (dwOptions & OPTION_WAR))
+  putlist(">");
+else if (LINE_IS_MACDEF(r->flg))        /* if in macro definition            */
+  putlist("#");                         /* prefix line with #                */
+else if (LINE_IS_MACEXP(r->flg))        /* if in macro expansion             */
+  putlist("+");                         /* prefix line with +                */
+else if (LINE_IS_MACINV(r->flg))        /* if in macro invocation            */
+  putlist("&");                         /* prefix line with &                */
+else if (LINE_IS_INVISIBLE(r->flg))
+  putlist("-");
+else if (LINE_IS_PEMTCMT(r->flg))
+  putlist("-");
+else if (*r->line->txt)                 /* otherwise                         */
+  putlist(" ");                         /* prefix line with blank            */
+
+if (r->codeptr > 0 || r->printovr & PRINTOV_PADDR)
+  putlist("%04X ", (unsigned short)(r->oldlc + ((dwOptions & OPTION_LPA) ? 0 : r->phase)));
+else if (r->printovr & PRINTOV_PLABEL)
+  putlist("%04X ", r->lblvalue);
+else if (r->printovr & PRINTOV_PDP && r->dpsetting >= 0)
+  putlist("%02X   ", (unsigned short)r->dpsetting);
+else if (r->printovr & PRINTOV_PTFR)
+  putlist("%04X ", r->tfradr);
+else if (r->printovr & PRINTOV_PPHA)
+  putlist("%04X ", (unsigned short)r->phase);
+else if (*r->line->txt)
+  putlist("     ");
 else
   {
-  putword((unsigned short)nDiff);
-  if (((nDiff & 0xff80) == 0x0000) ||
-      ((nDiff & 0xff80) == 0xff80))
-    warning |= (certain) ? WRN_OPT : 0;
+  putlist( "\n");
+  return;
   }
-}
-
-/*****************************************************************************/
-/* arith : process arithmetic operation                                      */
-/*****************************************************************************/
-
-void arith(int co, char noimm)
-{
-struct relocrecord p = {0};
 
-scanoperands(&p, 0);
-switch (mode)
+for (i = 0; i < r->codeptr && i < MAXLISTBYTES; i++)
   {
-  case ADRMODE_IMM :
-    if (noimm)
-      error |= ERR_ILLEGAL_ADDR;
-    opsize = 2;
-    putbyte((unsigned char)co);
-    break;
-  case ADRMODE_DIR :
-    putbyte((unsigned char)(co + 0x010));
-    break;
-  case ADRMODE_EXT :
-    putbyte((unsigned char)(co + 0x030));
-    break;
-  default:
-    putbyte((unsigned char)(co + 0x020));
+  if (dwOptions & OPTION_LPA)
+    putlist("%02X ", r->codebuf[i]);
+  else
+    putlist("%02X", r->codebuf[i]);
+  }
+for (; i <= MAXLISTBYTES; i++)
+  {
+  if (dwOptions & OPTION_LPA)
+    putlist("   ");
+  else
+    putlist("  ");
   }
-doaddress(&p);
-}
-
-/*****************************************************************************/
-/* accarith : process arithmetic operation with explicit accumulator         */
-/*****************************************************************************/
-
-void accarith(int co, char noimm, char ignore)
-{
-char *s = srcptr;                       /* remember current offset           */
-char expacc = 1;                        /* flag whether explicit acc.        */
-char ambig = 0;
 
-/* this is supposed to catch 6800 legacy expressions of the form
-     LDA A operands (i.e., a 6809 LDA mnemonic)
-     LDA B operands (i.e., a 6809 LDB mnemonic)
-   but it should NOT catch
-     LDA A,X
-     LDA B,X
-   which are valid 6809 operations! */
+if ((dwOptions & OPTION_LPA) &&
+    (*r->line->txt))
+  putlist("* ");
 
-skipspace();                            /* skip space                        */
-scanname();                             /* get following name                */
+if (strcmp(r->line->txt, r->srcline) && /* if text inserted                  */
+    (dwOptions & OPTION_EXP))           /* and expansion activated           */
+  putlist("%s", r->line->txt);          /* just print out the source line    */
+else                                    /* otherwise                         */
+  putlist("%s", r->srcline);            /* print possibly expanded line      */
 
-if (strcmp(unamebuf, "A") &&            /* has to be followed by A or B      */
-    strcmp(unamebuf, "B"))
-  expacc = 0;
+putlist("\n");                          /* send newline                      */
 
+/* allow to create [l]comments by using a double comment character;
+   commentchar+@ on start of line creates an insert instead of a comment */
+if ((dwOptions & OPTION_LPA) &&         /* patch output - check for comments */
+    (*r->line->txt))
+  {
 #if 1
-if (expacc && !skipspace())
-  expacc = 0;
-if (expacc && *srcptr == ',' && !(dwOptions & OPTION_TSC))
-  ambig = 1;
+  /* work on the already expanded text */
+  const char *srcptr = r->srcline;
 #else
-if (!(dwOptions & OPTION_TSC))
-  skipspace();
-if (*srcptr++ != ',')                   /* and a comma                       */
-  expacc = 0;
+  /* work on the original text */
+  const char *srcptr = r->line->txt;
 #endif
+  char c, iscchr, incomment = 0, nonblnk = 0, add_after = 0;
+  int fnd = -1, bef = 0;
+  for (i = 0; srcptr[i]; i++)
+    {
+    c = srcptr[i];
+    iscchr = ((c == '*') ||
+              ((dwOptions & OPTION_GAS) && (c == '|')) ||
+              (c == ';'));
+    if (!incomment &&
+        iscchr &&
+        (c == srcptr[i + 1] || 
+         (srcptr[i + 1] == '@' && !nonblnk)))
+      {
+      c = srcptr[++i];
+      if (srcptr[i + 1] == '+')
+        {
+        ++i;
+        add_after = 1;
+        }
+      fnd = ++i;
+      if (isspace(srcptr[fnd]))
+        fnd++;
+      break;
+      }
+    else if (isspace(c))
+      {
+      if (!nonblnk)
+        bef++;
+      }
+    else
+      {
+      if (iscchr)
+        incomment = 1;
+      nonblnk = 1;
+      }
+    }
+  if (fnd > 0 && (srcptr[fnd] || !(nonblnk || bef > 2)))
+    {
+    if (nonblnk || bef > 2)
+      putlist("lcomment %s%04X ", add_after ? "after " : "", r->oldlc);
+    else if (c == '@')
+      putlist("insert %s%04X ", add_after ? "after " : "", r->oldlc);
+    else
+      putlist("comment %s%04X ", add_after ? "after " : "", r->oldlc);
+    if (isspace(srcptr[fnd]))
+      putlist("\\");
+    pemt_putlist(srcptr, fnd);
+    }
+  }
 
-if (!expacc)                            /* if NOT followed by "A " or "B "   */
-  {
-#if 1
-  srcptr = s;                           /* go back to parm start             */
-#else
-  if (ignore)                           /* if ignoring that,                 */
-    srcptr = s;                         /* go back to parm start             */
-  else                                  /* otherwise                         */
-    error |= ERR_EXPR;                  /* flag as an error                  */
-#endif
+if (r->codeptr > MAXLISTBYTES &&        /* if there are additional bytes,    */
+    (dwOptions & (OPTION_LPA | OPTION_MUL)))
+  {                                     /* print them.                       */
+  if (dwOptions & OPTION_LPA)           /* if in patch mode                  */
+    putlist("patch");                   /* write "patch"                     */
+  for (i = MAXLISTBYTES; i < r->codeptr; i++)
+    {
+    if (!(i % MAXLISTBYTES))
+      {
+      if (i != MAXLISTBYTES)
+        {
+        putlist("\n");
+        if (dwOptions & OPTION_LPA &&   /* if in patch mode                  */
+            i < r->codeptr)             /* and bytes follow                  */
+          putlist("patch");             /* write "patch"                     */
+        }
+      if (dwOptions & OPTION_NUM)       /* if number output                  */
+        putlist("     ");
+      if (!r->absmode)
+        putlist(" ");
+      putlist(" %04X ",
+              (unsigned short)(r->oldlc +
+                               ((dwOptions & OPTION_LPA) ? 0 : r->phase) +
+                               i));
+      }
+    if (dwOptions & OPTION_LPA)         /* if in patch mode                  */
+      putlist("%02X ", r->codebuf[i]);
+    else
+      putlist("%02X", r->codebuf[i]);
+    }
+  putlist("\n");
   }
-else
+
+if (strcmp(r->line->txt, r->srcline) && /* if text inserted                  */
+    (dwOptions & OPTION_EXP))           /* and expansion activated           */
   {
-  if (unamebuf[0] == 'B')               /* eventually transform to acc.B     */
-    co |= 0x40;
-  if (ambig)
-    warning |= WRN_AMBIG;
+  if (dwOptions & OPTION_NUM)
+    putlist("%4d ", r->line->ln);
+  if (!r->absmode)
+    putlist(" ");
+  putlist("+                   ( %s )\n", r->srcline);
   }
-arith(co, noimm);                       /* then process as arithmetic        */
 }
 
 /*****************************************************************************/
-/* idxextarith : indexed / extended arithmetic, 6800 style                   */
+/* Listing thread                                                            */
 /*****************************************************************************/
 
-void idxextarith(int co)
+/* Listing lines are captured as records and formatted by a separate thread,
+   so that the assembler can continue with the next line in the meantime.
+   The thread reads the global listing settings (options, page layout,
+   titles) directly; these are only modified after listsync(), i.e., while
+   the queue is empty. Direct putlist() calls synchronize automatically.
+   LPA mode needs symbol table lookups, so it is always done synchronously. */
+
+#define LISTQSIZE       256             /* # records in listing queue        */
+
+#if LISTTHREAD
+struct listrec listq[LISTQSIZE];        /* listing record queue              */
+int listqhead = 0;                      /* index of next record to format    */
+int listqcount = 0;                     /* # records in the queue            */
+int listqquit = 0;                      /* set to terminate listing thread   */
+int listthreaded = 0;                   /* flag whether thread is running    */
+pthread_t listthread;                   /* listing thread                    */
+pthread_mutex_t listqmutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t listqnotempty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t listqnotfull = PTHREAD_COND_INITIALIZER;
+pthread_cond_t listqempty = PTHREAD_COND_INITIALIZER;
+#endif
+
+/*****************************************************************************/
+/* listtail : lists the pass 2 summary and the tables                        */
+/*****************************************************************************/
+
+void listtail(long errs, long warns, long toterrs, long totwarns)
 {
-struct relocrecord p = {0};
+if (errs || warns)
+  putlist("\n");
+if (errs)
+  putlist("%s%ld error(s) in pass 2.\n",
+          (dwOptions & OPTION_LPA) ? "* " : "", errs);
+if (warns)
+  putlist("%s%ld warning(s) in pass 2.\n",
+          (dwOptions & OPTION_LPA) ? "* " : "", warns);
+if (dwOptions & OPTION_SYM)
+  outsymtable();
+if ((relocatable) && (dwOptions & OPTION_REL))
+  outreltable();
+if ((dwOptions & OPTION_TXT) &&
+    (nPredefinedTexts < nTexts))
+  outtexttable();
+if (dwOptions & OPTION_XRF)
+  outxreftable();
+if (costing && !costname[0])            /* cost report goes into the listing */
+  outcost(NULL);
+
+putlist( "\n%s%ld error(s), %ld warning(s)\n",
+        (dwOptions & OPTION_LPA) ? "* " : "", toterrs, totwarns);
+}
 
-scanoperands(&p, 0);
-switch (mode)
-  {
-  case ADRMODE_IMM :
-    error |= ERR_ILLEGAL_ADDR;
-    opsize = 3;
-    putbyte((unsigned char)co);
-    break;
-  case ADRMODE_DIR :
-    mode = ADRMODE_EXT;                 /* implicitly convert to extended    */
-    /* fall thru to... */
-  case ADRMODE_EXT :
-    putbyte((unsigned char)(co + 0x030));
-    break;
-  default:
-    putbyte((unsigned char)(co + 0x020));
-    break;
- }
-doaddress(&p);
+/*****************************************************************************/
+/* formatlist : formats a listing record                                     */
+/*****************************************************************************/
+
+void formatlist(struct listrec *r)
+{
+double t = steptime();
+
+if (r->type == LREC_TAIL)
+  listtail(r->counts[0], r->counts[1], r->counts[2], r->counts[3]);
+else
+  outlist(r);
+stats.tlist += steptime() - t;          /* only touched by one thread        */
 }
 
+#if LISTTHREAD
+
 /*****************************************************************************/
-/* darith : process direct arithmetic                                        */
+/* listthreadfunc : listing thread main loop                                 */
 /*****************************************************************************/
 
-void darith(int co, char noimm)
+void *listthreadfunc(void *arg)
 {
-struct relocrecord p = {0};
+int idx;
 
-scanoperands(&p, 0);
-switch (mode)
+(void)arg;
+for (;;)
   {
-  case ADRMODE_IMM :
-    if (noimm)
-      error |= ERR_ILLEGAL_ADDR;
-    opsize = 3;
-    putbyte((unsigned char)co);
-    break;
-  case ADRMODE_DIR :
-    putbyte((unsigned char)(co + 0x010));
-    break;
-  case ADRMODE_EXT :
-    putbyte((unsigned char)(co + 0x030));
-    break;
-  default:
-    putbyte((unsigned char)(co + 0x020));
-    if (dwOptions & OPTION_H11)         /* specials for 68HC11 page bytes    */
-      {
-      if ((codebuf[0] == 0x18) &&
-          (co == 0x8c ||                /* CPX                               */
-           co == 0xce ||                /* LDX                               */
-           co == 0xcf))                 /* STX                               */
-        codebuf[0] = 0xcd;
-      }
+  pthread_mutex_lock(&listqmutex);
+  while (!listqcount && !listqquit)
+    pthread_cond_wait(&listqnotempty, &listqmutex);
+  if (!listqcount)                      /* if queue empty and told to quit   */
+    {
+    pthread_mutex_unlock(&listqmutex);
     break;
- }
-doaddress(&p);
+    }
+  idx = listqhead;
+  pthread_mutex_unlock(&listqmutex);
+
+  formatlist(&listq[idx]);              /* format outside the lock           */
+
+  pthread_mutex_lock(&listqmutex);
+  listqhead = (listqhead + 1) % LISTQSIZE;
+  if (!--listqcount)
+    pthread_cond_broadcast(&listqempty);
+  pthread_cond_signal(&listqnotfull);
+  pthread_mutex_unlock(&listqmutex);
+  }
+return NULL;
 }
 
-void darith18(int co, char noimm)
+#endif
+
+/*****************************************************************************/
+/* liststart : starts the listing thread                                     */
+/*****************************************************************************/
+
+void liststart()
 {
-codebuf[codeptr++] = 0x18;
-darith(co, noimm);
-if (codebuf[0] == 0xcd)
-  codebuf[0] = 0x18;
+#if LISTTHREAD
+listqquit = 0;
+listthreaded = !pthread_create(&listthread, NULL, listthreadfunc, NULL);
+#endif
 }
 
-void darith1a(int co, char noimm)
+/*****************************************************************************/
+/* listsync : waits until all queued listing records have been formatted     */
+/*****************************************************************************/
+
+void listsync()
 {
-codebuf[codeptr++] = 0x1a;
-darith(co, noimm);
+#if LISTTHREAD
+if (!listthreaded ||                    /* nothing to do on listing thread   */
+    pthread_equal(pthread_self(), listthread))
+  return;
+pthread_mutex_lock(&listqmutex);
+while (listqcount)
+  pthread_cond_wait(&listqempty, &listqmutex);
+pthread_mutex_unlock(&listqmutex);
+#endif
 }
 
 /*****************************************************************************/
-/* d2arith : process direct word arithmetic                                  */
+/* liststop : terminates the listing thread after formatting all records     */
 /*****************************************************************************/
 
-void d2arith(int co, char noimm)
+void liststop()
 {
-struct relocrecord p = {0};
+#if LISTTHREAD
+if (!listthreaded)
+  return;
+pthread_mutex_lock(&listqmutex);
+listqquit = 1;
+pthread_cond_signal(&listqnotempty);
+pthread_mutex_unlock(&listqmutex);
+pthread_join(listthread, NULL);
+listthreaded = 0;
+#endif
+}
 
-scanoperands(&p, 0);
-switch (mode)
+/*****************************************************************************/
+/* listrecord : returns a free listing record                                */
+/*****************************************************************************/
+
+struct listrec *listrecord()
+{
+static struct listrec rec;              /* record for synchronous listing    */
+
+#if LISTTHREAD
+if (listthreaded && !(dwOptions & OPTION_LPA))
+  {
+  struct listrec *r;
+  pthread_mutex_lock(&listqmutex);
+  while (listqcount == LISTQSIZE)
+    pthread_cond_wait(&listqnotfull, &listqmutex);
+  r = &listq[(listqhead + listqcount) % LISTQSIZE];
+  pthread_mutex_unlock(&listqmutex);
+  return r;                             /* slot is not touched by the thread */
+  }                                     /* until it is queued                */
+listsync();
+#endif
+return &rec;
+}
+
+/*****************************************************************************/
+/* listqueue : queues a filled listing record, or formats it directly        */
+/*****************************************************************************/
+
+void listqueue(struct listrec *r)
+{
+#if LISTTHREAD
+if (listthreaded && !(dwOptions & OPTION_LPA))
   {
-  case ADRMODE_IMM :
-    if (noimm)
-      error |= ERR_ILLEGAL_ADDR;
-    opsize = 3;
-    putword((unsigned short)co);
-    break;
-  case ADRMODE_DIR :
-    putword((unsigned short)(co + 0x010));
-    break;
-  case ADRMODE_EXT :
-    putword((unsigned short)(co + 0x030));
-    break;
-  default:
-    putword((unsigned short)(co + 0x020));
- }
-doaddress(&p);
+  pthread_mutex_lock(&listqmutex);
+  listqcount++;
+  pthread_cond_signal(&listqnotempty);
+  pthread_mutex_unlock(&listqmutex);
+  return;
+  }
+#endif
+formatlist(r);
 }
 
 /*****************************************************************************/
-/* qarith : process direct doubleword arithmetic                             */
+/* listline : lists the current line                                         */
 /*****************************************************************************/
 
-void qarith(int co, char noimm)
+void listline(struct oprecord *op, struct symrecord *lpLabel)
 {
-struct relocrecord p = {0};
+struct listrec *r = listrecord();
+
+r->type = LREC_LINE;
+r->line = curline;
+r->lvl = curline->lvl;
+r->rel = curline->rel;
+r->flg = curline->flg;
+r->absmode = absmode;
+r->skipped = (suppress || nSkipCount);
+r->condline = condline;
+r->op = op;
+r->label = lpLabel;
+r->lblvalue = lpLabel ? lpLabel->value : 0;
+r->oldlc = oldlc;
+r->loccounter = loccounter;
+r->tfradr = tfradr;
+r->phase = phase;
+r->dpsetting = dpsetting;
+r->printovr = printovr;
+r->warning = warning;
+r->codeptr = codeptr;
+memcpy(r->codebuf, codebuf, codeptr);
+strcpy(r->srcline, srcline);
+listqueue(r);
+}
 
-scanoperands(&p, 0);
-switch (mode)
-  {
-  case ADRMODE_IMM :
-    if (noimm)
-      error |= ERR_ILLEGAL_ADDR;
-    opsize = 5;
-    putbyte((unsigned char)0xcd);       /* this can ONLY be LDQ!             */
-    break;
-  case ADRMODE_DIR :
-    putword((unsigned short)(co + 0x010));
-    break;
-  case ADRMODE_EXT :
-    putword((unsigned short)(co + 0x030));
-    break;
-  default:
-    putword((unsigned short)(co + 0x020));
-    break;
- }
-doaddress(&p);
+/*****************************************************************************/
+/* listend : lists the pass 2 summary and tables, then closes the list file  */
+/*****************************************************************************/
+
+void listend(long errs, long warns, long toterrs, long totwarns)
+{
+struct listrec *r = listrecord();
+
+r->type = LREC_TAIL;
+r->counts[0] = errs;
+r->counts[1] = warns;
+r->counts[2] = toterrs;
+r->counts[3] = totwarns;
+listqueue(r);
 }
 
 /*****************************************************************************/
-/* oneaddr :                                                                 */
+/* listclose : waits for the listing to be completed and closes the file   */
 /*****************************************************************************/
 
-void oneaddr(int co)
+void listclose()
 {
-struct relocrecord p = {0};
-char *s;
+liststop();
+flushlist();
+fclose(listfile);
+listfile = NULL;
+}
 
-skipspace();
-#if 1
-if (co != 0x0e)                         /* check for 6800 convenience things */
-#else
-if ((dwOptions & OPTION_TSC) &&         /* if TSC mode, check for 6800       */
-    (co != 0x0e))                       /* convenience things                */
-#endif
-  {
-  s = srcptr;
-  scanname();                           /* look whether followed by A or B   */
-  if (((!strcmp(unamebuf, "A")) ||
-       (!strcmp(unamebuf, "B"))) &&
-      (*srcptr != ','))                 /* and NO comma                      */
-    {                                   /* if so, replace by 6809 mnemonic   */
-    warning |= WRN_AMBIG;               /* ... but not without a warning     */
-    onebyte(co | ((unamebuf[0] == 'A') ? 0x40 : 0x50));
-    return;
-    }
-  srcptr = s;
-  }
-
-scanoperands(&p, 0);
-switch (mode)
-  {
-  case ADRMODE_IMM :
-    error |= ERR_ILLEGAL_ADDR;
-    break;
-  case ADRMODE_DIR :
-    if ((dwOptions & OPTION_M00) &&     /* on MC6800, a DIRect JMP is not OK */
-        (co == 0x0e))
-      error |= ERR_ILLEGAL_ADDR;
-    else
-      putbyte((unsigned char)co);
-    break;
-  case ADRMODE_EXT :
-    putbyte((unsigned char)(co + 0x70));
-    break;
-  default:
-    putbyte((unsigned char)(co + 0x60));
-    break;
-  }
-
-if (p.exprcat & EXPRCAT_EXTADDR &&
-    mode == ADRMODE_PCR)
-  p.exprcat |= EXPRCAT_EXTOFF;
+/*****************************************************************************/
+/* listexit : writes out as much of the listing as possible on exit()        */
+/*****************************************************************************/
 
-doaddress(&p);
+void listexit()
+{
+if (!listfile)
+  return;
+listsync();
+flushlist();
 }
 
 /*****************************************************************************/
-/* accaddr :                                                                 */
+/* setlabel : sets a label                                                   */
 /*****************************************************************************/
 
-void accaddr(int co)
+void setlabel(struct symrecord * lp)
 {
-struct relocrecord p = {0};
-char *s;
-
-skipspace();
-#if 1
-                                        /* always check for 6800             */
-#else
-if (dwOptions & OPTION_TSC)             /* if TSC mode, check for 6800       */
-#endif
+if (lp)
   {
-  s = srcptr;
-  scanname();                           /* look whether followed by A or B   */
-  if (((!strcmp(unamebuf, "A")) ||
-       (!strcmp(unamebuf, "B"))) &&
-      (*srcptr != ','))                 /* and NO comma                      */
-    {                                   /* if so, replace                    */
-    onebyte(co | ((unamebuf[0] == 'A') ? 0x40 : 0x50));
-    return;
+  if (lp->cat == SYMCAT_PUBLICUNDEF)
+    {
+    lp->cat = SYMCAT_PUBLIC;
+    lp->value = (unsigned short)(loccounter + phase);
     }
-  srcptr = s;
-  }
-
-scanoperands(&p, 0);
-switch (mode)
-  {
-  case ADRMODE_IMM :
-    error |= ERR_ILLEGAL_ADDR;
-    break;
-  case ADRMODE_DIR :
-    mode = ADRMODE_EXT;                 /* silently convert to extended      */
-    /* fall through to ... */
-  case ADRMODE_EXT :
-    putbyte((unsigned char)(co + 0x70));
-    break;
-  default:
-    putbyte((unsigned char)(co + 0x60));
-    break;
-  }
-doaddress(&p);
+  else if (lp->cat == SYMCAT_EMPTYLOCAL)
+    {
+    lp->cat = SYMCAT_LOCALLABEL;
+    }
+  else if (lp->cat == SYMCAT_LOCALLABEL)
+    ;
+  else if (lp->cat != SYMCAT_EMPTY && lp->cat != SYMCAT_UNRESOLVED)
+    {
+    if (dwOptions & OPTION_RED)
+      {
+      /* if existing constant value equals the current location, let it through */
+      if (lp->cat == SYMCAT_CONSTANT &&
+          lp->value == (unsigned short)(loccounter + phase))
+        lp->cat = (global) ? SYMCAT_PUBLIC : SYMCAT_LABEL;
+      }
+    if ((lp->cat != SYMCAT_LABEL && lp->cat != SYMCAT_PUBLIC) ||
+        lp->value != (unsigned short)(loccounter + phase))
+      error |= ERR_LABEL_MULT;
+    }
+  else
+    {
+    lp->cat = (global) ? SYMCAT_PUBLIC : SYMCAT_LABEL;
+    lp->value = (unsigned short)(loccounter + phase);
+    } 
+  } 
 }
 
 /*****************************************************************************/
-/* tfrexg :                                                                  */
+/* putbyte : adds a byte to the instruction code buffer                      */
 /*****************************************************************************/
 
-void tfrexg(int co)
+void putbyte(unsigned char b)
 {
-struct regrecord * p;
-
-putbyte((unsigned char)co);
-skipspace();
-scanname();
-
-if (dwOptions & OPTION_H09)
-  p = findreg63(unamebuf);
-else
-  p = findreg(unamebuf);
-if (!p)
-  error |= ERR_ILLEGAL_ADDR;
-else
- postbyte = (p->tfr) << 4;
-skipspace();
-if (*srcptr == ',')
-  srcptr++;
-else
- error |= ERR_ILLEGAL_ADDR;
-skipspace();
-scanname();
-if ((p = findreg(unamebuf)) == 0)
-  error |= ERR_ILLEGAL_ADDR;
-else
- postbyte |= p->tfr;
-putbyte(postbyte);
+if (codeptr < sizeof(codebuf))
+  codebuf[codeptr] = b;
+codeptr++;
 }
 
 /*****************************************************************************/
-/* pshpul : operates on PSH / PUL mnemonics                                  */
+/* putword : adds a word to the instruction code buffer                      */
 /*****************************************************************************/
 
-void pshpul(int co, int mode)
+void putword(unsigned short w)
 {
-struct regrecord *p;
-struct relocrecord sp = {0};
-postbyte = 0;
-
-skipspace();
-
-if (mode == 1)                          /* 6800/6801/6811 mode:              */
-  {
-  scanname(); 
-  if ((p = findreg(unamebuf)) == 0)
-    error |= ERR_ILLEGAL_ADDR;
-  else
-    {
-    postbyte |= p->psh;
-    if (!postbyte)
-      error |= ERR_ILLEGAL_ADDR;
-    }
-  co |= postbyte & 0x7f;
-  if (postbyte & 0x80)
-    putbyte((unsigned char)0x18);
-  }
+putbyte((unsigned char)(w >> 8));
+putbyte((unsigned char)(w & 0xff));
+}
 
-putbyte((unsigned char)co);
+/*****************************************************************************/
+/* putdword : adds a doubleword to the instruction code buffer               */
+/*****************************************************************************/
 
-if (mode == 0)                          /* 6809/6309 mode:                   */
-  {
-  if (*srcptr == '#')
-    {
-    srcptr++;
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    postbyte = (unsigned char)scanexpr(0, &sp);
-    }
-  else do
-    {
-    if (*srcptr == ',')
-      srcptr++;
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    scanname(); 
-    if ((p = findreg(unamebuf)) == 0)
-      error |= ERR_ILLEGAL_ADDR;
-    else
-      postbyte |= p->psh; 
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    } while (*srcptr == ',');
-  putbyte(postbyte);
-  }
+void putdword(unsigned long d)
+{
+putbyte((unsigned char)((d >> 24) & 0xff));
+putbyte((unsigned char)((d >> 16) & 0xff));
+putbyte((unsigned char)((d >>  8) & 0xff));
+putbyte((unsigned char)(d & 0xff));
 }
 
 /*****************************************************************************/
-/* bitdirect :                                                               */
+/* doaddress : assemble the right addressing bytes for an instruction        */
 /*****************************************************************************/
 
-void bitdirect(int co)
+void doaddress(struct relocrecord *p)
 {
-struct relocrecord p = {0};
-unsigned short dir;
-
-skipspace();
-if (*srcptr++ != '#')
-  error |= ERR_EXPR;
-if (!(dwOptions & OPTION_TSC))
-  skipspace();
-dir = (unsigned short)scanexpr(0, &p);
-/* check for overflow - is this necessary? Don't know ... */
-if (dir > 0xff && dir < 0xff00)
-  warning |= WRN_IMM_TRUNC;
-if (!(dwOptions & OPTION_TSC))
-  skipspace();
-if (*srcptr++ != ',')
-  error |= ERR_EXPR;
-scanoperands(&p, 0);
+int offs;
+int addrelocation = 0;
+      
+if (p)                                  /* create relocation record          */
+  p->addr = (unsigned short)(loccounter + codeptr);
 
-/* HD6301/6303 can handle Immediate and Indexed addressing, whereas
-   HD6309 can handle Immediate, Extended and Indexed addressing */
 switch (mode)
   {
-  case ADRMODE_DIR :
-    if (dwOptions & OPTION_H01)
-      putbyte((unsigned char)(co + 0x70));
+  case ADRMODE_IMM :
+    if (opsize == 2)
+      {
+      putbyte((unsigned char)operand);
+      addrelocation = 1;
+      p->exprcat |= EXPRCAT_ONEBYTE;
+      }
+    else if (opsize == 5)               /* LDQ special                       */
+      putdword(operand);
     else
-      putbyte((unsigned char)co);
+      {
+      putword((unsigned short)operand);
+      addrelocation = 1;
+      }
+    break; 
+  case ADRMODE_DIR :
+    putbyte((unsigned char)operand);
     break;
   case ADRMODE_EXT :
-    if (dwOptions & OPTION_H01)
-      error |= ERR_ILLEGAL_ADDR;
-    else
-      putbyte((unsigned char)(co + 0x70));
+    if (((codebuf[0] == 0x7e) ||        /* special for JMP                   */
+         (codebuf[0] == 0xbd)) &&       /* and JSR                           */
+        pass > 1)
+      {
+      int nDiff = (int)(short)operand - (int)(short)(loccounter + phase) - 3;
+      if (((nDiff & 0xff80) == 0x0000) ||
+           ((nDiff & 0xff80) == 0xff80))
+           warning |= (certain) ? WRN_OPT : 0;
+      }
+    putword((unsigned short)operand);
+    addrelocation = 1;
     break;
-  case ADRMODE_POST:
-  case ADRMODE_IDX:
-    putbyte((unsigned char)(co + 0x60));
+  case ADRMODE_IDX :
+    putbyte((unsigned char)operand);
     break;
-  default :
-    error |= ERR_ILLEGAL_ADDR;
+  case ADRMODE_POST :
+  case ADRMODE_IND :
+    putbyte(postbyte);
+    switch (opsize)
+      {
+      case 2:
+        putbyte((unsigned char)operand);
+        break;
+      case 3:
+        putword((unsigned short)operand); 
+        addrelocation = 1;
+      }
     break;
-  }
-putbyte((unsigned char)dir);
-doaddress(&p);
+  case ADRMODE_PCR :
+  case ADRMODE_PIN :
+    offs = (unsigned short)operand - (loccounter + phase) - codeptr - 2;
+    if (offs < -128 || offs >= 128 || opsize == 3 || unknown || !certain)
+      {
+      // all unknowns with opsize 0 (w/o < or > prefix) are treated as 16-bit
+      if (opsize == 0 || opsize == 3)  
+        {
+        offs--;
+        opsize = 3;
+        postbyte++;
+        p->addr++;
+        }
+      if (!unknown)
+        {
+        // for Motorola as9 compatibility - overflows are captured
+        // and wrapped around if possible
+        if (opsize == 3)
+          {
+          if (offs < -32768)
+            {
+            offs += 0x10000;
+            warning |= WRN_REL_WRAP;
+            }
+          else if (offs > 32767)
+            {
+            offs -= 0x10000;
+            warning |= WRN_REL_WRAP;
+            }
+          }
+        if ((opsize == 2 && (offs < -128 || offs >= 128)) ||
+            (opsize == 3 && (offs < -32768 || offs >= 32768)))
+          error |= ERR_RANGE;
+        }
+      }
+    putbyte(postbyte);
+    if (opsize == 3)
+      {
+      putword((unsigned short)offs); 
+      if (mode == ADRMODE_PIN ||
+          p->exprcat & EXPRCAT_EXTADDR)
+        addrelocation = 1;
+      }
+    else
+      putbyte((unsigned char)offs);   
+  }     
+
+if (addrelocation)
+  addreloc(p);
 }
 
 /*****************************************************************************/
-/* bittrans :                                                                */
+/* onebyte : saves integer as one instruction byte                           */
 /*****************************************************************************/
 
-void bittrans(int co)
+void onebyte(int co)
 {
-struct regrecord *p;
-struct relocrecord rp = {0};
-long t;
+putbyte((unsigned char)co);
+}
 
-putword((unsigned short)co);
+/*****************************************************************************/
+/* twobyte : saves integer as two instruction bytes                          */
+/*****************************************************************************/
 
-skipspace();
-scanname();
-if ((p = findbitreg(unamebuf)) == 0)
-  error |= ERR_ILLEGAL_ADDR;
-else
-  postbyte = (p->tfr) << 6;
-if (!(dwOptions & OPTION_TSC))
-  skipspace();
-if (*srcptr == ',')
-  srcptr++;
-else
- error |= ERR_ILLEGAL_ADDR;
-if (!(dwOptions & OPTION_TSC))
-  skipspace();
-t = scanfactor(&rp);
-if (t & 0xfff8)
-  error |= ERR_ILLEGAL_ADDR;
-else
-  postbyte |= (t << 3);
-if (!(dwOptions & OPTION_TSC))
-  skipspace();
-if (*srcptr == ',')
-  srcptr++;
-else
- error |= ERR_ILLEGAL_ADDR;
-t = scanfactor(&rp);
-if (t & 0xfff8)
-  error |= ERR_ILLEGAL_ADDR;
-else
-  postbyte |= t;
-putbyte((unsigned char)postbyte);
-if (!(dwOptions & OPTION_TSC))
-  skipspace();
-if (*srcptr == ',')
-  srcptr++;
-else
- error |= ERR_ILLEGAL_ADDR;
-scanoperands(&rp, 0);
-switch (mode)
-  {
-  case ADRMODE_DIR :
-    putbyte((unsigned char)operand);
-    break;
-  default:
-    error |= ERR_ILLEGAL_ADDR;
-  }
+void twobyte(int co)
+{
+putword((unsigned short)co);
 }
 
 /*****************************************************************************/
-/* blocktrans :                                                              */
+/* threebyte : saves long integer as three instruction bytes                 */
 /*****************************************************************************/
 
-void blocktrans(int co)
+void threebyte(unsigned long co)
 {
-char reg1,reg2;
-char mode[3] = "";
-static char regnames[] = "DXYUS";
-static char *modes[] =
-  {
-  "++",
-  "--",
-  "+",
-  ",+"
-  };
-int i;
+putbyte((unsigned char)((co >> 16) & 0xff));
+putbyte((unsigned char)((co >> 8) & 0xff));
+putbyte((unsigned char)(co & 0xff));
+}
 
-skipspace();
-reg1 = toupper(*srcptr);
-for (i = 0; regnames[i]; i++)
-  if (reg1 == regnames[i])
-    break;
-if (!regnames[i])
-  error |= ERR_ILLEGAL_ADDR;
-else
-  reg1 = i;
-mode[0] = *++srcptr;
-if ((mode[0] != '+') && (mode[0] != '-'))
-  {
-  if (!(dwOptions & OPTION_TSC))
-    skipspace();
-  mode[0] = *srcptr;
-  }
-else
-  srcptr++;
-if (!(dwOptions & OPTION_TSC))
-  skipspace();
-if (*srcptr != ',') 
-  error |= ERR_ILLEGAL_ADDR;
-srcptr++;
-reg2 = toupper(*srcptr);
-for (i = 0; regnames[i]; i++)
-  if (reg2 == regnames[i])
-    break;
-if (!regnames[i])
-  error |= ERR_ILLEGAL_ADDR;
-else
-  reg2 = i;
-mode[1] = *++srcptr;
-if ((mode[1] != '+') && (mode[1] != '-'))
-  {
-  if (!(dwOptions & OPTION_TSC))
-    skipspace();
-  mode[1] = *srcptr;
-  }
-else
-  srcptr++;
-if ((mode[1] == ';') || (mode[1] == '*') ||
-    (mode[1] == ' ') || (mode[1] == '\t'))
-  mode[1] = '\0';
-for (i = 0; i < (sizeof(modes) / sizeof(modes[0])); i++)
-  if (!strcmp(mode, modes[i]))
-    break;
-if (i >= (sizeof(modes) / sizeof(modes[0])))
-  error |= ERR_ILLEGAL_ADDR;
-else
-  co |= i;
+/*****************************************************************************/
+/* fourbyte : saves long integer as four instruction bytes                   */
+/*****************************************************************************/
 
-putword((unsigned short)co);
-putbyte((unsigned char)((reg1 << 4) | reg2));
+void fourbyte(unsigned long co)
+{
+putbyte((unsigned char)((co >> 24) & 0xff));
+putbyte((unsigned char)((co >> 16) & 0xff));
+putbyte((unsigned char)((co >> 8) & 0xff));
+putbyte((unsigned char)(co & 0xff));
 }
 
 /*****************************************************************************/
-/* setmask :                                                                 */
+/* oneimm : saves one immediate value                                        */
 /*****************************************************************************/
 
-void setmask(int co)
+void oneimm(int co)
 {
 struct relocrecord p = {0};
-long mask = -1;
 
-/* expected:
-   dir [#]mask               |  dir,[#]mask
-   [[off],]indexreg [#]mask  |  [[off],]indexreg,[#]mask */
+scanoperands(&p, 0);
+if (mode >= ADRMODE_POST)
+  error |= ERR_ILLEGAL_ADDR;
+putbyte((unsigned char)co);
 
-scanoperands(&p, 1);                    /* get 1st part (dir/index)          */
+/* addreloc(0, 2, p); */                /* no relocation for immediate op's  */
 
-if (*srcptr == ',' ||                   /* either , or ' ' is valid          */
-    *srcptr == ' ')
-  srcptr++;
-if (!(dwOptions & OPTION_TSC))
-  skipspace();
-if (*srcptr == '#')
-  srcptr++;
-mask = scanexpr(0, &p);
-if (mask < 0 || mask > 0xff)
-  error |= ERR_EXPR;
+putbyte((unsigned char)operand);
+}
 
-switch (mode)
+/*****************************************************************************/
+/* lea :                                                                     */
+/*****************************************************************************/
+
+void lea(int co)
+{
+struct relocrecord p = {0};
+
+onebyte((unsigned char)co);
+scanoperands(&p, 0);
+if (mode == ADRMODE_IMM)
+  error |= ERR_ILLEGAL_ADDR;
+if (mode < ADRMODE_POST)
   {
-  case ADRMODE_IMM :
-  case ADRMODE_EXT :
-    error |= ERR_ILLEGAL_ADDR;
-    break;
-  case ADRMODE_DIR :
-    putbyte((unsigned char)(co));
-    break;
-  default:
-    putbyte((unsigned char)(co + 0x08));
-    break;
+  opsize = 3;
+  postbyte = 0x8f;
+  mode = ADRMODE_POST;
   }
 doaddress(&p);
-putbyte((unsigned char)mask);
 }
 
 /*****************************************************************************/
-/* brmask :                                                                  */
+/* sbranch : processes a short branch                                        */
 /*****************************************************************************/
 
-void brmask(int co)
+void sbranch(int co)
 {
-struct relocrecord p = {0}, pj = {0};
-long mask = -1;
+struct relocrecord p = {0};
 int offs;
 
-/* expected:
-   dir [#]mask target  |  dir,[#]mask,target
-   [[off],]indexreg [#]mask target  |  [[off],]indexreg,[#]mask,target */
-
-scanoperands(&p, 1);
-
-if (*srcptr == ',' ||                   /* either , or ' ' is valid          */
-    *srcptr == ' ')
-  srcptr++;
-if (!(dwOptions & OPTION_TSC))
-  skipspace();
-if (*srcptr == '#')
-  srcptr++;
-mask = scanexpr(0, &p);
-if (mask < 0 || mask > 0xff)
-  error |= ERR_EXPR;
-
-if (*srcptr == ',' ||                   /* either , or ' ' is valid          */
-    *srcptr == ' ')
-  srcptr++;
-if (!(dwOptions & OPTION_TSC))
-  skipspace();
-{
-char s_mode = mode;
-char s_opsize = opsize;
-long s_operand = operand;
-char s_unknown = unknown;
-char s_certain = certain;
-unsigned char s_postbyte = postbyte;
-scanoperands(&pj, 0);
+scanoperands(&p, 0);
 if (mode != ADRMODE_DIR && mode != ADRMODE_EXT)
   error |= ERR_ILLEGAL_ADDR;
-offs = (unsigned short)operand - (loccounter + phase) - 4;
-if (codeptr) offs--;
+offs = (unsigned short)operand - (loccounter + phase) - 2;
 if (!unknown && (offs < -128 || offs >= 128))
   error |= ERR_RANGE;
 if (pass == 2 && unknown)
   error |= ERR_LABEL_UNDEF;
-mode = s_mode;
-opsize = s_opsize;
-operand = s_operand;
-postbyte = s_postbyte;
-unknown = s_unknown;
-certain = s_certain;
-}
-
-switch (mode)
-  {
-  case ADRMODE_IMM :
-  case ADRMODE_EXT :
-    error |= ERR_ILLEGAL_ADDR;
-    break;
-  case ADRMODE_DIR :
-    putbyte((unsigned char)(co));
-    break;
-  default:
-    putbyte((unsigned char)(co + 0x0c));
-    break;
-  }
-
-doaddress(&p);
-putbyte((unsigned char)mask);
+putbyte((unsigned char)co);
 putbyte((unsigned char)offs);
 }
 
-
 /*****************************************************************************/
-/* expandline : un-tabify current line                                       */
+/* lbra : does a long branch                                                 */
 /*****************************************************************************/
 
-void expandline() 
+void lbra(int co)
 {
-int i, j = 0, k, j1;
-
-for (i = 0; i < LINELEN && j < LINELEN; i++)
-  {
-  if (inpline[i] == '\n')
-    {
-    srcline[j] = 0;
-    break;
-    }
-  else if (inpline[i] == '\t')
-    {
-    j1 = j;
-    for (k = 0; k < 8 - j1 % 8 && j < LINELEN; k++)
-      srcline[j++] = ' ';
-    }
-  else if (inpline[i] == '\r')
-    {
-    continue;
-    }
-  else
-    srcline[j++] = inpline[i];     
- }
-srcline[LINELEN - 1] = 0;
-}
+struct relocrecord p = {0};
+int nDiff;
 
-/*****************************************************************************/
-/* expandtext : expands all texts in a line                                  */
-/*****************************************************************************/
+scanoperands(&p, 0);
+if (mode != ADRMODE_DIR && mode != ADRMODE_EXT)
+  error |= ERR_ILLEGAL_ADDR;
+putbyte((unsigned char)co);
 
-void expandtext()
-{
-char *p;
-int i, j = 0;
+nDiff = operand - (loccounter + phase) - 3;
 
-for (p = curline->txt; (*p) && (j < LINELEN); )
+if (p.exprcat & EXPRCAT_EXTADDR)
   {
-  if (*p == '\\' && p[1] == '&')        /* when encountering \&,             */
-    {
-    srcline[j++] = *(++p);              /* swallow the \,                    */
-    p++;                                /* keep and skip over the &          */
-    }
-  else if (*p == '&' && (p[1] < '0' || p[1] > '9'))
-    {
-    struct symrecord *lp;
-    char iname[sizeof(namebuf)];
-    srcptr = p + 1;
-    scanname();
-    sprintf(iname, "&%.*s", (int)(sizeof(iname) - 2), namebuf);
-    lp = findsym(iname, 0);
-    if (lp && *namebuf &&               /* if symbol IS a text constant,     */
-        (lp->cat == SYMCAT_TEXT))
-      {                                 /* insert its content                */
-      char *from = texts[lp->value];
-      for (i = 0; j < LINELEN && from[i]; i++)
-        srcline[j++] = from[i];
-      p = srcptr;
-      }
-    else                                /* otherwise                         */
-      srcline[j++] = *p++;              /* simply use the '&' and go on.     */
-    }
-  else
-    srcline[j++] = *p++;
+  p.exprcat |= EXPRCAT_EXTOFF;
+  doaddress(&p);
+  }
+else
+  {
+  putword((unsigned short)nDiff);
+  if (((nDiff & 0xff80) == 0x0000) ||
+      ((nDiff & 0xff80) == 0xff80))
+    warning |= (certain) ? WRN_OPT : 0;
   }
-srcline[j >= LINELEN ? LINELEN - 1 : j] = '\0';
 }
 
 /*****************************************************************************/
-/* readfile : reads in a file and recurses through includes                  */
+/* lbranch : does a long branch                                              */
 /*****************************************************************************/
 
-struct linebuf *readfile(char *name, unsigned char lvl, struct linebuf *after)
+void lbranch(int co)
 {
-FILE *srcfile;
-struct linebuf *pNew;
-int lineno = 0;
-int i;
-int nfnidx = -1;
+struct relocrecord p = {0};
+int nDiff;
 
-for (i = 0; i < nfnms; i++)             /* prohibit recursion                */
-  if (!strcmp(name, fnms[i]))
-    {
-    nfnidx = i;
-    break;
-    }
-if (nfnidx < 0)
-  {
-  if (nfnms >= (sizeof(fnms) / sizeof(fnms[0])))
-    {
-    printf("%s(0) : error 21: nesting level too deep\n", name);
-    if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
-      putlist( "*** Error 21: nesting level too deep\n");
-    exit(4);
-    }
-  nfnidx = nfnms++;
-  }
+scanoperands(&p, 0);
+if (mode != ADRMODE_DIR && mode != ADRMODE_EXT)
+  error |= ERR_ILLEGAL_ADDR;
+putword((unsigned short)co);
+nDiff = operand - (loccounter + phase) - 4;
 
-if ((srcfile = fopen(name, "r")) == 0)
+if (p.exprcat & EXPRCAT_EXTADDR)
   {
-  printf("%s(0) : error 17: cannot open source file\n", name);
-  if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
-    putlist( "*** Error 17: cannot open source file\n");
-  exit(4);
+  p.exprcat |= EXPRCAT_EXTOFF;
+  doaddress(&p);
   }
-if (!fnms[nfnidx])                      /* if not yet done,                  */
-  fnms[nfnidx] = strdup(name);          /* remember the file name            */
-while (fgets(inpline, LINELEN, srcfile))
+else
   {
-  expandline();
-  pNew = allocline(after, fnms[nfnidx], ++lineno, lvl, srcline);
-  if (!pNew)
-    {
-    printf("%s(%d) : error 22: memory allocation error\n", name, lineno);
-    if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
-      putlist( "*** Error 22: memory allocation error\n");
-    exit(4);
-    }
-  if (!after)                           /* if 1st line                       */
-    rootline = pNew;                    /* remember it as root               */
-  after = pNew;                         /* insert behind the new line        */
+  putword((unsigned short)nDiff);
+  if (((nDiff & 0xff80) == 0x0000) ||
+      ((nDiff & 0xff80) == 0xff80))
+    warning |= (certain) ? WRN_OPT : 0;
   }
-fclose(srcfile);                        /* then close the file               */
-return after;                           /* pass back last line inserted      */
 }
 
 /*****************************************************************************/
-/* readbinary: reads in a binary file and converts to fcw / fcb lines        */
+/* arith : process arithmetic operation                                      */
 /*****************************************************************************/
 
-struct linebuf *readbinary
-    (
-    char *name,
-    unsigned char lvl,
-    struct linebuf *after,
-    struct symrecord *lp
-    )
+void arith(int co, char noimm)
 {
-FILE *srcfile;
-struct linebuf *pNew;
-int lineno = 0;
-int i;
-int nfnidx = -1;
-unsigned char binlin[16];
-int binlen;
-int fcbstart;
-
-for (i = 0; i < nfnms; i++)             /* prohibit recursion                */
-  if (!strcmp(name, fnms[i]))
-    {
-    nfnidx = i;
-    break;
-    }
-if (nfnidx < 0)
-  {
-  if (nfnms >= (sizeof(fnms) / sizeof(fnms[0])))
-    {
-    printf("%s(0) : error 21: nesting level too deep\n", name);
-    if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
-      putlist( "*** Error 21: nesting level too deep\n");
-    exit(4);
-    }
-  nfnidx = nfnms++;
-  }
+struct relocrecord p = {0};
 
-if ((srcfile = fopen(name, "rb")) == 0)
-  {
-  printf("%s(0) : error 17: cannot open source file\n", name);
-  if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
-    putlist( "*** Error 17: cannot open source file\n");
-  exit(4);
-  }
-if (!fnms[nfnidx])                      /* if not yet done,                  */
-  fnms[nfnidx] = strdup(name);          /* remember the file name            */
-while ((binlen = (int)fread(binlin, 1, sizeof(binlin), srcfile)) > 0)
+scanoperands(&p, 0);
+switch (mode)
   {
-  sprintf(inpline, "%s", (lineno || (!lp)) ? "" : lp->name);
-  i = 0;
-  if ((binlen & (~1)) && (binlen > 7))
-    {
-    sprintf(inpline + strlen(inpline), "\tFCW\t" /* , (binlen & 1) ? 'B' : 'W' */);
-    for (; i < (binlen & ~1); i += 2)
-      sprintf(inpline + strlen(inpline), "%s$%02X%02X", (i) ? "," : "",
-              binlin[i], binlin[i + 1]);
-    expandline();
-    pNew = allocline(after, fnms[nfnidx], ++lineno, lvl, srcline);
-    if (!pNew)
-      {
-      printf("%s(%d) : error 22: memory allocation error\n", name, lineno);
-      if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
-        putlist( "*** Error 22: memory allocation error\n");
-      exit(4);
-      }
-    if (!after)                         /* if 1st line                       */
-      rootline = pNew;                  /* remember it as root               */
-    after = pNew;                       /* insert behind the new line        */
-    inpline[0] = '\0';                  /* reset input line                  */
-    }
-  if ((binlen & 1) || (binlen <= 7))
-    {
-    fcbstart = i;
-    sprintf(inpline + strlen(inpline), "\tFCB\t");
-    for (; i < binlen; i++)
-      sprintf(inpline + strlen(inpline), "%s$%02X", (i > fcbstart) ? "," : "",
-              binlin[i]);
-
-    expandline();
-    pNew = allocline(after, fnms[nfnidx], ++lineno, lvl, srcline);
-    if (!pNew)
-      {
-      printf("%s(%d) : error 22: memory allocation error\n", name, lineno);
-      if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
-        putlist( "*** Error 22: memory allocation error\n");
-      exit(4);
-      }
-    if (!after)                         /* if 1st line                       */
-      rootline = pNew;                  /* remember it as root               */
-    after = pNew;                       /* insert behind the new line        */
-    }
+  case ADRMODE_IMM :
+    if (noimm)
+      error |= ERR_ILLEGAL_ADDR;
+    opsize = 2;
+    putbyte((unsigned char)co);
+    break;
+  case ADRMODE_DIR :
+    putbyte((unsigned char)(co + 0x010));
+    break;
+  case ADRMODE_EXT :
+    putbyte((unsigned char)(co + 0x030));
+    break;
+  default:
+    putbyte((unsigned char)(co + 0x020));
   }
-fclose(srcfile);                        /* then close the file               */
-return after;                           /* pass back last line inserted      */
+doaddress(&p);
 }
 
 /*****************************************************************************/
-/* setoptiontexts : sets up the option text variables                        */
+/* accarith : process arithmetic operation with explicit accumulator         */
 /*****************************************************************************/
 
-void setoptiontexts()
+void accarith(int co, char noimm, char ignore)
 {
-int i;
-                                        /* walk option list                  */
-for (i = 0; i < (sizeof(Options) / sizeof(Options[0])); i++)
+char *s = srcptr;                       /* remember current offset           */
+char expacc = 1;                        /* flag whether explicit acc.        */
+char ambig = 0;
+
+/* this is supposed to catch 6800 legacy expressions of the form
+     LDA A operands (i.e., a 6809 LDA mnemonic)
+     LDA B operands (i.e., a 6809 LDB mnemonic)
+   but it should NOT catch
+     LDA A,X
+     LDA B,X
+   which are valid 6809 operations! */
+
+skipspace();                            /* skip space                        */
+scanname();                             /* get following name                */
+
+if (strcmp(unamebuf, "A") &&            /* has to be followed by A or B      */
+    strcmp(unamebuf, "B"))
+  expacc = 0;
+
+#if 1
+if (expacc && !skipspace())
+  expacc = 0;
+if (expacc && *srcptr == ',' && !(dwOptions & OPTION_TSC))
+  ambig = 1;
+#else
+if (!(dwOptions & OPTION_TSC))
+  skipspace();
+if (*srcptr++ != ',')                   /* and a comma                       */
+  expacc = 0;
+#endif
+
+if (!expacc)                            /* if NOT followed by "A " or "B "   */
   {
-  if ((dwOptions & Options[i].dwAdd) ||
-      (!(dwOptions & ~Options[i].dwRem)))
-    settext(Options[i].Name, "1");
-  else
-    settext(Options[i].Name, "0");
+#if 1
+  srcptr = s;                           /* go back to parm start             */
+#else
+  if (ignore)                           /* if ignoring that,                 */
+    srcptr = s;                         /* go back to parm start             */
+  else                                  /* otherwise                         */
+    error |= ERR_EXPR;                  /* flag as an error                  */
+#endif
   }
+else
+  {
+  if (unamebuf[0] == 'B')               /* eventually transform to acc.B     */
+    co |= 0x40;
+  if (ambig)
+    warning |= WRN_AMBIG;
+  }
+arith(co, noimm);                       /* then process as arithmetic        */
 }
 
 /*****************************************************************************/
-/* setoption : processes an option string                                    */
+/* idxextarith : indexed / extended arithmetic, 6800 style                   */
 /*****************************************************************************/
 
-int setoption ( char *szOpt )
+void idxextarith(int co)
 {
-char iopt[4];
-int i;
+struct relocrecord p = {0};
 
-for (i = 0; szOpt[i] && i < sizeof(iopt); i++)
-  iopt[i] = toupper(szOpt[i]);
-if (i >= sizeof(iopt))
-  i--;
-iopt[i] = '\0';
-                                        /* search option list                */
-for (i = 0; i < (sizeof(Options) / sizeof(Options[0])); i++)
+scanoperands(&p, 0);
+switch (mode)
   {
-  if (!strcmp(iopt, Options[i].Name))   /* if option found                   */
-    {
-    dwOptions |= Options[i].dwAdd;      /* add flags                         */
-    dwOptions &= ~Options[i].dwRem;     /* and remove flags                  */
-
-    switch (Options[i].dwAdd)           /* afterprocessing for specials:     */
-      {
-      case OPTION_M09 :                 /* switch to MC6809 processor        */
-        optable = optable09;
-        optablesize = sizeof(optable09) / sizeof(optable09[0]);
-        regtable = regtable09;
-        bitregtable = bitregtable09;
-        bitregtablesize = sizeof(bitregtable09) / sizeof(bitregtable09[0]);
-        scanoperands = scanoperands09;
-        break;
-      case OPTION_H09 :                 /* switch to HD6309 processor        */
-        optable = optable09;
-        optablesize = sizeof(optable09) / sizeof(optable09[0]);
-        regtable = regtable63;
-        bitregtable = bitregtable09;
-        bitregtablesize = sizeof(bitregtable09) / sizeof(bitregtable09[0]);
-        scanoperands = scanoperands09;
-        break;
-      case OPTION_M00 :                 /* switch to MC6800 processor        */
-        optable = optable00;
-        optablesize = sizeof(optable00) / sizeof(optable00[0]);
-        regtable = regtable00;
-        bitregtable = bitregtable00;
-        bitregtablesize = sizeof(bitregtable00) / sizeof(bitregtable00[0]);
-        scanoperands = scanoperands00;
-        break;
-      case OPTION_M01 :                 /* switch to MC6801 processor        */
-        optable = optable01;
-        optablesize = sizeof(optable01) / sizeof(optable01[0]);
-        regtable = regtable01;
-        bitregtable = bitregtable00;
-        bitregtablesize = sizeof(bitregtable00) / sizeof(bitregtable00[0]);
-        scanoperands = scanoperands00;
-        break;
-      case OPTION_H01 :                 /* switch to HD6301 processor        */
-        optable = optable01;
-        optablesize = sizeof(optable01) / sizeof(optable01[0]);
-        regtable = regtable01;
-        bitregtable = bitregtable00;
-        bitregtablesize = sizeof(bitregtable00) / sizeof(bitregtable00[0]);
-        scanoperands = scanoperands00;
-        break;
-      case OPTION_H11 :                 /* switch to 68HC11 processor        */
-        optable = optable11;
-        optablesize = sizeof(optable11) / sizeof(optable11[0]);
-        regtable = regtable11;
-        bitregtable = bitregtable00;
-        bitregtablesize = sizeof(bitregtable00) / sizeof(bitregtable00[0]);
-        scanoperands = scanoperands11;
-        break;
-      }
-
-    setoptiontexts();
-    return 0;                           /* then return OK                    */
-    }
-  }
-
-return 1;                               /* unknown option                    */
+  case ADRMODE_IMM :
+    error |= ERR_ILLEGAL_ADDR;
+    opsize = 3;
+    putbyte((unsigned char)co);
+    break;
+  case ADRMODE_DIR :
+    mode = ADRMODE_EXT;                 /* implicitly convert to extended    */
+    /* fall thru to... */
+  case ADRMODE_EXT :
+    putbyte((unsigned char)(co + 0x030));
+    break;
+  default:
+    putbyte((unsigned char)(co + 0x020));
+    break;
+ }
+doaddress(&p);
 }
 
 /*****************************************************************************/
-/* pseudoop : processes all known pseudo-ops                                 */
+/* darith : process direct arithmetic                                        */
 /*****************************************************************************/
 
-void pseudoop(int co, struct symrecord * lp)
+void darith(int co, char noimm)
 {
-int i, j;
-char c, fillc;
 struct relocrecord p = {0};
 
-if (common &&                           /* if in COMMON definition mode      */
-    (co != PSEUDO_ENDCOM) &&            /* and this is neither ENDCOM        */
-    (co != PSEUDO_RMB))                 /* nor RMB                           */
-  error |= ERR_EXPR;                    /* this is an error.                 */
-
-switch (co)
+scanoperands(&p, 0);
+switch (mode)
   {
-  case PSEUDO_ABS :                     /* ABS                               */
-    absmode = 1;                        /* reset mode to absolute            */
-    break;
-  case PSEUDO_DEF :                     /* DEFINE                            */
-    global++;                           /* all labels from now on are global */
-    break;
-  case PSEUDO_ENDDEF :                  /* ENDDEF                            */
-    if (global)                         /* all labels from now on are local  */
-      global--;
-    else
-      error |= ERR_EXPR;                /* must be paired                    */
+  case ADRMODE_IMM :
+    if (noimm)
+      error |= ERR_ILLEGAL_ADDR;
+    opsize = 3;
+    putbyte((unsigned char)co);
     break;
-  case PSEUDO_COMMON :                  /* label COMMON                      */
-    if (absmode)                        /* if in absolute assembler mode     */
-      error |= ERR_RELOCATING;
-    if (!lp)
-      error |= ERR_LABEL_MISSING;
-    else
-      lp->cat = SYMCAT_COMMON;
-    common++;                           /* go into common mode               */
-    commonsym = lp;                     /* remember common symbol            */
+  case ADRMODE_DIR :
+    putbyte((unsigned char)(co + 0x010));
     break;
-  case PSEUDO_ENDCOM :                  /* ENDCOM                            */
-    if (absmode)                        /* if in absolute assembler mode     */
-      error |= ERR_RELOCATING;
-    if (common)                         /* terminate common mode             */
-      common--;
-    else
-      error |= ERR_EXPR;                /* must be paired                    */
+  case ADRMODE_EXT :
+    putbyte((unsigned char)(co + 0x030));
     break;
-  case PSEUDO_FILL :                    /* [label] FILL <value>,<byte_count> */
-    operand = scanexpr(0, &p);
-    if (unknown)
-      error |= ERR_LABEL_UNDEF;
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (*srcptr == ',')                 /* skip count?                       */
+  default:
+    putbyte((unsigned char)(co + 0x020));
+    if (dwOptions & OPTION_H11)         /* specials for 68HC11 page bytes    */
       {
-      fillc = (char)operand;
-      srcptr++;
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      goto DoFill;
+      if ((codebuf[0] == 0x18) &&
+          (co == 0x8c ||                /* CPX                               */
+           co == 0xce ||                /* LDX                               */
+           co == 0xcf))                 /* STX                               */
+        codebuf[0] = 0xcd;
       }
-    else
-      error |= ERR_EXPR;
     break;
-  case PSEUDO_RMB :                     /* [label] RMB <absolute expression> */
-  case PSEUDO_RZB :                     /* [label] RZB <absolute expression> */
-    fillc = (co == PSEUDO_RZB) ? 0 : rmbfillchr;
-  DoFill:
-    operand = scanexpr(0, &p);
-    if (unknown)
-      error |= ERR_LABEL_UNDEF;
+ }
+doaddress(&p);
+}
 
-    if (common)                         /* if in common mode                 */
-      {
-      if ((lp->cat != SYMCAT_EMPTY) &&
-          (lp->cat != SYMCAT_UNRESOLVED) &&
-          (lp->cat != SYMCAT_COMMONDATA))
-        error |= ERR_LABEL_MULT;
-      if (lp->cat != SYMCAT_COMMONDATA) /* if not yet done,                  */
-        {
-        lp->cat = SYMCAT_COMMONDATA;    /* set tymbol type                   */
-        lp->u.parent = commonsym;       /* remember COMMON symbol            */
-        lp->value = commonsym->value;   /* remember offset from COMMON symbol*/
-        commonsym->value +=             /* append # bytes to reserve to -"-  */
-            (unsigned short)operand;
-        }
-      break;
-      }
+void darith18(int co, char noimm)
+{
+codebuf[codeptr++] = 0x18;
+darith(co, noimm);
+if (codebuf[0] == 0xcd)
+  codebuf[0] = 0x18;
+}
 
-    printovr |= PRINTOV_PADDR;          /* print address in listing          */
-    setlabel(lp);
-    if (generating && pass == 2)
-      {
-      if (co != PSEUDO_RMB ||
-          outmode == OUT_BIN ||
-          outmode == OUT_REL)
-        {
-        if (co != PSEUDO_RMB)           /* if filling with a value,          */
-          {                             /* fill codebuf first                */
-          if (!inMacro)
-            generating = 1;
-          for (i = 0; i < operand && i < sizeof(codebuf); i++)
-            putbyte(fillc);
-          operand -= i;
-          }
-        for (i = 0; i < operand; i++)   /* if too much, output rest directly */
-          outbyte(fillc, i);
-        }
-      else switch (outmode)
-        {
-        case OUT_SREC :                 /* Motorola S51-09 ?                 */
-          flushhex();
-          break;
-        case OUT_IHEX :                 /* Intel Hex ?                       */
-          flushihex();  
-          break;
-        case OUT_FLEX :                 /* FLEX binary ?                     */
-          flushflex();
-          break;
-        }
-      }   
-    loccounter += (unsigned short)operand;
-    hexaddr = loccounter;
-    break;  
-  case PSEUDO_EQU :                     /* label EQU x                       */
-    nRepNext = 0;                       /* reset eventual repeat             */
-    if (dwOptions & OPTION_LPA)         /* if listing in patch format,       */
-      curline->flg |= LINCAT_PEMTCMT;   /* prefix with comment               */
-    operand = scanexpr(0, &p);
-    if (!lp)
-      error |= ERR_LABEL_MISSING;
-    else
-      {
-      if (lp->cat == SYMCAT_EMPTY ||
-          lp->cat == SYMCAT_UNRESOLVED ||
-          (lp->value == (unsigned short)operand &&
-           pass == 2))
-        {
-        if (lp->cat != SYMCAT_PUBLIC)
-          {   
-          if (exprcat == EXPRCAT_INTADDR)
-            lp->cat = SYMCAT_LABEL;
-          else
-            lp->cat = SYMCAT_CONSTANT;
-          }
-        lp->value = (unsigned short)operand;
-        printovr |= PRINTOV_PLABEL;
-        }
-      else if (lp->cat == SYMCAT_PUBLICUNDEF ||
-               (lp->cat == SYMCAT_PUBLIC &&
-                lp->value == (unsigned short)operand))
-        {
-        lp->cat = SYMCAT_PUBLIC;
-        if (!(exprcat & (EXPRCAT_INTADDR | EXPRCAT_EXTADDR)))
-          lp->u.flags |= SYMFLAG_ABSOLUTE;
-        lp->value = (unsigned short)operand;
-        /* Doesn't look like it's necessary ...
-        p.addr = (unsigned short)operand;
-        addreloc(&p);
-        */
-        }
-      else
-        error |= ERR_LABEL_MULT;
-      }
+void darith1a(int co, char noimm)
+{
+codebuf[codeptr++] = 0x1a;
+darith(co, noimm);
+}
+
+/*****************************************************************************/
+/* d2arith : process direct word arithmetic                                  */
+/*****************************************************************************/
+
+void d2arith(int co, char noimm)
+{
+struct relocrecord p = {0};
+
+scanoperands(&p, 0);
+switch (mode)
+  {
+  case ADRMODE_IMM :
+    if (noimm)
+      error |= ERR_ILLEGAL_ADDR;
+    opsize = 3;
+    putword((unsigned short)co);
     break;
-  case PSEUDO_PUB :                     /* PUBLIC a[,b[,c...]]               */
-  case PSEUDO_EXT :                     /* EXTERN a[,b[,c...]]               */
-    nRepNext = 0;                       /* reset eventual repeat             */
-    skipspace();
-    while (isalnum(*srcptr))
-      {
-      scanname();                       /* parse option                      */
-      lp = findsym(namebuf, 1);         /* look up the symbol                */
-      switch (co)
-        {
-        case PSEUDO_PUB :               /* PUBLIC a[,b[,c...]]               */
-          if (lp->cat == SYMCAT_EMPTY ||
-              lp->cat == SYMCAT_UNRESOLVED)
-            lp->cat = SYMCAT_PUBLICUNDEF;
-          else if (lp->cat == SYMCAT_LABEL)
-            lp->cat = SYMCAT_PUBLIC;
-          else if (lp->cat == SYMCAT_PUBLICUNDEF)
-            error |= ERR_LABEL_UNDEF;
-          else if (lp->cat != SYMCAT_PUBLIC)
-            error |= ERR_LABEL_MULT;
-          break;
-        case PSEUDO_EXT :               /* EXTERN a[,b[,c...]]               */
-          if (absmode)                  /* if not in relocating asm mode,    */
-            error |= ERR_RELOCATING;    /* set error                         */
-          if (lp->cat == SYMCAT_EMPTY ||
-              lp->cat == SYMCAT_UNRESOLVED)
-            lp->cat = SYMCAT_EXTERN;
-          else if (lp->cat != SYMCAT_EXTERN)
-            error |= ERR_LABEL_MULT;
-          break;
-        }
-      if (*srcptr == ',')
-        {
-        srcptr++;
-        if (!(dwOptions & OPTION_TSC))
-          skipspace();
-        }
-      }
+  case ADRMODE_DIR :
+    putword((unsigned short)(co + 0x010));
     break;
-  case PSEUDO_FCB :                     /* [label] FCB expr[,expr...]        */
-    setlabel(lp);
-    if (!inMacro)
-      generating = 1;
-    do
-      {
-      if (*srcptr == ',')
-        srcptr++;
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      if (*srcptr == '\"')
-        {
-        srcptr++;
-        while (*srcptr != '\"' && *srcptr)
-          putbyte(*srcptr++);
-        if (*srcptr == '\"')
-          srcptr++; 
-        }
-      else
-        {
-        long ex = scanexpr(0, &p);
-        p.addr = (unsigned short)(loccounter + codeptr);
-        putbyte((unsigned char)ex);
-        p.exprcat |= EXPRCAT_ONEBYTE;
-        addreloc(&p);
-        if (unknown && pass == 2)
-          error |= ERR_LABEL_UNDEF;
-        }
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      } while (*srcptr == ',');
-    break; 
-  case PSEUDO_FCC :                     /* [label] FCC expr[,expr...]        */
-    setlabel(lp);
-    if (!inMacro)
-      generating = 1;
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (!(dwOptions & OPTION_TSC))      /* if standard                       */
-      {                                 /* accept ONE sequence with an       */
-      c = *srcptr++;                    /* arbitrary delimiter character     */
-      while (*srcptr != c && *srcptr)
-        putbyte(*srcptr++);
-      if (*srcptr == c)
-        srcptr++;
-      }
-    else                                /* if TSC extended format            */
-      {                                 /* accept MORE sequences             */
-      do
-        {
-        if (*srcptr == ',')
-          srcptr++;
-        if (!(dwOptions & OPTION_TSC))
-          skipspace();
-        c = *srcptr;
-        if ((c == '$') || isalnum(c))
-          {
-          long ex = scanexpr(0, &p);
-          p.addr = (unsigned short)(loccounter + codeptr);
-          putbyte((unsigned char)ex);
-          if (unknown && pass == 2)
-            error |= ERR_LABEL_UNDEF;
-          }
-        else
-          {
-          srcptr++;
-          while (*srcptr != c && *srcptr)
-            putbyte(*srcptr++);
-          if (*srcptr == c)
-            srcptr++;
-          }
-        if (!(dwOptions & OPTION_TSC))
-          skipspace();
-        } while (*srcptr == ',');
-      }
+  case ADRMODE_EXT :
+    putword((unsigned short)(co + 0x030));
     break;
-  case PSEUDO_FCW :                     /* [label] FCW,FDB  expr[,expr...]   */
-    setlabel(lp);
-    if (!inMacro)
-      generating = 1;
-    do
-      {
-      unsigned short us;
+  default:
+    putword((unsigned short)(co + 0x020));
+ }
+doaddress(&p);
+}
 
-      if (*srcptr == ',')
-        srcptr++;
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      us = (unsigned short)scanexpr(0, &p);
-      p.addr = (unsigned short)(loccounter + codeptr);
-      putword(us);
-      addreloc(&p);
-      if (unknown && pass == 2)
-        error |= ERR_LABEL_UNDEF; 
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();     
-      } while (*srcptr == ',');
+/*****************************************************************************/
+/* qarith : process direct doubleword arithmetic                             */
+/*****************************************************************************/
+
+void qarith(int co, char noimm)
+{
+struct relocrecord p = {0};
+
+scanoperands(&p, 0);
+switch (mode)
+  {
+  case ADRMODE_IMM :
+    if (noimm)
+      error |= ERR_ILLEGAL_ADDR;
+    opsize = 5;
+    putbyte((unsigned char)0xcd);       /* this can ONLY be LDQ!             */
     break;
-  case PSEUDO_FCQ :                     /* [label] FCQ,FQB  expr[,expr...]   */
-    setlabel(lp);
-    if (!inMacro)
-      generating = 1;
-    do
-      {
-      if (*srcptr == ',')
-        srcptr++;
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      putdword(scanexpr(0, &p));
-      if (unknown && pass == 2)
-        error |= ERR_LABEL_UNDEF; 
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();     
-      } while (*srcptr == ',');
+  case ADRMODE_DIR :
+    putword((unsigned short)(co + 0x010));
     break;
-  case PSEUDO_ELSE :                    /* ELSE                              */
-    if (inMacro)                        /* don't process if in MACRO def.    */
-      break;
-    nRepNext = 0;                       /* reset eventual repeat             */
-    suppress = 1;
-    condline = 1;                       /* this is a conditional line        */
+  case ADRMODE_EXT :
+    putword((unsigned short)(co + 0x030));
     break;
-  case PSEUDO_ENDIF :                   /* ENDIF                             */
-    if (inMacro)                        /* don't process if in MACRO def.    */
-      break;
-    nRepNext = 0;                       /* reset eventual repeat             */
-    condline = 1;                       /* this is a conditional line        */
+  default:
+    putword((unsigned short)(co + 0x020));
     break;
-  case PSEUDO_IF :                      /* IF  <expression>[,<skip>]         */
-  case PSEUDO_IFN :                     /* IFN <expression>[,<skip>]         */
-    if (inMacro)                        /* don't process if in MACRO def.    */
-      break;
-    condline = 1;                       /* this is a conditional line        */
-    nRepNext = 0;                       /* reset eventual repeat             */
-    operand = scanexpr(0, &p);
-    if (unknown)
-      error |= ERR_LABEL_UNDEF;
-    if (co == PSEUDO_IFN)               /* if IFN                            */
-      operand = !operand;               /* reverse operand                   */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (*srcptr == ',')                 /* skip count?                       */
-      {
-      srcptr++;
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      nSkipCount = scanexpr(0, &p);
-      if (!operand)
-        nSkipCount = 0;
-      }
-    else if (!operand)
-      suppress = 2;
+ }
+doaddress(&p);
+}
+
+/*****************************************************************************/
+/* oneaddr :                                                                 */
+/*****************************************************************************/
+
+void oneaddr(int co)
+{
+struct relocrecord p = {0};
+char *s;
+
+skipspace();
+#if 1
+if (co != 0x0e)                         /* check for 6800 convenience things */
+#else
+if ((dwOptions & OPTION_TSC) &&         /* if TSC mode, check for 6800       */
+    (co != 0x0e))                       /* convenience things                */
+#endif
+  {
+  s = srcptr;
+  scanname();                           /* look whether followed by A or B   */
+  if (((!strcmp(unamebuf, "A")) ||
+       (!strcmp(unamebuf, "B"))) &&
+      (*srcptr != ','))                 /* and NO comma                      */
+    {                                   /* if so, replace by 6809 mnemonic   */
+    warning |= WRN_AMBIG;               /* ... but not without a warning     */
+    onebyte(co | ((unamebuf[0] == 'A') ? 0x40 : 0x50));
+    return;
+    }
+  srcptr = s;
+  }
+
+scanoperands(&p, 0);
+switch (mode)
+  {
+  case ADRMODE_IMM :
+    error |= ERR_ILLEGAL_ADDR;
     break;
-  case PSEUDO_IFC :                     /* IFC  <string1>,<string2>[,<skip>] */
-  case PSEUDO_IFNC :                    /* IFNC <string1>,<string2>[,<skip>] */
-    if (inMacro)                        /* don't process if in MACRO def.    */
-      break;
-    condline = 1;                       /* this is a conditional line        */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    scanstring(szBuf1, sizeof(szBuf1));
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (*srcptr != ',')                 /* if not on comma                   */
-      {
-      *szBuf2 = '\0';                   /* reset 2nd string                  */
-      error |= ERR_EXPR;                /* set error                         */
-      }
+  case ADRMODE_DIR :
+    if ((dwOptions & OPTION_M00) &&     /* on MC6800, a DIRect JMP is not OK */
+        (co == 0x0e))
+      error |= ERR_ILLEGAL_ADDR;
     else
-      {
-      srcptr++;
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      scanstring(szBuf2, sizeof(szBuf2));
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      }
-    operand = !strcmp(szBuf1, szBuf2);
-    if (co == PSEUDO_IFNC)
-      operand = !operand;
-    if (*srcptr == ',')                 /* if skip count                     */
-      {
-      srcptr++;
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      nSkipCount = scanexpr(0, &p);
-      if (!operand)
-        nSkipCount = 0;
-      }
-    else if (!operand)
-      suppress = 2;
+      putbyte((unsigned char)co);
     break;
-
-  case PSEUDO_IFD :                     /* IFD <symbol>[,skipcount]          */
-  case PSEUDO_IFND :                    /* IFND <symbol>[,skipcount]         */
-    /* ATTENTION: it is easy to produce phasing errors with these 2,         */
-    /*            since symbols are NOT reset when starting pass 2!          */
-    if (inMacro)                        /* don't process if in MACRO def.    */
-      break;
-    skipspace();
-    scanname();                         /* parse symbol name                 */
-    lp = findsym(namebuf, 0);           /* look up the symbol                */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (*srcptr == ',')                 /* if skip count                     */
-      {
-      srcptr++;
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      nSkipCount = scanexpr(0, &p);
-      if (!lp != (co == PSEUDO_IFND))
-        nSkipCount = 0;
-      }
-                                        /* if no skip count and NOT matched  */
-    else if (!lp != (co == PSEUDO_IFND))
-      suppress = 2;                     /* suppress until ELSE or ENDIF      */
-    condline = 1;                       /* this is a conditional line        */
+  case ADRMODE_EXT :
+    putbyte((unsigned char)(co + 0x70));
+    break;
+  default:
+    putbyte((unsigned char)(co + 0x60));
+    break;
+  }
+
+if (p.exprcat & EXPRCAT_EXTADDR &&
+    mode == ADRMODE_PCR)
+  p.exprcat |= EXPRCAT_EXTOFF;
+
+doaddress(&p);
+}
+
+/*****************************************************************************/
+/* accaddr :                                                                 */
+/*****************************************************************************/
+
+void accaddr(int co)
+{
+struct relocrecord p = {0};
+char *s;
+
+skipspace();
+#if 1
+                                        /* always check for 6800             */
+#else
+if (dwOptions & OPTION_TSC)             /* if TSC mode, check for 6800       */
+#endif
+  {
+  s = srcptr;
+  scanname();                           /* look whether followed by A or B   */
+  if (((!strcmp(unamebuf, "A")) ||
+       (!strcmp(unamebuf, "B"))) &&
+      (*srcptr != ','))                 /* and NO comma                      */
+    {                                   /* if so, replace                    */
+    onebyte(co | ((unamebuf[0] == 'A') ? 0x40 : 0x50));
+    return;
+    }
+  srcptr = s;
+  }
+
+scanoperands(&p, 0);
+switch (mode)
+  {
+  case ADRMODE_IMM :
+    error |= ERR_ILLEGAL_ADDR;
+    break;
+  case ADRMODE_DIR :
+    mode = ADRMODE_EXT;                 /* silently convert to extended      */
+    /* fall through to ... */
+  case ADRMODE_EXT :
+    putbyte((unsigned char)(co + 0x70));
+    break;
+  default:
+    putbyte((unsigned char)(co + 0x60));
+    break;
+  }
+doaddress(&p);
+}
+
+/*****************************************************************************/
+/* tfrexg :                                                                  */
+/*****************************************************************************/
+
+void tfrexg(int co)
+{
+struct regrecord * p;
+
+putbyte((unsigned char)co);
+skipspace();
+scanname();
+
+if (dwOptions & OPTION_H09)
+  p = findreg63(unamebuf);
+else
+  p = findreg(unamebuf);
+if (!p)
+  error |= ERR_ILLEGAL_ADDR;
+else
+ postbyte = (p->tfr) << 4;
+skipspace();
+if (*srcptr == ',')
+  srcptr++;
+else
+ error |= ERR_ILLEGAL_ADDR;
+skipspace();
+scanname();
+if ((p = findreg(unamebuf)) == 0)
+  error |= ERR_ILLEGAL_ADDR;
+else
+ postbyte |= p->tfr;
+putbyte(postbyte);
+}
+
+/*****************************************************************************/
+/* pshpul : operates on PSH / PUL mnemonics                                  */
+/*****************************************************************************/
+
+void pshpul(int co, int mode)
+{
+struct regrecord *p;
+struct relocrecord sp = {0};
+postbyte = 0;
+
+skipspace();
+
+if (mode == 1)                          /* 6800/6801/6811 mode:              */
+  {
+  scanname(); 
+  if ((p = findreg(unamebuf)) == 0)
+    error |= ERR_ILLEGAL_ADDR;
+  else
+    {
+    postbyte |= p->psh;
+    if (!postbyte)
+      error |= ERR_ILLEGAL_ADDR;
+    }
+  co |= postbyte & 0x7f;
+  if (postbyte & 0x80)
+    putbyte((unsigned char)0x18);
+  }
+
+putbyte((unsigned char)co);
+
+if (mode == 0)                          /* 6809/6309 mode:                   */
+  {
+  if (*srcptr == '#')
+    {
+    srcptr++;
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    postbyte = (unsigned char)scanexpr(0, &sp);
+    }
+  else do
+    {
+    if (*srcptr == ',')
+      srcptr++;
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    scanname(); 
+    if ((p = findreg(unamebuf)) == 0)
+      error |= ERR_ILLEGAL_ADDR;
+    else
+      postbyte |= p->psh; 
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    } while (*srcptr == ',');
+  putbyte(postbyte);
+  }
+}
+
+/*****************************************************************************/
+/* bitdirect :                                                               */
+/*****************************************************************************/
+
+void bitdirect(int co)
+{
+struct relocrecord p = {0};
+unsigned short dir;
+
+skipspace();
+if (*srcptr++ != '#')
+  error |= ERR_EXPR;
+if (!(dwOptions & OPTION_TSC))
+  skipspace();
+dir = (unsigned short)scanexpr(0, &p);
+/* check for overflow - is this necessary? Don't know ... */
+if (dir > 0xff && dir < 0xff00)
+  warning |= WRN_IMM_TRUNC;
+if (!(dwOptions & OPTION_TSC))
+  skipspace();
+if (*srcptr++ != ',')
+  error |= ERR_EXPR;
+scanoperands(&p, 0);
+
+/* HD6301/6303 can handle Immediate and Indexed addressing, whereas
+   HD6309 can handle Immediate, Extended and Indexed addressing */
+switch (mode)
+  {
+  case ADRMODE_DIR :
+    if (dwOptions & OPTION_H01)
+      putbyte((unsigned char)(co + 0x70));
+    else
+      putbyte((unsigned char)co);
+    break;
+  case ADRMODE_EXT :
+    if (dwOptions & OPTION_H01)
+      error |= ERR_ILLEGAL_ADDR;
+    else
+      putbyte((unsigned char)(co + 0x70));
+    break;
+  case ADRMODE_POST:
+  case ADRMODE_IDX:
+    putbyte((unsigned char)(co + 0x60));
+    break;
+  default :
+    error |= ERR_ILLEGAL_ADDR;
+    break;
+  }
+putbyte((unsigned char)dir);
+doaddress(&p);
+}
+
+/*****************************************************************************/
+/* bittrans :                                                                */
+/*****************************************************************************/
+
+void bittrans(int co)
+{
+struct regrecord *p;
+struct relocrecord rp = {0};
+long t;
+
+putword((unsigned short)co);
+
+skipspace();
+scanname();
+if ((p = findbitreg(unamebuf)) == 0)
+  error |= ERR_ILLEGAL_ADDR;
+else
+  postbyte = (p->tfr) << 6;
+if (!(dwOptions & OPTION_TSC))
+  skipspace();
+if (*srcptr == ',')
+  srcptr++;
+else
+ error |= ERR_ILLEGAL_ADDR;
+if (!(dwOptions & OPTION_TSC))
+  skipspace();
+t = scanfactor(&rp);
+if (t & 0xfff8)
+  error |= ERR_ILLEGAL_ADDR;
+else
+  postbyte |= (t << 3);
+if (!(dwOptions & OPTION_TSC))
+  skipspace();
+if (*srcptr == ',')
+  srcptr++;
+else
+ error |= ERR_ILLEGAL_ADDR;
+t = scanfactor(&rp);
+if (t & 0xfff8)
+  error |= ERR_ILLEGAL_ADDR;
+else
+  postbyte |= t;
+putbyte((unsigned char)postbyte);
+if (!(dwOptions & OPTION_TSC))
+  skipspace();
+if (*srcptr == ',')
+  srcptr++;
+else
+ error |= ERR_ILLEGAL_ADDR;
+scanoperands(&rp, 0);
+switch (mode)
+  {
+  case ADRMODE_DIR :
+    putbyte((unsigned char)operand);
+    break;
+  default:
+    error |= ERR_ILLEGAL_ADDR;
+  }
+}
+
+/*****************************************************************************/
+/* blocktrans :                                                              */
+/*****************************************************************************/
+
+void blocktrans(int co)
+{
+char reg1,reg2;
+char mode[3] = "";
+static char regnames[] = "DXYUS";
+static char *modes[] =
+  {
+  "++",
+  "--",
+  "+",
+  ",+"
+  };
+int i;
+
+skipspace();
+reg1 = toupper(*srcptr);
+for (i = 0; regnames[i]; i++)
+  if (reg1 == regnames[i])
+    break;
+if (!regnames[i])
+  error |= ERR_ILLEGAL_ADDR;
+else
+  reg1 = i;
+mode[0] = *++srcptr;
+if ((mode[0] != '+') && (mode[0] != '-'))
+  {
+  if (!(dwOptions & OPTION_TSC))
+    skipspace();
+  mode[0] = *srcptr;
+  }
+else
+  srcptr++;
+if (!(dwOptions & OPTION_TSC))
+  skipspace();
+if (*srcptr != ',') 
+  error |= ERR_ILLEGAL_ADDR;
+srcptr++;
+reg2 = toupper(*srcptr);
+for (i = 0; regnames[i]; i++)
+  if (reg2 == regnames[i])
+    break;
+if (!regnames[i])
+  error |= ERR_ILLEGAL_ADDR;
+else
+  reg2 = i;
+mode[1] = *++srcptr;
+if ((mode[1] != '+') && (mode[1] != '-'))
+  {
+  if (!(dwOptions & OPTION_TSC))
+    skipspace();
+  mode[1] = *srcptr;
+  }
+else
+  srcptr++;
+if ((mode[1] == ';') || (mode[1] == '*') ||
+    (mode[1] == ' ') || (mode[1] == '\t'))
+  mode[1] = '\0';
+for (i = 0; i < (sizeof(modes) / sizeof(modes[0])); i++)
+  if (!strcmp(mode, modes[i]))
+    break;
+if (i >= (sizeof(modes) / sizeof(modes[0])))
+  error |= ERR_ILLEGAL_ADDR;
+else
+  co |= i;
+
+putword((unsigned short)co);
+putbyte((unsigned char)((reg1 << 4) | reg2));
+}
+
+/*****************************************************************************/
+/* setmask :                                                                 */
+/*****************************************************************************/
+
+void setmask(int co)
+{
+struct relocrecord p = {0};
+long mask = -1;
+
+/* expected:
+   dir [#]mask               |  dir,[#]mask
+   [[off],]indexreg [#]mask  |  [[off],]indexreg,[#]mask */
+
+scanoperands(&p, 1);                    /* get 1st part (dir/index)          */
+
+if (*srcptr == ',' ||                   /* either , or ' ' is valid          */
+    *srcptr == ' ')
+  srcptr++;
+if (!(dwOptions & OPTION_TSC))
+  skipspace();
+if (*srcptr == '#')
+  srcptr++;
+mask = scanexpr(0, &p);
+if (mask < 0 || mask > 0xff)
+  error |= ERR_EXPR;
+
+switch (mode)
+  {
+  case ADRMODE_IMM :
+  case ADRMODE_EXT :
+    error |= ERR_ILLEGAL_ADDR;
+    break;
+  case ADRMODE_DIR :
+    putbyte((unsigned char)(co));
+    break;
+  default:
+    putbyte((unsigned char)(co + 0x08));
+    break;
+  }
+doaddress(&p);
+putbyte((unsigned char)mask);
+}
+
+/*****************************************************************************/
+/* brmask :                                                                  */
+/*****************************************************************************/
+
+void brmask(int co)
+{
+struct relocrecord p = {0}, pj = {0};
+long mask = -1;
+int offs;
+
+/* expected:
+   dir [#]mask target  |  dir,[#]mask,target
+   [[off],]indexreg [#]mask target  |  [[off],]indexreg,[#]mask,target */
+
+scanoperands(&p, 1);
+
+if (*srcptr == ',' ||                   /* either , or ' ' is valid          */
+    *srcptr == ' ')
+  srcptr++;
+if (!(dwOptions & OPTION_TSC))
+  skipspace();
+if (*srcptr == '#')
+  srcptr++;
+mask = scanexpr(0, &p);
+if (mask < 0 || mask > 0xff)
+  error |= ERR_EXPR;
+
+if (*srcptr == ',' ||                   /* either , or ' ' is valid          */
+    *srcptr == ' ')
+  srcptr++;
+if (!(dwOptions & OPTION_TSC))
+  skipspace();
+{
+char s_mode = mode;
+char s_opsize = opsize;
+long s_operand = operand;
+char s_unknown = unknown;
+char s_certain = certain;
+unsigned char s_postbyte = postbyte;
+scanoperands(&pj, 0);
+if (mode != ADRMODE_DIR && mode != ADRMODE_EXT)
+  error |= ERR_ILLEGAL_ADDR;
+offs = (unsigned short)operand - (loccounter + phase) - 4;
+if (codeptr) offs--;
+if (!unknown && (offs < -128 || offs >= 128))
+  error |= ERR_RANGE;
+if (pass == 2 && unknown)
+  error |= ERR_LABEL_UNDEF;
+mode = s_mode;
+opsize = s_opsize;
+operand = s_operand;
+postbyte = s_postbyte;
+unknown = s_unknown;
+certain = s_certain;
+}
+
+switch (mode)
+  {
+  case ADRMODE_IMM :
+  case ADRMODE_EXT :
+    error |= ERR_ILLEGAL_ADDR;
+    break;
+  case ADRMODE_DIR :
+    putbyte((unsigned char)(co));
+    break;
+  default:
+    putbyte((unsigned char)(co + 0x0c));
+    break;
+  }
+
+doaddress(&p);
+putbyte((unsigned char)mask);
+putbyte((unsigned char)offs);
+}
+
+
+/*****************************************************************************/
+/* expandline : un-tabify current line                                       */
+/*****************************************************************************/
+
+void expandline() 
+{
+int i, j = 0, k, j1;
+
+for (i = 0; i < LINELEN && j < LINELEN; i++)
+  {
+  if (inpline[i] == '\n')
+    {
+    srcline[j] = 0;
+    break;
+    }
+  else if (inpline[i] == '\t')
+    {
+    j1 = j;
+    for (k = 0; k < 8 - j1 % 8 && j < LINELEN; k++)
+      srcline[j++] = ' ';
+    }
+  else if (inpline[i] == '\r')
+    {
+    continue;
+    }
+  else
+    srcline[j++] = inpline[i];     
+ }
+srcline[LINELEN - 1] = 0;
+}
+
+/*****************************************************************************/
+/* expandtext : expands all texts in a line                                  */
+/*****************************************************************************/
+
+void expandtext()
+{
+char *p;
+int i, j = 0;
+
+for (p = curline->txt; (*p) && (j < LINELEN); )
+  {
+  if (*p == '\\' && p[1] == '&')        /* when encountering \&,             */
+    {
+    srcline[j++] = *(++p);              /* swallow the \,                    */
+    p++;                                /* keep and skip over the &          */
+    }
+  else if (*p == '&' && (p[1] < '0' || p[1] > '9'))
+    {
+    struct symrecord *lp;
+    char iname[sizeof(namebuf)];
+    srcptr = p + 1;
+    scanname();
+    sprintf(iname, "&%.*s", (int)(sizeof(iname) - 2), namebuf);
+    lp = findsym(iname, 0);
+    if (lp && *namebuf &&               /* if symbol IS a text constant,     */
+        (lp->cat == SYMCAT_TEXT))
+      {                                 /* insert its content                */
+      char *from = texts[lp->value];
+      for (i = 0; j < LINELEN && from[i]; i++)
+        srcline[j++] = from[i];
+      p = srcptr;
+      }
+    else                                /* otherwise                         */
+      srcline[j++] = *p++;              /* simply use the '&' and go on.     */
+    }
+  else
+    srcline[j++] = *p++;
+  }
+srcline[j >= LINELEN ? LINELEN - 1 : j] = '\0';
+}
+
+/*****************************************************************************/
+/* memsrcopen : opens a source file that is held in memory                   */
+/*****************************************************************************/
+
+FILE *memsrcopen(struct memsrc *src, char *mode)
+{
+FILE *fp;
+
+#if UNIX
+if (src->len &&                         /* read directly from memory         */
+    (fp = fmemopen((void *)src->text, src->len, mode)) != NULL)
+  return fp;
+#endif
+if ((fp = tmpfile()) != NULL)           /* otherwise go through a temp. file */
+  {
+  fwrite(src->text, 1, src->len, fp);
+  rewind(fp);
+  }
+return fp;
+}
+
+/*****************************************************************************/
+/* cachekey : returns the include cache key of a file in key (FNLEN + 1)     */
+/*****************************************************************************/
+
+char *cachekey(char *name, char *key)
+{
+#if UNIX
+if (*name != '/' &&                     /* key is the absolute path, as      */
+    strlen(name) < FNLEN / 2 &&         /* a server changes directories      */
+    getcwd(key, FNLEN - strlen(name) - 1))
+  strcat(strcat(key, "/"), name);
+else
+#endif
+  sprintf(key, "%.*s", FNLEN, name);
+return key;
+}
+
+/*****************************************************************************/
+/* cacheinclude : returns the include cache entry for a file                 */
+/*                the file is (re)loaded if it's new or has been changed;    */
+/*                NULL if it can't be cached                                 */
+/*****************************************************************************/
+
+struct memsrc *cacheinclude(char *name)
+{
+char key[FNLEN + 1];
+struct stat st;
+struct memsrc *src;
+FILE *fp;
+char *text;
+size_t len;
+int i;
+
+if (stat(cachekey(name, key), &st))
+  return NULL;
+
+for (i = 0; i < ninccache; i++)
+  if (!strcmp(key, inccache[i].name))
+    break;
+src = inccache + i;
+if (i < ninccache &&                    /* still up to date? Changes in the  */
+    src->mtime == st.st_mtime &&        /* second it was read can't be told  */
+    src->len == (size_t)st.st_size &&   /* by the time stamp                 */
+    src->mtime < src->loaded)
+  return src;
+if (i >= MAXFILES ||
+    !(fp = fopen(key, "rb")))
+  return NULL;
+if (!(text = (char *)malloc((size_t)st.st_size + 1)))
+  {
+  fclose(fp);
+  return NULL;
+  }
+len = fread(text, 1, (size_t)st.st_size, fp);
+fclose(fp);
+text[len] = '\0';
+if (i == ninccache)                     /* new entry                         */
+  {
+  if (!(src->name = strdup(key)))
+    {
+    free(text);
+    return NULL;
+    }
+  ninccache++;
+  }
+else
+  free((char *)src->text);
+src->text = text;
+src->len = len;
+src->mtime = st.st_mtime;
+src->loaded = time(NULL);
+return src;
+}
+
+/*****************************************************************************/
+/* cachereport : tells the server or -watch about a file the assembly reads  */
+/*               (even if it doesn't exist), so that it can cache and watch  */
+/*               it                                                          */
+/*****************************************************************************/
+
+void cachereport(char *name)
+{
+#if UNIX
+char key[FNLEN + 2];
+
+if (cachepipe < 0)
+  return;
+strcat(cachekey(name, key), "\n");
+if (write(cachepipe, key, strlen(key)) < 0)
+  cachepipe = -1;
+#else
+(void)name;
+#endif
+}
+
+/*****************************************************************************/
+/* srcopen : opens a source file; memory sources are preferred               */
+/*           in a batch or server, included files come from the cache        */
+/*****************************************************************************/
+
+FILE *srcopen(char *name, char *mode, int include)
+{
+struct memsrc *src;
+int i;
+
+for (i = 0; i < nmemsrcs; i++)
+  if (!strcmp(name, memsrcs[i].name))
+    return memsrcopen(memsrcs + i, mode);
+if (inccaching && include)
+  {
+  cachereport(name);
+  if (fastpaths &&
+      (src = cacheinclude(name)) != NULL)
+    return memsrcopen(src, mode);
+  }
+return fopen(name, mode);
+}
+
+/*****************************************************************************/
+/* readfile : reads in a file and recurses through includes                  */
+/*****************************************************************************/
+
+struct linebuf *readfile(char *name, unsigned char lvl, struct linebuf *after)
+{
+FILE *srcfile;
+struct linebuf *pNew;
+int lineno = 0;
+int i;
+int nfnidx = -1;
+double t = steptime();
+
+if (lvl)                                /* count included files              */
+  stats.includes++;
+
+for (i = 0; i < nfnms; i++)             /* prohibit recursion                */
+  if (!strcmp(name, fnms[i]))
+    {
+    nfnidx = i;
+    break;
+    }
+if (nfnidx < 0)
+  {
+  if (nfnms >= (sizeof(fnms) / sizeof(fnms[0])))
+    {
+    errorout(name, 0, 21, "nesting level too deep");
+    if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
+      putlist( "*** Error 21: nesting level too deep\n");
+    exit(4);
+    }
+  nfnidx = nfnms++;
+  }
+
+if ((srcfile = srcopen(name, "r", lvl > 0 || inwatch)) == 0)
+  {
+  errorout(name, 0, 17, "cannot open source file");
+  if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
+    putlist( "*** Error 17: cannot open source file\n");
+  exit(4);
+  }
+if (!fnms[nfnidx])                      /* if not yet done,                  */
+  fnms[nfnidx] = strdup(name);          /* remember the file name            */
+while (fgets(inpline, LINELEN, srcfile))
+  {
+  expandline();
+  pNew = allocline(after, fnms[nfnidx], ++lineno, lvl, srcline,
+                   MEM_SRCLINES);
+  if (!pNew)
+    {
+    errorout(name, (long)lineno, 22, "memory allocation error");
+    if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
+      putlist( "*** Error 22: memory allocation error\n");
+    exit(4);
+    }
+  if (!after)                           /* if 1st line                       */
+    rootline = pNew;                    /* remember it as root               */
+  after = pNew;                         /* insert behind the new line        */
+  }
+fclose(srcfile);                        /* then close the file               */
+costfile[nfnidx].lines += lineno;
+stats.tload += steptime() - t;
+traceevent(name, "load", t, lvl, NULL, 0);
+return after;                           /* pass back last line inserted      */
+}
+
+/*****************************************************************************/
+/* readbinary: reads in a binary file and converts to fcw / fcb lines        */
+/*****************************************************************************/
+
+struct linebuf *readbinary
+    (
+    char *name,
+    unsigned char lvl,
+    struct linebuf *after,
+    struct symrecord *lp
+    )
+{
+FILE *srcfile;
+struct linebuf *pNew;
+int lineno = 0;
+int i;
+int nfnidx = -1;
+unsigned char binlin[16];
+int binlen;
+int fcbstart;
+double t = steptime();
+
+stats.includes++;
+
+for (i = 0; i < nfnms; i++)             /* prohibit recursion                */
+  if (!strcmp(name, fnms[i]))
+    {
+    nfnidx = i;
+    break;
+    }
+if (nfnidx < 0)
+  {
+  if (nfnms >= (sizeof(fnms) / sizeof(fnms[0])))
+    {
+    errorout(name, 0, 21, "nesting level too deep");
+    if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
+      putlist( "*** Error 21: nesting level too deep\n");
+    exit(4);
+    }
+  nfnidx = nfnms++;
+  }
+
+if ((srcfile = srcopen(name, "rb", 1)) == 0)
+  {
+  errorout(name, 0, 17, "cannot open source file");
+  if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
+    putlist( "*** Error 17: cannot open source file\n");
+  exit(4);
+  }
+if (!fnms[nfnidx])                      /* if not yet done,                  */
+  fnms[nfnidx] = strdup(name);          /* remember the file name            */
+while ((binlen = (int)fread(binlin, 1, sizeof(binlin), srcfile)) > 0)
+  {
+  sprintf(inpline, "%s", (lineno || (!lp)) ? "" : lp->name);
+  i = 0;
+  if ((binlen & (~1)) && (binlen > 7))
+    {
+    sprintf(inpline + strlen(inpline), "\tFCW\t" /* , (binlen & 1) ? 'B' : 'W' */);
+    for (; i < (binlen & ~1); i += 2)
+      sprintf(inpline + strlen(inpline), "%s$%02X%02X", (i) ? "," : "",
+              binlin[i], binlin[i + 1]);
+    expandline();
+    pNew = allocline(after, fnms[nfnidx], ++lineno, lvl, srcline,
+                     MEM_BINLINES);
+    if (!pNew)
+      {
+      errorout(name, (long)lineno, 22, "memory allocation error");
+      if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
+        putlist( "*** Error 22: memory allocation error\n");
+      exit(4);
+      }
+    if (!after)                         /* if 1st line                       */
+      rootline = pNew;                  /* remember it as root               */
+    after = pNew;                       /* insert behind the new line        */
+    inpline[0] = '\0';                  /* reset input line                  */
+    }
+  if ((binlen & 1) || (binlen <= 7))
+    {
+    fcbstart = i;
+    sprintf(inpline + strlen(inpline), "\tFCB\t");
+    for (; i < binlen; i++)
+      sprintf(inpline + strlen(inpline), "%s$%02X", (i > fcbstart) ? "," : "",
+              binlin[i]);
+
+    expandline();
+    pNew = allocline(after, fnms[nfnidx], ++lineno, lvl, srcline,
+                     MEM_BINLINES);
+    if (!pNew)
+      {
+      errorout(name, (long)lineno, 22, "memory allocation error");
+      if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
+        putlist( "*** Error 22: memory allocation error\n");
+      exit(4);
+      }
+    if (!after)                         /* if 1st line                       */
+      rootline = pNew;                  /* remember it as root               */
+    after = pNew;                       /* insert behind the new line        */
+    }
+  }
+fclose(srcfile);                        /* then close the file               */
+costfile[nfnidx].lines += lineno;
+stats.tload += steptime() - t;
+traceevent(name, "load", t, lvl, NULL, 0);
+return after;                           /* pass back last line inserted      */
+}
+
+/*****************************************************************************/
+/* setoptiontexts : sets up the option text variables                        */
+/*****************************************************************************/
+
+void setoptiontexts()
+{
+int i;
+                                        /* walk option list                  */
+for (i = 0; i < (sizeof(Options) / sizeof(Options[0])); i++)
+  {
+  if ((dwOptions & Options[i].dwAdd) ||
+      (!(dwOptions & ~Options[i].dwRem)))
+    settext(Options[i].Name, "1");
+  else
+    settext(Options[i].Name, "0");
+  }
+}
+
+/*****************************************************************************/
+/* setoption : processes an option string                                    */
+/*****************************************************************************/
+
+int setoption ( char *szOpt )
+{
+char iopt[4];
+int i;
+
+listsync();                             /* options are used by listing thread*/
+for (i = 0; szOpt[i] && i < sizeof(iopt); i++)
+  iopt[i] = toupper(szOpt[i]);
+if (i >= sizeof(iopt))
+  i--;
+iopt[i] = '\0';
+                                        /* search option list                */
+for (i = 0; i < (sizeof(Options) / sizeof(Options[0])); i++)
+  {
+  if (!strcmp(iopt, Options[i].Name))   /* if option found                   */
+    {
+    dwOptions |= Options[i].dwAdd;      /* add flags                         */
+    dwOptions &= ~Options[i].dwRem;     /* and remove flags                  */
+
+    switch (Options[i].dwAdd)           /* afterprocessing for specials:     */
+      {
+      case OPTION_M09 :                 /* switch to MC6809 processor        */
+        optable = optable09;
+        optablesize = sizeof(optable09) / sizeof(optable09[0]);
+        regtable = regtable09;
+        bitregtable = bitregtable09;
+        bitregtablesize = sizeof(bitregtable09) / sizeof(bitregtable09[0]);
+        scanoperands = scanoperands09;
+        break;
+      case OPTION_H09 :                 /* switch to HD6309 processor        */
+        optable = optable09;
+        optablesize = sizeof(optable09) / sizeof(optable09[0]);
+        regtable = regtable63;
+        bitregtable = bitregtable09;
+        bitregtablesize = sizeof(bitregtable09) / sizeof(bitregtable09[0]);
+        scanoperands = scanoperands09;
+        break;
+      case OPTION_M00 :                 /* switch to MC6800 processor        */
+        optable = optable00;
+        optablesize = sizeof(optable00) / sizeof(optable00[0]);
+        regtable = regtable00;
+        bitregtable = bitregtable00;
+        bitregtablesize = sizeof(bitregtable00) / sizeof(bitregtable00[0]);
+        scanoperands = scanoperands00;
+        break;
+      case OPTION_M01 :                 /* switch to MC6801 processor        */
+        optable = optable01;
+        optablesize = sizeof(optable01) / sizeof(optable01[0]);
+        regtable = regtable01;
+        bitregtable = bitregtable00;
+        bitregtablesize = sizeof(bitregtable00) / sizeof(bitregtable00[0]);
+        scanoperands = scanoperands00;
+        break;
+      case OPTION_H01 :                 /* switch to HD6301 processor        */
+        optable = optable01;
+        optablesize = sizeof(optable01) / sizeof(optable01[0]);
+        regtable = regtable01;
+        bitregtable = bitregtable00;
+        bitregtablesize = sizeof(bitregtable00) / sizeof(bitregtable00[0]);
+        scanoperands = scanoperands00;
+        break;
+      case OPTION_H11 :                 /* switch to 68HC11 processor        */
+        optable = optable11;
+        optablesize = sizeof(optable11) / sizeof(optable11[0]);
+        regtable = regtable11;
+        bitregtable = bitregtable00;
+        bitregtablesize = sizeof(bitregtable00) / sizeof(bitregtable00[0]);
+        scanoperands = scanoperands11;
+        break;
+      }
+
+    setoptiontexts();
+    return 0;                           /* then return OK                    */
+    }
+  }
+
+return 1;                               /* unknown option                    */
+}
+
+/*****************************************************************************/
+/* pseudoop : processes all known pseudo-ops                                 */
+/*****************************************************************************/
+
+void pseudoop(int co, struct symrecord * lp)
+{
+int i, j;
+char c, fillc;
+struct relocrecord p = {0};
+
+if (common &&                           /* if in COMMON definition mode      */
+    (co != PSEUDO_ENDCOM) &&            /* and this is neither ENDCOM        */
+    (co != PSEUDO_RMB))                 /* nor RMB                           */
+  error |= ERR_EXPR;                    /* this is an error.                 */
+
+switch (co)
+  {
+  case PSEUDO_ABS :                     /* ABS                               */
+    absmode = 1;                        /* reset mode to absolute            */
+    break;
+  case PSEUDO_DEF :                     /* DEFINE                            */
+    global++;                           /* all labels from now on are global */
+    break;
+  case PSEUDO_ENDDEF :                  /* ENDDEF                            */
+    if (global)                         /* all labels from now on are local  */
+      global--;
+    else
+      error |= ERR_EXPR;                /* must be paired                    */
+    break;
+  case PSEUDO_COMMON :                  /* label COMMON                      */
+    if (absmode)                        /* if in absolute assembler mode     */
+      error |= ERR_RELOCATING;
+    if (!lp)
+      error |= ERR_LABEL_MISSING;
+    else
+      lp->cat = SYMCAT_COMMON;
+    common++;                           /* go into common mode               */
+    commonsym = lp;                     /* remember common symbol            */
+    break;
+  case PSEUDO_ENDCOM :                  /* ENDCOM                            */
+    if (absmode)                        /* if in absolute assembler mode     */
+      error |= ERR_RELOCATING;
+    if (common)                         /* terminate common mode             */
+      common--;
+    else
+      error |= ERR_EXPR;                /* must be paired                    */
+    break;
+  case PSEUDO_FILL :                    /* [label] FILL <value>,<byte_count> */
+    operand = scanexpr(0, &p);
+    if (unknown)
+      error |= ERR_LABEL_UNDEF;
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (*srcptr == ',')                 /* skip count?                       */
+      {
+      fillc = (char)operand;
+      srcptr++;
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      goto DoFill;
+      }
+    else
+      error |= ERR_EXPR;
+    break;
+  case PSEUDO_RMB :                     /* [label] RMB <absolute expression> */
+  case PSEUDO_RZB :                     /* [label] RZB <absolute expression> */
+    fillc = (co == PSEUDO_RZB) ? 0 : rmbfillchr;
+  DoFill:
+    operand = scanexpr(0, &p);
+    if (unknown)
+      error |= ERR_LABEL_UNDEF;
+
+    if (common)                         /* if in common mode                 */
+      {
+      if (!lp || !commonsym)            /* without a label, only reserve the */
+        {                               /* space in the block                */
+        if (commonsym && pass == 1)
+          commonsym->value += (unsigned short)operand;
+        break;
+        }
+      if ((lp->cat != SYMCAT_EMPTY) &&
+          (lp->cat != SYMCAT_UNRESOLVED) &&
+          (lp->cat != SYMCAT_COMMONDATA))
+        error |= ERR_LABEL_MULT;
+      if (lp->cat != SYMCAT_COMMONDATA) /* if not yet done,                  */
+        {
+        lp->cat = SYMCAT_COMMONDATA;    /* set tymbol type                   */
+        lp->u.parent = commonsym;       /* remember COMMON symbol            */
+        lp->value = commonsym->value;   /* remember offset from COMMON symbol*/
+        commonsym->value +=             /* append # bytes to reserve to -"-  */
+            (unsigned short)operand;
+        }
+      break;
+      }
+
+    printovr |= PRINTOV_PADDR;          /* print address in listing          */
+    setlabel(lp);
+    if (generating && pass == 2)
+      {
+      if (co != PSEUDO_RMB ||
+          outmode == OUT_BIN ||
+          outmode == OUT_REL)
+        {
+        if (co != PSEUDO_RMB)           /* if filling with a value,          */
+          {                             /* fill codebuf first                */
+          if (!inMacro)
+            generating = 1;
+          for (i = 0; i < operand && i < sizeof(codebuf); i++)
+            putbyte(fillc);
+          operand -= i;
+          }
+        for (i = 0; i < operand; i++)   /* if too much, output rest directly */
+          outbyte(fillc, i);
+        }
+      else switch (outmode)
+        {
+        case OUT_SREC :                 /* Motorola S51-09 ?                 */
+          flushhex();
+          break;
+        case OUT_IHEX :                 /* Intel Hex ?                       */
+          flushihex();  
+          break;
+        case OUT_FLEX :                 /* FLEX binary ?                     */
+          flushflex();
+          break;
+        }
+      }   
+    loccounter += (unsigned short)operand;
+    if (!hexcount)                      /* unless record bytes are pending,  */
+      hexaddr = loccounter;             /* continue behind reserved area     */
+    break;  
+  case PSEUDO_EQU :                     /* label EQU x                       */
+    nRepNext = 0;                       /* reset eventual repeat             */
+    if (dwOptions & OPTION_LPA)         /* if listing in patch format,       */
+      curline->flg |= LINCAT_PEMTCMT;   /* prefix with comment               */
+    operand = scanexpr(0, &p);
+    if (!lp)
+      error |= ERR_LABEL_MISSING;
+    else
+      {
+      if (lp->cat == SYMCAT_EMPTY ||
+          lp->cat == SYMCAT_UNRESOLVED ||
+          (lp->value == (unsigned short)operand &&
+           pass == 2))
+        {
+        if (lp->cat != SYMCAT_PUBLIC)
+          {   
+          if (exprcat == EXPRCAT_INTADDR)
+            lp->cat = SYMCAT_LABEL;
+          else
+            lp->cat = SYMCAT_CONSTANT;
+          }
+        lp->value = (unsigned short)operand;
+        printovr |= PRINTOV_PLABEL;
+        }
+      else if (lp->cat == SYMCAT_PUBLICUNDEF ||
+               (lp->cat == SYMCAT_PUBLIC &&
+                lp->value == (unsigned short)operand))
+        {
+        lp->cat = SYMCAT_PUBLIC;
+        if (!(exprcat & (EXPRCAT_INTADDR | EXPRCAT_EXTADDR)))
+          lp->u.flags |= SYMFLAG_ABSOLUTE;
+        lp->value = (unsigned short)operand;
+        /* Doesn't look like it's necessary ...
+        p.addr = (unsigned short)operand;
+        addreloc(&p);
+        */
+        }
+      else
+        error |= ERR_LABEL_MULT;
+      }
+    break;
+  case PSEUDO_PUB :                     /* PUBLIC a[,b[,c...]]               */
+  case PSEUDO_EXT :                     /* EXTERN a[,b[,c...]]               */
+    nRepNext = 0;                       /* reset eventual repeat             */
+    skipspace();
+    while (isalnum(*srcptr))
+      {
+      scanname();                       /* parse option                      */
+      lp = findsym(namebuf, 1);         /* look up the symbol                */
+      switch (co)
+        {
+        case PSEUDO_PUB :               /* PUBLIC a[,b[,c...]]               */
+          if (lp->cat == SYMCAT_EMPTY ||
+              lp->cat == SYMCAT_UNRESOLVED)
+            lp->cat = SYMCAT_PUBLICUNDEF;
+          else if (lp->cat == SYMCAT_LABEL)
+            lp->cat = SYMCAT_PUBLIC;
+          else if (lp->cat == SYMCAT_PUBLICUNDEF)
+            error |= ERR_LABEL_UNDEF;
+          else if (lp->cat != SYMCAT_PUBLIC)
+            error |= ERR_LABEL_MULT;
+          break;
+        case PSEUDO_EXT :               /* EXTERN a[,b[,c...]]               */
+          if (absmode)                  /* if not in relocating asm mode,    */
+            error |= ERR_RELOCATING;    /* set error                         */
+          if (lp->cat == SYMCAT_EMPTY ||
+              lp->cat == SYMCAT_UNRESOLVED)
+            lp->cat = SYMCAT_EXTERN;
+          else if (lp->cat != SYMCAT_EXTERN)
+            error |= ERR_LABEL_MULT;
+          break;
+        }
+      if (*srcptr == ',')
+        {
+        srcptr++;
+        if (!(dwOptions & OPTION_TSC))
+          skipspace();
+        }
+      }
+    break;
+  case PSEUDO_FCB :                     /* [label] FCB expr[,expr...]        */
+    setlabel(lp);
+    if (!inMacro)
+      generating = 1;
+    do
+      {
+      if (*srcptr == ',')
+        srcptr++;
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      if (*srcptr == '\"')
+        {
+        srcptr++;
+        while (*srcptr != '\"' && *srcptr)
+          putbyte(*srcptr++);
+        if (*srcptr == '\"')
+          srcptr++; 
+        }
+      else
+        {
+        long ex = scanexpr(0, &p);
+        p.addr = (unsigned short)(loccounter + codeptr);
+        putbyte((unsigned char)ex);
+        p.exprcat |= EXPRCAT_ONEBYTE;
+        addreloc(&p);
+        if (unknown && pass == 2)
+          error |= ERR_LABEL_UNDEF;
+        }
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      } while (*srcptr == ',');
+    break; 
+  case PSEUDO_FCC :                     /* [label] FCC expr[,expr...]        */
+    setlabel(lp);
+    if (!inMacro)
+      generating = 1;
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (!(dwOptions & OPTION_TSC))      /* if standard                       */
+      {                                 /* accept ONE sequence with an       */
+      c = *srcptr++;                    /* arbitrary delimiter character     */
+      while (*srcptr != c && *srcptr)
+        putbyte(*srcptr++);
+      if (*srcptr == c)
+        srcptr++;
+      }
+    else                                /* if TSC extended format            */
+      {                                 /* accept MORE sequences             */
+      do
+        {
+        if (*srcptr == ',')
+          srcptr++;
+        if (!(dwOptions & OPTION_TSC))
+          skipspace();
+        c = *srcptr;
+        if ((c == '$') || isalnum(c))
+          {
+          long ex = scanexpr(0, &p);
+          p.addr = (unsigned short)(loccounter + codeptr);
+          putbyte((unsigned char)ex);
+          if (unknown && pass == 2)
+            error |= ERR_LABEL_UNDEF;
+          }
+        else
+          {
+          srcptr++;
+          while (*srcptr != c && *srcptr)
+            putbyte(*srcptr++);
+          if (*srcptr == c)
+            srcptr++;
+          }
+        if (!(dwOptions & OPTION_TSC))
+          skipspace();
+        } while (*srcptr == ',');
+      }
+    break;
+  case PSEUDO_FCW :                     /* [label] FCW,FDB  expr[,expr...]   */
+    setlabel(lp);
+    if (!inMacro)
+      generating = 1;
+    do
+      {
+      unsigned short us;
+
+      if (*srcptr == ',')
+        srcptr++;
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      us = (unsigned short)scanexpr(0, &p);
+      p.addr = (unsigned short)(loccounter + codeptr);
+      putword(us);
+      addreloc(&p);
+      if (unknown && pass == 2)
+        error |= ERR_LABEL_UNDEF; 
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();     
+      } while (*srcptr == ',');
+    break;
+  case PSEUDO_FCQ :                     /* [label] FCQ,FQB  expr[,expr...]   */
+    setlabel(lp);
+    if (!inMacro)
+      generating = 1;
+    do
+      {
+      if (*srcptr == ',')
+        srcptr++;
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      putdword(scanexpr(0, &p));
+      if (unknown && pass == 2)
+        error |= ERR_LABEL_UNDEF; 
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();     
+      } while (*srcptr == ',');
+    break;
+  case PSEUDO_ELSE :                    /* ELSE                              */
+    if (inMacro)                        /* don't process if in MACRO def.    */
+      break;
+    nRepNext = 0;                       /* reset eventual repeat             */
+    suppress = 1;
+    condline = 1;                       /* this is a conditional line        */
+    break;
+  case PSEUDO_ENDIF :                   /* ENDIF                             */
+    if (inMacro)                        /* don't process if in MACRO def.    */
+      break;
+    nRepNext = 0;                       /* reset eventual repeat             */
+    condline = 1;                       /* this is a conditional line        */
+    break;
+  case PSEUDO_IF :                      /* IF  <expression>[,<skip>]         */
+  case PSEUDO_IFN :                     /* IFN <expression>[,<skip>]         */
+    if (inMacro)                        /* don't process if in MACRO def.    */
+      break;
+    condline = 1;                       /* this is a conditional line        */
+    nRepNext = 0;                       /* reset eventual repeat             */
+    operand = scanexpr(0, &p);
+    if (unknown)
+      error |= ERR_LABEL_UNDEF;
+    if (co == PSEUDO_IFN)               /* if IFN                            */
+      operand = !operand;               /* reverse operand                   */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (*srcptr == ',')                 /* skip count?                       */
+      {
+      srcptr++;
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      nSkipCount = scanexpr(0, &p);
+      if (!operand)
+        nSkipCount = 0;
+      }
+    else if (!operand)
+      suppress = 2;
+    break;
+  case PSEUDO_IFC :                     /* IFC  <string1>,<string2>[,<skip>] */
+  case PSEUDO_IFNC :                    /* IFNC <string1>,<string2>[,<skip>] */
+    if (inMacro)                        /* don't process if in MACRO def.    */
+      break;
+    condline = 1;                       /* this is a conditional line        */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    scanstring(szBuf1, sizeof(szBuf1));
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (*srcptr != ',')                 /* if not on comma                   */
+      {
+      *szBuf2 = '\0';                   /* reset 2nd string                  */
+      error |= ERR_EXPR;                /* set error                         */
+      }
+    else
+      {
+      srcptr++;
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      scanstring(szBuf2, sizeof(szBuf2));
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      }
+    operand = !strcmp(szBuf1, szBuf2);
+    if (co == PSEUDO_IFNC)
+      operand = !operand;
+    if (*srcptr == ',')                 /* if skip count                     */
+      {
+      srcptr++;
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      nSkipCount = scanexpr(0, &p);
+      if (!operand)
+        nSkipCount = 0;
+      }
+    else if (!operand)
+      suppress = 2;
+    break;
+
+  case PSEUDO_IFD :                     /* IFD <symbol>[,skipcount]          */
+  case PSEUDO_IFND :                    /* IFND <symbol>[,skipcount]         */
+    /* ATTENTION: it is easy to produce phasing errors with these 2,         */
+    /*            since symbols are NOT reset when starting pass 2!          */
+    if (inMacro)                        /* don't process if in MACRO def.    */
+      break;
+    skipspace();
+    scanname();                         /* parse symbol name                 */
+    lp = findsym(namebuf, 0);           /* look up the symbol                */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (*srcptr == ',')                 /* if skip count                     */
+      {
+      srcptr++;
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      nSkipCount = scanexpr(0, &p);
+      if (!lp != (co == PSEUDO_IFND))
+        nSkipCount = 0;
+      }
+                                        /* if no skip count and NOT matched  */
+    else if (!lp != (co == PSEUDO_IFND))
+      suppress = 2;                     /* suppress until ELSE or ENDIF      */
+    condline = 1;                       /* this is a conditional line        */
     break;
 
   case PSEUDO_ORG :                     /* ORG <expression>                  */
@@ -6939,1686 +9091,4552 @@ switch (co)
       error |= ERR_RELOCATING;          /* set error                         */
       break;                            /* and ignore                        */
       }
-    if (generating && pass == 2)
+    if (generating && pass == 2)
+      {
+      switch (outmode)
+        {
+        case OUT_BIN :                  /* binary output file                */
+          j = (int)(unsigned short)operand - (int)loccounter;
+          if (j > 0)                    /* if forward gap                    */
+            {                           /* get current pos and file end      */
+            long pos = ftell(objfile);
+            long avbytes = fseek(objfile, 0, SEEK_END) - pos;
+            fseek(objfile, pos, SEEK_SET);
+            for (i = 0; i < j; i++)     /* seek forward that many bytes      */
+              {
+              if (i < avbytes)
+                fseek(objfile, 1, SEEK_CUR);
+              else if (dwOptions & OPTION_FBG)
+                fputc(rmbfillchr, objfile);
+              }
+            }
+          else                          /* if backward gap                   */
+            {
+            j = -j;
+            if (dwOptions & OPTION_FBG) /* and we're filling gaps,           */
+              for (i = 0; i < j; i++)   /* seek back that many bytes         */
+                fseek(objfile, -1, SEEK_CUR);
+            }
+          break;
+        case OUT_SREC :                 /* motorola s51-09                   */
+          flushhex();  
+          break;
+        case OUT_IHEX :                 /* intel hex format                  */
+          flushihex();  
+          break;
+        case OUT_FLEX :                 /* FLEX binary                       */
+          flushflex();
+          break;
+        case OUT_REL :                  /* RELASMB output                    */
+          break;
+        }
+      }
+    loccounter = (unsigned short)operand;
+    hexaddr = loccounter;
+    break;
+  case PSEUDO_SETDP :                   /* SETDP [<abs page value>]          */
+    nRepNext = 0;                       /* reset eventual repeat             */
+    skipspace();
+    if ((!*srcptr) || (*srcptr == '*') || (*srcptr == ';'))
+      operand = -1;
+    else
+      operand = scanexpr(0, &p);
+    if (unknown)
+      error |= ERR_LABEL_UNDEF;
+    if (!(operand & 255))
+      operand = (unsigned short)operand >> 8;
+    if ((unsigned)operand > 255)
+      operand = -1;
+    if (absmode)
+      {
+      dpsetting = operand;
+      printovr |= PRINTOV_PDP;
+      }
+    else
+      error |= ERR_RELOCATING;
+    break;
+  case PSEUDO_SET :                     /* label SET <non external expr>     */
+    nRepNext = 0;                       /* reset eventual repeat             */
+    operand = scanexpr(0, &p);
+    if (!lp)
+      error |= ERR_LABEL_MISSING;
+    else
+      {
+      if (lp->cat & SYMCAT_VARIABLE ||
+          lp->cat == SYMCAT_UNRESOLVED)
+        {
+        if (exprcat == EXPRCAT_INTADDR)
+          lp->cat = SYMCAT_VARADDR;
+        else
+          lp->cat = SYMCAT_VARIABLE;
+        lp->value = (unsigned short)operand;
+        printovr |= PRINTOV_PLABEL;
+        }
+      else
+        error |= ERR_LABEL_MULT;
+      }
+    break;
+  case PSEUDO_END :                     /* END [loadaddr]                    */
+    nRepNext = 0;                       /* reset possible repeat             */
+    skipspace();                        /* skip blanks                       */
+    if (!(curline->lvl & LINCAT_LVLMASK))  /* only in outermost level!       */
+      {
+      if (isfactorstart(*srcptr))       /* if possible transfer address      */
+        {
+        tfradr = (unsigned short)       /* get transfer address              */
+            scanexpr(0, &p);
+        if (error)                      /* if error in here                  */
+          tfradr = 0;                   /* reset to zero                     */
+        else                            /* otherwise                         */
+          {
+          tfradrset = 1;                /* remember transfer addr. is set    */
+          printovr |= PRINTOV_PTFR;
+          }
+        }
+      }
+                                        /* terminate current level           */
+    g_termflg = (curline->lvl & LINCAT_LVLMASK);  /* (and any sublevels)     */
+    break;     
+  case PSEUDO_INCLUDE :                 /* INCLUDE <filename>                */
+    nRepNext = 0;                       /* reset eventual repeat             */
+    if (inMacro ||                      /* if in macro definition            */
+        (curline->flg & LINCAT_MACEXP)) /* or macro expansion                */
+      error |= ERR_EXPR;                /* this is an error.                 */
+    else if (pass == 1)                 /* otherwise expand if in pass 1     */
+      {
+      char fname[FNLEN + 1];
+      int instring = 0;
+      char *osrc = srcptr;
+                                        /* if impossible                     */
+      if ((curline->lvl & LINCAT_LVLMASK) == LINCAT_LVLMASK)
+        {
+#if 0
+        allocline(curline, "NULL", -1, 0x0f,
+                  "Error including file - nesting level too deep",
+                  MEM_SRCLINES);
+#endif
+        error |= ERR_MALLOC;            /* set OUT OF MEMORY error           */
+        break;
+        }
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      if (*srcptr == '\"')
+        {
+        srcptr++;
+        instring = 1;
+        }
+      for (i = 0; i < FNLEN; i++)
+        {
+        if (*srcptr == 0 ||
+            (!instring && *srcptr == ' ') ||
+            *srcptr == '"')
+          break;
+        fname[i] = *srcptr++;
+        }
+      fname[i] = 0;
+      curline->flg |= LINCAT_INVISIBLE; /* preclude listing of INCLUDE line  */
+                                        
+      readfile(fname,                   /* append include after current line */
+               (unsigned char)((curline->lvl & LINCAT_LVLMASK) + 1),
+               curline);
+      expandtext();                     /* re-expand current line            */
+      srcptr = osrc;
+      }
+    break; 
+  case PSEUDO_OPT :                     /* OPT,OPTION  option[,option...]    */
+    nRepNext = 0;                       /* reset eventual repeat             */
+    skipspace();
+    while (isalnum(*srcptr))
+      {
+      scanname();                       /* parse option                      */
+      if (setoption(unamebuf))
+        error |= ERR_OPTION_UNK;
+      if (*srcptr == ',')
+        {
+        srcptr++;
+        if (!(dwOptions & OPTION_TSC))
+          skipspace();
+        }
+      }
+    break;
+  case PSEUDO_NAM :                     /* NAM,TTL <text>                    */
+  case PSEUDO_STTL :                    /* STTL <text>                       */
+    nRepNext = 0;                       /* reset eventual repeat             */
+    listsync();                         /* titles are used by listing thread */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (isalnum(*srcptr))
+      {
+      char *tgt = (co == PSEUDO_NAM) ? szTitle : szSubtitle;
+      char *lnblnk = tgt;
+      int nBytes = 0;
+      while (*srcptr && nBytes < (sizeof(szTitle) - 1))
+        {
+        if (*srcptr != ' ')
+          lnblnk = tgt;
+        *tgt++ = *srcptr++;
+        nBytes++;
+        }
+      lnblnk[1] = '\0';                 /* terminate after last nonblank     */
+      while (*srcptr)                   /* skip rest if too long             */
+        srcptr++;
+      }
+    break;
+  case PSEUDO_PAG :                     /* PAG [<abs expression>]            */
+    listsync();                         /* page # is used by listing thread  */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (isfactorstart(*srcptr))         /* if possible new page number       */
+      {
+      int nPage = scanexpr(0, &p);      /* get new page #                    */
+      if (!error && listfile)           /* if valid and writing listfile     */
+        nCurPage = nPage - 1;
+      else
+        break;
+      }
+    curline->flg |= LINCAT_INVISIBLE;
+    if ((listing & LIST_ON) && listfile &&
+        (dwOptions & OPTION_PAG) &&
+        (!(curline->lvl & LINCAT_LVLMASK) || (dwOptions & OPTION_LLL)) &&
+        (pass > 1 || (dwOptions & OPTION_LP1)))
+      PageFeed();
+    break;
+  case PSEUDO_SPC :                     /* SPC <n[,keep]>                    */
+    {
+    int nSpc = 1, nKeep = 0;
+    listsync();                         /* line # is used by listing thread  */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (isfactorstart(*srcptr))         /* if possible new page number       */
+      {
+      nSpc = scanexpr(0, &p);           /* get # space lines                 */
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      if (*srcptr == ',')               /* if followed by ,                  */
+        {
+        srcptr++;
+        if (!(dwOptions & OPTION_TSC))
+          skipspace();
+        nKeep = scanexpr(0, &p);        /* get # keep lines                  */
+        }
+      if (error)
+        break;
+      }
+    curline->flg |= LINCAT_INVISIBLE;
+    if (listing & LIST_ON)
+      {
+      if (nSpc > 0)                     /* if spaces needed                  */
+        {
+        if ((dwOptions & OPTION_PAG) &&
+            (nCurLine + nSpc + nKeep >= nLinesPerPage))
+          PageFeed();
+        else for (; nSpc; nSpc--)
+          putlist("\n");
+        }
+      else if (nKeep &&
+          (dwOptions & OPTION_PAG) &&
+          (nCurLine + nKeep >= nLinesPerPage))
+        PageFeed();
+      }
+    }
+    break;
+  case PSEUDO_REP :                     /* REP n                             */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    nRepNext = scanexpr(0, &p);         /* get # repetitions                 */
+    curline->flg |= LINCAT_INVISIBLE;
+    break;
+  case PSEUDO_SETPG :                   /* SETPG pagelen                     */
+    listsync();                         /* used by listing thread            */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    nLinesPerPage = scanexpr(0, &p);    /* get # lines per page              */
+    if (nLinesPerPage < 10)             /* adjust to boundary values         */
+      nLinesPerPage = 10;
+    else if (nLinesPerPage > 1000)
+      nLinesPerPage = 1000;
+    curline->flg |= LINCAT_INVISIBLE;
+    break;
+  case PSEUDO_SETLI :                   /* SETLI linelen                     */
+    listsync();                         /* used by listing thread            */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    nColsPerLine = scanexpr(0, &p);     /* get # columns per line            */
+    if (nColsPerLine < 40)              /* adjust to boundary values         */
+      nColsPerLine = 40;
+    else if (nColsPerLine > 2000)
+      nColsPerLine = 2000;
+    curline->flg |= LINCAT_INVISIBLE;
+    break;
+  case PSEUDO_SYMLEN :                  /* SYMLEN symbollength               */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    maxidlen = scanexpr(0, &p);         /* get # significant ID places       */
+    if (maxidlen < 6)                   /* adjust to boundary values         */
+      maxidlen = 6;
+    else if ((outmode == OUT_REL) &&
+             (maxidlen > 8))
+      maxidlen = 8;
+    else if (maxidlen > MAXIDLEN)
+      maxidlen = MAXIDLEN;
+    curline->flg |= LINCAT_INVISIBLE;
+    break;
+  case PSEUDO_MACRO :                   /* label MACRO                       */
+    if (!lp)                            /* a macro NEEDS a label!            */
+      error |= ERR_LABEL_MISSING;
+    if (lp->cat == SYMCAT_EMPTY)
+      {
+      if (nMacros < MAXMACROS)          /* if space for another macro defin. */
+        {
+        lp->cat = SYMCAT_MACRO;         /* remember it's a macro             */
+        macros[nMacros] = curline;      /* remember pointer to start line    */
+        lp->value = nMacros++;          /* and remember the macro            */
+        }
+      else
+        error |= ERR_MALLOC;
+      }
+    else if (lp->cat != SYMCAT_MACRO ||
+             macros[lp->value] != curline)
+      error |= ERR_LABEL_MULT;
+    inMacro++;
+    curline->flg |= LINCAT_MACDEF;
+    if (inMacro > 1)
+      error |= ERR_NESTING;
+    break;
+  case PSEUDO_ENDM :                    /* ENDM                              */
+    if (inMacro)
+      inMacro--;
+    else
+      {
+      if (lvlMacro)
+        lvlMacro--;
+      if (!(curline->flg & LINCAT_MACEXP))
+        error |= ERR_EXPR;
+      }
+    break;
+  case PSEUDO_EXITM :                   /* EXITM                             */
+    if (inMacro)
+      ;
+    else
+      {
+      if (lvlMacro)
+        lvlMacro--;
+      if (!(curline->flg & LINCAT_MACEXP))
+        error |= ERR_EXPR;
+      }
+    break;
+  case PSEUDO_REG :                     /* label REG <register list>         */
+    if (!lp)                            /* label is mandatory!               */
+      error |= ERR_LABEL_MISSING;
+    {
+    struct regrecord *p;
+    postbyte = 0;
+    do
+      {
+      if (*srcptr == ',')
+        srcptr++;
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      scanname(); 
+      if ((p = findreg(unamebuf)) == 0)
+        error |= ERR_ILLEGAL_ADDR;
+      else
+        postbyte |= p->psh; 
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      } while (*srcptr == ',');
+    if (lp->cat == SYMCAT_EMPTY)
+      {
+      lp->cat = SYMCAT_REG;
+      lp->value = postbyte;
+      }
+    else if (lp->cat != SYMCAT_REG ||
+             lp->value != postbyte)
+      error |= ERR_LABEL_MULT;
+    }
+    break;
+  case PSEUDO_ERR :                     /* ERR text?                         */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (pass != 1)                      /* ignore in pass 1                  */
+      {
+      errormsg[14] = srcptr;
+      error |= ERR_ERRTXT;
+      }
+    break;
+  case PSEUDO_WRN :                     /* WRN text?                         */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (pass != 1)                      /* ignore in pass 1                  */
+      {
+      warningmsg[14] = srcptr;
+      warning |= WRN_WRNTXT;
+      }
+    break;
+  case PSEUDO_TEXT :                    /* TEXT text ?                       */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (!lp)                            /* label is mandatory!               */
+      error |= ERR_LABEL_MISSING;
+    else if (lp->cat != SYMCAT_EMPTY && /* and must be text, if there        */
+             lp->cat != SYMCAT_TEXT)
+      error |= ERR_LABEL_MULT;
+    else                                /* if all OK, (re)define text        */
+      {
+      scanstring(szBuf1, sizeof(szBuf1));
+      settext(lp->name, szBuf1);
+      }
+    break;
+  case PSEUDO_NAME :                    /* NAME <modulename> ?               */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    scanname();
+    if (!namebuf[0])                    /* name must be given                */
+      error |= ERR_EXPR;
+#if 0
+    // gcc 9.1.0 flags this as "output may be truncated" (well, duh!), so use sprintf instead
+    strncpy(modulename, namebuf, maxidlen);
+    modulename[maxidlen] = '\0';
+#else
+    sprintf(modulename, "%.*s", maxidlen, namebuf);
+#endif
+    break;
+  case PSEUDO_BINARY :                  /* BIN[ARY] <filename> ?             */
+    nRepNext = 0;                       /* reset eventual repeat             */
+    if (pass == 1)                      /* expand if in pass 1               */
+      {
+      char fname[FNLEN + 1];
+      int instring = 0;
+      char *osrc = srcptr;
+
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      if (*srcptr == '\"')
+        {
+        srcptr++;
+        instring = 1;
+        }
+      for (i = 0; i < FNLEN; i++)
+        {
+        if (*srcptr == 0 ||
+            (!instring && *srcptr == ' ') ||
+            *srcptr == '"')
+          break;
+        fname[i] = *srcptr++;
+        }
+      fname[i] = 0;
+      curline->flg |= LINCAT_INVISIBLE; /* preclude listing of BINARY line   */
+                                        
+      readbinary(fname,                 /* append binary after current line  */
+               (unsigned char)((curline->lvl & LINCAT_LVLMASK) + 1),
+               curline, lp);
+      expandtext();                     /* re-expand current line            */
+      srcptr = osrc;
+      }
+    break; 
+  case PSEUDO_PHASE :                   /* PHASE address ?                   */
+    nRepNext = 0;                       /* reset eventual repeat             */
+    operand = scanexpr(0, &p);
+    if (unknown)
+      error |= ERR_LABEL_UNDEF;
+    if (relocatable &&                  /* if in relocating assembler mode   */
+        (!absmode))
+      {
+      error |= ERR_RELOCATING;          /* set error                         */
+      break;                            /* and ignore                        */
+      }
+    /* ... now act on operand! */
+    phase = (int)operand - (int)loccounter;
+    printovr |= PRINTOV_PPHA;
+    break;
+  case PSEUDO_DEPHASE :                 /* DEPHASE ?                         */
+    /* end last PHASE */
+    phase = 0;
+    printovr |= PRINTOV_PPHA;
+    break;
+  case PSEUDO_PEMT :                    /* PEMT <text>                       */
+    nRepNext = 0;                       /* reset eventual repeat             */
+    skipspace();
+    if (isalnum(*srcptr))
       {
-      switch (outmode)
+      char *tgt = szBuf1;
+      char *lnblnk = tgt;
+      int nBytes = 0;
+      while (*srcptr && nBytes < (sizeof(szBuf1) - 1))
         {
-        case OUT_BIN :                  /* binary output file                */
-          j = (int)(unsigned short)operand - (int)loccounter;
-          if (j > 0)                    /* if forward gap                    */
-            {                           /* get current pos and file end      */
-            long pos = ftell(objfile);
-            long avbytes = fseek(objfile, 0, SEEK_END) - pos;
-            fseek(objfile, pos, SEEK_SET);
-            for (i = 0; i < j; i++)     /* seek forward that many bytes      */
-              {
-              if (i < avbytes)
-                fseek(objfile, 1, SEEK_CUR);
-              else if (dwOptions & OPTION_FBG)
-                fputc(rmbfillchr, objfile);
-              }
-            }
-          else                          /* if backward gap                   */
-            {
-            j = -j;
-            if (dwOptions & OPTION_FBG) /* and we're filling gaps,           */
-              for (i = 0; i < j; i++)   /* seek back that many bytes         */
-                fseek(objfile, -1, SEEK_CUR);
-            }
-          break;
-        case OUT_SREC :                 /* motorola s51-09                   */
-          flushhex();  
-          break;
-        case OUT_IHEX :                 /* intel hex format                  */
-          flushihex();  
-          break;
-        case OUT_FLEX :                 /* FLEX binary                       */
-          flushflex();
-          break;
-        case OUT_REL :                  /* RELASMB output                    */
-          break;
+        if (*srcptr != ' ')
+          lnblnk = tgt;
+        *tgt++ = *srcptr++;
+        nBytes++;
         }
+      lnblnk[1] = '\0';                 /* terminate after last nonblank     */
+      while (*srcptr)                   /* skip rest if too long             */
+        srcptr++;
+      if (!(dwOptions & OPTION_LPA))
+        curline->flg |= LINCAT_INVISIBLE;
       }
-    loccounter = (unsigned short)operand;
-    hexaddr = loccounter;
     break;
-  case PSEUDO_SETDP :                   /* SETDP [<abs page value>]          */
-    nRepNext = 0;                       /* reset eventual repeat             */
-    skipspace();
-    if ((!*srcptr) || (*srcptr == '*') || (*srcptr == ';'))
-      operand = -1;
-    else
-      operand = scanexpr(0, &p);
-    if (unknown)
-      error |= ERR_LABEL_UNDEF;
-    if (!(operand & 255))
-      operand = (unsigned short)operand >> 8;
-    if ((unsigned)operand > 255)
-      operand = -1;
-    if (absmode)
+  }
+}
+
+/*****************************************************************************/
+/* macskip : skips a range of macro lines                                    */
+/*****************************************************************************/
+
+struct linebuf *macskip(struct linebuf *pmac, int nSkips)
+{
+if (nSkips < 0)                         /* we need to go to the line BEFORE  */
+  nSkips--;                             /* the one we need!                  */
+while (nSkips)
+  {
+  if (nSkips < 0)
+    {
+    if (!pmac->prev)
+      break;
+    pmac = pmac->prev;
+    nSkips++;
+    }
+  else
+    {
+    if (!pmac->next)
+      break;
+    pmac = pmac->next;
+    nSkips--;
+    }
+  }
+return pmac;
+}
+
+/*****************************************************************************/
+/* expandmacro : expands a macro definition below the current line           */
+/*****************************************************************************/
+
+void expandmacro(struct symrecord *lp, struct symrecord *lpmac)
+{
+struct oprecord *op;
+char szMacInv[LINELEN];                 /* macro invocation line             */
+char szLine[LINELEN];                   /* current macro line                */
+char *szMacParm[10];
+char *s, *d;                            /* source / destination work pointers*/
+char *srcsave = srcptr;
+struct linebuf *cursave = curline;
+int nMacParms = 1;
+int nInString = 0;
+                                        /* current macro line                */
+struct linebuf *pmac = macros[lpmac->value]->next;
+struct linebuf *pcur = curline;         /* current expanded macro line       */
+struct linebuf *pdup = NULL;            /* DUP start line                    */
+int nDup = 0;                           /* # repetitions for DUP             */
+int terminate = 0;                      /* terminate macro expansion if set  */
+int skipit = 0;                         /* skip this line                    */
+int suppress[64] = {0};                 /* internal suppression (max.64 lvl) */
+int ifcount = 0;                        /* internal if counter               */
+int curlvl = curline->lvl & LINCAT_LVLMASK;
+struct relocrecord p = {0};
+double t = steptime();
+
+stats.macros++;
+#if 0
+if ((listing & LIST_ON) &&              /* if listing pass 1                 */
+    (dwOptions & OPTION_LIS) &&
+    (dwOptions & OPTION_LP1) &&
+    (dwOptions & OPTION_MAC))
+  outlist(NULL, NULL);                  /* show macro invocation BEFORE      */
+                                        /* processing the expansions         */
+#endif
+
+skipspace();                            /* skip spaces before macro args     */
+
+if (!lp)                                /* if no macro label                 */
+  szMacParm[0] = "";                    /* set &0 to blank                   */
+else                                    /* otherwise                         */
+  szMacParm[0] = lp->name;              /* set &0 to line label              */
+                                        /* initialize all parameters to ""   */
+for (nMacParms = 1; nMacParms < 10; nMacParms++)
+  szMacParm[nMacParms] = "";
+nMacParms = 1;                          /* reset # parsed parms to 1         */
+
+strcpy(szMacInv, srcptr);               /* copy the current line for mangling*/
+srcptr = szMacInv;                      /* set pointer to internal buffer    */
+
+while (*srcptr)                         /* while there are parameters        */
+  {
+  if (*srcptr == ',')                   /* if parameter delimiter            */
+    {
+    *srcptr++ = '\0';                   /* delimit & advance behind it       */
+    if (!(dwOptions & OPTION_TSC))
+      skipspace();
+    if (++nMacParms >= 10)
+      break;
+    }
+  else                                  /* otherwise walk thru parameter     */
+    {
+    szMacParm[nMacParms] = srcptr;      /* store parameter start pointer     */
+    if ((*srcptr == '\'') ||            /* if delimited string               */
+        (*srcptr == '\"'))
       {
-      dpsetting = operand;
-      printovr |= PRINTOV_PDP;
+      nInString = 1;                    /* remember we're in delimited strg  */
+      srcptr++;
       }
-    else
-      error |= ERR_RELOCATING;
-    break;
-  case PSEUDO_SET :                     /* label SET <non external expr>     */
-    nRepNext = 0;                       /* reset eventual repeat             */
-    operand = scanexpr(0, &p);
-    if (!lp)
-      error |= ERR_LABEL_MISSING;
-    else
+    while (*srcptr)                     /* walk to end of parameter          */
+      {
+      if (!nInString &&
+          ((*srcptr == ' ') || (*srcptr == ',')))
+        break;
+      else if (nInString &&
+              *srcptr == *szMacParm[nMacParms])
+        {
+        szMacParm[nMacParms]++;
+        *srcptr++ = '\0';
+        break;
+        }
+      else
+        srcptr++;
+      }
+    if (*srcptr == ' ')                 /* ' ' terminates in TSC             */
       {
-      if (lp->cat & SYMCAT_VARIABLE ||
-          lp->cat == SYMCAT_UNRESOLVED)
+      if (dwOptions & OPTION_TSC)
         {
-        if (exprcat == EXPRCAT_INTADDR)
-          lp->cat = SYMCAT_VARADDR;
-        else
-          lp->cat = SYMCAT_VARIABLE;
-        lp->value = (unsigned short)operand;
-        printovr |= PRINTOV_PLABEL;
+        *srcptr++ = '\0';
+        break;
         }
       else
-        error |= ERR_LABEL_MULT;
+        skipspace();
       }
-    break;
-  case PSEUDO_END :                     /* END [loadaddr]                    */
-    nRepNext = 0;                       /* reset possible repeat             */
-    skipspace();                        /* skip blanks                       */
-    if (!(curline->lvl & LINCAT_LVLMASK))  /* only in outermost level!       */
+    else if (*srcptr == ',')            /* advance to next                   */
       {
-      if (isfactorstart(*srcptr))       /* if possible transfer address      */
+      *srcptr++ = '\0';
+      if (++nMacParms >= 10)
+        break;
+      if (!(dwOptions & OPTION_TSC))
+        skipspace();
+      }
+    }
+  }
+
+/*---------------------------------------------------------------------------*/
+/* OK, got macro arguments &0...&9 now                                       */
+/*---------------------------------------------------------------------------*/
+
+while (pmac)                            /* walk through the macro lines      */
+  {
+  srcptr = s = pmac->txt;
+  d = szLine;
+  op = NULL;
+  skipit = 0;
+
+  while (*s)                            /* first, expand the line            */
+    {
+    if (*s == '\\' && s[1] == '&')
+      {
+      s++;
+      *d++ = *s++;
+      }
+    else if (*s == '&')
+      {
+      if (s[1] >= '0' && s[1] <= '9')
         {
-        tfradr = (unsigned short)       /* get transfer address              */
-            scanexpr(0, &p);
-        if (error)                      /* if error in here                  */
-          tfradr = 0;                   /* reset to zero                     */
-        else                            /* otherwise                         */
-          {
-          tfradrset = 1;                /* remember transfer addr. is set    */
-          printovr |= PRINTOV_PTFR;
+        char *from = szMacParm[s[1] - '0'];
+        int i = 0, j = (int)(d - szLine);
+        for (; j < LINELEN && from[i]; i++, j++)
+          *d++ = from[i];
+        s += 2;
+        }
+      else
+        {
+        struct symrecord *lp;
+        char iname[sizeof(namebuf)];
+        char *nc;
+        parsename(s + 1, &nc);
+        sprintf(iname, "&%.*s", (int)(sizeof(iname) - 2), namebuf);
+        lp = findsym(iname, 0);
+        if (lp && *namebuf &&           /* if symbol IS a text constant,     */
+            (lp->cat == SYMCAT_TEXT))
+          {                             /* insert its content                */
+          int i = 0, j = (int)(d - szLine);
+          char *from = texts[lp->value];
+          for (; j < LINELEN && from[i]; i++, j++)
+            *d++ = from[i];
+          s = nc;
           }
+        else
+          *d++ = *s++;
         }
       }
-                                        /* terminate current level           */
-    g_termflg = (curline->lvl & LINCAT_LVLMASK);  /* (and any sublevels)     */
-    break;     
-  case PSEUDO_INCLUDE :                 /* INCLUDE <filename>                */
-    nRepNext = 0;                       /* reset eventual repeat             */
-    if (inMacro ||                      /* if in macro definition            */
-        (curline->flg & LINCAT_MACEXP)) /* or macro expansion                */
-      error |= ERR_EXPR;                /* this is an error.                 */
-    else if (pass == 1)                 /* otherwise expand if in pass 1     */
+    else
+      *d++ = *s++;
+    }
+  *d = '\0';
+
+  srcptr = szLine;                      /* then, look whether code or macro  */
+  if (isalnum(*srcptr))
+    {
+    scanname();
+    lp = findsym(namebuf, 1);
+    if (*srcptr == ':')
+      srcptr++;
+    } 
+  skipspace();
+  if (isalnum(*srcptr))                 /* then parse opcode                 */
+    {
+    scanname(); 
+    op = findop(unamebuf);
+    }
+  skipspace();                          /* and skip to eventual parameter    */
+
+  if (op && op->cat == OPCAT_PSEUDO)    /* if pseudo-op                      */
+    {
+    switch (op->code)                   /* examine for macro expansion       */
       {
-      char fname[FNLEN + 1];
-      int instring = 0;
-      char *osrc = srcptr;
-                                        /* if impossible                     */
-      if ((curline->lvl & LINCAT_LVLMASK) == LINCAT_LVLMASK)
-        {
-#if 0
-        allocline(curline, "NULL", -1, 0x0f,
-                  "Error including file - nesting level too deep");
-#endif
-        error |= ERR_MALLOC;            /* set OUT OF MEMORY error           */
+      case PSEUDO_ENDM :                /* ENDM ?                            */
+        terminate = 1;                  /* terminate macro expansion         */
+        break;
+      case PSEUDO_EXITM :               /* EXITM ?                           */
+        if (!suppress[ifcount])         /* if not suppressed                 */
+          terminate = 1;                /* terminate macro expansion         */
+        break;
+      case PSEUDO_DUP :                 /* DUP ?                             */
+        if (pdup != NULL)               /* nesting not allowed               */
+          error |= ERR_NESTING;
+        else
+          {
+          nDup = scanexpr(0, &p);       /* scan the expression               */
+          pdup = pmac;                  /* remember DUP start line           */
+          if (nDup < 1 || nDup > 255)   /* if invalid # repetitions          */
+            {
+            error |= ERR_EXPR;          /* set error here                    */
+            nDup = 1;
+            }
+          else
+            skipit = 1;                 /* skip this line                    */
+          }
+        break;
+      case PSEUDO_ENDD :                /* ENDD ?                            */
+        if (!pdup)                      /* if no DUP defined                 */
+          error |= ERR_EXPR;            /* can't do that here.               */
+        else
+          {
+          nDup--;                       /* decrement # duplications          */
+          if (!nDup)                    /* if done,                          */
+            pdup = NULL;                /* reset dup start                   */
+          else                          /* otherwise                         */
+            pmac = pdup;                /* reset current line to DUP op      */
+          skipit = 1;                   /* this line isn't really there      */
+          }
+        break;
+      case PSEUDO_IF :                  /* IF                                */
+      case PSEUDO_IFN :                 /* IFN                               */
+        ifcount++;                      /* increment # ifs                   */
+                                        /* take suppression from higher level*/
+        suppress[ifcount] = suppress[ifcount - 1];
+        if (suppress[ifcount])          /* if already suppressed             */
+          suppress[ifcount]++;          /* inrease # suppressions            */
+        else                            /* otherwise evaluate expression     */
+          {
+          operand = scanexpr(0, &p);
+          if (unknown)
+            error |= ERR_LABEL_UNDEF;
+          if (op->code == PSEUDO_IFN)   /* if IFN                            */
+            operand = !operand;         /* invert operand                    */
+          if (!operand)                 /* if evaulation to zer0             */
+            suppress[ifcount]++;        /* suppress until ELSE or ENDIF      */
+          if (!(dwOptions & OPTION_TSC))
+            skipspace();
+          if (*srcptr == ',')           /* if skip count passed              */
+            {
+            int nSkips;
+            srcptr++;
+            if (!(dwOptions & OPTION_TSC))
+              skipspace();
+            nSkips = scanexpr(0, &p);   /* scan skip count                   */
+            ifcount--;                  /* this needs no ENDIF               */
+            if (nSkips < -255 || nSkips > 255 || nSkips == 0)
+              {
+              error |= ERR_EXPR;
+              break;
+              }
+            if (operand)                /* if evaluation is true             */
+              pmac = macskip(pmac, nSkips); /* then skip the amount of lines */
+            }
+          }
+        skipit = 1;                     /* don't add this line!              */
+        break;
+      case PSEUDO_IFC :                 /* IFC                               */
+      case PSEUDO_IFNC :                /* IFNC                              */
+        ifcount++;                      /* increment # ifs                   */
+                                        /* take suppression from higher level*/
+        suppress[ifcount] = suppress[ifcount - 1];
+        if (suppress[ifcount])          /* if already suppressed             */
+          suppress[ifcount]++;          /* inrease # suppressions            */
+        else                            /* otherwise evaluate expression     */
+          {
+          if (!(dwOptions & OPTION_TSC))
+            skipspace();
+          scanstring(szBuf1, sizeof(szBuf1));
+          if (!(dwOptions & OPTION_TSC))
+            skipspace();
+          if (*srcptr != ',')           /* if not on comma                   */
+            {
+            *szBuf2 = '\0';             /* reset 2nd string                  */
+            error |= ERR_EXPR;          /* set error                         */
+            }
+          else
+            {
+            srcptr++;
+            if (!(dwOptions & OPTION_TSC))
+              skipspace();
+            scanstring(szBuf2, sizeof(szBuf2));
+            }
+          operand = !strcmp(szBuf1, szBuf2);
+          if (op->code == PSEUDO_IFNC)
+            operand = !operand;
+          if (!operand)                 /* if evaulation to zer0             */
+            suppress[ifcount]++;        /* suppress until ELSE or ENDIF      */
+          if (!(dwOptions & OPTION_TSC))
+            skipspace();
+          if (*srcptr == ',')           /* if skip count passed              */
+            {
+            int nSkips;
+            srcptr++;
+            if (!(dwOptions & OPTION_TSC))
+              skipspace();
+            nSkips = scanexpr(0, &p);   /* scan skip count                   */
+            ifcount--;                  /* this needs no ENDIF               */
+            if (nSkips < -255 || nSkips > 255 || nSkips == 0)
+              {
+              error |= ERR_EXPR;
+              break;
+              }
+            if (operand)                /* if evaluation is true             */
+              pmac = macskip(pmac, nSkips); /* then skip the amount of lines */
+            }
+          }
+        if (!error)
+          skipit = 1;                   /* don't add this line!              */
         break;
-        }
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      if (*srcptr == '\"')
-        {
-        srcptr++;
-        instring = 1;
-        }
-      for (i = 0; i < FNLEN; i++)
-        {
-        if (*srcptr == 0 ||
-            (!instring && *srcptr == ' ') ||
-            *srcptr == '"')
-          break;
-        fname[i] = *srcptr++;
-        }
-      fname[i] = 0;
-      curline->flg |= LINCAT_INVISIBLE; /* preclude listing of INCLUDE line  */
-                                        
-      readfile(fname,                   /* append include after current line */
-               (unsigned char)((curline->lvl & LINCAT_LVLMASK) + 1),
-               curline);
-      expandtext();                     /* re-expand current line            */
-      srcptr = osrc;
-      }
-    break; 
-  case PSEUDO_OPT :                     /* OPT,OPTION  option[,option...]    */
-    nRepNext = 0;                       /* reset eventual repeat             */
-    skipspace();
-    while (isalnum(*srcptr))
-      {
-      scanname();                       /* parse option                      */
-      if (setoption(unamebuf))
-        error |= ERR_OPTION_UNK;
-      if (*srcptr == ',')
-        {
-        srcptr++;
-        if (!(dwOptions & OPTION_TSC))
-          skipspace();
-        }
-      }
-    break;
-  case PSEUDO_NAM :                     /* NAM,TTL <text>                    */
-  case PSEUDO_STTL :                    /* STTL <text>                       */
-    nRepNext = 0;                       /* reset eventual repeat             */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (isalnum(*srcptr))
-      {
-      char *tgt = (co == PSEUDO_NAM) ? szTitle : szSubtitle;
-      char *lnblnk = tgt;
-      int nBytes = 0;
-      while (*srcptr && nBytes < (sizeof(szTitle) - 1))
-        {
-        if (*srcptr != ' ')
-          lnblnk = tgt;
-        *tgt++ = *srcptr++;
-        nBytes++;
-        }
-      lnblnk[1] = '\0';                 /* terminate after last nonblank     */
-      while (*srcptr)                   /* skip rest if too long             */
-        srcptr++;
-      }
-    break;
-  case PSEUDO_PAG :                     /* PAG [<abs expression>]            */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (isfactorstart(*srcptr))         /* if possible new page number       */
-      {
-      int nPage = scanexpr(0, &p);      /* get new page #                    */
-      if (!error && listfile)           /* if valid and writing listfile     */
-        nCurPage = nPage - 1;
-      else
+      case PSEUDO_ELSE :                /* ELSE                              */
+        if (!suppress[ifcount])         /* if IF not suppressed              */
+          suppress[ifcount]++;          /* suppress ELSE clause              */
+        else                            /* otherwise                         */
+          suppress[ifcount]--;          /* decrement suppression             */
+        skipit = 1;                     /* don't add this line!              */
+        break;
+      case PSEUDO_ENDIF :               /* ENDIF                             */
+        if (ifcount)
+          ifcount--;
+        if (suppress[ifcount])
+          suppress[ifcount]--;
+        skipit = 1;                     /* don't add this line!              */
         break;
       }
-    curline->flg |= LINCAT_INVISIBLE;
-    if ((listing & LIST_ON) && listfile &&
-        (dwOptions & OPTION_PAG) &&
-        (!(curline->lvl & LINCAT_LVLMASK) || (dwOptions & OPTION_LLL)) &&
-        (pass > 1 || (dwOptions & OPTION_LP1)))
-      PageFeed();
-    break;
-  case PSEUDO_SPC :                     /* SPC <n[,keep]>                    */
-    {
-    int nSpc = 1, nKeep = 0;
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (isfactorstart(*srcptr))         /* if possible new page number       */
+    }
+
+  if (!skipit && !suppress[ifcount])    /* if not skipping this one          */
+    {                                   /* add line to source                */
+    pcur = allocline(pcur, curline->fn, curline->ln,
+                     (unsigned char)curlvl, szLine, MEM_MACLINES);
+    if (!pcur)
       {
-      nSpc = scanexpr(0, &p);           /* get # space lines                 */
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      if (*srcptr == ',')               /* if followed by ,                  */
-        {
-        srcptr++;
-        if (!(dwOptions & OPTION_TSC))
-          skipspace();
-        nKeep = scanexpr(0, &p);        /* get # keep lines                  */
-        }
-      if (error)
-        break;
+      error |= ERR_MALLOC;
+      break;
       }
-    curline->flg |= LINCAT_INVISIBLE;
-    if (listing & LIST_ON)
+    else
       {
-      if (nSpc > 0)                     /* if spaces needed                  */
-        {
-        if ((dwOptions & OPTION_PAG) &&
-            (nCurLine + nSpc + nKeep >= nLinesPerPage))
-          PageFeed();
-        else for (; nSpc; nSpc--)
-          putlist("\n");
-        }
-      else if (nKeep &&
-          (dwOptions & OPTION_PAG) &&
-          (nCurLine + nKeep >= nLinesPerPage))
-        PageFeed();
+      pcur->flg = LINCAT_MACEXP;        /* mark as macro expansion           */
+      pcur->mac = (short)lpmac->value;  /* remember where it came from       */
+      costmac[lpmac->value].lines++;
+      stats.macrolines++;
+      curline = pcur;
+      error = ERR_OK;
+      warning = WRN_OK;
+      expandtext();
       }
     }
-    break;
-  case PSEUDO_REP :                     /* REP n                             */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    nRepNext = scanexpr(0, &p);         /* get # repetitions                 */
-    curline->flg |= LINCAT_INVISIBLE;
-    break;
-  case PSEUDO_SETPG :                   /* SETPG pagelen                     */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    nLinesPerPage = scanexpr(0, &p);    /* get # lines per page              */
-    if (nLinesPerPage < 10)             /* adjust to boundary values         */
-      nLinesPerPage = 10;
-    else if (nLinesPerPage > 1000)
-      nLinesPerPage = 1000;
-    curline->flg |= LINCAT_INVISIBLE;
-    break;
-  case PSEUDO_SETLI :                   /* SETLI linelen                     */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    nColsPerLine = scanexpr(0, &p);     /* get # columns per line            */
-    if (nColsPerLine < 40)              /* adjust to boundary values         */
-      nColsPerLine = 40;
-    else if (nColsPerLine > 2000)
-      nColsPerLine = 2000;
-    curline->flg |= LINCAT_INVISIBLE;
-    break;
-  case PSEUDO_SYMLEN :                  /* SYMLEN symbollength               */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    maxidlen = scanexpr(0, &p);         /* get # significant ID places       */
-    if (maxidlen < 6)                   /* adjust to boundary values         */
-      maxidlen = 6;
-    else if ((outmode == OUT_REL) &&
-             (maxidlen > 8))
-      maxidlen = 8;
-    else if (maxidlen > MAXIDLEN)
-      maxidlen = MAXIDLEN;
-    curline->flg |= LINCAT_INVISIBLE;
-    break;
-  case PSEUDO_MACRO :                   /* label MACRO                       */
-    if (!lp)                            /* a macro NEEDS a label!            */
-      error |= ERR_LABEL_MISSING;
-    if (lp->cat == SYMCAT_EMPTY)
+
+  if (terminate)                        /* if macro termination needed       */
+    break;                              /* terminate here                    */
+
+  pmac = pmac->next;
+  }
+
+curline = cursave;
+expandtext();
+srcptr = srcsave;                       /* restore source pointer            */
+codeptr = 0;
+traceevent(lpmac->name, "macro", t, lvlMacro, curline->fn, curline->ln);
+costmac[lpmac->value].calls++;
+if (costing)                            /* expansion is charged to the macro */
+  {
+  t = stattime() - t;
+  costmac[lpmac->value].t12[1] += t;
+  costnested += t;
+  }
+}
+
+/*****************************************************************************/
+/* processline : processes a source line                                     */
+/*****************************************************************************/
+
+void processline()
+{
+struct symrecord *lp, *lpLabel = NULL, *lpmac = NULL;
+struct oprecord *op = NULL;
+int co;
+unsigned short cat;
+char c;
+char noimm;
+unsigned short page;
+char nomac = 0;
+
+#if 0
+srcptr = curline->txt;
+#else
+srcptr = srcline;
+#endif
+
+oldlc = loccounter;
+unknown = 0;
+certain = 1;
+lp = 0;
+codeptr = 0;
+condline = 0;
+printovr = 0;
+xrefkind = XREF_READ;
+stats.lines[(int)pass]++;
+
+if (inMacro)
+  curline->flg |= LINCAT_MACDEF;
+
+if (isValidNameChar(*srcptr, 1))        /* look for label on line start      */
+  {
+  scanname();
+  lp = findsym(namebuf, 1);
+  if (*srcptr == ':')                   /* skip : following label            */
+    srcptr++;
+
+  if (lp)
+    {
+    if ((lp->cat != SYMCAT_COMMONDATA) &&
+        (lp->u.flags & SYMFLAG_FORWARD))
+      lp->u.flags |= SYMFLAG_PASSED;
+    if ((absmode) &&
+        (lp->cat == SYMCAT_PUBLICUNDEF ||
+         lp->cat == SYMCAT_PUBLIC))
+      lp->u.flags |= SYMFLAG_ABSOLUTE;
+    }
+
+  lpLabel = lp;
+  addxref(lp, XREF_DEF);                /* remember definition site          */
+  } 
+skipspace();
+
+if (*srcptr == '\\')                    /* if macro explicitly prohibited    */
+  {
+  srcptr++;
+  nomac = 1;
+  }
+
+if (isValidNameChar(*srcptr, 1))        /* mnemonic or macro name            */
+  {
+  scanname();
+  if (!nomac)                           /* if macro allowed                  */
+    lpmac = findsym(namebuf, 0);        /* look whether opcode is a macro    */
+  if (lpmac && lpmac->cat == SYMCAT_MACRO)
+    {
+    if (pass == 1 &&                    /* if in pass 1 and not in macro def */
+        !LINE_IS_MACDEF(curline->flg))
+      {                                 /* if on top level,                  */
+      if (!LINE_IS_MACEXP(curline->flg))
+        curline->flg |= LINCAT_MACINV;  /* mark as macro invocation          */
+      if (dwOptions & OPTION_DLM)
+        setlabel(lp);
+      if (++lvlMacro <= LINCAT_LVLMASK)
+        expandmacro(lp, lpmac);         /* expand macro below current line   */
+      else                              /* unless nesting level is too deep  */
+        error |= ERR_NESTING;
+      }
+    }
+  else                                  /* no macro, so check mnemonics      */
+    {
+    if ((dwOptions & OPTION_H09) &&     /* adjust some mnemonics             */
+        ((!strcmp(unamebuf, "ASLD")) || /* that are available in the 6309    */
+        (!strcmp(unamebuf, "ASRD")) ||  /* but are implemented as (slower)   */
+        (!strcmp(unamebuf, "LSLD")) ||  /* convenience instructions on the   */
+        (!strcmp(unamebuf, "LSRD")) ||  /* 6809                              */
+        (!strcmp(unamebuf, "DECD")) ||
+        (!strcmp(unamebuf, "INCD")) ||
+        (!strcmp(unamebuf, "CLRD"))))
+      strcat(unamebuf, "63");
+    op = findop(unamebuf);
+    if (op)
       {
-      if (nMacros < MAXMACROS)          /* if space for another macro defin. */
+      if ((dwOptions & OPTION_TSC))     /* if TSC compatible, skip space NOW */
+        skipspace();                    /* since it's not allowed inside arg */
+      if (op->cat != OPCAT_PSEUDO)
         {
-        lp->cat = SYMCAT_MACRO;         /* remember it's a macro             */
-        macros[nMacros] = curline;      /* remember pointer to start line    */
-        lp->value = nMacros++;          /* and remember the macro            */
+        setlabel(lp);
+        if (!inMacro)
+          generating = 1;
         }
-      else
-        error |= ERR_MALLOC;
-      }
-    else if (lp->cat != SYMCAT_MACRO ||
-             macros[lp->value] != curline)
-      error |= ERR_LABEL_MULT;
-    inMacro++;
-    curline->flg |= LINCAT_MACDEF;
-    if (inMacro > 1)
-      error |= ERR_NESTING;
-    break;
-  case PSEUDO_ENDM :                    /* ENDM                              */
-    if (inMacro)
-      inMacro--;
-    else
-      {
-      if (lvlMacro)
-        lvlMacro--;
-      if (!(curline->flg & LINCAT_MACEXP))
+      co = op->code;
+      cat = op->cat;
+      if (xrefing)                      /* classify only if recording        */
+        xrefkind = xrefopkind(op);
+                                        /* only pseudo-ops in common mode!   */
+      if (common && (cat != OPCAT_PSEUDO))
         error |= ERR_EXPR;
+
+      noimm = cat & OPCAT_NOIMM;        /* isolate "no immediate possible"   */
+      cat &= ~OPCAT_NOIMM;
+      if (dwOptions & OPTION_H11)       /* if in 86HC11 mode,                */
+        {                               /* isolate pageXX flag               */
+        page = cat & (OPCAT_PAGE18 | OPCAT_PAGE1A);
+        cat &= ~(OPCAT_PAGE18 | OPCAT_PAGE1A);
+        }
+      if (dwOptions & OPTION_H09)       /* if in HD6309 mode,                */
+        cat &= ~OPCAT_6309;             /* mask out the 6309 flag (=allow)   */
+      if (dwOptions & OPTION_H01)       /* if in HD6301 mode,                */
+        cat &= ~OPCAT_6301;             /* mask out the 6301 flag (=allow)   */
+      switch (cat)
+        {
+        case OPCAT_ONEBYTE :
+          onebyte(co);
+          break;
+        case OPCAT_TWOBYTE :
+          twobyte(co);
+          break;
+        case OPCAT_THREEBYTE :
+          threebyte(co);
+          break;
+        case OPCAT_FOURBYTE :
+          fourbyte(co);
+          break;
+        case OPCAT_2IMMBYTE :           /* 6309 only                         */
+          putbyte((unsigned char)(co >> 8));
+          /* fall thru on purpose! */
+        case OPCAT_IMMBYTE :
+          oneimm(co);
+          break;
+        case OPCAT_LEA :
+          lea(co);
+          break;
+        case OPCAT_SBRANCH :
+          sbranch(co);
+          break;
+        case OPCAT_LBR2BYTE :
+          lbranch(co);
+          break;
+        case OPCAT_LBR1BYTE :
+          lbra(co);
+          break;
+        case OPCAT_2ARITH :             /* 6309 only                         */
+          putbyte((unsigned char)(co >> 8));
+          /* fall thru on purpose! */
+        case OPCAT_ARITH :
+          arith(co, noimm);
+          break;
+        case OPCAT_ACCARITH :           /* 6800-style arith                  */
+          accarith(co, noimm, 0);
+          break;
+        case OPCAT_OACCARITH :          /* potential 6800-style arith        */
+          accarith(co, noimm, 1);
+          break;
+        case OPCAT_DBLREG1BYTE :
+          if ((dwOptions & OPTION_H11) && (page & OPCAT_PAGE18))
+            darith18(co, noimm);
+          else if ((dwOptions & OPTION_H11) && (page & OPCAT_PAGE1A))
+            darith1a(co, noimm);
+          else
+            darith(co, noimm);
+          break;
+        case OPCAT_DBLREG2BYTE :
+          d2arith(co, noimm);
+          break;
+        case OPCAT_SINGLEADDR :
+          oneaddr(co);
+          break;
+        case OPCAT_IREG :                 /* 6309 only                         */
+          putbyte((unsigned char)(co >> 8));
+          /* fall thru on purpose! */
+        case OPCAT_2REG :
+          tfrexg(co);
+          break;
+        case OPCAT_STACK :
+          pshpul(co, 0);
+          break;
+        case OPCAT_BITDIRECT :          /* 6301/6309 only                    */
+          bitdirect(co);
+          break;
+        case OPCAT_BITTRANS :           /* 6309 only                         */
+          bittrans(co);
+          break;
+        case OPCAT_BLOCKTRANS :         /* 6309 only                         */
+          blocktrans(co);
+          break;
+        case OPCAT_QUADREG1BYTE :
+          qarith(co, noimm);
+          break;
+        case OPCAT_IDXEXT :
+          idxextarith(co);
+          break;
+        case OPCAT_ACCADDR :
+          accaddr(co);
+          break;
+        case OPCAT_SETMASK :            /* 68HC11 only                       */
+          setmask(co);
+          break;
+        case OPCAT_BRMASK :             /* 68HC11 only                       */
+          brmask(co);
+          break;
+        case OPCAT_OSTACK :
+          pshpul(co, 1);
+          break;
+        case OPCAT_PSEUDO :
+          pseudoop(co, lp);
+          break;
+        default :
+          error |= ERR_ILLEGAL_MNEM;
+          break;
+        }
+      c = *srcptr;                      /* get current character             */
+      if (((dwOptions & OPTION_TSC) && (c == '*')) ||
+          ((dwOptions & OPTION_GAS) && (c == '|')) ||
+          (c == ';'))
+        c = '\0';
+      if (c != ' ' &&
+          *(srcptr - 1) != ' ' &&
+          c != '\0')
+        error |= ERR_ILLEGAL_ADDR; 
       }
-    break;
-  case PSEUDO_EXITM :                   /* EXITM                             */
-    if (inMacro)
-      ;
     else
-      {
-      if (lvlMacro)
-        lvlMacro--;
-      if (!(curline->flg & LINCAT_MACEXP))
-        error |= ERR_EXPR;
-      }
-    break;
-  case PSEUDO_REG :                     /* label REG <register list>         */
-    if (!lp)                            /* label is mandatory!               */
-      error |= ERR_LABEL_MISSING;
+      error |= ERR_ILLEGAL_MNEM;
+    }
+  }
+else
+  {
+  nRepNext = 0;                         /* reset possible repeat if no code  */
+  setlabel(lp);
+  c = *srcptr;                          /* now look where we are at ...      */
+  if ((c == '*') ||
+      ((dwOptions & OPTION_GAS) && (c == '|')) ||
+      (c == ';'))
+    c = '\0';
+  if (c)                                /* if NOT empty or comment,          */
+    error |= ERR_EXPR;                  /* mark as invalid expression        */
+  }
+
+if (inMacro)                            /* if in macro definition            */
+  {
+  codeptr = 0;                          /* ignore the code                   */
+  error &= (ERR_MALLOC | ERR_NESTING);  /* ignore most errors                */
+  warning &= WRN_SYM;                   /* ignore most warnings              */
+  }
+
+if (pass == 2)
+  {
+  outbuffer();
+  if (jsonfile)
+    outjson();
+  if ((listing & LIST_ON) &&
+      (dwOptions & OPTION_LIS))
+    listline(op, lpLabel);
+  }
+else if ((listing & LIST_ON) &&
+         (dwOptions & OPTION_LIS) &&
+         (dwOptions & OPTION_LP1))
+  {
+  if (curline->flg & LINCAT_MACEXP ||   /* prevent 2nd listing of macro      */
+      !curline->next ||                 /* since this is done in expansion   */
+      !(curline->next->flg & LINCAT_MACEXP))
+    listline(op, lpLabel);
+  }
+
+if (error || warning)
+  report();
+loccounter += codeptr;
+}
+
+/*****************************************************************************/
+/* suppressline : suppresses a line                                          */
+/*****************************************************************************/
+
+void suppressline()
+{
+struct oprecord * op = NULL;
+
+srcptr = srcline;
+oldlc = loccounter;
+codeptr = 0;
+condline = 0;
+if (nSkipCount > 0)
+  {
+  nSkipCount--;
+  condline = 1;                         /* this is STILL conditional         */
+  }
+else
+  {
+  if (isalnum(*srcptr))
     {
-    struct regrecord *p;
-    postbyte = 0;
-    do
+    scanname();
+    if (*srcptr == ':')
+      srcptr++;
+    }
+  skipspace();
+  scanname();
+  op = findop(unamebuf);
+  if (op && op->cat == OPCAT_PSEUDO)    /* examine pseudo-ops in detail      */
+    {
+    if ((op->code == PSEUDO_IF) ||      /* IF variants                       */
+        (op->code == PSEUDO_IFN) ||
+        (op->code == PSEUDO_IFC) ||
+        (op->code == PSEUDO_IFNC) ||
+        (op->code == PSEUDO_IFD) ||
+        (op->code == PSEUDO_IFND))
       {
-      if (*srcptr == ',')
-        srcptr++;
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      scanname(); 
-      if ((p = findreg(unamebuf)) == 0)
-        error |= ERR_ILLEGAL_ADDR;
-      else
-        postbyte |= p->psh; 
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      } while (*srcptr == ',');
-    if (lp->cat == SYMCAT_EMPTY)
+      ifcount++;
+      condline = 1;                     /* this is a conditional line        */
+      }
+    else if (op->code == PSEUDO_ENDIF)  /* ENDIF                             */
       {
-      lp->cat = SYMCAT_REG;
-      lp->value = postbyte;
+      if (ifcount > 0)
+        ifcount--;
+      else if (suppress == 1 || suppress == 2)
+        suppress = 0;
+      condline = 1;                     /* this is a conditional line        */
       }
-    else if (lp->cat != SYMCAT_REG ||
-             lp->value != postbyte)
-      error |= ERR_LABEL_MULT;
-    }
-    break;
-  case PSEUDO_ERR :                     /* ERR text?                         */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (pass != 1)                      /* ignore in pass 1                  */
+    else if (op->code == PSEUDO_ELSE)   /* ELSE                              */
       {
-      errormsg[14] = srcptr;
-      error |= ERR_ERRTXT;
+      if (ifcount == 0 && suppress == 2)
+        suppress = 0;
+      condline = 1;                     /* this is a conditional line        */
       }
-    break;
-  case PSEUDO_WRN :                     /* WRN text?                         */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (pass != 1)                      /* ignore in pass 1                  */
+    }  
+  }
+
+if ((pass == 2) && jsonfile)
+  outjson();
+if (((pass == 2) || (dwOptions & OPTION_LP1)) &&
+    (listing & LIST_ON) &&
+    (dwOptions & OPTION_LIS))
+  listline(op, NULL);
+}
+
+/*****************************************************************************/
+/* outstats : prints the statistics                                          */
+/*****************************************************************************/
+
+void outstats()
+{
+FILE *fp;
+long peakkb = 0;
+int i;
+#if UNIX
+struct rusage ru;
+
+if (!getrusage(RUSAGE_SELF, &ru))
+#if defined(__APPLE__)
+  peakkb = ru.ru_maxrss / 1024;         /* macOS reports bytes               */
+#else
+  peakkb = ru.ru_maxrss;                /* Linux / BSD report KB             */
+#endif
+#endif
+
+if (!statsname[0])                      /* human-readable form               */
+  {
+  printf("Statistics:\n");
+  printf("  load ............. %9.3f ms\n", stats.tload * 1000.);
+  printf("  pass 1 ........... %9.3f ms\n", stats.tpass[1] * 1000.);
+  printf("  pass 2 ........... %9.3f ms\n", stats.tpass[2] * 1000.);
+  printf("  listing .......... %9.3f ms%s\n", stats.tlist * 1000.,
+         (LISTTHREAD && (listing & LIST_ON) && !(dwOptions & OPTION_LPA)) ?
+             " (in parallel to pass 2)" : "");
+  printf("  output flush ..... %9.3f ms\n", stats.toutput * 1000.);
+  printf("  total ............ %9.3f ms\n", stats.ttotal * 1000.);
+  printf("  lines ............ %9ld / %ld\n", stats.lines[1], stats.lines[2]);
+  printf("  findsym .......... %9ld calls, %ld probes\n",
+         stats.findsym, stats.findsymprobes);
+  printf("  findop ........... %9ld calls, %ld probes\n",
+         stats.findop, stats.findopprobes);
+  printf("  macro expansions . %9ld, %ld lines\n",
+         stats.macros, stats.macrolines);
+  printf("  includes ......... %9ld\n", stats.includes);
+  printf("  relocations ...... %9ld\n", relcounter);
+  printf("  bytes emitted .... %9ld\n", stats.bytes);
+  printf("  peak memory ...... %9ld KB, %ld KB of it accounted for\n",
+         peakkb, (memacct[MEM_COUNT].peak + 1023) / 1024);
+  return;
+  }
+
+fp = strcmp(statsname, "-") ?           /* "-" writes JSON to the console    */
+         fopen(statsname, "w") : conopen();
+if (!fp)
+  {
+  errorout(srcname, 0, 31, "cannot write statistics file %s", statsname);
+  return;
+  }
+fprintf(fp, "{\"version\":\"%s\",\"src\":", VERSION);
+jsonstring(fp, srcname);
+fprintf(fp, ",\"time\":{\"load\":%.6f,\"pass1\":%.6f,\"pass2\":%.6f,"
+        "\"listing\":%.6f,\"output\":%.6f,\"total\":%.6f},",
+        stats.tload, stats.tpass[1], stats.tpass[2],
+        stats.tlist, stats.toutput, stats.ttotal);
+fprintf(fp, "\"lines\":[%ld,%ld],\"findsym\":{\"calls\":%ld,\"probes\":%ld},"
+        "\"findop\":{\"calls\":%ld,\"probes\":%ld},",
+        stats.lines[1], stats.lines[2], stats.findsym, stats.findsymprobes,
+        stats.findop, stats.findopprobes);
+fprintf(fp, "\"macros\":{\"expansions\":%ld,\"lines\":%ld},\"includes\":%ld,"
+        "\"relocations\":%ld,\"bytes\":%ld,\"peakkb\":%ld,",
+        stats.macros, stats.macrolines, stats.includes,
+        relcounter, stats.bytes, peakkb);
+fprintf(fp, "\"memory\":{");
+for (i = 0; i <= MEM_COUNT; i++)
+  {
+  fprintf(fp, "%s", i ? "," : "");
+  jsonstring(fp, memacct[i].name);
+  fprintf(fp, ":{\"cur\":%ld,\"peak\":%ld,\"allocs\":%ld}",
+          memacct[i].cur, memacct[i].peak, memacct[i].allocs);
+  }
+fprintf(fp, "}}\n");
+if (strcmp(statsname, "-"))
+  fclose(fp);
+else
+  conclose(fp);
+}
+
+/*****************************************************************************/
+/* usage : prints out correct usage                                          */
+/*****************************************************************************/
+
+void usage(char *nm)
+{
+printf("Usage: %s [-option*] srcname*\n",
+       nm ? nm : "a09");
+printf("Available options are:\n");
+printf("-B[objname] ........ output to binary file (default)\n");
+printf("-F[objname] ........ output to FLEX binary file\n");
+/* printf("-G[objname] ........ output Gnu .o format file\n"); */
+printf("-R[objname] ........ output to FLEX relocatable object file\n");
+printf("-S[objname] ........ output to Motorola S51-09 file\n");
+printf("-X[objname] ........ output to Intel Hex file\n");
+printf("-Z[objname] ........ output to LZ-compressed self-extracting binary\n");
+printf("-L[listname] ....... create listing file \n");
+printf("-J[jsonname] ....... create JSON Lines listing file\n");
+printf("-Pprevname[,base] .. write only changes against previous build image\n");
+printf("                     (S-record, Intel Hex or FLEX output only)\n");
+printf("-Mgap .............. merge changed ranges up to gap bytes apart\n");
+printf("-xref[=xrefname] ... write indexed cross-reference database\n");
+printf("-stats[=jsonname] .. print timing and counters (JSON to file or -)\n");
+printf("-trace[=tracename] . write Chrome trace events of the assembly\n");
+printf("-mem ............... report memory usage after each pass\n");
+printf("-cost[=costname] ... report costs per macro and source file\n");
+printf("                     (at the end of the listing, if there is one)\n");
+printf("-nofast ............ disable fast paths (reference engine)\n");
+printf("-maxerr N .......... stop the assembly after N errors\n");
+printf("-failfast .......... stop after pass 1 if it produced errors\n");
+printf("-batch ............. assemble each file as a module of its own\n");
+printf("-jobs N ............ assemble a batch in N parallel processes\n");
+#if UNIX
+printf("-watch ............. assemble again whenever a source file changes\n");
+printf("-pch header ........ assemble header first, using a precompiled\n");
+printf("                     snapshot (header.pch) while it's up to date\n");
+#endif
+printf("-cache dir ......... reuse the output of an identical earlier assembly\n");
+printf("-sym[=symname] ..... write symbol file (default srcname.sym)\n");
+printf("-i symname ......... import symbols from a symbol file as constants\n");
+printf("-link[=base] ....... link FLEX relocatable modules (srcname*.rel)\n");
+printf("                     into the output file, from base (hex) on;\n");
+printf("                     library members only as far as needed\n");
+printf("-mklib libname ..... bundle FLEX relocatable modules\n");
+printf("                     (srcname*.rel) into an indexed library\n");
+printf("-MD ................ write make dependencies (objname.d)\n");
+printf("-MF depname ........ write make dependencies to depname\n");
+printf("-C ................. suppress code output\n");
+printf("-Dsymbol[=value] ... predefines a symbol\n");
+printf("                     for TSC 6809 Assembler compatibility,\n");
+printf("                     you should only use symbols A through C\n");
+printf("-Ooption ........... sets an option (as in OPT pseudoop)\n");
+printf("-W ................. suppress warnings\n");
+#if UNIX
+printf("-serve socket ...... serve assemblies on a UNIX domain socket\n");
+printf("-client socket ..... let a server assemble (if there is one)\n");
+printf("                     (both only as the first option)\n");
+#endif
+printf("srcname ............ source file name(s)\n");
+
+exit(2);
+}
+
+/*****************************************************************************/
+/* getlongoption : processes a long option; returns 1 if it is one, 2 if it  */
+/*                 consumed the next argument, too                           */
+/*****************************************************************************/
+
+int getlongoption(char *arg, char *next)
+{
+char *val;
+size_t len;
+
+if (*arg == '-')                        /* "--name" is accepted, too         */
+  arg++;
+val = strchr(arg, '=');
+len = val ? (size_t)(val - arg) : strlen(arg);
+if (len == 4 && !strncmp(arg, "xref", 4))
+  {                                     /* cross-reference database          */
+  strcpy(xrefname, val ? val + 1 : "");
+  xreffile = 1;
+  return 1;
+  }
+if (len == 5 && !strncmp(arg, "trace", 5))
+  {                                     /* Chrome trace event file           */
+  strcpy(tracename, val ? val + 1 : "");
+  tracing = 1;
+  return 1;
+  }
+if (len == 3 && !strncmp(arg, "mem", 3))
+  {                                     /* memory report                     */
+  memreport = 1;
+  return 1;
+  }
+if (len == 4 && !strncmp(arg, "cost", 4))
+  {                                     /* cost attribution report           */
+  strcpy(costname, val ? val + 1 : "");
+  costing = 1;
+  return 1;
+  }
+if (len == 5 && !strncmp(arg, "stats", 5))
+  {                                     /* statistics                        */
+  strcpy(statsname, val ? val + 1 : "");
+  statsing = 1;
+  return 1;
+  }
+if (len == 6 && !strncmp(arg, "nofast", 6))
+  {                                     /* reference engine, no fast paths   */
+  fastpaths = 0;
+  return 1;
+  }
+if (len == 6 && !strncmp(arg, "maxerr", 6))
+  {                                     /* error limit, as "-maxerr=N" or    */
+  if (!val && !next)                    /* "-maxerr N"                       */
+    usage(NULL);
+  maxerrors = strtol(val ? val + 1 : next, NULL, 0);
+  return val ? 1 : 2;
+  }
+if (len == 8 && !strncmp(arg, "failfast", 8))
+  {                                     /* stop after pass 1 with errors     */
+  failfast = 1;
+  return 1;
+  }
+if (len == 5 && !strncmp(arg, "watch", 5))
+  {                                     /* reassemble whenever a file changes*/
+  watchmode = 1;
+  return 1;
+  }
+if (len == 3 && !strncmp(arg, "pch", 3))
+  {                                     /* precompiled header, as "-pch=hdr" */
+  if (!val && !next)                    /* or "-pch hdr"                     */
+    usage(NULL);
+  strcpy(pchname, val ? val + 1 : next);
+  return val ? 1 : 2;
+  }
+if (len == 2 && !strncmp(arg, "MD", 2))
+  {                                     /* make dependencies                 */
+  depfile = 1;
+  return 1;
+  }
+if (len == 2 && !strncmp(arg, "MF", 2))
+  {                                     /* dependency file, as "-MF=name" or */
+  if (!val && !next)                    /* "-MF name"                        */
+    usage(NULL);
+  strcpy(depname, val ? val + 1 : next);
+  depfile = 1;
+  return val ? 1 : 2;
+  }
+if (len == 3 && !strncmp(arg, "sym", 3))
+  {                                     /* symbol file                       */
+  strcpy(symname, val ? val + 1 : "");
+  symfile = 1;
+  return 1;
+  }
+if (len == 1 && *arg == 'i')
+  {                                     /* symbol file to import, as         */
+  if (!val && !next)                    /* "-i=name" or "-i name"            */
+    usage(NULL);
+  if (nsymimports < MAXIMPORTS)
+    strcpy(symimports[nsymimports++], val ? val + 1 : next);
+  return val ? 1 : 2;
+  }
+if (len == 4 && !strncmp(arg, "link", 4))
+  {                                     /* link .rel modules, as "-link" or  */
+  linkmode = 1;                         /* "-link=base"                      */
+  linkbase = val ? (unsigned short)strtol(val + 1 + (val[1] == '$'), NULL, 16)
+                 : 0;
+  return 1;
+  }
+if (len == 5 && !strncmp(arg, "mklib", 5))
+  {                                     /* write .rel library, as            */
+  if (!val && !next)                    /* "-mklib=name" or "-mklib name"    */
+    usage(NULL);
+  strcpy(libname, val ? val + 1 : next);
+  return val ? 1 : 2;
+  }
+if (len == 5 && !strncmp(arg, "cache", 5))
+  {                                     /* output cache, as "-cache=dir" or  */
+  if (!val && !next)                    /* "-cache dir"                      */
+    usage(NULL);
+  strcpy(cachedir, val ? val + 1 : next);
+  return val ? 1 : 2;
+  }
+if (len == 5 && !strncmp(arg, "batch", 5))
+  {                                     /* assemble each file as a module    */
+  batchmode = 1;
+  return 1;
+  }
+if (len == 4 && !strncmp(arg, "jobs", 4))
+  {                                     /* # batch workers, as "-jobs=N" or  */
+  if (!val && !next)                    /* "-jobs N"                         */
+    usage(NULL);
+  batchjobs = atoi(val ? val + 1 : next);
+  if (batchjobs < 1)
+    batchjobs = 1;
+  return val ? 1 : 2;
+  }
+return 0;
+}
+
+/*****************************************************************************/
+/* getoptions : retrieves the options from the passed argument array         */
+/*****************************************************************************/
+
+void getoptions (int argc, char* argv[])
+{
+int i, j, k;
+char *ld;
+
+for (i = 1; i < argc; i++)
+  {
+#if !UNIX
+  /* code for DOS / Windows / OS2 */
+  if ((argv[i][0] == '-') ||
+      (argv[i][0] == '/'))
+#else
+  /* code for UNIX derivates */
+  if (argv[i][0] == '-')
+#endif
+    {
+    k = getlongoption(argv[i] + 1,      /* long options consume the whole    */
+                      (i + 1 < argc) ?  /* argument, maybe the next one, too */
+                          argv[i + 1] : NULL);
+    if (k > 1)                          /* if next one consumed, remove it   */
       {
-      warningmsg[14] = srcptr;
-      warning |= WRN_WRNTXT;
+      for (j = i + 1; j < argc; j++)
+        argv[j] = argv[j + 1];
+      argc--;
       }
-    break;
-  case PSEUDO_TEXT :                    /* TEXT text ?                       */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (!lp)                            /* label is mandatory!               */
-      error |= ERR_LABEL_MISSING;
-    else if (lp->cat != SYMCAT_EMPTY && /* and must be text, if there        */
-             lp->cat != SYMCAT_TEXT)
-      error |= ERR_LABEL_MULT;
-    else                                /* if all OK, (re)define text        */
+    j = k ? (int)strlen(argv[i]) : 1;
+    for (; j < (int)strlen(argv[i]); j++)
       {
-      scanstring(szBuf1, sizeof(szBuf1));
-      settext(lp->name, szBuf1);
+      switch (tolower(argv[i][j]))
+        {
+        case 'c' :                      /* suppress code output              */
+          outmode = OUT_NONE;
+          break;
+        case 'u' :                      /* undefined is treated as external  */
+          dwOptions |= OPTION_UEX;
+          break;
+        case 'b' :                      /* define binary output file         */
+        case 's' :                      /* define Motorola output file       */
+        case 'x' :                      /* define Intel Hex output file      */
+        case 'f' :                      /* define FLEX output file           */
+        case 'r' :                      /* define FLEX relocatable output f. */
+        case 'z' :                      /* define LZ-compressed output file  */
+    /*  case 'g' : */                   /* define GNU output file            */
+          strcpy(objname,               /* copy in the name                  */
+                  argv[i] + j + 1);
+          switch (tolower(argv[i][j]))  /* then set output mode              */
+            {
+            case 'b' :
+              outmode = OUT_BIN;
+              break;
+            case 's' :
+              outmode = OUT_SREC;
+              break;
+            case 'x' :
+              outmode = OUT_IHEX;
+              break;
+            case 'f' :
+              outmode = OUT_FLEX;
+              break;
+            case 'z' :
+              outmode = OUT_LZB;
+              break;
+/*
+            case 'g' :
+              outmode = OUT_GAS;
+              relocatable = 1;
+              dwOptions |= OPTION_REL;
+              break;
+*/
+            case 'r' :
+              outmode = OUT_REL;
+              maxidlen = 8;             /* only 8 significant ID chars!      */
+              relocatable = 1;
+              absmode = 0;
+              break;
+            }
+          j = strlen(argv[i]);          /* advance behind copied name        */
+          break;
+        case 'j' :                      /* define JSON Lines listing file    */
+          strcpy(jsonname,              /* copy in the name                  */
+                  argv[i] + j + 1);
+          j = strlen(argv[i]);          /* advance behind copied name        */
+          jsonlisting = 1;              /* remember we're writing JSON       */
+          break;
+        case 'l' :                      /* define listing file               */
+          strcpy(listname,              /* copy in the name                  */
+                  argv[i] + j + 1);
+          j = strlen(argv[i]);          /* advance behind copied name        */
+          listing = LIST_ON;            /* remember we're listing            */
+          break;
+        case 'd' :                      /* define a symbol ?                 */
+          srcptr = argv[i] + j + 1;     /* parse in the name                 */
+          scanname();
+          if (!namebuf[0])              /* if no name there                  */
+            usage(argv[0]);             /* show usage and get out            */
+          if (*srcptr == '=')           /* if followed by value              */
+            srcptr++;                   /* advance behind it                 */
+          else                          /* otherwise go to ""                */
+            srcptr = argv[i] + strlen(argv[i]);
+          settext(namebuf, srcptr);     /* define the symbol                 */
+          j = strlen(argv[i]);          /* advance behind copied name        */
+          break;
+        case 'p' :                      /* previous image for delta output   */
+          strcpy(prevname,              /* copy in the name                  */
+                  argv[i] + j + 1);
+          ld = strrchr(prevname, ',');  /* binary load address given?        */
+          if (ld)
+            {
+            *ld++ = '\0';
+            if (*ld == '$')
+              ld++;
+            prevbase = strtol(ld, NULL, 16) & 0xffff;
+            }
+          j = strlen(argv[i]);          /* advance behind copied name        */
+          break;
+        case 'm' :                      /* merge gap for delta output        */
+          deltagap = atoi(argv[i] + j + 1);
+          j = strlen(argv[i]);          /* advance behind number             */
+          break;
+        case 'i' :                      /* symbol file to import             */
+          if (nsymimports < MAXIMPORTS)
+            strcpy(symimports[nsymimports++], argv[i] + j + 1);
+          j = strlen(argv[i]);          /* advance behind copied name        */
+          break;
+        case 'o' :                      /* option                            */
+          if (setoption(argv[i] + j + 1))
+            usage(argv[0]);
+          j = strlen(argv[i]);          /* advance behind option             */
+          break;
+        }
       }
-    break;
-  case PSEUDO_NAME :                    /* NAME <modulename> ?               */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    scanname();
-    if (!namebuf[0])                    /* name must be given                */
-      error |= ERR_EXPR;
-#if 0
-    // gcc 9.1.0 flags this as "output may be truncated" (well, duh!), so use sprintf instead
-    strncpy(modulename, namebuf, maxidlen);
-    modulename[maxidlen] = '\0';
+    for (j = i; j < argc; j++)          /* remove all consumed arguments     */
+      argv[j] = argv[j + 1];
+    argc--;                             /* reduce # arguments                */
+    i--;                                /* and restart with next one         */
+    }
+  }
+
+if (argc < 2)                           /* if not at least one filename left */
+  usage(argv[0]);                       /* complain & terminate              */
+
+if (prevname[0] &&                      /* delta output needs record format  */
+    outmode != OUT_SREC && outmode != OUT_IHEX && outmode != OUT_FLEX)
+  {
+  errorout(argv[1], 0, 28, "delta output needs -S, -X or -F output mode");
+  exit(4);
+  }
+
+strcpy(srcname, argv[1]);               /* copy it in.                       */
+
+if (!objname[0])                        /* if no object name defined         */
+  {
+  strcpy(objname, srcname);             /* copy in the source name           */
+  ld = strrchr(objname, '.');           /* look whether there's a dot in it  */
+  if (!ld)                              /* if not                            */
+    ld = objname + strlen(objname);     /* append extension                  */
+  switch (outmode)                      /* which output mode?                */
+    {
+    case OUT_BIN :                      /* binary ?                          */
+#if !UNIX
+      strcpy(ld, ".bin");               /* DOS / Windows / OS2               */
 #else
-    sprintf(modulename, "%.*s", maxidlen, namebuf);
+      strcpy(ld, ".b");                 /* UNIX                              */
 #endif
-    break;
-  case PSEUDO_BINARY :                  /* BIN[ARY] <filename> ?             */
-    nRepNext = 0;                       /* reset eventual repeat             */
-    if (pass == 1)                      /* expand if in pass 1               */
-      {
-      char fname[FNLEN + 1];
-      int instring = 0;
-      char *osrc = srcptr;
+      break;
+    case OUT_SREC :                     /* Motorola S51-09 ?                 */
+      strcpy(ld, ".s09");
+      break;
+    case OUT_IHEX :                     /* Intel Hex ?                       */
+      strcpy(ld, ".hex");
+      break;
+    case OUT_FLEX :                     /* FLEX binary ?                     */
+      strcpy(ld, ".bin");
+      break;
+    case OUT_GAS :                      /* GNU relocatable object ?          */
+      strcpy(ld, ".o");
+      break;
+    case OUT_REL :                      /* Flex9 relocatable object ?        */
+      strcpy(ld, ".rel");
+      break;
+    case OUT_LZB :                      /* LZ-compressed binary ?            */
+      strcpy(ld, ".lzb");
+      break;
+    }
+  }
 
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      if (*srcptr == '\"')
-        {
-        srcptr++;
-        instring = 1;
-        }
-      for (i = 0; i < FNLEN; i++)
-        {
-        if (*srcptr == 0 ||
-            (!instring && *srcptr == ' ') ||
-            *srcptr == '"')
-          break;
-        fname[i] = *srcptr++;
-        }
-      fname[i] = 0;
-      curline->flg |= LINCAT_INVISIBLE; /* preclude listing of BINARY line   */
-                                        
-      readbinary(fname,                 /* append binary after current line  */
-               (unsigned char)((curline->lvl & LINCAT_LVLMASK) + 1),
-               curline, lp);
-      expandtext();                     /* re-expand current line            */
-      srcptr = osrc;
-      }
-    break; 
-  case PSEUDO_PHASE :                   /* PHASE address ?                   */
-    nRepNext = 0;                       /* reset eventual repeat             */
-    operand = scanexpr(0, &p);
-    if (unknown)
-      error |= ERR_LABEL_UNDEF;
-    if (relocatable &&                  /* if in relocating assembler mode   */
-        (!absmode))
-      {
-      error |= ERR_RELOCATING;          /* set error                         */
-      break;                            /* and ignore                        */
+if ((listing & LIST_ON) && !listname[0])/* if no list file specified         */
+  {
+  strcpy(listname, srcname);            /* copy in the source name           */
+  ld = strrchr(listname, '.');          /* look whether there's a dot in it  */
+  if (!ld)                              /* if not                            */
+    ld = listname + strlen(listname);   /* append extension                  */
+  strcpy(ld, ".lst");                   /* .lst                              */
+  }
+
+if (jsonlisting && !jsonname[0])        /* if no JSON file name specified    */
+  {
+  strcpy(jsonname, srcname);            /* copy in the source name           */
+  ld = strrchr(jsonname, '.');          /* look whether there's a dot in it  */
+  if (!ld)                              /* if not                            */
+    ld = jsonname + strlen(jsonname);   /* append extension                  */
+  strcpy(ld, ".jsonl");                 /* .jsonl                            */
+  }
+
+if (tracing && !tracename[0])           /* if no trace file name specified   */
+  {
+  strcpy(tracename, srcname);           /* copy in the source name           */
+  ld = strrchr(tracename, '.');         /* look whether there's a dot in it  */
+  if (!ld)                              /* if not                            */
+    ld = tracename + strlen(tracename); /* append extension                  */
+  strcpy(ld, ".trace.json");            /* .trace.json                       */
+  }
+
+if (depfile && !depname[0])             /* if no dependency file specified   */
+  {                                     /* take the object's name, or the    */
+  strcpy(depname,                       /* source's if there is none         */
+         (outmode == OUT_NONE) ? srcname : objname);
+  ld = strrchr(depname, '.');           /* look whether there's a dot in it  */
+  if (!ld)                              /* if not                            */
+    ld = depname + strlen(depname);     /* append extension                  */
+  strcpy(ld, ".d");                     /* .d                                */
+  }
+
+if (symfile && !symname[0])             /* if no symbol file name specified  */
+  {
+  strcpy(symname, srcname);             /* copy in the source name           */
+  ld = strrchr(symname, '.');           /* look whether there's a dot in it  */
+  if (!ld)                              /* if not                            */
+    ld = symname + strlen(symname);     /* append extension                  */
+  strcpy(ld, ".sym");                   /* .sym                              */
+  }
+
+if (xreffile && !xrefname[0])           /* if no xref file name specified    */
+  {
+  strcpy(xrefname, srcname);            /* copy in the source name           */
+  ld = strrchr(xrefname, '.');          /* look whether there's a dot in it  */
+  if (!ld)                              /* if not                            */
+    ld = xrefname + strlen(xrefname);   /* append extension                  */
+  strcpy(ld, ".xrf");                   /* .xrf                              */
+  }
+}
+
+/*****************************************************************************/
+/* processfile : processes the input file                                    */
+/*****************************************************************************/
+
+void processfile(struct linebuf *pline)
+{
+struct linebuf *plast = pline;
+double t = 0., tn = 0.;
+long nb = 0;
+
+while (pline)
+  {
+  if (g_termflg < 0 ||                  /* skip all lines until going up     */
+      (pline->lvl & LINCAT_LVLMASK) < g_termflg)
+    {
+    if (costing)                        /* if attributing costs, remember    */
+      {                                 /* where this line starts            */
+      t = stattime();
+      tn = costnested;
+      nb = stats.bytes;
       }
-    /* ... now act on operand! */
-    phase = (int)operand - (int)loccounter;
-    printovr |= PRINTOV_PPHA;
-    break;
-  case PSEUDO_DEPHASE :                 /* DEPHASE ?                         */
-    /* end last PHASE */
-    phase = 0;
-    printovr |= PRINTOV_PPHA;
-    break;
-  case PSEUDO_PEMT :                    /* PEMT <text>                       */
-    nRepNext = 0;                       /* reset eventual repeat             */
-    skipspace();
-    if (isalnum(*srcptr))
+    if (pline == pchnext && pass == 1)  /* behind a header to precompile     */
+      pchsave();
+    curline = pline;
+    error = ERR_OK;
+    warning = WRN_OK;
+    expandtext();                       /* expand text symbols               */
+    srcptr = srcline;
+    if (suppress || nSkipCount)
+      suppressline();
+    else
       {
-      char *tgt = szBuf1;
-      char *lnblnk = tgt;
-      int nBytes = 0;
-      while (*srcptr && nBytes < (sizeof(szBuf1) - 1))
+      if (nRepNext)
         {
-        if (*srcptr != ' ')
-          lnblnk = tgt;
-        *tgt++ = *srcptr++;
-        nBytes++;
+        for (; nRepNext > 0; nRepNext--)
+          {
+          processline();
+          error = ERR_OK;
+          warning = WRN_OK;
+          }
+        nRepNext = 0;
+        }
+      else
+        {
+        processline();
+        error = ERR_OK;
+        warning = WRN_OK;
         }
-      lnblnk[1] = '\0';                 /* terminate after last nonblank     */
-      while (*srcptr)                   /* skip rest if too long             */
-        srcptr++;
-      if (!(dwOptions & OPTION_LPA))
-        curline->flg |= LINCAT_INVISIBLE;
       }
-    break;
+    if (costing)                        /* charge the line's costs, minus    */
+      addcost(pline,                    /* macro expansions done in there    */
+              stattime() - t - (costnested - tn),
+              stats.bytes - nb);
+    }
+  plast = pline;
+  pline = pline->next;
+  }
+
+if (suppress)
+  {
+  errorout(expandfn(plast->fn), plast->ln, 18,
+           "improperly nested IF statements");
+  if (((dwOptions & OPTION_LP1) || pass == 2) &&
+      (listing & LIST_ON))
+    putlist( "*** Error 18: improperly nested IF statements\n");
+  errors++;
+  suppress = 0;
+  }
+
+if (common)
+  {
+  errorout(expandfn(plast->fn), plast->ln, 24,
+           "improperly nested COMMON statements");
+  if (((dwOptions & OPTION_LP1) || pass == 2) &&
+      (listing & LIST_ON))
+    putlist( "*** Error 24: improperly nested COMMON statements\n");
+  errors++;
+  common = 0;
   }
 }
 
 /*****************************************************************************/
-/* macskip : skips a range of macro lines                                    */
+/* fnv1a : continues a 32-bit FNV-1a hash over a block of data               */
+/*****************************************************************************/
+
+unsigned long fnv1a(unsigned long h, const void *data, size_t len)
+{
+const unsigned char *p = (const unsigned char *)data;
+
+while (len--)
+  h = ((h ^ *p++) * 16777619UL) & 0xffffffffUL;
+return h;
+}
+
+/*****************************************************************************/
+/* filehash : hashes a file's contents; returns 0 if it can't be read        */
+/*****************************************************************************/
+
+int filehash(char *name, unsigned long *h)
+{
+char buf[8192];
+size_t n;
+FILE *fp = fopen(name, "rb");
+
+if (!fp)
+  return 0;
+*h = 2166136261UL;
+while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+  *h = fnv1a(*h, buf, n);
+fclose(fp);
+return 1;
+}
+
+/*****************************************************************************/
+/* pchstatehash : hashes everything a header's assembly depends on, apart    */
+/*                from the files: a09 itself, options, symbols and texts     */
+/*****************************************************************************/
+
+unsigned long pchstatehash()
+{
+unsigned long h = fnv1a(2166136261UL, VERSION, sizeof(VERSION));
+long st[6];
+int i;
+
+st[0] = (long)sizeof(struct symrecord); /* snapshots hold raw records        */
+st[1] = (long)dwOptions;
+st[2] = maxidlen;
+st[3] = outmode;
+st[4] = relocatable;
+st[5] = absmode;
+h = fnv1a(h, st, sizeof(st));
+for (i = 0; i < symtable.counter; i++)
+  h = fnv1a(h, symtable.rec + i, sizeof(symtable.rec[i].name) + 1);
+for (i = 0; i < nTexts; i++)
+  h = fnv1a(h, texts[i], strlen(texts[i]) + 1);
+return h;
+}
+
+/*****************************************************************************/
+/* pchput / pchputs : write a block / a string to a snapshot                 */
 /*****************************************************************************/
 
-struct linebuf *macskip(struct linebuf *pmac, int nSkips)
+void pchput(FILE *fp, const void *data, size_t len)
 {
-if (nSkips < 0)                         /* we need to go to the line BEFORE  */
-  nSkips--;                             /* the one we need!                  */
-while (nSkips)
+fwrite(data, 1, len, fp);
+}
+
+void pchputs(FILE *fp, const char *s)
+{
+long len = (long)strlen(s);
+
+pchput(fp, &len, sizeof(len));
+pchput(fp, s, len);
+}
+
+/*****************************************************************************/
+/* pchisendm : checks whether a line's mnemonic is ENDM                      */
+/*****************************************************************************/
+
+int pchisendm(char *s)
+{
+while (*s && !isspace((unsigned char)*s))
+  s++;                                  /* skip label                        */
+while (isspace((unsigned char)*s))
+  s++;
+return toupper((unsigned char)s[0]) == 'E' &&
+       toupper((unsigned char)s[1]) == 'N' &&
+       toupper((unsigned char)s[2]) == 'D' &&
+       toupper((unsigned char)s[3]) == 'M' &&
+       (!s[4] || isspace((unsigned char)s[4]));
+}
+
+/*****************************************************************************/
+/* pchsave : writes the snapshot when pass 1 reaches the end of the header   */
+/*****************************************************************************/
+
+void pchsave()
+{
+FILE *fp;
+char *hdr[MAXFILES], tmp[FNLEN + 32];
+struct linebuf *pline;
+unsigned long h;
+long l[8], n;
+int nhdr = 0, i, j;
+
+pchnext = NULL;                         /* only once                         */
+if (errors || inMacro || ifcount ||     /* only plain definitions can be     */
+    loccounter || phase ||              /* precompiled                       */
+    stats.bytes || lcltable.counter || commonsym)
+  {
+  printf("%s(0) : header can't be precompiled (errors, open blocks or "
+         "code)\n", pchname);
+  return;
+  }
+for (i = 0; i < nfnms; i++)             /* header files: all but the main    */
+  if (i < pchmain[0] || i >= pchmain[1])
+    hdr[nhdr++] = fnms[i];
+#if UNIX                                /* written under a temporary name,   */
+sprintf(tmp, "%.*s.%ld", FNLEN, pchsnap, (long)getpid());
+#else
+sprintf(tmp, "%.*s~", FNLEN, pchsnap);  /* as others may be reading it       */
+#endif
+if (!(fp = fopen(tmp, "wb")))
   {
-  if (nSkips < 0)
-    {
-    if (!pmac->prev)
+  errorout(pchname, 0, 36, "cannot write snapshot %s", pchsnap);
+  return;
+  }
+pchput(fp, "A09PCH1", 8);
+pchput(fp, &pchstate, sizeof(pchstate));
+n = nhdr;                               /* files and their hashes            */
+pchput(fp, &n, sizeof(n));
+for (i = 0; i < nhdr; i++)
+  {
+  h = 0;
+  filehash(hdr[i], &h);
+  pchputs(fp, hdr[i]);
+  pchput(fp, &h, sizeof(h));
+  }
+l[0] = (long)dwOptions;                 /* settings                          */
+l[1] = maxidlen;
+l[2] = dpsetting;
+l[3] = rmbfillchr;
+l[4] = nLinesPerPage;
+l[5] = nColsPerLine;
+l[6] = symtable.counter;
+l[7] = nTexts;
+pchput(fp, l, sizeof(l));
+pchputs(fp, szTitle);
+pchputs(fp, szSubtitle);
+pchput(fp, symtable.rec,                /* symbols, as they are              */
+       symtable.counter * sizeof(struct symrecord));
+for (i = 0; i < nTexts; i++)            /* texts                             */
+  pchputs(fp, texts[i]);
+n = nMacros;                            /* macros: MACRO line up to ENDM     */
+pchput(fp, &n, sizeof(n));
+for (i = 0; i < nMacros; i++)
+  {
+  for (n = 0, pline = macros[i]; pline; pline = pline->next)
+    if (n++ && pchisendm(pline->txt))
       break;
-    pmac = pmac->prev;
-    nSkips++;
-    }
-  else
+  pchput(fp, &n, sizeof(n));
+  for (pline = macros[i]; n--; pline = pline->next)
     {
-    if (!pmac->next)
-      break;
-    pmac = pmac->next;
-    nSkips--;
+    for (j = 0; j < nhdr && hdr[j] != pline->fn; j++)
+      ;
+    l[0] = j;
+    l[1] = pline->ln;
+    l[2] = pline->lvl;
+    l[3] = pline->flg;
+    pchput(fp, l, 4 * sizeof(long));
+    pchputs(fp, pline->txt);
     }
   }
-return pmac;
+#if !UNIX
+remove(pchsnap);
+#endif
+if (fclose(fp) || rename(tmp, pchsnap))
+  {
+  errorout(pchname, 0, 36, "cannot write snapshot %s", pchsnap);
+  unlink(tmp);
+  }
 }
 
 /*****************************************************************************/
-/* expandmacro : expands a macro definition below the current line           */
+/* pchget / pchgets : read a block / a string from a snapshot                */
 /*****************************************************************************/
 
-void expandmacro(struct symrecord *lp, struct symrecord *lpmac)
+char *pchcur, *pchend;                  /* read position in a snapshot       */
+
+int pchget(void *data, size_t len)
 {
-struct oprecord *op;
-char szMacInv[LINELEN];                 /* macro invocation line             */
-char szLine[LINELEN];                   /* current macro line                */
-char *szMacParm[10];
-char *s, *d;                            /* source / destination work pointers*/
-char *srcsave = srcptr;
-struct linebuf *cursave = curline;
-int nMacParms = 1;
-int nInString = 0;
-                                        /* current macro line                */
-struct linebuf *pmac = macros[lpmac->value]->next;
-struct linebuf *pcur = curline;         /* current expanded macro line       */
-struct linebuf *pdup = NULL;            /* DUP start line                    */
-int nDup = 0;                           /* # repetitions for DUP             */
-int terminate = 0;                      /* terminate macro expansion if set  */
-int skipit = 0;                         /* skip this line                    */
-int suppress[64] = {0};                 /* internal suppression (max.64 lvl) */
-int ifcount = 0;                        /* internal if counter               */
-int curlvl = curline->lvl & LINCAT_LVLMASK;
-struct relocrecord p = {0};
+if ((size_t)(pchend - pchcur) < len)
+  return 0;
+memcpy(data, pchcur, len);
+pchcur += len;
+return 1;
+}
 
-#if 0
-if ((listing & LIST_ON) &&              /* if listing pass 1                 */
-    (dwOptions & OPTION_LIS) &&
-    (dwOptions & OPTION_LP1) &&
-    (dwOptions & OPTION_MAC))
-  outlist(NULL, NULL);                  /* show macro invocation BEFORE      */
-                                        /* processing the expansions         */
-#endif
+char *pchgets()
+{
+long len;
+char *s;
 
-skipspace();                            /* skip spaces before macro args     */
+if (!pchget(&len, sizeof(len)) || len < 0 || len > pchend - pchcur ||
+    !(s = (char *)malloc(len + 1)))
+  return NULL;
+pchget(s, len);
+s[len] = '\0';
+return s;
+}
 
-if (!lp)                                /* if no macro label                 */
-  szMacParm[0] = "";                    /* set &0 to blank                   */
-else                                    /* otherwise                         */
-  szMacParm[0] = lp->name;              /* set &0 to line label              */
-                                        /* initialize all parameters to ""   */
-for (nMacParms = 1; nMacParms < 10; nMacParms++)
-  szMacParm[nMacParms] = "";
-nMacParms = 1;                          /* reset # parsed parms to 1         */
+/*****************************************************************************/
+/* pchload : restores the state after the header from its snapshot           */
+/*           returns 0 if there is no snapshot or it is out of date          */
+/*****************************************************************************/
 
-strcpy(szMacInv, srcptr);               /* copy the current line for mangling*/
-srcptr = szMacInv;                      /* set pointer to internal buffer    */
+int pchload()
+{
+char *map = NULL, *s;
+size_t size = 0;
+unsigned long state, h, hf;
+long l[8], n, nf, m;
+int ok = 0, i, j;
+struct linebuf *plast = NULL;
+#if UNIX
+int fd = open(pchsnap, O_RDONLY);
+struct stat st;
+
+if (fd >= 0 && !fstat(fd, &st) &&       /* map the snapshot                  */
+    st.st_size > 0 &&
+    (map = (char *)mmap(NULL, (size_t)st.st_size, PROT_READ,
+                        MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+  map = NULL;
+if (map)
+  size = (size_t)st.st_size;
+if (fd >= 0)
+  close(fd);
+#else
+FILE *fp = fopen(pchsnap, "rb");
+if (fp && !fseek(fp, 0L, SEEK_END) && (n = ftell(fp)) > 0 &&
+    !fseek(fp, 0L, SEEK_SET) && (map = (char *)malloc(n)) != NULL)
+  size = fread(map, 1, n, fp);
+if (fp)
+  fclose(fp);
+#endif
+if (!map)
+  return 0;
+pchcur = map + 8;
+pchend = map + size;
+if (size < 8 ||                         /* check magic, state                */
+    memcmp(map, "A09PCH1", 8) ||
+    !pchget(&state, sizeof(state)) || state != pchstate ||
+    !pchget(&nf, sizeof(nf)) || nf < 1 || nf > MAXFILES)
+  goto done;
+s = pchcur;                             /* and all files' contents           */
+for (i = 0; i < nf; i++)
+  {
+  char *fn = pchgets();
+  int same = fn && pchget(&h, sizeof(h)) && filehash(fn, &hf) && h == hf;
+  free(fn);
+  if (!same)
+    goto done;
+  }
+
+pchcur = s;                             /* up to date: register the files    */
+for (i = 0; i < nf; i++)
+  {
+  s = pchgets();
+  pchget(&h, sizeof(h));
+  for (j = 0; j < nfnms && strcmp(s, fnms[j]); j++)
+    ;                                   /* imported symbol files are         */
+  if (j < nfnms)                        /* already there                     */
+    free(s);
+  else
+    fnms[nfnms++] = s;
+  }
+if (!pchget(l, sizeof(l)) ||            /* settings                          */
+    l[6] < 0 || l[6] > MAXLABELS || l[7] < 0 || l[7] > MAXTEXTS)
+  goto corrupt;
+if (l[0] & OPTION_H11)                  /* CPU first; it changes options     */
+  setoption("H11");
+else if (l[0] & OPTION_H01)
+  setoption("H01");
+else if (l[0] & OPTION_M01)
+  setoption("M01");
+else if (l[0] & OPTION_M00)
+  setoption("M00");
+else if (l[0] & OPTION_H09)
+  setoption("H09");
+else
+  setoption("M09");
+dwOptions = (unsigned long)l[0];
+maxidlen = (int)l[1];
+dpsetting = l[2];
+rmbfillchr = (char)l[3];
+nLinesPerPage = (int)l[4];
+nColsPerLine = (int)l[5];
+for (i = 0; i < 2; i++)
+  {
+  if (!(s = pchgets()))
+    goto corrupt;
+  sprintf(i ? szSubtitle : szTitle, "%.*s", 127, s);
+  free(s);
+  }
+
+memadd(MEM_SYMBOLS,                     /* symbols                           */
+       (l[6] - symtable.counter) * (long)sizeof(struct symrecord));
+symtable.counter = l[6];
+if (!pchget(symtable.rec, symtable.counter * sizeof(struct symrecord)))
+  goto corrupt;
+for (i = 0; i < symtable.counter; i++)
+  {                                     /* the header has been passed, so    */
+  symtable.rec[i].xref = 0;             /* nothing in it is a forward ref.   */
+  if (symtable.rec[i].cat != SYMCAT_COMMONDATA &&
+      symtable.rec[i].cat != SYMCAT_UNRESOLVED)
+    symtable.rec[i].u.flags &= ~SYMFLAG_FORWARD;
+  }
+for (i = 0; i < nTexts; i++)            /* texts                             */
+  free(texts[i]);
+for (nTexts = 0; nTexts < l[7]; nTexts++)
+  {
+  if (!(texts[nTexts] = pchgets()))
+    goto corrupt;
+  memadd(MEM_TEXTS, (long)(strlen(texts[nTexts]) + 1));
+  }
 
-while (*srcptr)                         /* while there are parameters        */
+if (!pchget(&n, sizeof(n)) ||           /* macros                            */
+    n < 0 || n > MAXMACROS)
+  goto corrupt;
+for (nMacros = 0; nMacros < n; nMacros++)
   {
-  if (*srcptr == ',')                   /* if parameter delimiter            */
+  if (!pchget(&m, sizeof(m)) || m < 1)
+    goto corrupt;
+  for (j = 0; j < m; j++)
     {
-    *srcptr++ = '\0';                   /* delimit & advance behind it       */
-    if (!(dwOptions & OPTION_TSC))
-      skipspace();
-    if (++nMacParms >= 10)
-      break;
-    }
-  else                                  /* otherwise walk thru parameter     */
-    {
-    szMacParm[nMacParms] = srcptr;      /* store parameter start pointer     */
-    if ((*srcptr == '\'') ||            /* if delimited string               */
-        (*srcptr == '\"'))
-      {
-      nInString = 1;                    /* remember we're in delimited strg  */
-      srcptr++;
-      }
-    while (*srcptr)                     /* walk to end of parameter          */
-      {
-      if (!nInString &&
-          ((*srcptr == ' ') || (*srcptr == ',')))
-        break;
-      else if (nInString &&
-              *srcptr == *szMacParm[nMacParms])
-        {
-        szMacParm[nMacParms]++;
-        *srcptr++ = '\0';
-        break;
-        }
-      else
-        srcptr++;
-      }
-    if (*srcptr == ' ')                 /* ' ' terminates in TSC             */
-      {
-      if (dwOptions & OPTION_TSC)
-        {
-        *srcptr++ = '\0';
-        break;
-        }
-      else
-        skipspace();
-      }
-    else if (*srcptr == ',')            /* advance to next                   */
-      {
-      *srcptr++ = '\0';
-      if (++nMacParms >= 10)
-        break;
-      if (!(dwOptions & OPTION_TSC))
-        skipspace();
-      }
+    if (!pchget(l, 4 * sizeof(long)) || !(s = pchgets()))
+      goto corrupt;
+    plast = allocline(plast,
+                      (l[0] >= 0 && l[0] < nf) ? fnms[l[0]] : pchname,
+                      (int)l[1], (unsigned char)l[2], s, MEM_SRCLINES);
+    free(s);
+    if (!plast)
+      goto corrupt;
+    plast->flg = (unsigned char)l[3];
+    if (!pchlines)
+      pchlines = plast;
+    if (!j)
+      macros[nMacros] = plast;
     }
   }
+ok = 1;
+
+done:
+#if UNIX
+munmap(map, size);
+#else
+free(map);
+#endif
+return ok;
+
+corrupt:                                /* too late to go back               */
+errorout(pchname, 0, 36, "snapshot %s is damaged", pchsnap);
+unlink(pchsnap);
+exit(4);
+return 0;
+}
+
+/*****************************************************************************/
+/* FLEX relocatable linker (-link) and libraries (-mklib)                    */
+/*****************************************************************************/
+
+/* Each module of a .rel file starts on a 252 byte boundary with the 24 byte
+   header that writerelhdr() writes, followed by the binary data, the
+   external table, the global table and the module name. A COMMON block
+   comes as a header of its own with just one global, the block itself.
+   Relocatable modules are placed one after the other from the link base
+   on, absolute ones keep their addresses; COMMON blocks are allocated
+   behind the last relocatable module.
+
+   A library bundles .rel files as members, with an index of their globals
+   sorted by name in front, so that the linker can look up an unresolved
+   external without touching the members at all:
+
+     "A09LIB1\0", # members (4), # globals (4)
+     per member : offset (4), size (4), name of its 1st module (8)
+     per global : name (8), member (4)
+     the members' .rel images
+
+   A member is linked as a whole when one of its globals is needed.        */
+
+struct linkmodule
+  {
+  char *fn;                             /* file it comes from                */
+  unsigned char *hdr;                   /* its header                        */
+  unsigned short base;                  /* load address (relocatable)        */
+  char absolute;                        /* flag whether absolute module      */
+  };
+
+struct linklib
+  {
+  char *fn;                             /* library file name                 */
+  unsigned char *buf;                   /* its contents                      */
+  long size;                            /* its size                          */
+  long nmembers;                        /* # members                         */
+  long nglobals;                        /* # globals in the index            */
+  char *loaded;                         /* flags which members are linked    */
+  };
+
+#define LIBMAGIC "A09LIB1"              /* library signature, with the NUL   */
+
+struct linkmodule *linkmods = NULL;     /* modules to link                   */
+int nlinkmods = 0;                      /* # modules to link                 */
+unsigned short linkloc = 0;             /* next relocatable module's address */
+struct linklib linklibs[MAXFILES];      /* libraries to search               */
+int nlinklibs = 0;                      /* # libraries to search             */
+
+/*****************************************************************************/
+/* linkword : returns a big-endian word from a module                        */
+/*****************************************************************************/
+
+unsigned short linkword(unsigned char *p)
+{
+return (unsigned short)((p[0] << 8) | p[1]);
+}
+
+/*****************************************************************************/
+/* linklong : returns a big-endian long from a library                       */
+/*****************************************************************************/
+
+long linklong(unsigned char *p)
+{
+return ((long)p[0] << 24) | ((long)p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/*****************************************************************************/
+/* linkputlong : writes a big-endian long to a library                       */
+/*****************************************************************************/
+
+void linkputlong(FILE *fp, long l)
+{
+fputc((int)((l >> 24) & 0xff), fp);
+fputc((int)((l >> 16) & 0xff), fp);
+fputc((int)((l >> 8) & 0xff), fp);
+fputc((int)(l & 0xff), fp);
+}
+
+/*****************************************************************************/
+/* linkname : copies a symbol name from a module, without trailing blanks    */
+/*****************************************************************************/
+
+void linkname(char *name, unsigned char *p)
+{
+int i;
+
+memcpy(name, p, 8);
+for (i = 8; i > 0 && (name[i - 1] == ' ' || !name[i - 1]); i--)
+  ;
+name[i] = '\0';
+}
+
+/*****************************************************************************/
+/* linkkey : converts a symbol name to a library index key                   */
+/*****************************************************************************/
+
+void linkkey(unsigned char *key, char *name)
+{
+int i;
+
+for (i = 0; i < 8; i++)                 /* blank padded, as in the modules   */
+  key[i] = (unsigned char)(*name ? *name++ : ' ');
+}
+
+/*****************************************************************************/
+/* linkkeycmp : compares two library index entries for qsort()               */
+/*****************************************************************************/
+
+int linkkeycmp(const void *a, const void *b)
+{
+return memcmp(a, b, 8);
+}
+
+/*****************************************************************************/
+/* linkread : reads a whole .rel or library file                             */
+/*****************************************************************************/
+
+unsigned char *linkread(char *fn, long *size)
+{
+unsigned char *buf = NULL;
+FILE *fp;
+
+*size = 0;
+if ((fp = fopen(fn, "rb")) != NULL)
+  {
+  if (!fseek(fp, 0L, SEEK_END) && (*size = ftell(fp)) > 0 &&
+      !fseek(fp, 0L, SEEK_SET) &&
+      (buf = (unsigned char *)malloc(*size)) != NULL)
+    *size = (long)fread(buf, 1, *size, fp);
+  fclose(fp);
+  }
+if (!buf)
+  {
+  errorout(fn, 0, 17, "cannot open source file");
+  exit(4);
+  }
+if (nfnms < MAXFILES)                   /* the files are dependencies        */
+  fnms[nfnms++] = strdup(fn);
+return buf;
+}
+
+/*****************************************************************************/
+/* linknext : returns the next module of a .rel image, NULL at its end       */
+/*****************************************************************************/
+
+unsigned char *linknext(char *fn, unsigned char *buf, long size, long *off)
+{
+unsigned char *hdr = buf + *off;
+long total = 0;
+
+if (*off >= size)
+  return NULL;
+if (*off + 24 <= size &&                /* header, external table, globals,  */
+    hdr[0] == 0x03 &&                   /* module name and, unless it's a    */
+    (hdr[1] & 0x10))                    /* COMMON block, the data            */
+  total = 24 + linkword(hdr + 8) + linkword(hdr + 14) + linkword(hdr + 18) +
+          ((hdr[1] & 0x08) ? 0 : linkword(hdr + 2));
+if (!total || *off + total > size)
+  {
+  errorout(fn, 0, 40, "invalid relocatable module");
+  exit(4);
+  }
+*off = (*off + total + 251) / 252 * 252;
+return hdr;
+}
+
+/*****************************************************************************/
+/* linkput : puts a byte into the memory image                               */
+/*****************************************************************************/
+
+void linkput(unsigned short addr, unsigned char uc)
+{
+if (bUsedBytes[addr / 8] & (1 << (addr % 8)))
+  warnings++;                           /* modules overlap                   */
+bUsedBytes[addr / 8] |= (1 << (addr % 8));
+memimage[addr] = uc;
+}
+
+/*****************************************************************************/
+/* linkglobal : defines a global symbol for the link                         */
+/*****************************************************************************/
+
+void linkglobal(char *fn, char *name, unsigned short value, char cat)
+{
+struct symrecord *p;
+
+if (symtable.counter == MAXLABELS)
+  {
+  errorout(fn, 0, 23, "out of symbol storage");
+  exit(4);
+  }
+p = findsym(name, 1);
+if (cat == SYMCAT_COMMON &&             /* COMMON blocks get the biggest     */
+    p->cat == SYMCAT_COMMON)            /* size that's requested             */
+  {
+  if (value > p->value)
+    p->value = value;
+  }
+else if (p->cat != SYMCAT_EMPTY)
+  {
+  errorout(fn, 0, 42, "multiple definitions of %s", name);
+  errors++;
+  }
+else
+  {
+  p->cat = cat;
+  p->value = value;
+  }
+}
 
-/*---------------------------------------------------------------------------*/
-/* OK, got macro arguments &0...&9 now                                       */
-/*---------------------------------------------------------------------------*/
+/*****************************************************************************/
+/* linkfile : places the modules of a .rel image and collects their globals  */
+/*****************************************************************************/
 
-while (pmac)                            /* walk through the macro lines      */
-  {
-  srcptr = s = pmac->txt;
-  d = szLine;
-  op = NULL;
-  skipit = 0;
+void linkfile(char *fn, unsigned char *buf, long size)
+{
+struct linkmodule *m;
+unsigned char *hdr, *p, *end;
+char name[9];
+long off = 0;
 
-  while (*s)                            /* first, expand the line            */
+while ((hdr = linknext(fn, buf, size, &off)) != NULL)
+  {
+  if (hdr[1] & 0x08)                    /* COMMON block                      */
     {
-    if (*s == '\\' && s[1] == '&')
-      {
-      s++;
-      *d++ = *s++;
-      }
-    else if (*s == '&')
+    linkname(name, hdr + 24);
+    linkglobal(fn, name, linkword(hdr + 2), SYMCAT_COMMON);
+    continue;
+    }
+  if (!(nlinkmods & 15) &&
+      !(linkmods = (struct linkmodule *)
+            realloc(linkmods, (nlinkmods + 16) * sizeof(struct linkmodule))))
+    {
+    errorout(fn, 0, 22, "memory allocation error");
+    exit(4);
+    }
+  m = linkmods + nlinkmods++;
+  m->fn = fn;
+  m->hdr = hdr;
+  m->absolute = (hdr[1] & 0x02) != 0;
+  m->base = m->absolute ? 0 : linkloc;
+  if (!m->absolute)
+    linkloc += linkword(hdr + 2);
+  if ((hdr[20] & 0x80) && !tfradrset)   /* 1st transfer address counts       */
+    {
+    tfradr = (unsigned short)(linkword(hdr + 10) + m->base);
+    tfradrset = 1;
+    }
+  p = hdr + 24 + linkword(hdr + 2) + linkword(hdr + 8);
+  for (end = p + linkword(hdr + 14); p + 12 <= end; p += 12)
+    {
+    linkname(name, p);
+    linkglobal(fn, name,
+               (unsigned short)(linkword(p + 9) +
+                                ((p[11] & 0x10) ? 0 : m->base)),
+               SYMCAT_PUBLIC);
+    }
+  }
+}
+
+/*****************************************************************************/
+/* linklib : checks a library file and adds it to the ones to search         */
+/*****************************************************************************/
+
+void linklib(char *fn, unsigned char *buf, long size)
+{
+struct linklib *l = linklibs + nlinklibs++;
+unsigned char *e;
+long i;
+int ok = (size >= 16);
+
+l->fn = fn;
+l->buf = buf;
+l->size = size;
+l->nmembers = ok ? linklong(buf + 8) : 0;
+l->nglobals = ok ? linklong(buf + 12) : 0;
+ok = ok &&                              /* the tables have to fit in         */
+     l->nmembers <= (size - 16) / 16 &&
+     l->nglobals <= (size - 16 - 16 * l->nmembers) / 12;
+for (i = 0; ok && i < l->nmembers; i++) /* so do the members                 */
+  {
+  e = buf + 16 + 16 * i;
+  ok = linklong(e) <= size - linklong(e + 4);
+  }
+e = buf + 16 + 16 * l->nmembers;        /* and the index' member numbers     */
+for (i = 0; ok && i < l->nglobals; i++)
+  ok = linklong(e + 12 * i + 8) < l->nmembers;
+if (!ok || !(l->loaded = (char *)calloc(l->nmembers + 1, 1)))
+  {
+  errorout(fn, 0, 40, "invalid relocatable library");
+  exit(4);
+  }
+}
+
+/*****************************************************************************/
+/* linkpull : links the library member that defines an external, if any      */
+/*****************************************************************************/
+
+void linkpull(char *name)
+{
+unsigned char key[8], *idx, *e;
+long lo, hi, mid, member;
+int i, cmp;
+
+linkkey(key, name);
+for (i = 0; i < nlinklibs; i++)         /* 1st library that has it counts    */
+  {
+  idx = linklibs[i].buf + 16 + 16 * linklibs[i].nmembers;
+  for (lo = 0, hi = linklibs[i].nglobals - 1; lo <= hi; )
+    {                                   /* binary search in the index        */
+    mid = (lo + hi) / 2;
+    e = idx + 12 * mid;
+    cmp = memcmp(key, e, 8);
+    if (cmp < 0)
+      hi = mid - 1;
+    else if (cmp > 0)
+      lo = mid + 1;
+    else
       {
-      if (s[1] >= '0' && s[1] <= '9')
-        {
-        char *from = szMacParm[s[1] - '0'];
-        int i = 0, j = (int)(d - szLine);
-        for (; j < LINELEN && from[i]; i++, j++)
-          *d++ = from[i];
-        s += 2;
-        }
-      else
+      member = linklong(e + 8);
+      if (!linklibs[i].loaded[member])
         {
-        struct symrecord *lp;
-        char iname[sizeof(namebuf)];
-        char *nc;
-        parsename(s + 1, &nc);
-        sprintf(iname, "&%.*s", (int)(sizeof(iname) - 2), namebuf);
-        lp = findsym(iname, 0);
-        if (lp && *namebuf &&           /* if symbol IS a text constant,     */
-            (lp->cat == SYMCAT_TEXT))
-          {                             /* insert its content                */
-          int i = 0, j = (int)(d - szLine);
-          char *from = texts[lp->value];
-          for (; j < LINELEN && from[i]; i++, j++)
-            *d++ = from[i];
-          s = nc;
-          }
-        else
-          *d++ = *s++;
+        linklibs[i].loaded[member] = 1;
+        e = linklibs[i].buf + 16 + 16 * member;
+        linkfile(linklibs[i].fn, linklibs[i].buf + linklong(e),
+                 linklong(e + 4));
         }
+      return;
       }
-    else
-      *d++ = *s++;
     }
-  *d = '\0';
+  }
+}
 
-  srcptr = szLine;                      /* then, look whether code or macro  */
-  if (isalnum(*srcptr))
-    {
-    scanname();
-    lp = findsym(namebuf, 1);
-    if (*srcptr == ':')
-      srcptr++;
-    } 
-  skipspace();
-  if (isalnum(*srcptr))                 /* then parse opcode                 */
-    {
-    scanname(); 
-    op = findop(unamebuf);
-    }
-  skipspace();                          /* and skip to eventual parameter    */
+/*****************************************************************************/
+/* makelib : bundles .rel files into a library (-mklib)                      */
+/*****************************************************************************/
 
-  if (op && op->cat == OPCAT_PSEUDO)    /* if pseudo-op                      */
+int makelib(char *files[])
+{
+unsigned char **bufs, *hdr, *p, *end, *idx = NULL, *e;
+long *sizes, nglobals = 0, off, pos;
+int nfiles, i, k;
+char name[9], first[9];
+FILE *fp;
+
+if (!inbatch && !incache)
+  printf("A09 Assembler V" VERSION "\n");
+for (nfiles = 0; files[nfiles]; nfiles++)
+  ;
+bufs = (unsigned char **)malloc(nfiles * sizeof(unsigned char *));
+sizes = (long *)malloc(nfiles * sizeof(long));
+if (!bufs || !sizes)
+  {
+  errorout(libname, 0, 22, "memory allocation error");
+  exit(4);
+  }
+errors = 0;
+strcpy(objname, libname);               /* the library is the target         */
+pchmain[0] = nfnms;                     /* the members are the main sources  */
+for (i = 0; i < nfiles; i++)            /* read the members, index globals   */
+  {
+  bufs[i] = linkread(files[i], &sizes[i]);
+  off = 0;
+  while ((hdr = linknext(files[i], bufs[i], sizes[i], &off)) != NULL)
     {
-    switch (op->code)                   /* examine for macro expansion       */
-      {
-      case PSEUDO_ENDM :                /* ENDM ?                            */
-        terminate = 1;                  /* terminate macro expansion         */
-        break;
-      case PSEUDO_EXITM :               /* EXITM ?                           */
-        if (!suppress[ifcount])         /* if not suppressed                 */
-          terminate = 1;                /* terminate macro expansion         */
-        break;
-      case PSEUDO_DUP :                 /* DUP ?                             */
-        if (pdup != NULL)               /* nesting not allowed               */
-          error |= ERR_NESTING;
-        else
-          {
-          nDup = scanexpr(0, &p);       /* scan the expression               */
-          pdup = pmac;                  /* remember DUP start line           */
-          if (nDup < 1 || nDup > 255)   /* if invalid # repetitions          */
-            {
-            error |= ERR_EXPR;          /* set error here                    */
-            nDup = 1;
-            }
-          else
-            skipit = 1;                 /* skip this line                    */
-          }
-        break;
-      case PSEUDO_ENDD :                /* ENDD ?                            */
-        if (!pdup)                      /* if no DUP defined                 */
-          error |= ERR_EXPR;            /* can't do that here.               */
-        else
-          {
-          nDup--;                       /* decrement # duplications          */
-          if (!nDup)                    /* if done,                          */
-            pdup = NULL;                /* reset dup start                   */
-          else                          /* otherwise                         */
-            pmac = pdup;                /* reset current line to DUP op      */
-          skipit = 1;                   /* this line isn't really there      */
-          }
-        break;
-      case PSEUDO_IF :                  /* IF                                */
-      case PSEUDO_IFN :                 /* IFN                               */
-        ifcount++;                      /* increment # ifs                   */
-                                        /* take suppression from higher level*/
-        suppress[ifcount] = suppress[ifcount - 1];
-        if (suppress[ifcount])          /* if already suppressed             */
-          suppress[ifcount]++;          /* inrease # suppressions            */
-        else                            /* otherwise evaluate expression     */
-          {
-          operand = scanexpr(0, &p);
-          if (unknown)
-            error |= ERR_LABEL_UNDEF;
-          if (op->code == PSEUDO_IFN)   /* if IFN                            */
-            operand = !operand;         /* invert operand                    */
-          if (!operand)                 /* if evaulation to zer0             */
-            suppress[ifcount]++;        /* suppress until ELSE or ENDIF      */
-          if (!(dwOptions & OPTION_TSC))
-            skipspace();
-          if (*srcptr == ',')           /* if skip count passed              */
-            {
-            int nSkips;
-            srcptr++;
-            if (!(dwOptions & OPTION_TSC))
-              skipspace();
-            nSkips = scanexpr(0, &p);   /* scan skip count                   */
-            ifcount--;                  /* this needs no ENDIF               */
-            if (nSkips < -255 || nSkips > 255 || nSkips == 0)
-              {
-              error |= ERR_EXPR;
-              break;
-              }
-            if (operand)                /* if evaluation is true             */
-              pmac = macskip(pmac, nSkips); /* then skip the amount of lines */
-            }
-          }
-        skipit = 1;                     /* don't add this line!              */
-        break;
-      case PSEUDO_IFC :                 /* IFC                               */
-      case PSEUDO_IFNC :                /* IFNC                              */
-        ifcount++;                      /* increment # ifs                   */
-                                        /* take suppression from higher level*/
-        suppress[ifcount] = suppress[ifcount - 1];
-        if (suppress[ifcount])          /* if already suppressed             */
-          suppress[ifcount]++;          /* inrease # suppressions            */
-        else                            /* otherwise evaluate expression     */
-          {
-          if (!(dwOptions & OPTION_TSC))
-            skipspace();
-          scanstring(szBuf1, sizeof(szBuf1));
-          if (!(dwOptions & OPTION_TSC))
-            skipspace();
-          if (*srcptr != ',')           /* if not on comma                   */
-            {
-            *szBuf2 = '\0';             /* reset 2nd string                  */
-            error |= ERR_EXPR;          /* set error                         */
-            }
-          else
-            {
-            srcptr++;
-            if (!(dwOptions & OPTION_TSC))
-              skipspace();
-            scanstring(szBuf2, sizeof(szBuf2));
-            }
-          operand = !strcmp(szBuf1, szBuf2);
-          if (op->code == PSEUDO_IFNC)
-            operand = !operand;
-          if (!operand)                 /* if evaulation to zer0             */
-            suppress[ifcount]++;        /* suppress until ELSE or ENDIF      */
-          if (!(dwOptions & OPTION_TSC))
-            skipspace();
-          if (*srcptr == ',')           /* if skip count passed              */
-            {
-            int nSkips;
-            srcptr++;
-            if (!(dwOptions & OPTION_TSC))
-              skipspace();
-            nSkips = scanexpr(0, &p);   /* scan skip count                   */
-            ifcount--;                  /* this needs no ENDIF               */
-            if (nSkips < -255 || nSkips > 255 || nSkips == 0)
-              {
-              error |= ERR_EXPR;
-              break;
-              }
-            if (operand)                /* if evaluation is true             */
-              pmac = macskip(pmac, nSkips); /* then skip the amount of lines */
-            }
-          }
-        if (!error)
-          skipit = 1;                   /* don't add this line!              */
-        break;
-      case PSEUDO_ELSE :                /* ELSE                              */
-        if (!suppress[ifcount])         /* if IF not suppressed              */
-          suppress[ifcount]++;          /* suppress ELSE clause              */
-        else                            /* otherwise                         */
-          suppress[ifcount]--;          /* decrement suppression             */
-        skipit = 1;                     /* don't add this line!              */
-        break;
-      case PSEUDO_ENDIF :               /* ENDIF                             */
-        if (ifcount)
-          ifcount--;
-        if (suppress[ifcount])
-          suppress[ifcount]--;
-        skipit = 1;                     /* don't add this line!              */
-        break;
+    if (hdr[1] & 0x08)                  /* COMMON blocks aren't in the index */
+      continue;
+    p = hdr + 24 + linkword(hdr + 2) + linkword(hdr + 8);
+    for (end = p + linkword(hdr + 14); p + 12 <= end; p += 12)
+      {
+      if (!(nglobals & 255) &&
+          !(idx = (unsigned char *)realloc(idx, (nglobals + 256) * 12)))
+        {
+        errorout(files[i], 0, 22, "memory allocation error");
+        exit(4);
+        }
+      e = idx + 12 * nglobals++;
+      linkname(name, p);
+      linkkey(e, name);
+      e[8] = (unsigned char)((i >> 24) & 0xff);
+      e[9] = (unsigned char)((i >> 16) & 0xff);
+      e[10] = (unsigned char)((i >> 8) & 0xff);
+      e[11] = (unsigned char)(i & 0xff);
       }
     }
+  }
+pchmain[1] = nfnms;
+if (nglobals)
+  qsort(idx, nglobals, 12, linkkeycmp);
+for (off = 1; off < nglobals; off++)    /* a global may only be there once   */
+  if (!memcmp(idx + 12 * off, idx + 12 * (off - 1), 8))
+    {
+    linkname(name, idx + 12 * off);
+    errorout(files[linklong(idx + 12 * off + 8)], 0, 42,
+             "multiple definitions of %s", name);
+    errors++;
+    }
+if (errors)
+  {
+  printf("%ld error(s), no output written\n", errors);
+  return 1;
+  }
 
-  if (!skipit && !suppress[ifcount])    /* if not skipping this one          */
-    {                                   /* add line to source                */
-    pcur = allocline(pcur, curline->fn, curline->ln,
-                     (unsigned char)(LINCAT_MACEXP | curlvl),
-                     szLine);
-    if (!pcur)
+if (!(fp = fopen(libname, "wb")))
+  {
+  errorout(srcname, 0, 20, "cannot write object file %s", libname);
+  exit(4);
+  }
+fwrite(LIBMAGIC, 1, 8, fp);
+linkputlong(fp, nfiles);
+linkputlong(fp, nglobals);
+pos = 16 + 16L * nfiles + 12 * nglobals;
+for (i = 0; i < nfiles; i++)            /* member table                      */
+  {
+  linkputlong(fp, pos);
+  linkputlong(fp, sizes[i]);
+  first[0] = '\0';                      /* named after its 1st module        */
+  off = 0;
+  while (!first[0] && (hdr = linknext(files[i], bufs[i], sizes[i], &off)))
+    if (!(hdr[1] & 0x08))
       {
-      error |= ERR_MALLOC;
-      break;
+      p = hdr + 24 + linkword(hdr + 2) + linkword(hdr + 8) +
+          linkword(hdr + 14);
+      for (k = 0; k < 8 && k < linkword(hdr + 18) && p[k] != 0x04; k++)
+        first[k] = (char)p[k];
+      first[k] = '\0';
       }
-    else
+  linkkey((unsigned char *)name, first);
+  fwrite(name, 1, 8, fp);
+  pos += sizes[i];
+  }
+if (nglobals)
+  fwrite(idx, 12, nglobals, fp);
+for (i = 0; i < nfiles; i++)
+  {
+  fwrite(bufs[i], 1, sizes[i], fp);
+  free(bufs[i]);
+  }
+fclose(fp);
+free(idx);
+free(sizes);
+free(bufs);
+if (depfile)
+  writedeps();
+printf("%d member(s) with %ld global(s) in %s\n", nfiles, nglobals, libname);
+return 0;
+}
+
+/*****************************************************************************/
+/* linkmodules : links .rel modules into an absolute output file             */
+/*****************************************************************************/
+
+int linkmodules(char *files[])
+{
+struct linkmodule *m;
+unsigned char *bufs[MAXFILES], *hdr, *p, *end;
+char name[9];
+int nbufs = 0, i, k;
+long off, size;
+unsigned short addr, val;
+struct symrecord *sp;
+
+if (!inbatch && !incache)
+  printf("A09 Assembler V" VERSION "\n");
+if (outmode == OUT_NONE || outmode == OUT_REL || outmode == OUT_GAS)
+  {
+  errorout(srcname, 0, 40, "-link needs -b, -s, -x, -f or -z output");
+  exit(4);
+  }
+errors = warnings = 0;
+linkmods = NULL;
+nlinkmods = nlinklibs = 0;
+linkloc = linkbase;
+
+pchmain[0] = nfnms;                     /* the files are the main sources    */
+for (i = 0; files[i]; i++)              /* place all modules, collect their  */
+  {                                     /* globals and note the libraries    */
+  if (nbufs == MAXFILES)
+    {
+    errorout(files[i], 0, 40, "too many files to link");
+    exit(4);
+    }
+  bufs[nbufs] = linkread(files[i], &size);
+  if (size >= 8 && !memcmp(bufs[nbufs], LIBMAGIC, 8))
+    linklib(files[i], bufs[nbufs], size);
+  else
+    linkfile(files[i], bufs[nbufs], size);
+  nbufs++;
+  }
+pchmain[1] = nfnms;
+for (k = 0; nlinklibs && k < nlinkmods; k++)
+  {                                     /* pull in library members for all   */
+  hdr = linkmods[k].hdr;                /* externals that are still open,    */
+  p = hdr + 24 + linkword(hdr + 2);     /* including those of the members    */
+  for (end = p + linkword(hdr + 8); p + 3 <= end; p += 3)
+    if (p[2] & 0x80)
       {
-      curline = pcur;
-      error = ERR_OK;
-      warning = WRN_OK;
-      expandtext();
+      linkname(name, p + 3);
+      p += 8;
+      sp = findsym(name, 0);
+      if (!sp || (sp->cat != SYMCAT_PUBLIC && sp->cat != SYMCAT_COMMON))
+        linkpull(name);
       }
+  }
+for (i = 0; i < symtable.counter; i++)  /* COMMON blocks go behind them      */
+  if (symtable.rec[i].cat == SYMCAT_COMMON)
+    {
+    val = symtable.rec[i].value;
+    symtable.rec[i].value = linkloc;
+    linkloc += val;
     }
 
-  if (terminate)                        /* if macro termination needed       */
-    break;                              /* terminate here                    */
 
-  pmac = pmac->next;
+if (!(memimage = (unsigned char *)malloc(0x10000)))
+  {
+  errorout(srcname, 0, 22, "memory allocation error");
+  exit(4);
+  }
+memset(bUsedBytes, 0, sizeof(bUsedBytes));
+for (m = linkmods; m < linkmods + nlinkmods; m++)
+  {                                     /* load and relocate the modules     */
+  p = m->hdr + 24;
+  end = p + linkword(m->hdr + 2);
+  if (!m->absolute)                     /* relocatable data                  */
+    for (addr = m->base; p < end; p++)
+      linkput(addr++, *p);
+  while (m->absolute && p + 4 <= end)   /* absolute data blocks              */
+    {
+    size = linkword(p);
+    addr = linkword(p + 2);
+    for (p += 4; size-- > 0 && p < end; p++)
+      linkput(addr++, *p);
+    }
+  p = end;                              /* external table                    */
+  for (end = p + linkword(m->hdr + 8); p + 3 <= end; )
+    {
+    addr = (unsigned short)(linkword(p) + m->base);
+    i = p[2];
+    p += 3;
+    if (i & 0x80)                       /* external symbol                   */
+      {
+      linkname(name, p);
+      p += 8;
+      sp = findsym(name, 0);
+      if (!sp || (sp->cat != SYMCAT_PUBLIC && sp->cat != SYMCAT_COMMON))
+        {
+        errorout(m->fn, 0, 41, "unresolved external %s", name);
+        errors++;
+        continue;
+        }
+      val = sp->value;
+      }
+    else if (m->absolute)               /* absolute module's own address     */
+      continue;
+    else                                /* relocatable module's own address  */
+      val = m->base;
+    if (i & 0x20)                       /* subtract it?                      */
+      val = (unsigned short)-val;
+    if (i & 0x40)                       /* single byte                       */
+      memimage[addr] += (unsigned char)val;
+    else
+      {
+      val += linkword(memimage + addr);
+      memimage[addr] = (unsigned char)(val >> 8);
+      memimage[(unsigned short)(addr + 1)] = (unsigned char)val;
+      }
+    }
   }
+for (i = 0; i < nbufs; i++)
+  free(bufs[i]);
+for (i = 0; i < nlinklibs; i++)
+  free(linklibs[i].loaded);
+free(linkmods);
+linkmods = NULL;
 
-curline = cursave;
-expandtext();
-srcptr = srcsave;                       /* restore source pointer            */
-codeptr = 0;
+if (warnings)
+  printf("%ld byte(s) loaded more than once\n", warnings);
+if (errors)
+  {
+  printf("%ld error(s), no output written\n", errors);
+  return 1;
+  }
+if (!(objfile = fopen(objname,
+                      ((outmode != OUT_SREC) && (outmode != OUT_IHEX)) ?
+                          "wb" : "w")))
+  {
+  errorout(srcname, 0, 20, "cannot write object file %s", objname);
+  exit(4);
+  }
+#define LINK_USED(a) (bUsedBytes[(a) / 8] & (1 << ((a) % 8)))
+for (off = 0; off < 0x10000 && !LINK_USED(off); off++)
+  ;
+for (size = 0xffff; size >= off && !LINK_USED(size); size--)
+  ;
+for (; outmode == OUT_BIN && off <= size; off++)
+  fputc(LINK_USED(off) ? memimage[off] : rmbfillchr, objfile);
+for (; outmode != OUT_LZB && off <= size; )
+  {                                     /* record formats: each contiguous   */
+  if (!LINK_USED(off))                  /* range on its own                  */
+    {
+    off++;
+    continue;
+    }
+  for (hexaddr = (unsigned short)off; off <= size && LINK_USED(off); off++)
+    switch (outmode)
+      {
+      case OUT_SREC :
+        outhex(memimage[off]);
+        break;
+      case OUT_IHEX :
+        outihex(memimage[off]);
+        break;
+      case OUT_FLEX :
+        outflex(memimage[off]);
+        break;
+      }
+  switch (outmode)
+    {
+    case OUT_SREC :
+      flushhex();
+      break;
+    case OUT_IHEX :
+      flushihex();
+      break;
+    case OUT_FLEX :
+      flushflex();
+      break;
+    }
+  }
+#undef LINK_USED
+switch (outmode)                        /* then the end records              */
+  {
+  case OUT_SREC :
+    chksum = (tfradr & 0xff) + ((tfradr >> 8) & 0xff) + 3;
+    fprintf(objfile, "S903%04X%02X\n", tfradr, 0xff - (chksum & 0xff));
+    break;
+  case OUT_IHEX :
+    fprintf(objfile, ":00000001FF\n");
+    break;
+  case OUT_FLEX :
+    if (tfradrset)
+      {
+      fputc(0x16, objfile);
+      fputc((tfradr >> 8) & 0xff, objfile);
+      fputc(tfradr & 0xff, objfile);
+      }
+    break;
+  case OUT_LZB :
+    writelzb();
+    break;
+  }
+fclose(objfile);
+objfile = NULL;
+if (symfile)
+  writesyms();
+if (depfile)
+  writedeps();
+printf("%d module(s) linked, last address: %04lX\n", nlinkmods, size);
+return errors ? 1 : 0;
 }
 
 /*****************************************************************************/
-/* processline : processes a source line                                     */
+/* a09reset : resets the assembler to its initial state                      */
+/*            closes all open files and releases all allocated memory        */
 /*****************************************************************************/
 
-void processline()
+void a09reset()
 {
-struct symrecord *lp, *lpLabel = NULL, *lpmac = NULL;
-struct oprecord *op = NULL;
-int co;
-unsigned short cat;
-char c;
-char noimm;
-unsigned short page;
-char nomac = 0;
+int i;
+struct linebuf *pline;
 
-#if 0
-srcptr = curline->txt;
-#else
-srcptr = srcline;
+if (listfile)                           /* close what's left open            */
+  listclose();
+if (objfile)
+  fclose(objfile);
+if (jsonfile)
+  fclose(jsonfile);
+if (tracefile)
+  fclose(tracefile);
+listfile = objfile = jsonfile = tracefile = NULL;
+#if LISTTHREAD
+listqhead = listqcount = listqquit = 0;
 #endif
+nListBuf = 0;
+
+while (rootline)                        /* release all lines                 */
+  {
+  pline = rootline;
+  rootline = rootline->next;
+  free(pline);
+  }
+curline = NULL;
+for (i = 0; i < nfnms; i++)
+  free(fnms[i]);
+memset(fnms, 0, sizeof(fnms));
+nfnms = 0;
+for (i = 0; i < nTexts; i++)
+  free(texts[i]);
+memset(texts, 0, sizeof(texts));
+nTexts = nPredefinedTexts = 0;
+memset(macros, 0, sizeof(macros));
+nMacros = inMacro = lvlMacro = 0;
+free(xreftable);
+xreftable = NULL;
+xrefcount = xrefalloc = 0;
+xrefing = xreffile = 0;
+xrefkind = XREF_READ;
+xrefname[0] = '\0';
+free(memimage);
+memimage = NULL;
+
+symtable.counter = 0;                   /* tables                            */
+lcltable.counter = 0;
+relcounter = 0;
+relhdrfoff = 0;
+reldataorg = -2;
+reldatasize = 0;
+relabsfoff = -1;
+memset(bUsedBytes, 0, sizeof(bUsedBytes));
 
-oldlc = loccounter;
-unknown = 0;
-certain = 1;
-lp = 0;
+dwOptions = dwDefOptions;               /* options and output settings       */
+optable = optable09;
+optablesize = sizeof(optable09) / sizeof(optable09[0]);
+regtable = regtable09;
+bitregtable = bitregtable09;
+bitregtablesize = sizeof(bitregtable09) / sizeof(bitregtable09[0]);
+scanoperands = scanoperands09;
+listing = LIST_OFF;
+#ifdef A09_LIBRARY
+outmode = OUT_NONE;                     /* liba09: only the memory image,    */
+#else                                   /* unless an output file is asked for*/
+outmode = OUT_BIN;
+#endif
+listname[0] = objname[0] = jsonname[0] = srcname[0] = '\0';
+jsonlisting = 0;
+prevname[0] = '\0';
+prevbase = -1;
+deltagap = 4;
+fastpaths = 1;
+maxerrors = 0;
+failfast = 0;
+batchmode = 0;
+batchjobs = 1;
+watchmode = 0;
+pchname[0] = pchsnap[0] = '\0';
+depfile = 0;
+depname[0] = '\0';
+cachedir[0] = '\0';
+linkmode = 0;
+linkbase = 0;
+libname[0] = '\0';
+symname[0] = '\0';
+symfile = 0;
+nsymimports = 0;
+pchstate = 0;
+pchnext = NULL;
+while (pchlines)                        /* release the snapshot's macros     */
+  {
+  pline = pchlines;
+  pchlines = pchlines->next;
+  free(pline);
+  }
+hexmaxcount = 16;
+ihexmaxcount = 32;
+iflexmaxcount = 255;
+hexaddr = 0;
+hexcount = 0;
+chksum = 0;
+maxidlen = MAXIDLEN;
+modulename[0] = '\0';
+
+pass = 0;                               /* assembly state                    */
+relocatable = 0;
+absmode = 1;
+global = 0;
+common = 0;
+rmbfillchr = 0;
+commonsym = NULL;
+g_termflg = 0;
+generating = 0;
+loccounter = oldlc = 0;
+phase = 0;
+error = errors = warning = warnings = 0;
+nTotErrors = nTotWarnings = 0;
+dpsetting = 0;
 codeptr = 0;
+suppress = 0;
 condline = 0;
+ifcount = 0;
 printovr = 0;
+nRepNext = 0;
+nSkipCount = 0;
+tfradr = 0;
+tfradrset = 0;
+
+nCurLine = nCurCol = nCurPage = 0;      /* listing layout                    */
+nLinesPerPage = 66;
+nColsPerLine = 80;
+szTitle[0] = szSubtitle[0] = szListDate[0] = '\0';
+
+memset(&stats, 0, sizeof(stats));       /* statistics and reports            */
+statsing = 0;
+statsname[0] = '\0';
+tracing = 0;
+tracename[0] = '\0';
+tracebase = 0.;
+memset(costmac, 0, sizeof(costmac));
+memset(costfile, 0, sizeof(costfile));
+costing = 0;
+costname[0] = '\0';
+costnested = 0.;
+costlastfn = NULL;
+costlastidx = 0;
+for (i = 0; i <= MEM_COUNT; i++)
+  memacct[i].cur = memacct[i].peak = memacct[i].allocs = 0;
+memreport = 0;
+}
+
+/*****************************************************************************/
+/* assemblemodule : assembles one file of a batch as a module of its own     */
+/*****************************************************************************/
+
+int assemblemodule(int nopts, char *opts[], char *file)
+{
+char **args = (char **)malloc((nopts + 2) * sizeof(char *));
+int rc;
+
+if (!args)
+  return 4;
+memcpy(args, opts,                      /* getoptions() modifies its array   */
+       nopts * sizeof(char *));
+args[nopts] = file;
+args[nopts + 1] = NULL;
+rc = assemble(nopts + 1, args);
+free(args);
+return rc;
+}
+
+/*****************************************************************************/
+/* runbatch : assembles each file as a module of its own (-batch)            */
+/*            the files are handed out to batchjobs worker processes through */
+/*            a pipe; a worker that ended on a fatal error is replaced       */
+/*****************************************************************************/
+
+int runbatch(int nopts, char *opts[], int nfiles, char *files[])
+{
+int i, rc = 0;
+#if UNIX
+int fds[2], running = 0, jobs = batchjobs, status;
+pid_t pid;
+
+if (pipe(fds))
+  {
+  errorout(files[0], 0, 34, "cannot start batch workers");
+  return 4;
+  }
+fflush(stdout);
+for (;;)
+  {
+  while (running < jobs)                /* start (or replace) workers        */
+    {
+    if ((pid = fork()) < 0)
+      break;
+    if (!pid)                           /* worker: assemble the files it     */
+      {                                 /* gets from the pipe                */
+      static char outbuf[0x10000];
+      int r;
+      close(fds[1]);
+      setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+      inbatch = inccaching = 1;
+      rc = 0;
+      while (read(fds[0], &i, sizeof(i)) == sizeof(i))
+        {
+        r = assemblemodule(nopts, opts, files[i]);
+        fflush(stdout);                 /* keep a module's output together   */
+        if (r > rc)
+          rc = r;
+        }
+      exit(rc);
+      }
+    running++;
+    }
+  if (!running)
+    {
+    if (jobs)                           /* no worker could be started        */
+      {
+      errorout(files[0], 0, 34, "cannot start batch workers");
+      rc = 4;
+      }
+    break;
+    }
+  if (fds[1] >= 0)                      /* then hand out all files           */
+    {
+    for (i = 0; i < nfiles; i++)
+      write(fds[1], &i, sizeof(i));
+    close(fds[1]);
+    fds[1] = -1;
+    }
+  if (wait(&status) < 0)
+    break;
+  running--;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) > 2)
+    {
+    rc = 4;                             /* fatal error in a module; a new    */
+    continue;                           /* worker takes over the rest        */
+    }
+  if (WEXITSTATUS(status) > rc)
+    rc = WEXITSTATUS(status);
+  jobs = 0;                             /* normal end: pipe is drained       */
+  }
+if (fds[1] >= 0)
+  close(fds[1]);
+close(fds[0]);
+#else
+inbatch = inccaching = 1;               /* no fork(): one after the other    */
+for (i = 0; i < nfiles; i++)
+  {
+  int r = assemblemodule(nopts, opts, files[i]);
+  if (r > rc)
+    rc = r;
+  }
+inbatch = inccaching = 0;
+#endif
+return rc;
+}
+
+/*****************************************************************************/
+/* assemble : assembles the sources given in a command line                  */
+/*****************************************************************************/
+
+int assemble(int argc, char *argv[])
+{
+static char atexitset = 0;
+int i;
+struct linebuf *pLastLine = NULL;
+double tstart = stattime(), t, tl, tw;
+char **args;
+struct linebuf *pchlast = NULL;
+char *s;
+
+a09reset();
+
+settext("ASM", "A09");                  /* initialize predefined texts       */
+settext("VERSION", VERSNUM);
+settext("PASS", "1");
+settext("FILCHR", RMBDEFCHR);
+setoptiontexts();
+nPredefinedTexts = nTexts;
+
+args = (char **)                        /* keep the command line for -batch  */
+    malloc((argc + 1) * sizeof(char *));
+if (!args)
+  {
+  errorout(argv[0], 0, 22, "memory allocation error");
+  exit(4);
+  }
+memcpy(args, argv, (argc + 1) * sizeof(char *));
+getoptions(argc, argv);
+#if UNIX && !defined(A09_LIBRARY)
+if (watchmode && !inwatch)              /* -watch: assemble until stopped    */
+  {
+  i = runwatch(argc, args);
+  free(args);
+  return i;
+  }
+#endif
+if (batchmode && !inbatch)              /* -batch: each file is a module     */
+  {
+  int nopts = 0, nfiles = 0;
+  printf("A09 Assembler V" VERSION "\n");
+  for (i = 0; i < argc; i++)            /* getoptions() left the files       */
+    if (i &&                            /* in order in argv                  */
+        args[i] == argv[nfiles + 1])
+      argv[nfiles++] = args[i];
+    else
+      args[nopts++] = args[i];
+  i = runbatch(nopts, args, nfiles, argv);
+  free(args);
+  return i;
+  }
+#if UNIX && !defined(A09_LIBRARY)
+if (cachedir[0] && !incache &&          /* -cache: reuse an earlier result   */
+    !statsing && !tracing &&            /* unless timings, a previous image  */
+    !memreport && !costing &&           /* or the reference engine are       */
+    !prevname[0] && fastpaths)          /* involved                          */
+  {
+  i = outcache(argc, args);
+  free(args);
+  return i;
+  }
+#endif
+free(args);
+if (libname[0])                         /* -mklib: no assembly at all        */
+  return makelib(argv + 1);
+if (linkmode)                           /* -link: neither                    */
+  return linkmodules(argv + 1);
+pass = 1;
+loccounter = 0;
+phase = 0;
+error = 0;
+warning = 0;
+nTotErrors = errors = 0;
+nTotWarnings = warnings = 0;
+generating = 0;
+common = 0;
+g_termflg = -1;
+if (!absmode)                           /* in relocating mode                */
+  dpsetting = -1;                       /* there IS no Direct Page           */
+if (outmode != OUT_REL)                 /* Undef->Ext only for RELASMB output*/
+  dwOptions &= ~OPTION_UEX;
+
+if (!inbatch && !incache)               /* a batch shows its banner once     */
+  printf("A09 Assembler V" VERSION "\n");
+
+if ((listing & LIST_ON) &&
+    ((listfile = fopen(listname, "w")) == 0))
+  {
+  errorout(srcname, 0, 19, "Cannot open list file %s", listname);
+  exit(4);
+  }
+if (listing & LIST_ON)
+  {
+  if (!atexitset++)
+    atexit(listexit);                   /* write listing on premature exit   */
+  if (fastpaths)
+    liststart();                        /* start listing thread              */
+  }
+
+if (jsonlisting &&
+    ((jsonfile = fopen(jsonname, "w")) == 0))
+  {
+  errorout(srcname, 0, 29, "Cannot open JSON file %s", jsonname);
+  exit(4);
+  }
+
+if (tracing)
+  {
+  if ((tracefile = fopen(tracename, "w")) == 0)
+    {
+    errorout(srcname, 0, 32, "Cannot open trace file %s", tracename);
+    exit(4);
+    }
+  tracebase = tstart;                   /* start with process metadata       */
+  fprintf(tracefile, "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"args\":{\"name\":\"A09 %s\"}}", VERSION);
+  }
+
+for (i = 0; i < nsymimports; i++)       /* -i: import symbol files           */
+  importsyms(symimports[i]);
+if (pchname[0])                         /* -pch: the precompiled header      */
+  {                                     /* comes first                       */
+  sprintf(pchsnap, "%.*s", FNLEN - 4, pchname);
+  if (!(s = strrchr(pchsnap, '.')) ||   /* replace the extension by .pch,    */
+      strpbrk(s, "/\\") ||              /* unless the header has that one    */
+      !stricmp(s, ".pch"))              /* already                           */
+    s = pchsnap + strlen(pchsnap);
+  strcpy(s, ".pch");
+  pchstate = pchstatehash();
+  if (!fastpaths)                       /* reference engine: plain source    */
+    pLastLine = readfile(pchname, 0, pLastLine);
+  else if (!pchload())                  /* no up-to-date snapshot: assemble  */
+    {                                   /* it and take one                   */
+    pLastLine = readfile(pchname, 0, pLastLine);
+    pchlast = pLastLine;
+    }
+  }
+pchmain[0] = nfnms;
+for (i = 1; argv[i]; i++)               /* read in all source files          */
+  pLastLine = readfile(argv[i], 0, pLastLine);
+pchmain[1] = nfnms;
+if (pchlast)
+  pchnext = pchlast->next;
+if (!rootline)                          /* if no lines in there              */
+  {
+  errorout(srcname, 0, 23, "no source lines in file");
+  if (((dwOptions & OPTION_LP1) || pass == 2) &&
+      (listing & LIST_ON))
+    putlist( "*** Error 23: no source lines in file\n");
+  exit(4);
+  }
+
+                                        /* Pass 1 - parse all symbols        */
+if ((listing & LIST_ON) && (dwOptions & OPTION_LP1))
+  putlist( "*** Pass 1 ***\n\n");
+
+t = stattime();
+tl = stats.tload;
+processfile(rootline);
+stats.tpass[1] = stattime() - t -       /* includes are loaded in pass 1     */
+                 (stats.tload - tl);
+traceevent("pass 1", "pass", t, -1, NULL, 0);
+if (memreport)
+  outmem(1);
+if (errors)
+  {
+  printf("%ld error(s) in pass 1\n",errors);
+  if ((listing & LIST_ON) && (dwOptions & OPTION_LP1))
+    putlist("%s%ld error(s) in pass 1.\n",
+            (dwOptions & OPTION_LPA) ? "* " : "", errors);
+  nTotErrors = errors;
+  }
+if (warnings)
+  {
+  printf("%ld warning(s) in pass 1\n", warnings);
+  if ((listing & LIST_ON) && (dwOptions & OPTION_LP1))
+    putlist("%s%ld warning(s) in pass 1.\n",
+            (dwOptions & OPTION_LPA) ? "* " : "",
+            warnings);
+  nTotWarnings = warnings;
+  }
+if (failfast && nTotErrors)             /* fail fast: no pass 2, no output   */
+  {
+  printf("assembly stopped after pass 1\n");
+  if (listing & LIST_ON)
+    putlist("%s%ld error(s) in pass 1, assembly stopped.\n",
+            (dwOptions & OPTION_LPA) ? "* " : "", nTotErrors);
+  if (outmode >= OUT_BIN)               /* don't leave an old object file    */
+    unlink(objname);
+  if (statsing)
+    outstats();
+  return 1;                             /* listing is flushed by listexit()  */
+  }
 
-if (inMacro)
-  curline->flg |= LINCAT_MACDEF;
+                                        /* Pass 2 - generate output          */
+pass = 2;
+settext("PASS", "2");
+loccounter = 0;
+phase = 0;
+errors = 0;
+warnings = 0;
+generating = 0;
+reldataorg = -2;
+reldatasize = 0;
+g_termflg = -1;
+memset(bUsedBytes, 0, sizeof(bUsedBytes));
+for (i = 0; i < symtable.counter; i++)   /* reset all PASSED flags            */
+  if (symtable.rec[i].cat != SYMCAT_COMMONDATA)
+    symtable.rec[i].u.flags &= ~SYMFLAG_PASSED;
+xrefing = xreffile ||                   /* record cross-references for -xref */
+          ((listing & LIST_ON) &&       /* or a listing with OPT XRF; pass 1 */
+           (dwOptions & OPTION_XRF));   /* left the options as they end up   */
+if (dwOptions & OPTION_UEX)
+  {                                     /* make all undefined symbols extern */
+  for (i = 0; i < symtable.counter; i++)
+    if (symtable.rec[i].cat == SYMCAT_UNRESOLVED)
+      symtable.rec[i].cat = SYMCAT_EXTERN;
+  }
 
-if (isValidNameChar(*srcptr, 1))        /* look for label on line start      */
+if (listing & LIST_ON)
   {
-  scanname();
-  lp = findsym(namebuf, 1);
-  if (*srcptr == ':')                   /* skip : following label            */
-    srcptr++;
-
-  if (lp)
+  if ((dwOptions & OPTION_LP1))
     {
-    if ((lp->cat != SYMCAT_COMMONDATA) &&
-        (lp->u.flags & SYMFLAG_FORWARD))
-      lp->u.flags |= SYMFLAG_PASSED;
-    if ((absmode) &&
-        (lp->cat == SYMCAT_PUBLICUNDEF ||
-         lp->cat == SYMCAT_PUBLIC))
-      lp->u.flags |= SYMFLAG_ABSOLUTE;
+    if (dwOptions & OPTION_PAG)
+      PageFeed();
+    else
+      putlist("\n");
+    putlist( "*** Pass 2 ***\n\n");
     }
+  else if (nTotErrors || nTotWarnings)
+    putlist("%s%ld error(s), %ld warning(s) unlisted in pass 1\n",
+            (dwOptions & OPTION_LPA) ? "* " : "",
+            nTotErrors, nTotWarnings);
+  }
 
-  lpLabel = lp;
-  } 
-skipspace();
-
-if (*srcptr == '\\')                    /* if macro explicitly prohibited    */
+if ((outmode >= OUT_BIN) &&
+    ((objfile = fopen(objname,
+                     ((outmode != OUT_SREC) && (outmode != OUT_IHEX)) ? "wb" : "w"))
+                     == 0))
   {
-  srcptr++;
-  nomac = 1;
+  errorout(srcname, 0, 20, "cannot write object file %s", objname);
+  if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
+    putlist( "*** Error 20: cannot write object file %s\n", objname);
+  exit(4);
   }
 
-if (isValidNameChar(*srcptr, 1))        /* mnemonic or macro name            */
+if ((outmode == OUT_LZB ||               /* if collecting a memory image      */
+     prevname[0] || keepimage) &&
+    ((memimage = (unsigned char *)malloc(0x10000)) == NULL))
   {
-  scanname();
-  if (!nomac)                           /* if macro allowed                  */
-    lpmac = findsym(namebuf, 0);        /* look whether opcode is a macro    */
-  if (lpmac && lpmac->cat == SYMCAT_MACRO)
-    {
-    if (pass == 1 &&                    /* if in pass 1 and not in macro def */
-        !LINE_IS_MACDEF(curline->flg))
-      {                                 /* if on top level,                  */
-      if (!LINE_IS_MACEXP(curline->flg))
-        curline->flg |= LINCAT_MACINV;  /* mark as macro invocation          */
-      if (dwOptions & OPTION_DLM)
-        setlabel(lp);
-      if (++lvlMacro <= LINCAT_LVLMASK)
-        expandmacro(lp, lpmac);         /* expand macro below current line   */
-      else                              /* unless nesting level is too deep  */
-        error |= ERR_NESTING;
-      }
-    }
-  else                                  /* no macro, so check mnemonics      */
-    {
-    if ((dwOptions & OPTION_H09) &&     /* adjust some mnemonics             */
-        ((!strcmp(unamebuf, "ASLD")) || /* that are available in the 6309    */
-        (!strcmp(unamebuf, "ASRD")) ||  /* but are implemented as (slower)   */
-        (!strcmp(unamebuf, "LSLD")) ||  /* convenience instructions on the   */
-        (!strcmp(unamebuf, "LSRD")) ||  /* 6809                              */
-        (!strcmp(unamebuf, "DECD")) ||
-        (!strcmp(unamebuf, "INCD")) ||
-        (!strcmp(unamebuf, "CLRD"))))
-      strcat(unamebuf, "63");
-    op = findop(unamebuf);
-    if (op)
-      {
-      if ((dwOptions & OPTION_TSC))     /* if TSC compatible, skip space NOW */
-        skipspace();                    /* since it's not allowed inside arg */
-      if (op->cat != OPCAT_PSEUDO)
-        {
-        setlabel(lp);
-        if (!inMacro)
-          generating = 1;
-        }
-      co = op->code;
-      cat = op->cat;
-                                        /* only pseudo-ops in common mode!   */
-      if (common && (cat != OPCAT_PSEUDO))
-        error |= ERR_EXPR;
+  errorout(srcname, 0, 22, "memory allocation error");
+  exit(4);
+  }
 
-      noimm = cat & OPCAT_NOIMM;        /* isolate "no immediate possible"   */
-      cat &= ~OPCAT_NOIMM;
-      if (dwOptions & OPTION_H11)       /* if in 86HC11 mode,                */
-        {                               /* isolate pageXX flag               */
-        page = cat & (OPCAT_PAGE18 | OPCAT_PAGE1A);
-        cat &= ~(OPCAT_PAGE18 | OPCAT_PAGE1A);
-        }
-      if (dwOptions & OPTION_H09)       /* if in HD6309 mode,                */
-        cat &= ~OPCAT_6309;             /* mask out the 6309 flag (=allow)   */
-      if (dwOptions & OPTION_H01)       /* if in HD6301 mode,                */
-        cat &= ~OPCAT_6301;             /* mask out the 6301 flag (=allow)   */
-      switch (cat)
-        {
-        case OPCAT_ONEBYTE :
-          onebyte(co);
-          break;
-        case OPCAT_TWOBYTE :
-          twobyte(co);
-          break;
-        case OPCAT_THREEBYTE :
-          threebyte(co);
-          break;
-        case OPCAT_FOURBYTE :
-          fourbyte(co);
-          break;
-        case OPCAT_2IMMBYTE :           /* 6309 only                         */
-          putbyte((unsigned char)(co >> 8));
-          /* fall thru on purpose! */
-        case OPCAT_IMMBYTE :
-          oneimm(co);
-          break;
-        case OPCAT_LEA :
-          lea(co);
-          break;
-        case OPCAT_SBRANCH :
-          sbranch(co);
-          break;
-        case OPCAT_LBR2BYTE :
-          lbranch(co);
-          break;
-        case OPCAT_LBR1BYTE :
-          lbra(co);
-          break;
-        case OPCAT_2ARITH :             /* 6309 only                         */
-          putbyte((unsigned char)(co >> 8));
-          /* fall thru on purpose! */
-        case OPCAT_ARITH :
-          arith(co, noimm);
-          break;
-        case OPCAT_ACCARITH :           /* 6800-style arith                  */
-          accarith(co, noimm, 0);
-          break;
-        case OPCAT_OACCARITH :          /* potential 6800-style arith        */
-          accarith(co, noimm, 1);
-          break;
-        case OPCAT_DBLREG1BYTE :
-          if ((dwOptions & OPTION_H11) && (page & OPCAT_PAGE18))
-            darith18(co, noimm);
-          else if ((dwOptions & OPTION_H11) && (page & OPCAT_PAGE1A))
-            darith1a(co, noimm);
-          else
-            darith(co, noimm);
-          break;
-        case OPCAT_DBLREG2BYTE :
-          d2arith(co, noimm);
-          break;
-        case OPCAT_SINGLEADDR :
-          oneaddr(co);
-          break;
-        case OPCAT_IREG :                 /* 6309 only                         */
-          putbyte((unsigned char)(co >> 8));
-          /* fall thru on purpose! */
-        case OPCAT_2REG :
-          tfrexg(co);
-          break;
-        case OPCAT_STACK :
-          pshpul(co, 0);
-          break;
-        case OPCAT_BITDIRECT :          /* 6301/6309 only                    */
-          bitdirect(co);
-          break;
-        case OPCAT_BITTRANS :           /* 6309 only                         */
-          bittrans(co);
-          break;
-        case OPCAT_BLOCKTRANS :         /* 6309 only                         */
-          blocktrans(co);
-          break;
-        case OPCAT_QUADREG1BYTE :
-          qarith(co, noimm);
-          break;
-        case OPCAT_IDXEXT :
-          idxextarith(co);
-          break;
-        case OPCAT_ACCADDR :
-          accaddr(co);
-          break;
-        case OPCAT_SETMASK :            /* 68HC11 only                       */
-          setmask(co);
-          break;
-        case OPCAT_BRMASK :             /* 68HC11 only                       */
-          brmask(co);
-          break;
-        case OPCAT_OSTACK :
-          pshpul(co, 1);
-          break;
-        case OPCAT_PSEUDO :
-          pseudoop(co, lp);
-          break;
-        default :
-          error |= ERR_ILLEGAL_MNEM;
-          break;
-        }
-      c = *srcptr;                      /* get current character             */
-      if (((dwOptions & OPTION_TSC) && (c == '*')) ||
-          ((dwOptions & OPTION_GAS) && (c == '|')) ||
-          (c == ';'))
-        c = '\0';
-      if (c != ' ' &&
-          *(srcptr - 1) != ' ' &&
-          c != '\0')
-        error |= ERR_ILLEGAL_ADDR; 
-      }
-    else
-      error |= ERR_ILLEGAL_MNEM;
-    }
+if (outmode == OUT_REL)                 /* if writing FLEX Relocatable       */
+  {
+  writerelcommon();                     /* write out common blocks           */
+  relhdrfoff = ftell(objfile);
+  writerelhdr(0);                       /* write out initial header          */
+  relabsfoff = -1;
   }
-else
+
+t = stattime();
+processfile(rootline);
+stats.tpass[2] = stattime() - t;
+traceevent("pass 2", "pass", t, -1, NULL, 0);
+if (memreport)
+  outmem(2);
+
+if (errors)
   {
-  nRepNext = 0;                         /* reset possible repeat if no code  */
-  setlabel(lp);
-  c = *srcptr;                          /* now look where we are at ...      */
-  if ((c == '*') ||
-      ((dwOptions & OPTION_GAS) && (c == '|')) ||
-      (c == ';'))
-    c = '\0';
-  if (c)                                /* if NOT empty or comment,          */
-    error |= ERR_EXPR;                  /* mark as invalid expression        */
+  printf("%ld error(s) in pass 2\n", errors);
+  nTotErrors += errors;
+  }
+if (warnings)
+  {
+  printf("%ld warning(s) in pass 2\n", warnings);
+  nTotWarnings += warnings;
   }
 
-if (inMacro)                            /* if in macro definition            */
+if (listing & LIST_ON)
   {
-  codeptr = 0;                          /* ignore the code                   */
-  error &= (ERR_MALLOC | ERR_NESTING);  /* ignore most errors                */
-  warning &= WRN_SYM;                   /* ignore most warnings              */
+  listend(errors, warnings,             /* list summary and tables; this is  */
+          nTotErrors, nTotWarnings);    /* done while writing the object file*/
   }
+else if (inbatch)                       /* tell the modules apart            */
+  printf("%s: last assembled address: %04X\n", srcname, loccounter - 1);
+else
+  printf("Last assembled address: %04X\n", loccounter - 1);
 
-if (pass == 2)
+t = stattime();
+if (prevname[0])                        /* if writing delta output           */
   {
-  outbuffer();
-  if ((listing & LIST_ON) &&
-      (dwOptions & OPTION_LIS))
-    outlist(op, lpLabel);
+  tw = stattime();
+  writedelta();
+  traceevent("writedelta", "output", tw, -1, NULL, 0);
   }
-else if ((listing & LIST_ON) &&
-         (dwOptions & OPTION_LIS) &&
-         (dwOptions & OPTION_LP1))
+if (xreffile)                           /* if writing cross-reference db     */
   {
-  if (curline->flg & LINCAT_MACEXP ||   /* prevent 2nd listing of macro      */
-      !curline->next ||                 /* since this is done in expansion   */
-      !(curline->next->flg & LINCAT_MACEXP))
-    outlist(op, lpLabel);
+  tw = stattime();
+  writexref();
+  traceevent("writexref", "output", tw, -1, NULL, 0);
+  }
+if (symfile)                            /* if writing the symbol file        */
+  {
+  tw = stattime();
+  writesyms();
+  traceevent("writesyms", "output", tw, -1, NULL, 0);
+  }
+if (depfile)                            /* if writing make dependencies      */
+  {
+  tw = stattime();
+  writedeps();
+  traceevent("writedeps", "output", tw, -1, NULL, 0);
   }
 
-if (error || warning)
-  report();
-loccounter += codeptr;
+tw = stattime();
+switch (outmode)                        /* look whether object cleanup needed*/
+  {
+  case OUT_SREC :                       /* Motorola S51-09                   */
+    flushhex();
+    chksum = (tfradr & 0xff) + ((tfradr >> 8) & 0xff) + 3;
+    fprintf(objfile, "S903%04X%02X\n", tfradr, 0xff - (chksum & 0xff));
+    break;
+  case OUT_IHEX :                       /* Intel Hex                         */
+    flushihex();
+#if 0
+    /* put transfer address in here... unfortunately, the official
+       Intel documentation doesn't allow this mechanism */
+    chksum = ((tfradr >> 8) & 0xff) + (tfradr & 0xff) + 1;
+    fprintf(objfile, ":00%04X01%02X\n", tfradr, (-(signed)chksum) & 0xff);
+#else
+    fprintf(objfile, ":00000001FF\n");
+#endif
+    break;
+  case OUT_FLEX :                       /* FLEX binary                       */
+    flushflex();
+    if (tfradrset)                      /* if transfer address set           */
+      {                                 /* write out transfer address block  */
+      fputc(0x16, objfile);
+      fputc((tfradr >> 8) & 0xff, objfile);
+      fputc(tfradr & 0xff, objfile);
+      }
+    break;
+  case OUT_REL :                        /* FLEX Relocatable                  */
+
+    if (absmode)                        /* if producing an absolute module   */
+      {                                 /* correct the last object record    */
+      long curoff = ftell(objfile);
+      if (relabsfoff >= 0)
+        {
+        long blockcnt = curoff - relabsfoff - 4;
+        fseek(objfile, relabsfoff, SEEK_SET);
+        fputc((unsigned char)(blockcnt >> 8), objfile);
+        fputc((unsigned char)(blockcnt & 0xFF), objfile);
+        fseek(objfile, curoff, SEEK_SET);
+        }
+      /* relabsfoff = curoff; */
+      }
+
+    writerelext();                      /* write out External table          */
+    writerelglobal();                   /* write out Global table            */
+    writerelmodname();                  /* write out Module Name             */
+
+    i = (int)ftell(objfile);            /* fill last sector with zeroes      */
+    while (i % 252)
+      {
+      fputc(0, objfile);
+      i++;
+      }
+                                        /* reposition on header              */
+    fseek(objfile, relhdrfoff, SEEK_SET);
+    writerelhdr(0);                     /* rewrite completed header          */
+    break;
+  case OUT_LZB :                        /* LZ-compressed binary              */
+    writelzb();
+    break;
+  }
+
+if (objfile)
+  fclose(objfile);
+objfile = NULL;
+traceevent(objname, "output", tw, -1, NULL, 0);
+if (jsonfile)
+  fclose(jsonfile);
+jsonfile = NULL;
+if (listfile)
+  {
+  tw = stattime();
+  listclose();
+  traceevent(listname, "output", tw, -1, NULL, 0);
+  }
+stats.toutput = stattime() - t;
+stats.ttotal = stattime() - tstart;
+if (costing &&                          /* if cost report not in the listing */
+    (costname[0] || !(listing & LIST_ON)))
+  writecost();
+if (statsing)
+  outstats();
+if (tracefile)
+  {
+  traceevent("a09", "total", tstart, -1, NULL, 0);
+  fprintf(tracefile, "]\n");
+  fclose(tracefile);
+  tracefile = NULL;
+  }
+
+if (errors && outmode >= OUT_BIN)
+  unlink(objname);
+
+return (errors) ? 1 : 0;
 }
 
 /*****************************************************************************/
-/* suppressline : suppresses a line                                          */
+/* liba09 : the assembler as a library                                       */
+/*          the assembler's state is global, so a context holds the inputs   */
+/*          and results of an assembly; a09assemble() serializes all callers */
+/*          and resets the state before and after each run                   */
+/*****************************************************************************/
+
+#ifdef A09_LIBRARY
+#undef printf
+#undef exit
+
+struct a09context
+  {
+  int nargs;                            /* # command line arguments          */
+  char *args[MAXFILES + 64];            /* command line arguments            */
+  int nsrcs;                            /* # memory sources                  */
+  struct memsrc srcs[MAXFILES];         /* memory sources (copies)           */
+  char *console;                        /* collected console output          */
+  size_t conlen, consize;               /* used / allocated console size     */
+  unsigned char image[0x10000];         /* generated code                    */
+  unsigned char used[8192];             /* 1 bit per used byte in image      */
+  int hasimage;                         /* image is valid                    */
+  A09SYMBOL *syms;                      /* symbols after the assembly        */
+  int nsyms;
+  A09DIAG *diags;                       /* errors and warnings               */
+  int ndiags, diagsize;
+  int rc;                               /* exit code of the assembly         */
+  jmp_buf env;                          /* return point for a09exit()        */
+  };
+
+pthread_mutex_t a09lock = PTHREAD_MUTEX_INITIALIZER;
+A09CONTEXT *a09ctx = NULL;              /* context currently assembling      */
+
+/*****************************************************************************/
+/* a09printf : collects console output in the current context                */
 /*****************************************************************************/
 
-void suppressline()
+int a09printf(const char *format, ...)
 {
-struct oprecord * op = NULL;
+va_list argp;
+int n;
+A09CONTEXT *ctx = a09ctx;
+
+if (!ctx)
+  return 0;
+va_start(argp, format);
+n = vsnprintf(NULL, 0, format, argp);
+va_end(argp);
+if (n < 0)
+  return n;
+if (ctx->conlen + n + 1 > ctx->consize)
+  {
+  size_t size = (ctx->conlen + n + 1) * 2;
+  char *p = (char *)realloc(ctx->console, size);
+  if (!p)
+    return -1;
+  ctx->console = p;
+  ctx->consize = size;
+  }
+va_start(argp, format);
+vsnprintf(ctx->console + ctx->conlen, n + 1, format, argp);
+va_end(argp);
+ctx->conlen += n;
+return n;
+}
 
-srcptr = srcline;
-oldlc = loccounter;
-codeptr = 0;
-condline = 0;
-if (nSkipCount > 0)
+/*****************************************************************************/
+/* a09exit : ends the current assembly instead of the process                */
+/*****************************************************************************/
+
+void a09exit(int rc)
+{
+if (!a09ctx)
+  exit(rc);
+a09ctx->rc = rc;
+longjmp(a09ctx->env, 1);
+}
+
+/*****************************************************************************/
+/* a09diag : collects an error or warning in the current context             */
+/*****************************************************************************/
+
+void a09diag(char *fn, long ln, int num, int warn, char *msg)
+{
+A09CONTEXT *ctx = a09ctx;
+A09DIAG *d;
+
+if (ctx->ndiags >= ctx->diagsize)
   {
-  nSkipCount--;
-  condline = 1;                         /* this is STILL conditional         */
+  int size = ctx->diagsize ? ctx->diagsize * 2 : 16;
+  A09DIAG *p = (A09DIAG *)realloc(ctx->diags, size * sizeof(A09DIAG));
+  if (!p)
+    return;
+  ctx->diags = p;
+  ctx->diagsize = size;
+  }
+d = ctx->diags + ctx->ndiags++;
+d->fn = strdup(fn ? expandfn(fn) : "");
+d->ln = ln;
+d->pass = pass;
+d->num = num;
+d->warning = warn;
+d->msg = strdup(msg);                   /* errorout() passes a local buffer  */
+}
+
+/*****************************************************************************/
+/* a09clear : releases the results of the last assembly                      */
+/*****************************************************************************/
+
+void a09clear(A09CONTEXT *ctx)
+{
+int i;
+
+for (i = 0; i < ctx->nsyms; i++)
+  free(ctx->syms[i].name);
+free(ctx->syms);
+ctx->syms = NULL;
+ctx->nsyms = 0;
+for (i = 0; i < ctx->ndiags; i++)
+  {
+  free(ctx->diags[i].fn);
+  free((char *)ctx->diags[i].msg);
+  }
+ctx->ndiags = 0;
+ctx->conlen = 0;
+if (ctx->console)
+  ctx->console[0] = '\0';
+ctx->hasimage = 0;
+ctx->rc = 0;
+}
+
+/*****************************************************************************/
+/* a09create : creates an assembler context                                  */
+/*****************************************************************************/
+
+A09CONTEXT *a09create(void)
+{
+return (A09CONTEXT *)calloc(1, sizeof(A09CONTEXT));
+}
+
+/*****************************************************************************/
+/* a09destroy : releases an assembler context                                */
+/*****************************************************************************/
+
+void a09destroy(A09CONTEXT *ctx)
+{
+int i;
+
+if (!ctx)
+  return;
+a09clear(ctx);
+for (i = 0; i < ctx->nargs; i++)
+  free(ctx->args[i]);
+for (i = 0; i < ctx->nsrcs; i++)
+  {
+  free(ctx->srcs[i].name);
+  free((char *)ctx->srcs[i].text);
   }
-else
+free(ctx->diags);
+free(ctx->console);
+free(ctx);
+}
+
+/*****************************************************************************/
+/* a09option : adds a command line argument (option or file name)            */
+/*****************************************************************************/
+
+int a09option(A09CONTEXT *ctx, const char *arg)
+{
+if (ctx->nargs >= (int)(sizeof(ctx->args) / sizeof(ctx->args[0])) - 2 ||
+    !(ctx->args[ctx->nargs] = strdup(arg)))
+  return -1;
+ctx->nargs++;
+return 0;
+}
+
+/*****************************************************************************/
+/* a09source : adds a source file that is read from memory                   */
+/*             a name that is already known replaces that file's text        */
+/*****************************************************************************/
+
+int a09source(A09CONTEXT *ctx, const char *name, const char *text, size_t len)
+{
+int i;
+char *copy = (char *)malloc(len + 1);
+
+if (!copy)
+  return -1;
+memcpy(copy, text, len);
+copy[len] = '\0';
+for (i = 0; i < ctx->nsrcs; i++)
+  if (!strcmp(ctx->srcs[i].name, name))
+    break;
+if (i == ctx->nsrcs)
   {
-  if (isalnum(*srcptr))
+  if (i >= MAXFILES || !(ctx->srcs[i].name = strdup(name)))
     {
-    scanname();
-    if (*srcptr == ':')
-      srcptr++;
+    free(copy);
+    return -1;
     }
-  skipspace();
-  scanname();
-  op = findop(unamebuf);
-  if (op && op->cat == OPCAT_PSEUDO)    /* examine pseudo-ops in detail      */
-    {
-    if ((op->code == PSEUDO_IF) ||      /* IF variants                       */
-        (op->code == PSEUDO_IFN) ||
-        (op->code == PSEUDO_IFC) ||
-        (op->code == PSEUDO_IFNC) ||
-        (op->code == PSEUDO_IFD) ||
-        (op->code == PSEUDO_IFND))
-      {
-      ifcount++;
-      condline = 1;                     /* this is a conditional line        */
-      }
-    else if (op->code == PSEUDO_ENDIF)  /* ENDIF                             */
-      {
-      if (ifcount > 0)
-        ifcount--;
-      else if (suppress == 1 || suppress == 2)
-        suppress = 0;
-      condline = 1;                     /* this is a conditional line        */
-      }
-    else if (op->code == PSEUDO_ELSE)   /* ELSE                              */
-      {
-      if (ifcount == 0 && suppress == 2)
-        suppress = 0;
-      condline = 1;                     /* this is a conditional line        */
-      }
-    }  
+  ctx->nsrcs++;
   }
+else
+  free((char *)ctx->srcs[i].text);
+ctx->srcs[i].text = copy;
+ctx->srcs[i].len = len;
+return 0;
+}
 
-if (((pass == 2) || (dwOptions & OPTION_LP1)) &&
-    (listing & LIST_ON) &&
-    (dwOptions & OPTION_LIS))
-  outlist(op, NULL);
+/*****************************************************************************/
+/* a09assemble : assembles with the context's options and sources            */
+/*               returns a09's exit code: 0 ok, 1 errors, 2 usage, 4 fatal   */
+/*****************************************************************************/
+
+int a09assemble(A09CONTEXT *ctx, const char *name)
+{
+char *argv[MAXFILES + 64 + 2];          /* "a09", the args, name and NULL    */
+int argc = 0, i, j;
+
+pthread_mutex_lock(&a09lock);
+a09clear(ctx);
+argv[argc++] = "a09";
+for (i = 0; i < ctx->nargs; i++)
+  argv[argc++] = ctx->args[i];
+if (name)
+  argv[argc++] = (char *)name;
+argv[argc] = NULL;
+
+a09ctx = ctx;
+if (!setjmp(ctx->env))
+  {
+  memcpy(memsrcs, ctx->srcs, ctx->nsrcs * sizeof(struct memsrc));
+  nmemsrcs = ctx->nsrcs;                /* assemble() resets all but these   */
+  keepimage = 1;
+  diaghook = a09diag;
+  ctx->rc = assemble(argc, argv);
+  }
+
+if (memimage && pass == 2)              /* copy out the results              */
+  {
+  for (i = 0; i < 0x10000; i++)
+    ctx->image[i] = (bUsedBytes[i / 8] & (1 << (i % 8))) ? memimage[i] : 0;
+  memcpy(ctx->used, bUsedBytes, sizeof(ctx->used));
+  ctx->hasimage = 1;
+  }
+ctx->syms = (A09SYMBOL *)calloc(symtable.counter + 1, sizeof(A09SYMBOL));
+for (i = j = 0; ctx->syms && i < symtable.counter; i++)
+  if (symtable.rec[i].cat != SYMCAT_EMPTY &&
+      symtable.rec[i].cat != SYMCAT_TEXT &&
+      symtable.rec[i].cat != SYMCAT_MACRO &&
+      (ctx->syms[j].name = strdup(symtable.rec[i].name)) != NULL)
+    {
+    ctx->syms[j].value = symtable.rec[i].value;
+    ctx->syms[j++].cat = symtable.rec[i].cat;
+    }
+ctx->nsyms = j;
+
+a09reset();                             /* leave nothing behind              */
+keepimage = 0;
+diaghook = NULL;
+nmemsrcs = 0;
+a09ctx = NULL;
+pthread_mutex_unlock(&a09lock);
+return ctx->rc;
+}
+
+/*****************************************************************************/
+/* a09image : returns the generated code and its used-byte bitmap            */
+/*****************************************************************************/
+
+const unsigned char *a09image(A09CONTEXT *ctx, const unsigned char **used)
+{
+if (used)
+  *used = ctx->hasimage ? ctx->used : NULL;
+return ctx->hasimage ? ctx->image : NULL;
+}
+
+/*****************************************************************************/
+/* a09symbols / a09symbol : access the symbol table of the last assembly     */
+/*****************************************************************************/
+
+int a09symbols(A09CONTEXT *ctx)
+{
+return ctx->nsyms;
+}
+
+const A09SYMBOL *a09symbol(A09CONTEXT *ctx, int i)
+{
+return (i >= 0 && i < ctx->nsyms) ? ctx->syms + i : NULL;
+}
+
+/*****************************************************************************/
+/* a09diags / a09diagnostic : access the errors and warnings                 */
+/*****************************************************************************/
+
+int a09diags(A09CONTEXT *ctx)
+{
+return ctx->ndiags;
+}
+
+const A09DIAG *a09diagnostic(A09CONTEXT *ctx, int i)
+{
+return (i >= 0 && i < ctx->ndiags) ? ctx->diags + i : NULL;
+}
+
+/*****************************************************************************/
+/* a09console : returns the console output of the last assembly              */
+/*****************************************************************************/
+
+const char *a09console(A09CONTEXT *ctx)
+{
+return ctx->console ? ctx->console : "";
 }
+#endif
+
+#if UNIX && !defined(A09_LIBRARY)
+char *servesock = NULL;                 /* socket the server listens on      */
 
 /*****************************************************************************/
-/* usage : prints out correct usage                                          */
+/* serverstop : removes the server socket when the server is terminated      */
 /*****************************************************************************/
 
-void usage(char *nm)
+void serverstop(int sig)
 {
-printf("Usage: %s [-option*] srcname*\n",
-       nm ? nm : "a09");
-printf("Available options are:\n");
-printf("-B[objname] ........ output to binary file (default)\n");
-printf("-F[objname] ........ output to FLEX binary file\n");
-/* printf("-G[objname] ........ output Gnu .o format file\n"); */
-printf("-R[objname] ........ output to FLEX relocatable object file\n");
-printf("-S[objname] ........ output to Motorola S51-09 file\n");
-printf("-X[objname] ........ output to Intel Hex file\n");
-printf("-L[listname] ....... create listing file \n");
-printf("-C ................. suppress code output\n");
-printf("-Dsymbol[=value] ... predefines a symbol\n");
-printf("                     for TSC 6809 Assembler compatibility,\n");
-printf("                     you should only use symbols A through C\n");
-printf("-Ooption ........... sets an option (as in OPT pseudoop)\n");
-printf("-W ................. suppress warnings\n");
-printf("srcname ............ source file name(s)\n");
-
-exit(2);
+unlink(servesock);
+signal(sig, SIG_DFL);
+raise(sig);
 }
 
 /*****************************************************************************/
-/* getoptions : retrieves the options from the passed argument array         */
+/* cachedassemble : assembles in a child process with the include cache      */
+/*                  the files the child reads are loaded here, too, so the   */
+/*                  following children inherit them; returns the child's    */
+/*                  exit code or -1 if it couldn't be started. readlist, if  */
+/*                  not NULL, gets the names of these files, each one ended  */
+/*                  by a NUL byte and the list by an empty one (or NULL)     */
 /*****************************************************************************/
 
-void getoptions (int argc, char* argv[])
+int cachedassemble(int argc, char *argv[], int out, char **readlist)
 {
-int i, j;
-char *ld;
-
-for (i = 1; i < argc; i++)
+char *names = NULL, *p, *end;
+size_t nlen = 0, nsize = 0;
+ssize_t n;
+int fds[2], status, rc = 4;
+pid_t pid;
+
+if (readlist)
+  *readlist = NULL;
+fflush(stdout);
+if (pipe(fds))
+  return -1;
+if (!(pid = fork()))                    /* the child assembles               */
   {
-#if !UNIX
-  /* code for DOS / Windows / OS2 */
-  if ((argv[i][0] == '-') ||
-      (argv[i][0] == '/'))
-#else
-  /* code for UNIX derivates */
-  if (argv[i][0] == '-')
-#endif
+  close(fds[0]);
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  cachepipe = fds[1];
+  if (out >= 0)                         /* console output goes to out        */
     {
-    for (j = 1; j < (int)strlen(argv[i]); j++)
-      {
-      switch (tolower(argv[i][j]))
-        {
-        case 'c' :                      /* suppress code output              */
-          outmode = OUT_NONE;
-          break;
-        case 'u' :                      /* undefined is treated as external  */
-          dwOptions |= OPTION_UEX;
-          break;
-        case 'b' :                      /* define binary output file         */
-        case 's' :                      /* define Motorola output file       */
-        case 'x' :                      /* define Intel Hex output file      */
-        case 'f' :                      /* define FLEX output file           */
-        case 'r' :                      /* define FLEX relocatable output f. */
-    /*  case 'g' : */                   /* define GNU output file            */
-          strcpy(objname,               /* copy in the name                  */
-                  argv[i] + j + 1);
-          switch (tolower(argv[i][j]))  /* then set output mode              */
-            {
-            case 'b' :
-              outmode = OUT_BIN;
-              break;
-            case 's' :
-              outmode = OUT_SREC;
-              break;
-            case 'x' :
-              outmode = OUT_IHEX;
-              break;
-            case 'f' :
-              outmode = OUT_FLEX;
-              break;
-/*
-            case 'g' :
-              outmode = OUT_GAS;
-              relocatable = 1;
-              dwOptions |= OPTION_REL;
-              break;
-*/
-            case 'r' :
-              outmode = OUT_REL;
-              maxidlen = 8;             /* only 8 significant ID chars!      */
-              relocatable = 1;
-              absmode = 0;
-              break;
-            }
-          j = strlen(argv[i]);          /* advance behind copied name        */
-          break;
-        case 'l' :                      /* define listing file               */
-          strcpy(listname,              /* copy in the name                  */
-                  argv[i] + j + 1);
-          j = strlen(argv[i]);          /* advance behind copied name        */
-          listing = LIST_ON;            /* remember we're listing            */
-          break;
-        case 'd' :                      /* define a symbol ?                 */
-          srcptr = argv[i] + j + 1;     /* parse in the name                 */
-          scanname();
-          if (!namebuf[0])              /* if no name there                  */
-            usage(argv[0]);             /* show usage and get out            */
-          if (*srcptr == '=')           /* if followed by value              */
-            srcptr++;                   /* advance behind it                 */
-          else                          /* otherwise go to ""                */
-            srcptr = argv[i] + strlen(argv[i]);
-          settext(namebuf, srcptr);     /* define the symbol                 */
-          j = strlen(argv[i]);          /* advance behind copied name        */
-          break;
-        case 'o' :                      /* option                            */
-          if (setoption(argv[i] + j + 1))
-            usage(argv[0]);
-          j = strlen(argv[i]);          /* advance behind option             */
-          break;
-        }
-      }
-    for (j = i; j < argc; j++)          /* remove all consumed arguments     */
-      argv[j] = argv[j + 1];
-    argc--;                             /* reduce # arguments                */
-    i--;                                /* and restart with next one         */
+    dup2(out, 1);
+    close(out);
+    }
+  inccaching = 1;
+  exit(assemble(argc, argv));
+  }
+close(fds[1]);
+if (pid < 0)
+  {
+  close(fds[0]);
+  return -1;
+  }
+for (;;)                                /* collect the files it reads        */
+  {
+  if (nlen + 4096 > nsize)
+    {
+    if (!(p = (char *)realloc(names, nsize = nlen + 65536)))
+      break;
+    names = p;
     }
+  if ((n = read(fds[0], names + nlen, nsize - nlen - 1)) <= 0)
+    break;
+  nlen += n;
   }
+close(fds[0]);
+if (waitpid(pid, &status, 0) == pid && WIFEXITED(status))
+  rc = WEXITSTATUS(status);
 
-if (argc < 2)                           /* if not at least one filename left */
-  usage(argv[0]);                       /* complain & terminate              */
+for (p = names;                         /* and load them here, too           */
+     p && p < names + nlen;
+     p = end + 1)
+  {
+  if (!(end = memchr(p, '\n', names + nlen - p)))
+    break;
+  *end = '\0';
+  cacheinclude(p);
+  }
+if (p)                                  /* end of the list                   */
+  *p = '\0';
+if (readlist)
+  *readlist = names;
+else
+  free(names);
+return rc;
+}
 
-strcpy(srcname, argv[1]);               /* copy it in.                       */
+/*****************************************************************************/
+/* serverrequest : handles one request to the assembly server                */
+/*                 the request is the working directory, the # arguments and */
+/*                 the arguments, each terminated by a NUL byte; the answer  */
+/*                 is the console output, a NUL byte and the exit code       */
+/*****************************************************************************/
 
-if (!objname[0])                        /* if no object name defined         */
+void serverrequest(int conn)
+{
+char *req = NULL, *p, *end;
+char **args = NULL;
+size_t len = 0, size = 0;
+ssize_t n;
+int argc, i, rc = 4;
+char answer[2];
+
+for (;;)                                /* read up to the client's EOF       */
   {
-  strcpy(objname, srcname);             /* copy in the source name           */
-  ld = strrchr(objname, '.');           /* look whether there's a dot in it  */
-  if (!ld)                              /* if not                            */
-    ld = objname + strlen(objname);     /* append extension                  */
-  switch (outmode)                      /* which output mode?                */
+  if (len + 4096 > size)
     {
-    case OUT_BIN :                      /* binary ?                          */
-#if !UNIX
-      strcpy(ld, ".bin");               /* DOS / Windows / OS2               */
-#else
-      strcpy(ld, ".b");                 /* UNIX                              */
-#endif
-      break;
-    case OUT_SREC :                     /* Motorola S51-09 ?                 */
-      strcpy(ld, ".s09");
-      break;
-    case OUT_IHEX :                     /* Intel Hex ?                       */
-      strcpy(ld, ".hex");
-      break;
-    case OUT_FLEX :                     /* FLEX binary ?                     */
-      strcpy(ld, ".bin");
-      break;
-    case OUT_GAS :                      /* GNU relocatable object ?          */
-      strcpy(ld, ".o");
-      break;
-    case OUT_REL :                      /* Flex9 relocatable object ?        */
-      strcpy(ld, ".rel");
+    if (!(p = (char *)realloc(req, size = len + 65536)))
       break;
+    req = p;
     }
+  if ((n = read(conn, req + len, size - len - 1)) <= 0)
+    break;
+  len += n;
   }
+if (!req)
+  return;
+req[len] = '\0';
+end = req + len;
+p = req + strlen(req) + 1;              /* 1st: working directory            */
+argc = (p < end) ? atoi(p) : 0;         /* 2nd: # arguments                  */
+if (argc > 0 && argc < 0x10000)
+  args = (char **)malloc((argc + 2) * sizeof(char *));
+if (args)
+  {
+  args[0] = "a09";
+  for (i = 1, p += strlen(p) + 1; i <= argc && p < end; i++)
+    {
+    args[i] = p;
+    p += strlen(p) + 1;
+    }
+  args[i] = NULL;
+  argc = i;
+  }
+if (!args || chdir(req))
+  dprintf(conn, "a09 server: bad request\n");
+else if ((rc = cachedassemble(argc, args, conn, NULL)) < 0)
+  {
+  dprintf(conn, "a09 server: cannot start assembly\n");
+  rc = 4;
+  }
+answer[0] = '\0';
+answer[1] = (char)rc;
+if (write(conn, answer, 2) < 0)
+  rc = 4;
+free(args);
+free(req);
+}
 
-if ((listing & LIST_ON) && !listname[0])/* if no list file specified         */
-  {
-  strcpy(listname, srcname);            /* copy in the source name           */
-  ld = strrchr(listname, '.');          /* look whether there's a dot in it  */
-  if (!ld)                              /* if not                            */
-    ld = listname + strlen(listname);   /* append extension                  */
-  strcpy(ld, ".lst");                   /* .lst                              */
-  }
+/*****************************************************************************/
+/* runserver : serves assembly requests on a UNIX domain socket (-serve)     */
+/*****************************************************************************/
+
+int runserver(char *sockname)
+{
+struct sockaddr_un addr;
+int sock, conn;
+
+memset(&addr, 0, sizeof(addr));
+addr.sun_family = AF_UNIX;
+if (strlen(sockname) >= sizeof(addr.sun_path) ||
+    (sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+  {
+  errorout(sockname, 0, 35, "cannot create server socket");
+  return 4;
+  }
+strcpy(addr.sun_path, sockname);
+unlink(sockname);                       /* remove a stale socket             */
+if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+    listen(sock, 16))
+  {
+  errorout(sockname, 0, 35, "cannot create server socket");
+  close(sock);
+  return 4;
+  }
+signal(SIGPIPE, SIG_IGN);               /* clients may go away               */
+servesock = sockname;                   /* clean up when terminated          */
+signal(SIGINT, serverstop);
+signal(SIGTERM, serverstop);
+printf("A09 Assembler V" VERSION " serving on %s\n", sockname);
+fflush(stdout);
+while ((conn = accept(sock, NULL, NULL)) >= 0)
+  {
+  serverrequest(conn);                  /* one request at a time             */
+  close(conn);
+  }
+close(sock);
+unlink(sockname);
+return 4;
 }
 
 /*****************************************************************************/
-/* processfile : processes the input file                                    */
+/* runclient : passes the command line to an assembly server (-client)       */
+/*             returns -1 if there's no server, so a09 assembles itself      */
 /*****************************************************************************/
 
-void processfile(struct linebuf *pline)
+int runclient(char *sockname, int argc, char *argv[])
 {
-struct linebuf *plast = pline;
+struct sockaddr_un addr;
+char buf[4096], held[2];
+int sock, i, nheld = 0;
+ssize_t n;
+
+memset(&addr, 0, sizeof(addr));
+addr.sun_family = AF_UNIX;
+if (strlen(sockname) >= sizeof(addr.sun_path) ||
+    (sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+  return -1;
+strcpy(addr.sun_path, sockname);
+if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+    !getcwd(buf, sizeof(buf)))
+  {
+  close(sock);
+  return -1;
+  }
+signal(SIGPIPE, SIG_IGN);
+n = write(sock, buf, strlen(buf) + 1);  /* working directory                 */
+sprintf(buf, "%d", argc);
+n = write(sock, buf, strlen(buf) + 1);  /* # arguments                       */
+for (i = 0; i < argc && n >= 0; i++)    /* arguments                         */
+  n = write(sock, argv[i], strlen(argv[i]) + 1);
+shutdown(sock, SHUT_WR);
 
-while (pline)
+while ((n = read(sock, buf,             /* copy the console output,          */
+                 sizeof(buf))) > 0)     /* holding back the last 2 bytes     */
   {
-  if (g_termflg < 0 ||                  /* skip all lines until going up     */
-      (pline->lvl & LINCAT_LVLMASK) < g_termflg)
+  for (i = 0; i < n; i++)
     {
-    curline = pline;
-    error = ERR_OK;
-    warning = WRN_OK;
-    expandtext();                       /* expand text symbols               */
-    srcptr = srcline;
-    if (suppress || nSkipCount)
-      suppressline();
-    else
+    if (nheld == 2)
       {
-      if (nRepNext)
-        {
-        for (; nRepNext > 0; nRepNext--)
-          {
-          processline();
-          error = ERR_OK;
-          warning = WRN_OK;
-          }
-        nRepNext = 0;
-        }
-      else
-        {
-        processline();
-        error = ERR_OK;
-        warning = WRN_OK;
-        }
+      putchar(held[0]);
+      held[0] = held[1];
+      nheld = 1;
       }
+    held[nheld++] = buf[i];
     }
-  plast = pline;
-  pline = pline->next;
   }
-
-if (suppress)
+close(sock);
+if (nheld < 2 || held[0])
   {
-  printf("%s(%ld) : error 18: improperly nested IF statements\n",
-         expandfn(plast->fn), plast->ln);
-  if (((dwOptions & OPTION_LP1) || pass == 2) &&
-      (listing & LIST_ON))
-    putlist( "*** Error 18: improperly nested IF statements\n");
-  errors++;
-  suppress = 0;
+  if (nheld)
+    fwrite(held, 1, nheld, stdout);
+  errorout(sockname, 0, 35, "no answer from server");
+  return 4;
   }
+return (unsigned char)held[1];
+}
 
-if (common)
+struct watchfile                        /* a file -watch is watching         */
   {
-  printf("%s(%ld) : error 24: improperly nested COMMON statements\n",
-         expandfn(plast->fn), plast->ln);
-  if (((dwOptions & OPTION_LP1) || pass == 2) &&
-      (listing & LIST_ON))
-    putlist( "*** Error 24: improperly nested COMMON statements\n");
-  errors++;
-  common = 0;
+  char *name;                           /* its include cache key             */
+  int exists;                           /* whether it existed, and its       */
+  time_t mtime;                         /* time stamp and size when it was   */
+  off_t size;                           /* assembled                         */
+  int wd;                               /* inotify watch of its directory    */
+  };
+
+/*****************************************************************************/
+/* watchchanged : returns the 1st watched file that changed on disk since    */
+/*                it was assembled, appeared or vanished; NULL if none did   */
+/*****************************************************************************/
+
+char *watchchanged(struct watchfile *files, int n)
+{
+struct stat st;
+int i;
+
+for (i = 0; i < n; i++)
+  if (stat(files[i].name, &st) ?
+          files[i].exists :
+          (!files[i].exists ||
+           st.st_mtime != files[i].mtime ||
+           st.st_size != files[i].size))
+    return files[i].name;
+return NULL;
+}
+
+/*****************************************************************************/
+/* runwatch : assembles again whenever one of the source files changes       */
+/*            (-watch); unchanged files come from the include cache          */
+/*****************************************************************************/
+
+int runwatch(int argc, char *argv[])
+{
+struct watchfile files[MAXFILES];
+struct stat st;
+char *names, *changed, *p;
+int i, j, k, n, rc;
+#ifdef __linux__
+int fd;
+char dir[FNLEN + 1];
+char buf[4096]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+struct inotify_event *ev;
+ssize_t len;
+#endif
+
+inwatch = 1;                            /* the children shouldn't watch      */
+for (;;)
+  {
+  rc = cachedassemble(argc, argv, -1, &names);
+  for (n = 0, p = names;                /* note the files it has read, as    */
+       p && *p && n < MAXFILES;         /* they were assembled; they needn't */
+       p += strlen(p) + 1, n++)         /* exist                             */
+    {
+    files[n].name = p;
+    for (j = 0; j < ninccache && strcmp(inccache[j].name, p); j++)
+      ;
+    files[n].exists = (j < ninccache) || !stat(p, &st);
+    files[n].mtime = (j < ninccache) ? inccache[j].mtime : st.st_mtime;
+    files[n].size = (j < ninccache) ? (off_t)inccache[j].len : st.st_size;
+    }
+  for (j = k = 0; j < ninccache; j++)   /* forget the files it doesn't read  */
+    {                                   /* any more                          */
+    for (i = 0; i < n && strcmp(files[i].name, inccache[j].name); i++)
+      ;
+    if (i < n)
+      inccache[k++] = inccache[j];
+    else
+      {
+      free(inccache[j].name);
+      free((char *)inccache[j].text);
+      }
+    }
+  ninccache = k;
+  printf("%s\nwatching %d file(s), press Ctrl-C to stop\n",
+         (rc < 0) ? "cannot start assembly" :
+             (rc ? "assembly failed" : "assembly done"),
+         n);
+  fflush(stdout);
+  changed = watchchanged(files, n);     /* changed while being assembled?    */
+#ifdef __linux__
+  fd = changed ? -1 : inotify_init();
+  for (i = 0; fd >= 0 && i < n; i++)    /* watch their directories, so that  */
+    {                                   /* new and replaced files are        */
+    sprintf(dir, "%.*s",                /* noticed, too                      */
+            FNLEN, files[i].name);
+    if (!(p = strrchr(dir, '/')))
+      strcpy(dir, ".");
+    else
+      p[p == dir] = '\0';
+    files[i].wd = inotify_add_watch(fd, dir,
+                      IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_TO |
+                      IN_MOVED_FROM | IN_DELETE);
+    }
+  while (fd >= 0 && n && !changed &&
+         (len = read(fd, buf, sizeof(buf))) > 0)
+    for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len)
+      {
+      ev = (struct inotify_event *)p;
+      for (i = 0; ev->len && i < n; i++)
+        if (files[i].wd == ev->wd &&
+            !strcmp(ev->name, strrchr(files[i].name, '/') ?
+                                  strrchr(files[i].name, '/') + 1 :
+                                  files[i].name))
+          changed = files[i].name;
+      }
+  if (fd >= 0)
+    close(fd);
+#endif
+  while (!changed)                      /* no inotify: poll the files        */
+    {
+    sleep(1);
+    changed = watchchanged(files, n);
+    }
+  usleep(50000);                        /* let the writer finish             */
+  printf("%s changed, assembling again\n", changed);
+  free(names);
   }
+return 0;
 }
 
 /*****************************************************************************/
-/* main : the main function                                                  */
+/* outcachekey : returns what an assembly depends on apart from the files    */
+/*               it loads: a09 itself, the working directory and the         */
+/*               command line                                                */
 /*****************************************************************************/
 
-int main (int argc, char *argv[])
+char *outcachekey(int argc, char *argv[])
 {
+char cwd[FNLEN + 1], *key;
+size_t len;
 int i;
-struct linebuf *pLastLine = NULL;
-
-scanoperands = scanoperands09;
 
-settext("ASM", "A09");                  /* initialize predefined texts       */
-settext("VERSION", VERSNUM);
-settext("PASS", "1");
-settext("FILCHR", RMBDEFCHR);
-setoptiontexts();
-nPredefinedTexts = nTexts;
+if (!getcwd(cwd, sizeof(cwd)))
+  return NULL;
+len = sizeof(VERSION) + strlen(cwd) + 8;
+for (i = 1; i < argc; i++)
+  len += strlen(argv[i]) + 1;
+if (!(key = (char *)malloc(len)))
+  return NULL;
+sprintf(key, "A09 %s\n%s\n", VERSION, cwd);
+for (i = 1; i < argc; i++)
+  strcat(strcat(key, argv[i]), "\n");
+return key;
+}
 
-getoptions(argc, argv);
-pass = 1;
-loccounter = 0;
-phase = 0;
-error = 0;
-warning = 0;
-nTotErrors = errors = 0;
-nTotWarnings = warnings = 0;
-generating = 0;
-common = 0;
-g_termflg = -1;
-if (!absmode)                           /* in relocating mode                */
-  dpsetting = -1;                       /* there IS no Direct Page           */
-if (outmode != OUT_REL)                 /* Undef->Ext only for RELASMB output*/
-  dwOptions &= ~OPTION_UEX;
+/*****************************************************************************/
+/* outcachenames : fills in the names of the output files; returns their #   */
+/*****************************************************************************/
 
-printf("A09 Assembler V" VERSION "\n");
+int outcachenames(char *names[])
+{
+int n = 0;
 
-if ((listing & LIST_ON) &&
-    ((listfile = fopen(listname, "w")) == 0))
-  {
-  printf("%s(0) : error 19: Cannot open list file %s\n", srcname, listname);
-  exit(4);
-  }
+if (outmode != OUT_NONE)
+  names[n++] = objname;
+if (listing & LIST_ON)
+  names[n++] = listname;
+if (jsonlisting)
+  names[n++] = jsonname;
+if (xreffile)
+  names[n++] = xrefname;
+if (depfile)
+  names[n++] = depname;
+if (symfile)
+  names[n++] = symname;
+return n;
+}
 
-for (i = 1; argv[i]; i++)               /* read in all source files          */
-  pLastLine = readfile(argv[i], 0, pLastLine);
-if (!rootline)                          /* if no lines in there              */
-  {
-  printf("%s(0) : error 23: no source lines in file\n", srcname);
-  if (((dwOptions & OPTION_LP1) || pass == 2) &&
-      (listing & LIST_ON))
-    putlist( "*** Error 23: no source lines in file\n");
-  exit(4);
-  }
+/*****************************************************************************/
+/* outcacheblock : returns the next block of a cache entry and its length    */
+/*                 (-1 for a file that hasn't been written)                  */
+/*****************************************************************************/
 
-                                        /* Pass 1 - parse all symbols        */
-if ((listing & LIST_ON) && (dwOptions & OPTION_LP1))
-  putlist( "*** Pass 1 ***\n\n");
+char *outcacheblock(long *len)
+{
+char *p;
 
-processfile(rootline);
-if (errors)
-  {
-  printf("%ld error(s) in pass 1\n",errors);
-  if ((listing & LIST_ON) && (dwOptions & OPTION_LP1))
-    putlist("%s%ld error(s) in pass 1.\n",
-            (dwOptions & OPTION_LPA) ? "* " : "", errors);
-  nTotErrors = errors;
-  }
-if (warnings)
-  {
-  printf("%ld warning(s) in pass 1\n", warnings);
-  if ((listing & LIST_ON) && (dwOptions & OPTION_LP1))
-    putlist("%s%ld warning(s) in pass 1.\n",
-            (dwOptions & OPTION_LPA) ? "* " : "",
-            warnings);
-  nTotWarnings = warnings;
-  }
+if (!pchget(len, sizeof(*len)) || *len < -1 || *len > pchend - pchcur)
+  return NULL;
+p = pchcur;
+if (*len > 0)
+  pchcur += *len;
+return p;
+}
 
-                                        /* Pass 2 - generate output          */
-pass = 2;
-settext("PASS", "2");
-loccounter = 0;
-phase = 0;
-errors = 0;
-warnings = 0;
-generating = 0;
-reldataorg = -2;
-reldatasize = 0;
-g_termflg = -1;
-memset(bUsedBytes, 0, sizeof(bUsedBytes));
-for (i = 0; i < symtable.counter; i++)   /* reset all PASSED flags            */
-  if (symtable.rec[i].cat != SYMCAT_COMMONDATA)
-    symtable.rec[i].u.flags &= ~SYMFLAG_PASSED;
-if (dwOptions & OPTION_UEX)
-  {                                     /* make all undefined symbols extern */
-  for (i = 0; i < symtable.counter; i++)
-    if (symtable.rec[i].cat == SYMCAT_UNRESOLVED)
-      symtable.rec[i].cat = SYMCAT_EXTERN;
-  }
+/*****************************************************************************/
+/* outcachehit : restores the console output and the output files from a     */
+/*               cache entry; returns the exit code or -1 if there's no      */
+/*               matching entry                                              */
+/*****************************************************************************/
 
-if (listing & LIST_ON)
-  {
-  if ((dwOptions & OPTION_LP1))
+int outcachehit(char *entry, char *key)
+{
+FILE *fp = fopen(entry, "rb");
+char *buf = NULL, *s, *outs, *data;
+long size = 0, rc = -1, n, len;
+unsigned long h, hf;
+int round, i, ok = 0;
+
+if (fp && !fseek(fp, 0L, SEEK_END) && (size = ftell(fp)) > 8 &&
+    !fseek(fp, 0L, SEEK_SET) && (buf = (char *)malloc(size)) != NULL)
+  size = (long)fread(buf, 1, size, fp);
+if (fp)
+  fclose(fp);
+if (!buf)
+  return -1;
+pchcur = buf + 8;
+pchend = buf + size;
+if (size < 8 || memcmp(buf, "A09OUT1", 8) ||
+    !(s = pchgets()))
+  goto done;
+ok = !strcmp(s, key);                   /* same a09, directory and options   */
+free(s);
+if (!ok || !pchget(&rc, sizeof(rc)) || !pchget(&n, sizeof(n)))
+  goto done;
+while (ok && n-- > 0)                   /* same contents of all files        */
+  {
+  s = pchgets();
+  ok = s && pchget(&h, sizeof(h)) && filehash(s, &hf) && h == hf;
+  free(s);
+  }
+outs = pchcur;
+for (round = 0; ok && round < 2; round++)
+  {                                     /* check it all, then restore it     */
+  pchcur = outs;
+  if (!(data = outcacheblock(&len)) || len < 0)
+    ok = 0;                             /* console output                    */
+  else if (round)
+    fwrite(data, 1, len, stdout);
+  if (!pchget(&n, sizeof(n)))
+    ok = 0;
+  for (i = 0; ok && i < n; i++)         /* output files                      */
     {
-    if (dwOptions & OPTION_PAG)
-      PageFeed();
-    else
-      putlist("\n");
-    putlist( "*** Pass 2 ***\n\n");
+    s = pchgets();
+    if (!s || !(data = outcacheblock(&len)))
+      ok = 0;
+    else if (round && len < 0)
+      unlink(s);
+    else if (round && (!(fp = fopen(s, "wb")) ||
+                       fwrite(data, 1, len, fp) != (size_t)len))
+      errorout(srcname, 0, 38, "cannot write %s from the cache", s);
+    if (round && fp)
+      fclose(fp);
+    fp = NULL;
+    free(s);
     }
-  else if (nTotErrors || nTotWarnings)
-    putlist("%s%ld error(s), %ld warning(s) unlisted in pass 1\n",
-            (dwOptions & OPTION_LPA) ? "* " : "",
-            nTotErrors, nTotWarnings);
   }
+done:
+free(buf);
+return ok ? (int)rc : -1;
+}
 
-if ((outmode >= OUT_BIN) &&
-    ((objfile = fopen(objname,
-                     ((outmode != OUT_SREC) && (outmode != OUT_IHEX)) ? "wb" : "w"))
-                     == 0))
-  {
-  printf("%s(0) : error 20: cannot write object file %s\n", srcname, objname);
-  if (((dwOptions & OPTION_LP1) || pass == 2) && (listing & LIST_ON))
-    putlist( "*** Error 20: cannot write object file %s\n", objname);
-  exit(4);
-  }
+/*****************************************************************************/
+/* outcachestore : writes a cache entry                                      */
+/*****************************************************************************/
 
-if (outmode == OUT_REL)                 /* if writing FLEX Relocatable       */
-  {
-  writerelcommon();                     /* write out common blocks           */
-  relhdrfoff = ftell(objfile);
-  writerelhdr(0);                       /* write out initial header          */
-  relabsfoff = -1;
-  }
+void outcachestore(char *entry, char *key, int rc,
+                   char *console, long clen)
+{
+FILE *fp, *fo;
+char tmp[FNLEN + 32], *names[6], *data;
+unsigned long h;
+long l;
+int n, i;
+
+for (i = 0; i < nfnms; i++)             /* all files have to be readable     */
+  if (!filehash(fnms[i], &h))
+    return;
+mkdir(cachedir, 0777);
+sprintf(tmp, "%.*s.%ld", FNLEN, entry, (long)getpid());
+if (!(fp = fopen(tmp, "wb")))
+  return;
+pchput(fp, "A09OUT1", 8);
+pchputs(fp, key);
+l = rc;
+pchput(fp, &l, sizeof(l));
+l = nfnms;                              /* files and their hashes            */
+pchput(fp, &l, sizeof(l));
+for (i = 0; i < nfnms; i++)
+  {
+  filehash(fnms[i], &h);
+  pchputs(fp, fnms[i]);
+  pchput(fp, &h, sizeof(h));
+  }
+pchput(fp, &clen, sizeof(clen));        /* console output                    */
+pchput(fp, console, clen);
+n = outcachenames(names);               /* output files                      */
+l = n;
+pchput(fp, &l, sizeof(l));
+for (i = 0; i < n; i++)
+  {
+  pchputs(fp, names[i]);
+  l = -1;
+  data = NULL;
+  if ((fo = fopen(names[i], "rb")) != NULL &&
+      !fseek(fo, 0L, SEEK_END) && (l = ftell(fo)) >= 0 &&
+      !fseek(fo, 0L, SEEK_SET) && (data = (char *)malloc(l + 1)) != NULL)
+    l = (long)fread(data, 1, l, fo);
+  else
+    l = -1;
+  if (fo)
+    fclose(fo);
+  pchput(fp, &l, sizeof(l));
+  if (l > 0)
+    pchput(fp, data, l);
+  free(data);
+  }
+if (fclose(fp) || rename(tmp, entry))
+  unlink(tmp);
+}
 
-processfile(rootline);
+/*****************************************************************************/
+/* outcacherelease : ends capturing the console output; it's passed on to    */
+/*                   the real console and returned                           */
+/*****************************************************************************/
 
-if (errors)
-  {
-  printf("%ld error(s) in pass 2\n", errors);
-  nTotErrors += errors;
-  }
-if (warnings)
-  {
-  printf("%ld warning(s) in pass 2\n", warnings);
-  nTotWarnings += warnings;
-  }
+FILE *outcachecap = NULL;               /* captured console output           */
+int outcachefd = -1;                    /* the real console                  */
 
-if (listing & LIST_ON)
-  {
-  if (errors || warnings)
-    putlist("\n");
-  if (errors)
-    putlist("%s%ld error(s) in pass 2.\n",
-            (dwOptions & OPTION_LPA) ? "* " : "", errors);
-  if (warnings)
-    putlist("%s%ld warning(s) in pass 2.\n",
-            (dwOptions & OPTION_LPA) ? "* " : "", warnings);
-  if (dwOptions & OPTION_SYM)
-    outsymtable();
-  if ((relocatable) && (dwOptions & OPTION_REL))
-    outreltable();
-  if ((dwOptions & OPTION_TXT) &&
-      (nPredefinedTexts < nTexts))
-    outtexttable();
-
-  putlist( "\n%s%ld error(s), %ld warning(s)\n",
-          (dwOptions & OPTION_LPA) ? "* " : "", nTotErrors, nTotWarnings);
-  fclose(listfile);
-  }
-else
-  printf("Last assembled address: %04X\n", loccounter - 1);
+char *outcacherelease(long *len)
+{
+char *console = NULL;
 
-switch (outmode)                        /* look whether object cleanup needed*/
-  {
-  case OUT_SREC :                       /* Motorola S51-09                   */
-    flushhex();
-    chksum = (tfradr & 0xff) + ((tfradr >> 8) & 0xff) + 3;
-    fprintf(objfile, "S903%04X%02X\n", tfradr, 0xff - (chksum & 0xff));
-    break;
-  case OUT_IHEX :                       /* Intel Hex                         */
-    flushihex();
-#if 0
-    /* put transfer address in here... unfortunately, the official
-       Intel documentation doesn't allow this mechanism */
-    chksum = ((tfradr >> 8) & 0xff) + (tfradr & 0xff) + 1;
-    fprintf(objfile, ":00%04X01%02X\n", tfradr, (-(signed)chksum) & 0xff);
-#else
-    fprintf(objfile, ":00000001FF\n");
-#endif
-    break;
-  case OUT_FLEX :                       /* FLEX binary                       */
-    flushflex();
-    if (tfradrset)                      /* if transfer address set           */
-      {                                 /* write out transfer address block  */
-      fputc(0x16, objfile);
-      fputc((tfradr >> 8) & 0xff, objfile);
-      fputc(tfradr & 0xff, objfile);
-      }
-    break;
-  case OUT_REL :                        /* FLEX Relocatable                  */
+*len = 0;
+if (!outcachecap)
+  return NULL;
+fflush(stdout);
+dup2(outcachefd, 1);
+close(outcachefd);
+if (!fseek(outcachecap, 0L, SEEK_END) && (*len = ftell(outcachecap)) >= 0 &&
+    !fseek(outcachecap, 0L, SEEK_SET) &&
+    (console = (char *)malloc(*len + 1)) != NULL)
+  {
+  *len = (long)fread(console, 1, *len, outcachecap);
+  fwrite(console, 1, *len, stdout);
+  }
+fclose(outcachecap);
+outcachecap = NULL;
+return console;
+}
 
-    if (absmode)                        /* if producing an absolute module   */
-      {                                 /* correct the last object record    */
-      long curoff = ftell(objfile);
-      if (relabsfoff >= 0)
-        {
-        long blockcnt = curoff - relabsfoff - 4;
-        fseek(objfile, relabsfoff, SEEK_SET);
-        fputc((unsigned char)(blockcnt >> 8), objfile);
-        fputc((unsigned char)(blockcnt & 0xFF), objfile);
-        fseek(objfile, curoff, SEEK_SET);
-        }
-      /* relabsfoff = curoff; */
-      }
+/*****************************************************************************/
+/* outcacheexit : passes the captured console output on when a fatal error   */
+/*                ends the assembly; nothing is cached then                  */
+/*****************************************************************************/
 
-    writerelext();                      /* write out External table          */
-    writerelglobal();                   /* write out Global table            */
-    writerelmodname();                  /* write out Module Name             */
+void outcacheexit(void)
+{
+long len;
 
-    i = (int)ftell(objfile);            /* fill last sector with zeroes      */
-    while (i % 252)
-      {
-      fputc(0, objfile);
-      i++;
-      }
-                                        /* reposition on header              */
-    fseek(objfile, relhdrfoff, SEEK_SET);
-    writerelhdr(0);                     /* rewrite completed header          */
-    break;
-  }
+free(outcacherelease(&len));
+}
 
-if (objfile)
-  fclose(objfile);
+/*****************************************************************************/
+/* outcache : assembles through the output cache (-cache); an entry is found */
+/*            by a09's version, the directory and the command line and used  */
+/*            if the contents of all files it loaded are still the same      */
+/*****************************************************************************/
 
-if (errors && outmode >= OUT_BIN)
-  unlink(objname);
+int outcache(int argc, char *argv[])
+{
+static char atexitset = 0;
+char *key = outcachekey(argc, argv), entry[FNLEN + 1], *console;
+long clen;
+int rc;
+
+if (!inbatch)
+  printf("A09 Assembler V" VERSION "\n");
+if (key)
+  {
+  sprintf(entry, "%.*s/%08lx.a09c", FNLEN - 16, cachedir,
+          fnv1a(2166136261UL, key, strlen(key)));
+  if ((rc = outcachehit(entry, key)) >= 0)
+    {
+    free(key);
+    return rc;
+    }
+  fflush(stdout);                       /* capture the console output        */
+  if ((outcachecap = tmpfile()) != NULL &&
+      ((outcachefd = dup(1)) < 0 || dup2(fileno(outcachecap), 1) < 0))
+    {
+    if (outcachefd >= 0)
+      close(outcachefd);
+    fclose(outcachecap);
+    outcachecap = NULL;
+    }
+  if (!atexitset)
+    atexit(outcacheexit);
+  atexitset = 1;
+  }
+incache = 1;
+rc = assemble(argc, argv);
+incache = 0;
+console = outcacherelease(&clen);
+if (key && console)
+  outcachestore(entry, key, rc, console, clen);
+free(console);
+free(key);
+return rc;
+}
+#endif
 
-return (errors) ? 1 : 0;
+/*****************************************************************************/
+/* main : the main function                                                  */
+/*        left out with A09_NO_MAIN to link the core into bench/microbench.c */
+/*        or liba09                                                          */
+/*****************************************************************************/
+
+#ifndef A09_NO_MAIN
+int main (int argc, char *argv[])
+{
+#if UNIX
+int rc;
+char *opt = "";
+
+if (argc > 2 && argv[1][0] == '-')      /* "-serve" / "--serve" and          */
+  opt = argv[1] + 1 +                   /* "-client" / "--client"            */
+        (argv[1][1] == '-');
+if (!strcmp(opt, "serve"))
+  return runserver(argv[2]);
+if (!strcmp(opt, "client"))
+  {
+  if ((rc = runclient(argv[2], argc - 3, argv + 3)) >= 0)
+    return rc;
+  argv[2] = argv[0];                    /* no server: assemble directly      */
+  return assemble(argc - 2, argv + 2);
+  }
+#endif
+return assemble(argc, argv);
 }
+#endif
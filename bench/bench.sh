@@ -0,0 +1,53 @@
+#!/bin/sh
+# bench.sh - runs the A09 benchmark suite
+#
+#   bench.sh [a09 [gensrc [outdir [size]]]]
+#
+# generates the sources for each scenario, assembles them with listing off
+# and on and reports lines/second and peak RSS, as taken from a09 -stats.
+# size is passed to gensrc; 0 selects each scenario's default size.
+
+A09=${1:-./a09}
+GENSRC=${2:-bench/gensrc}
+OUT=${3:-bench/out}
+SIZE=${4:-0}
+SCENARIOS=${SCENARIOS:-"equ macro dup include binary local h6309 hc11"}
+
+mkdir -p "$OUT" || exit 1
+# a09 runs in the output directory, as INCLUDE paths are relative to it
+A09=`cd \`dirname "$A09"\` && pwd`/`basename "$A09"`
+
+# jsonval file key : extracts the first number named key from the -stats
+# JSON output
+jsonval()
+{
+  awk -v k="\"$2\":" '{ i = index($0, k)
+                         if (i) { s = substr($0, i + length(k))
+                                  match(s, /^[0-9.]+/)
+                                  print substr(s, 1, RLENGTH) } }' "$1"
+}
+
+printf "%-10s %-4s %10s %10s %12s %10s\n" \
+       scenario list lines seconds lines/s peakkb
+for s in $SCENARIOS; do
+  "$GENSRC" $s $SIZE "$OUT" || exit 1
+  for l in off on; do
+    if [ $l = on ]; then lst="-l$s.lst"; else lst=""; fi
+    # a scenario that doesn't assemble cleanly would time the error path
+    json="$OUT/$s.$l.json"
+    if ! (cd "$OUT" &&
+          "$A09" -b$s.bin $lst -stats=$s.$l.json $s.asm >$s.$l.out) ||
+       [ ! -s "$json" ]; then
+      echo "$s: a09 failed, see $OUT/$s.$l.out" >&2
+      exit 1
+    fi
+    # lines processed in both passes, total wall clock time
+    lines=`sed -n 's/.*"lines":\[\([0-9]*\),\([0-9]*\)\].*/\1 \2/p' "$json" |
+           awk '{print $1 + $2}'`
+    total=`jsonval "$json" total`
+    peak=`jsonval "$json" peakkb`
+    echo "$s $l $lines $total $peak" |
+      awk '{ printf "%-10s %-4s %10d %10.4f %12.0f %10d\n",
+                    $1, $2, $3, $4, ($4 > 0) ? $3 / $4 : 0, $5 }'
+  done
+done
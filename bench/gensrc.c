@@ -0,0 +1,340 @@
+/* GENSRC.C - synthetic source generator for the A09 benchmark suite
+
+   Writes reproducible stress sources for the assembler's hot paths, one
+   scenario at a time:
+
+     gensrc scenario size outdir
+
+   writes outdir/scenario.asm (plus the include files or binary blob that
+   the scenario needs). size is the scenario's scale (symbols, macro
+   invocations, bytes, ...); 0 selects the default size.
+
+   Scenarios:
+     equ        EQU-heavy symbol table (mind MAXLABELS in a09.c)
+     macro      macro-heavy code, 10 macros with parameters
+     dup        DUP-heavy data generation
+     include    include tree (files nested up to 20 levels deep)
+     binary     large BINARY blob
+     local      numeric local label heavy code
+     h6309      HD6309 instruction mix
+     hc11       68HC11 instruction mix
+     common     two relocatable modules sharing a COMMON block; also
+                writes common2.asm and common.bin, the binary that
+                linking both from $0100 on has to produce
+
+   The output only depends on the scenario and the size, so runs can be
+   compared across builds.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*****************************************************************************/
+/* Global variables                                                          */
+/*****************************************************************************/
+
+unsigned long seed = 12345;             /* pseudo-random number state        */
+char *outdir = ".";                     /* output directory                  */
+
+/*****************************************************************************/
+/* rnd : returns a reproducible pseudo-random number 0..n-1                  */
+/*****************************************************************************/
+
+unsigned long rnd(unsigned long n)
+{
+seed = seed * 1103515245UL + 12345UL;   /* same LCG on all platforms         */
+return ((seed >> 16) & 0x7fff) % n;
+}
+
+/*****************************************************************************/
+/* openout : creates an output file in the output directory                  */
+/*****************************************************************************/
+
+FILE *openout(char *name)
+{
+char path[1024];
+FILE *fp;
+
+sprintf(path, "%s/%s", outdir, name);
+if (!(fp = fopen(path, "wb")))
+  {
+  fprintf(stderr, "gensrc: cannot write %s\n", path);
+  exit(1);
+  }
+return fp;
+}
+
+/*****************************************************************************/
+/* genequ : EQU-heavy symbol table                                           */
+/*****************************************************************************/
+
+void genequ(FILE *fp, long n)
+{
+long i;
+
+for (i = 0; i < n; i++)                 /* define symbols in scrambled order */
+  fprintf(fp, "S%06lu EQU $%04lX\n", (unsigned long)((i * 7919) % n),
+          (unsigned long)rnd(0x10000));
+fprintf(fp, "        ORG $1000\n");
+for (i = 0; i < n; i++)                 /* then reference them               */
+  {
+  fprintf(fp, "        LDX #S%06lu\n", (unsigned long)rnd(n));
+  if (i % 10000 == 9999)                /* stay within 64K                   */
+    fprintf(fp, "        ORG $1000\n");
+  }
+fprintf(fp, "        END\n");
+}
+
+/*****************************************************************************/
+/* genmacro : macro-heavy code                                               */
+/*****************************************************************************/
+
+void genmacro(FILE *fp, long n)
+{
+long i;
+
+for (i = 0; i < 10; i++)
+  {
+  fprintf(fp, "MAC%ld    MACRO\n", i);
+  fprintf(fp, "        LDA #&1\n");
+  fprintf(fp, "        LDB #&2\n");
+  fprintf(fp, "        STD VAR%ld\n", i);
+  fprintf(fp, "        LEAX &1,X\n");
+  fprintf(fp, "        ADDD #%ld\n", i * 3);
+  fprintf(fp, "        ENDM\n");
+  }
+fprintf(fp, "        ORG $0100\n");
+for (i = 0; i < 10; i++)
+  fprintf(fp, "VAR%ld    RMB 2\n", i);
+fprintf(fp, "        ORG $1000\n");
+for (i = 0; i < n; i++)
+  {
+  fprintf(fp, "        MAC%lu %lu,%lu\n",
+          (unsigned long)rnd(10), (unsigned long)rnd(100),
+          (unsigned long)rnd(100));
+  if (i % 4000 == 3999)                 /* stay within 64K                   */
+    fprintf(fp, "        ORG $1000\n");
+  }
+fprintf(fp, "        END\n");
+}
+
+/*****************************************************************************/
+/* gendup : DUP-heavy data generation                                        */
+/*****************************************************************************/
+
+void gendup(FILE *fp, long n)
+{
+long i;
+
+fprintf(fp, "        ORG $0000\n");
+for (i = 0; i < n; i++)                 /* n blocks of 8 repetitions         */
+  {
+  fprintf(fp, "        DUP 8\n");
+  fprintf(fp, "        FCB %lu,%lu\n",
+          (unsigned long)rnd(256), (unsigned long)rnd(256));
+  fprintf(fp, "        ENDD\n");
+  if (i % 1000 == 999)                  /* stay within 64K                   */
+    fprintf(fp, "        ORG $0000\n");
+  }
+fprintf(fp, "        END\n");
+}
+
+/*****************************************************************************/
+/* geninclude : include tree                                                 */
+/*****************************************************************************/
+
+void geninclude(FILE *fp, long n)
+{
+long f, i;
+char name[64];
+FILE *inc;
+int nfiles = 100;                       /* MAXFILES in a09.c is 128          */
+
+if (n > 64000)                          /* 1 byte per line, all files have   */
+  n = 64000;                            /* to fit into 64K                   */
+
+for (f = 0; f < nfiles; f++)            /* file f includes file f + 1 every  */
+  {                                     /* 20 files, up to 20 levels deep    */
+  sprintf(name, "inc%03ld.asm", f);
+  inc = openout(name);
+  fprintf(inc, "        ORG $%04lX\n", (unsigned long)(f * 640));
+  for (i = 0; i < n / nfiles; i++)
+    fprintf(inc, "        FCB %lu\n", (unsigned long)rnd(256));
+  fprintf(inc, "F%03ld     NOP\n", f);
+  if ((f % 20) != 19 && f + 1 < nfiles)
+    fprintf(inc, "        INCLUDE inc%03ld.asm\n", f + 1);
+  fclose(inc);
+  }
+for (f = 0; f < nfiles; f += 20)
+  fprintf(fp, "        INCLUDE inc%03ld.asm\n", f);
+fprintf(fp, "        END\n");
+}
+
+/*****************************************************************************/
+/* genbinary : large BINARY blob                                             */
+/*****************************************************************************/
+
+void genbinary(FILE *fp, long n)
+{
+long i;
+FILE *bin = openout("blob.bin");
+
+if (n > 0xe000)                         /* must fit behind the ORG           */
+  n = 0xe000;
+for (i = 0; i < n; i++)
+  fputc((int)rnd(256), bin);
+fclose(bin);
+fprintf(fp, "        ORG $1000\n");
+fprintf(fp, "BLOB    BIN blob.bin\n");
+fprintf(fp, "        END\n");
+}
+
+/*****************************************************************************/
+/* genlocal : numeric local label heavy code                                 */
+/*****************************************************************************/
+
+void genlocal(FILE *fp, long n)
+{
+long i;
+
+fprintf(fp, "        ORG $0000\n");
+for (i = 0; i < n; i++)
+  {
+  fprintf(fp, "%ld       LDA ,X+\n", i % 10);
+  fprintf(fp, "        BNE %ldB\n", i % 10);
+  if (i % 5000 == 4999)                 /* stay within 64K; local labels     */
+    fprintf(fp, "        ORG $0000\n");
+  else                                  /* don't reach across an ORG         */
+    fprintf(fp, "        BRA %ldF\n", (i + 1) % 10);
+  }
+fprintf(fp, "%ld       RTS\n", n % 10);
+fprintf(fp, "        END\n");
+}
+
+/*****************************************************************************/
+/* gencommon : COMMON block referenced by name and by member, 2 modules      */
+/*****************************************************************************/
+
+void gencommon(FILE *fp, long n)
+{
+unsigned buf = 0x0100 + 6 * n + 1 + 4;  /* linked behind both modules        */
+FILE *fp2, *bin;
+long i;
+
+fprintf(fp, "        NAME COMMON1\n");
+fprintf(fp, "BUF     COMMON\n");
+fprintf(fp, "B1      RMB 2\n");
+fprintf(fp, "B2      RMB 2\n");
+fprintf(fp, "        ENDCOM\n");
+fp2 = openout("common2.asm");
+fprintf(fp2, "        NAME COMMON2\n");
+fprintf(fp2, "BUF     COMMON\n");
+fprintf(fp2, "        RMB 4\n");
+fprintf(fp2, "        ENDCOM\n");
+fprintf(fp2, "        LDX #BUF\n");
+fprintf(fp2, "        RTS\n");
+fprintf(fp2, "        END\n");
+fclose(fp2);
+bin = openout("common.bin");
+for (i = 0; i < n; i++)
+  {
+  fprintf(fp, "        LDX #BUF\n");
+  fprintf(fp, "        LDD B2\n");
+  fprintf(bin, "%c%c%c", 0x8e, buf >> 8, buf & 0xff);
+  fprintf(bin, "%c%c%c", 0xfc, (buf + 2) >> 8, (buf + 2) & 0xff);
+  }
+fprintf(fp, "        RTS\n");
+fprintf(fp, "        END\n");
+fprintf(bin, "%c", 0x39);
+fprintf(bin, "%c%c%c%c", 0x8e, buf >> 8, buf & 0xff, 0x39);
+fclose(bin);
+}
+
+/*****************************************************************************/
+/* genmix : instruction mix for a given CPU                                  */
+/*****************************************************************************/
+
+void genmix(FILE *fp, long n, char *opt, char **ins, int nins)
+{
+long i;
+
+fprintf(fp, "        OPT %s\n", opt);
+fprintf(fp, "        ORG $0000\n");
+fprintf(fp, "DAT     EQU $40\n");
+for (i = 0; i < n; i++)
+  {
+  fprintf(fp, "        %s\n", ins[rnd(nins)]);
+  if (i % 10000 == 9999)                /* stay within 64K                   */
+    fprintf(fp, "        ORG $0000\n");
+  }
+fprintf(fp, "        END\n");
+}
+
+char *ins6309[] =
+  {
+  "LDQ #$12345678", "STQ DAT", "ADDR A,B", "TFM X+,Y+", "MULD #3",
+  "LDW ,X++", "ADDE #1", "SUBF <DAT", "AIM #$0F,<DAT", "DIVD #7",
+  "LDA [$10,Y]", "LEAX 5,PCR", "PSHSW", "SEXW", "LDMD #1",
+  };
+
+char *ins68hc11[] =
+  {
+  "LDY #$1234", "LDX DAT", "IDIV", "BSET DAT,#$01", "BCLR DAT,#$80",
+  "BRCLR DAT,#$01,*", "XGDX", "XGDY", "LDD 2,Y", "STD 4,X",
+  "CPD #$1000", "ABY", "FDIV", "INY", "BRSET 3,X,#$10,*",
+  };
+
+/*****************************************************************************/
+/* main : program entry point                                                */
+/*****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+char name[64];
+FILE *fp;
+long n;
+
+if (argc < 4)
+  {
+  fprintf(stderr, "Usage: gensrc scenario size outdir\n"
+                  "scenarios: equ macro dup include binary local "
+                  "h6309 hc11 common\n");
+  return 2;
+  }
+n = atol(argv[2]);
+outdir = argv[3];
+sprintf(name, "%.50s.asm", argv[1]);
+fp = openout(name);
+fprintf(fp, "* %s benchmark, size %ld, generated by gensrc\n", argv[1], n);
+fprintf(fp, "        OPT NOW\n");       /* code wraps around deliberately    */
+
+if (!strcmp(argv[1], "equ"))
+  genequ(fp, n ? n : 8000);
+else if (!strcmp(argv[1], "macro"))
+  genmacro(fp, n ? n : 5000);
+else if (!strcmp(argv[1], "dup"))
+  gendup(fp, n ? n : 5000);
+else if (!strcmp(argv[1], "include"))
+  geninclude(fp, n ? n : 50000);
+else if (!strcmp(argv[1], "binary"))
+  genbinary(fp, n ? n : 0xe000);
+else if (!strcmp(argv[1], "local"))
+  genlocal(fp, n ? n : 20000);
+else if (!strcmp(argv[1], "h6309"))
+  genmix(fp, n ? n : 30000, "H63", ins6309,
+         sizeof(ins6309) / sizeof(ins6309[0]));
+else if (!strcmp(argv[1], "hc11"))
+  genmix(fp, n ? n : 30000, "H11", ins68hc11,
+         sizeof(ins68hc11) / sizeof(ins68hc11[0]));
+else if (!strcmp(argv[1], "common"))
+  gencommon(fp, n ? n : 1000);
+else
+  {
+  fprintf(stderr, "gensrc: unknown scenario %s\n", argv[1]);
+  return 2;
+  }
+
+fclose(fp);
+return 0;
+}
@@ -0,0 +1,281 @@
+/* MICROBENCH.C - micro-benchmarks for the A09 assembler core
+
+   Times individual hot functions of the assembler in tight loops on
+   representative inputs:
+
+     findsym    insert and lookup at various symbol table sizes
+     findop     lookup in each CPU's mnemonic table
+     scanexpr   typical operand shapes
+     expandtext lines with and without & text substitutions
+     flushhex   Motorola S-record output
+     flushihex  Intel hex output
+
+   a09.c is a single translation unit without a header, so the core is
+   included here with A09_NO_MAIN defined, which leaves out a09's main().
+
+   Each benchmark is repeated several times; the fastest run is reported
+   in nanoseconds per call, which keeps the results stable enough to spot
+   per-function regressions.
+
+     microbench [repetitions]
+*/
+
+#define A09_NO_MAIN
+#include "../a09.c"
+
+/*****************************************************************************/
+/* Global variables                                                          */
+/*****************************************************************************/
+
+int nreps = 5;                          /* # repetitions per benchmark       */
+char bnames[MAXLABELS][16];             /* symbol names in insertion order   */
+unsigned long bseed = 12345;            /* pseudo-random number state        */
+long bsink;                             /* keeps results from being dropped  */
+
+/*****************************************************************************/
+/* brnd : returns a reproducible pseudo-random number 0..n-1                 */
+/*****************************************************************************/
+
+unsigned long brnd(unsigned long n)
+{
+bseed = bseed * 1103515245UL + 12345UL;
+return ((bseed >> 16) & 0x7fff) % n;
+}
+
+/*****************************************************************************/
+/* benchreport : prints the result of a benchmark                            */
+/*****************************************************************************/
+
+void benchreport(char *name, char *variant, double best, long calls)
+{
+printf("%-12s %-24s %10ld %10.1f ns/call\n",
+       name, variant, calls, best * 1e9 / calls);
+}
+
+/*****************************************************************************/
+/* benchfindsym : findsym() insert and lookup with n symbols                 */
+/*****************************************************************************/
+
+void benchfindsym(int n)
+{
+int r, i;
+long calls = 100000;
+double t, ins = 1e9, look = 1e9;
+char variant[32];
+
+for (i = 0; i < n; i++)                 /* scrambled insertion order         */
+  sprintf(bnames[i], "S%05d", (int)((i * 7919L) % n));
+for (r = 0; r < nreps; r++)
+  {
+  symtable.counter = 0;
+  t = stattime();
+  for (i = 0; i < n; i++)
+    bsink += findsym(bnames[i], 1)->cat;
+  t = stattime() - t;
+  if (t < ins)
+    ins = t;
+
+  bseed = 12345;
+  t = stattime();
+  for (i = 0; i < calls; i++)
+    bsink += findsym(bnames[brnd(n)], 0)->cat;
+  t = stattime() - t;
+  if (t < look)
+    look = t;
+  }
+symtable.counter = 0;
+
+sprintf(variant, "insert %d", n);
+benchreport("findsym", variant, ins, n);
+sprintf(variant, "lookup %d", n);
+benchreport("findsym", variant, look, calls);
+}
+
+/*****************************************************************************/
+/* benchfindop : findop() on all mnemonics of a CPU's table, plus misses     */
+/*****************************************************************************/
+
+void benchfindop(char *cpu)
+{
+int r, i, n;
+long calls = 0;
+double t, best = 1e9;
+char names[1024][8];
+char variant[32];
+
+setoption(cpu);
+for (n = 0; n < optablesize && n < 1000; n++)
+  strcpy(names[n], optable[n].name);
+for (i = 0; i < n / 10; i++)            /* 10% misses                        */
+  sprintf(names[n + i], "X%dQ", i);
+n += i;
+
+for (r = 0; r < nreps; r++)
+  {
+  calls = 0;
+  t = stattime();
+  for (i = 0; i < 100; i++)
+    {
+    int j;
+    for (j = 0; j < n; j++)
+      bsink += (findop(names[j]) != NULL);
+    calls += n;
+    }
+  t = stattime() - t;
+  if (t < best)
+    best = t;
+  }
+sprintf(variant, "%s (%d entries)", cpu, optablesize);
+setoption("M09");
+
+benchreport("findop", variant, best, calls);
+}
+
+/*****************************************************************************/
+/* benchscanexpr : scanexpr() on typical operand shapes                      */
+/*****************************************************************************/
+
+void benchscanexpr(char *expr)
+{
+int r, i;
+long calls = 100000;
+double t, best = 1e9;
+struct relocrecord p = {0};
+
+for (r = 0; r < nreps; r++)
+  {
+  t = stattime();
+  for (i = 0; i < calls; i++)
+    {
+    srcptr = expr;
+    bsink += scanexpr(0, &p);
+    }
+  t = stattime() - t;
+  if (t < best)
+    best = t;
+  }
+error = ERR_OK;
+benchreport("scanexpr", expr, best, calls);
+}
+
+/*****************************************************************************/
+/* benchexpandtext : expandtext() on a given line                            */
+/*****************************************************************************/
+
+void benchexpandtext(char *variant, char *txt)
+{
+int r, i;
+long calls = 100000;
+double t, best = 1e9;
+struct linebuf *pline = allocline(NULL, "bench", 1, 0, txt, MEM_SRCLINES);
+struct linebuf *cursave = curline;
+
+curline = pline;
+for (r = 0; r < nreps; r++)
+  {
+  t = stattime();
+  for (i = 0; i < calls; i++)
+    {
+    expandtext();
+    bsink += srcline[0];
+    }
+  t = stattime() - t;
+  if (t < best)
+    best = t;
+  }
+curline = cursave;
+free(pline);
+benchreport("expandtext", variant, best, calls);
+}
+
+/*****************************************************************************/
+/* benchflush : flushhex() / flushihex() on full records                     */
+/*****************************************************************************/
+
+void benchflush(char *name, void (*flush)(), int count)
+{
+int r, i, j;
+long calls = 100000;
+double t, best = 1e9;
+char variant[32];
+
+for (r = 0; r < nreps; r++)
+  {
+  hexaddr = 0;
+  t = stattime();
+  for (i = 0; i < calls; i++)
+    {
+    for (j = 0; j < count; j++)
+      hexbuffer[j] = (unsigned char)(i + j);
+    hexcount = count;
+    flush();
+    }
+  t = stattime() - t;
+  if (t < best)
+    best = t;
+  }
+sprintf(variant, "%d bytes/record", count);
+benchreport(name, variant, best, calls);
+}
+
+/*****************************************************************************/
+/* main : the micro-benchmark's main function                                */
+/*****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+struct symrecord *lp;
+
+a09reset();                             /* a09's initial state               */
+if (argc > 1 && atoi(argv[1]) > 0)
+  nreps = atoi(argv[1]);
+
+printf("A09 V" VERSION " micro-benchmarks, best of %d runs\n", nreps);
+printf("%-12s %-24s %10s %10s\n", "function", "case", "calls", "time");
+
+benchfindsym(1000);                     /* runs on an empty symbol table     */
+benchfindsym(4000);
+benchfindsym(MAXLABELS);
+
+scanoperands = scanoperands09;          /* same setup as a09's main()        */
+settext("ASM", "A09");
+settext("VERSION", VERSNUM);
+settext("PASS", "2");
+settext("FILCHR", RMBDEFCHR);
+setoptiontexts();
+nPredefinedTexts = nTexts;
+pass = 2;
+g_termflg = -1;
+
+benchfindop("M09");
+benchfindop("H09");
+benchfindop("M00");
+benchfindop("M01");
+benchfindop("H11");
+
+lp = findsym("LABEL", 1);               /* symbols for the expressions       */
+lp->cat = SYMCAT_CONSTANT;
+lp->value = 0x1234;
+lp = findsym("COUNT", 1);
+lp->cat = SYMCAT_CONSTANT;
+lp->value = 10;
+benchscanexpr("$1234");
+benchscanexpr("LABEL");
+benchscanexpr("LABEL+COUNT*2");
+benchscanexpr("(LABEL+2)&$FF00");
+benchscanexpr("'A'+%00100000");
+benchscanexpr("*-LABEL");
+
+settext("NAME", "some text");
+benchexpandtext("plain", "LOOP    LDA     ,X+     get next byte");
+benchexpandtext("&NAME", "        FCC     \"&NAME\"  text constant");
+benchexpandtext("\\&", "        LDA     #'\\&    escaped ampersand");
+
+objfile = fopen(UNIX ? "/dev/null" : "NUL", "w");
+benchflush("flushhex", flushhex, hexmaxcount);
+benchflush("flushihex", flushihex, ihexmaxcount);
+fclose(objfile);
+objfile = NULL;
+
+return (bsink == 0x7fffffff);           /* never true; uses the sink         */
+}
@@ -0,0 +1,10 @@
+* macexp.asm - expanded macro lines have to be flagged as
+* such; otherwise the ENDM of each expansion reports
+* "Error in expression"
+PAIR    MACRO
+        LDA #&1
+        LDB #&2
+        ENDM
+        PAIR 1,2
+        PAIR 3,4
+        END
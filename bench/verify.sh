@@ -0,0 +1,166 @@
+#!/bin/sh
+# verify.sh - checks a09's fast paths against its reference engine
+#
+#   verify.sh [a09 [gensrc [outdir]]] [sourcefile...]
+#
+# assembles each benchmark scenario (and each given source file) twice,
+# once with -nofast and once normally, in every output mode. The object
+# files, listings (including the symbol table), JSON Lines listings and
+# console output have to be identical, and so have the exit statuses (a09
+# must not be killed by a signal); the first divergence per source is
+# reported with the file and line it stems from. The normal side is run
+# twice with -cache, so what gets compared is replayed from the cache.
+# Finally, the two modules of the common scenario are linked with -link;
+# with and without -nofast, the result has to be the expected binary.
+# The regression sources in bench/regress are checked like the scenarios,
+# and they have to assemble without errors.
+
+A09=${1:-./a09}
+GENSRC=${2:-bench/gensrc}
+OUT=${3:-bench/out}
+[ $# -gt 3 ] && shift 3 || set --
+SCENARIOS=${SCENARIOS:-"equ macro dup include binary local h6309 hc11"}
+MODES="b s x f z r"
+REGRESS=`dirname "$0"`/regress
+
+mkdir -p "$OUT/verify" || exit 1
+# a09 runs in the source's directory, as INCLUDE paths are relative to it
+A09=`cd \`dirname "$A09"\` && pwd`/`basename "$A09"`
+VOUT=`cd "$OUT/verify" && pwd`
+rm -rf "$VOUT/cache"                    # no hits from an earlier a09 build
+
+# srcline jsonl address : prints file(line) of the code at an address
+srcline()
+{
+  awk -v a=$2 '
+    function num(k,   s) { s = substr($0, index($0, "\"" k "\":") + length(k) + 3)
+                           return s + 0 }
+    { lc = num("oldlc"); n = num("codeptr")
+      if (n > 0 && a >= lc && a < lc + n) {
+        s = substr($0, index($0, "\"fn\":\"") + 6)
+        print substr(s, 1, index(s, "\"") - 1) "(" num("ln") ")"
+        exit } }' "$1"
+}
+
+# binbase jsonl : prints the lowest address that got code
+binbase()
+{
+  awk 'function num(k,   s) { s = substr($0, index($0, "\"" k "\":") + length(k) + 3)
+                              return s + 0 }
+       num("codeptr") > 0 && (!n++ || num("oldlc") < lo) { lo = num("oldlc") }
+       END { print lo + 0 }' "$1"
+}
+
+# compare src mode : compares one source's reference and fast output
+compare()
+{
+  r="$VOUT/$2.$1.ref"; f="$VOUT/$2.$1.fast"
+  if ! cmp -s "$r.jsonl" "$f.jsonl"; then
+    n=`cmp "$r.jsonl" "$f.jsonl" | sed -n 's/.* line \([0-9]*\).*/\1/p'`
+    rec=`sed -n "${n:-1}p" "$r.jsonl"`
+    fn=`echo "$rec" | sed -n 's/.*"fn":"\([^"]*\)".*/\1/p'`
+    ln=`echo "$rec" | sed -n 's/.*"ln":\([0-9]*\).*/\1/p'`
+    echo "$fn($ln): -$1 JSON listing differs in record $n"
+    return 1
+  fi
+  if ! cmp -s "$r.lst" "$f.lst"; then
+    n=`cmp "$r.lst" "$f.lst" | sed -n 's/.* line \([0-9]*\).*/\1/p'`
+    echo "$2: -$1 listing differs in line ${n:-?}"
+    echo "  reference: `sed -n "${n:-1}p" "$r.lst"`"
+    echo "  fast     : `sed -n "${n:-1}p" "$f.lst"`"
+    return 1
+  fi
+  if ! cmp -s "$r.out" "$f.out"; then
+    echo "$2: -$1 console output differs"
+    diff "$r.out" "$f.out" | sed -n '2,3p'
+    return 1
+  fi
+  if [ -f "$r.obj" -o -f "$f.obj" ] && ! cmp -s "$r.obj" "$f.obj"; then
+    off=`cmp "$r.obj" "$f.obj" 2>&1 | sed -n 's/.*differ: [a-z]* \([0-9]*\).*/\1/p'`
+    where=$2
+    if [ $1 = b -a -n "$off" ]; then
+      at=`srcline "$r.jsonl" $((\`binbase "$r.jsonl"\` + off - 1))`
+      [ -n "$at" ] && where=$at
+    fi
+    echo "$where: -$1 object file differs at byte ${off:-?}"
+    return 1
+  fi
+  return 0
+}
+
+# verify dir src : checks one source in all output modes
+verify()
+{
+  for m in $MODES; do
+    for e in ref fast; do
+      o="$VOUT/$2.$m.$e"
+      rm -f "$o.obj"
+      if [ $e = ref ]; then opts=-nofast; else opts="-cache $VOUT/cache"; fi
+      # the fast side runs twice, so that it is compared as a cache hit
+      for run in 1 2; do
+        [ $e = ref -a $run = 2 ] && break
+        (cd "$1" &&
+         "$A09" $opts -$m"$o.obj" -l"$o.lst" -j"$o.jsonl" "$2" >"$o.raw")
+        st=$?
+        sed '/^A09 Assembler V/d' "$o.raw" >"$o.out"
+        if [ $st -ge 128 ]; then
+          echo "$2: -$m a09 ($e) was killed by signal $((st - 128))"
+          return 1
+        fi
+        [ $e = ref ] && refst=$st
+        if [ -n "$clean" -a $st != 0 ]; then
+          echo "$2: -$m a09 ($e) failed with exit status $st"
+          return 1
+        fi
+        if [ $st != $refst ]; then
+          echo "$2: -$m exit status differs: reference $refst, fast $st"
+          return 1
+        fi
+      done
+    done
+    compare $m "$2" || return 1
+  done
+  echo "$2: OK"
+  return 0
+}
+
+# verifylink dir : assembles the modules of the common scenario and links
+# them, with and without -nofast; both have to produce common.bin
+verifylink()
+{
+  for e in ref fast; do
+    o="$VOUT/common.link.$e"
+    if [ $e = ref ]; then opts=-nofast; else opts=; fi
+    rm -f "$o.bin"
+    (cd "$1" &&
+     "$A09" $opts -r"$o.1.rel" common.asm >/dev/null &&
+     "$A09" $opts -r"$o.2.rel" common2.asm >/dev/null &&
+     "$A09" $opts -link=100 -b"$o.bin" "$o.1.rel" "$o.2.rel" >/dev/null)
+    if ! cmp -s "$1/common.bin" "$o.bin"; then
+      off=`cmp "$1/common.bin" "$o.bin" 2>&1 |
+           sed -n 's/.*differ: [a-z]* \([0-9]*\).*/\1/p'`
+      echo "common.asm: -link output ($e) differs at byte ${off:-?}"
+      return 1
+    fi
+  done
+  echo "common.asm: link OK"
+  return 0
+}
+
+rc=0
+for s in $SCENARIOS; do
+  "$GENSRC" $s 0 "$OUT" || exit 1
+  verify "$OUT" $s.asm || rc=1
+done
+"$GENSRC" common 0 "$OUT" || exit 1
+verifylink "$OUT" || rc=1
+clean=1                                 # regression sources assemble cleanly
+for src in "$REGRESS"/*.asm; do
+  [ -f "$src" ] || continue
+  verify "`dirname "$src"`" "`basename "$src"`" || rc=1
+done
+clean=
+for src in "$@"; do
+  verify "`dirname "$src"`" "`basename "$src"`" || rc=1
+done
+exit $rc
@@ -0,0 +1,54 @@
+/* LIBA09.H - embeddable interface to the A09 assembler
+
+   Build liba09.a with "make liba09.a" (a09.c compiled with A09_LIBRARY)
+   and link it together with -lpthread.
+
+   A context collects command line arguments and in-memory source files,
+   assembles them and keeps the results: the generated code as a 64K
+   memory image, the symbol table, the errors and warnings and the console
+   output. Memory sources are looked up by name before the file system, so
+   INCLUDEs can be satisfied from memory, too. No object file is written
+   unless an output option (-b, -s, ...) is given; fatal errors show up
+   among the diagnostics like all others.
+
+   Contexts can be used from several threads; the assembler itself runs
+   one assembly at a time.
+*/
+
+#ifndef LIBA09_H
+#define LIBA09_H
+
+#include <stddef.h>
+
+typedef struct a09context A09CONTEXT;
+
+typedef struct a09symbol                /* symbol after an assembly          */
+  {
+  char *name;                           /* symbol name                       */
+  long value;                           /* symbol value                      */
+  int cat;                              /* category, see SYMCAT_ in a09.c   */
+  } A09SYMBOL;
+
+typedef struct a09diag                  /* error or warning                  */
+  {
+  char *fn;                             /* file name                         */
+  long ln;                              /* line number                       */
+  int pass;                             /* pass (1 or 2)                     */
+  int num;                              /* error / warning number            */
+  int warning;                          /* 0 error, 1 warning                */
+  const char *msg;                      /* message text                      */
+  } A09DIAG;
+
+A09CONTEXT *a09create(void);
+void a09destroy(A09CONTEXT *ctx);
+int a09option(A09CONTEXT *ctx, const char *arg);
+int a09source(A09CONTEXT *ctx, const char *name, const char *text, size_t len);
+int a09assemble(A09CONTEXT *ctx, const char *name);
+const unsigned char *a09image(A09CONTEXT *ctx, const unsigned char **used);
+int a09symbols(A09CONTEXT *ctx);
+const A09SYMBOL *a09symbol(A09CONTEXT *ctx, int i);
+int a09diags(A09CONTEXT *ctx);
+const A09DIAG *a09diagnostic(A09CONTEXT *ctx, int i);
+const char *a09console(A09CONTEXT *ctx);
+
+#endif